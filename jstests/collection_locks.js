@@ -0,0 +1,22 @@
+// writes to an existing collection only lock that collection; serverStatus reports it per collection
+
+t = db.jstests_collection_locks;
+t.drop();
+t.insert( { _id : 0 } ); // creates the collection under the db lock
+assert( !db.getLastError() );
+
+for ( i = 1; i < 100; i++ )
+    t.insert( { _id : i } );
+t.update( { _id : 0 } , { $set : { a : 1 } } );
+t.remove( { _id : 1 } );
+assert( !db.getLastError() );
+assert.eq( 99 , t.count() );
+
+locks = db.serverStatus().locks;
+assert( locks[ db.getName() ] , "db entry" );
+if ( locks[ db.getName() ].collections ) {
+    c = locks[ db.getName() ].collections[ t.getName() ];
+    assert( c , "collection entry" );
+    assert.lte( 100 , c.acquireCount.W , "acquireCount" );
+    assert( "W" in c.timeLockedMicros , "timeLockedMicros" );
+}
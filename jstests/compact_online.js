@@ -0,0 +1,50 @@
+// compact with online:true drains and frees mostly empty extents while other ops keep running
+
+t = db.jstests_compact_online;
+t.drop();
+
+big = "";
+while ( big.length < 1000 )
+    big += "x";
+
+for ( i = 0; i < 20000; i++ )
+    t.insert( { _id : i , a : i % 100 , s : big } );
+t.ensureIndex( { a : 1 } );
+assert( !db.getLastError() );
+
+// leave most extents nearly empty
+t.remove( { _id : { $mod : [ 10 , 1 ] } } );
+t.remove( { _id : { $mod : [ 10 , 2 ] } } );
+t.remove( { _id : { $mod : [ 10 , 3 ] } } );
+t.remove( { _id : { $mod : [ 10 , 4 ] } } );
+t.remove( { _id : { $mod : [ 10 , 5 ] } } );
+t.remove( { _id : { $mod : [ 10 , 6 ] } } );
+t.remove( { _id : { $mod : [ 10 , 7 ] } } );
+assert.eq( 6000 , t.count() );
+var before = t.validate().extentCount;
+
+// writers and readers while the extents drain
+s = startParallelShell( "for ( i = 20000; i < 22000; i++ ) { db.jstests_compact_online.insert( { _id : i , a : i % 100 } ); db.jstests_compact_online.findOne( { a : i % 100 } ); }" );
+
+res = db.runCommand( { compact : t.getName() , online : true , batchSize : 50 } );
+printjson( res );
+assert.commandWorked( res );
+assert.gt( res.extentsFreed , 0 );
+assert.gt( res.recordsMoved , 0 );
+s();
+
+assert.eq( 8000 , t.count() );
+assert.eq( 80 , t.find( { a : 3 } ).itcount() );
+assert.eq( 80 , t.find( { a : 3 } ).hint( { $natural : 1 } ).itcount() );
+assert.eq( big , t.findOne( { _id : 10 } ).s );
+v = t.validate( true );
+assert( v.valid , tojson( v ) );
+assert.lt( v.extentCount , before );
+
+// freed space is reused
+for ( i = 0; i < 1000; i++ )
+    t.insert( { _id : "b" + i , s : big } );
+assert( !db.getLastError() );
+assert( t.validate( true ).valid );
+
+assert.commandFailed( db.runCommand( { compact : t.getName() , online : true , maxFill : 2 } ) );
@@ -0,0 +1,56 @@
+// collMod compressRecords: records are stored snappy compressed and read back unchanged
+
+t = db.jstests_compress_records;
+t.drop();
+db.createCollection( t.getName() );
+assert.commandWorked( db.runCommand( { collMod : t.getName() , compressRecords : true } ) );
+
+text = "";
+while ( text.length < 2000 )
+    text += "the quick brown fox jumps over the lazy dog ";
+
+for ( i = 0; i < 500; i++ )
+    t.insert( { _id : i , a : i % 10 , text : text , sub : { b : i , text : text } } );
+t.insert( { a : -1 } ); // too small to be worth compressing, and gets an _id added
+assert( !db.getLastError() );
+
+s = t.stats();
+assert( s.compression , "no compression stats: " + tojson( s ) );
+assert.lt( s.compression.ratio , 0.5 , tojson( s.compression ) );
+assert.lt( s.size , 500 * text.length , "records not smaller than their text" );
+
+// matcher, projection and index keys all see the uncompressed object
+assert.eq( 50 , t.find( { a : 3 } ).itcount() );
+assert.eq( 50 , t.find( { "sub.text" : text , a : 3 } ).itcount() );
+assert.eq( text , t.findOne( { _id : 7 } , { text : 1 } ).text );
+t.ensureIndex( { "sub.b" : 1 } );
+assert.eq( 7 , t.findOne( { "sub.b" : 7 } )._id );
+assert.eq( 1 , t.find( { a : -1 } ).itcount() );
+
+// $inc on a compressed record is rewritten rather than applied in place
+t.update( { _id : 7 } , { $inc : { a : 100 } } );
+assert.eq( 107 , t.findOne( { _id : 7 } ).a );
+t.update( { a : { $lt : 10 } } , { $set : { text : "short" } } , false , true );
+assert.eq( 500 , t.find( { text : "short" } ).itcount() );
+assert.eq( 1 , t.find( { text : text } ).itcount() );
+
+t.remove( { _id : { $lt : 250 } } );
+assert.eq( 251 , t.count() );
+assert( t.validate( true ).valid );
+
+// clearing the flag leaves existing records readable
+assert.commandWorked( db.runCommand( { collMod : t.getName() , compressRecords : false } ) );
+t.insert( { _id : 1000 , text : text } );
+assert.eq( text , t.findOne( { _id : 1000 } ).text );
+assert.eq( 251 , t.find( { _id : { $gte : 250 } } ).itcount() );
+
+// removing everything, index buckets included, leaves nothing counted as compressed
+t.remove();
+assert.eq( 0 , t.count() );
+assert( !t.stats().compression , tojson( t.stats().compression ) );
+assert( t.validate( true ).valid );
+
+// not allowed on capped collections
+db.jstests_compress_records_capped.drop();
+db.createCollection( "jstests_compress_records_capped" , { capped : true , size : 10000 } );
+assert.commandFailed( db.runCommand( { collMod : "jstests_compress_records_capped" , compressRecords : true } ) );
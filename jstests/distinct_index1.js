@@ -34,14 +34,16 @@ assert.eq( 1000 , x.stats.nscannedObjects , "AC3" )
 
 t.ensureIndex( { a : 1 } )
 
+// the index skips from each value of a to the next
 x = d( "a" );
-assert.eq( 1000 , x.stats.n , "BA1" )
-assert.eq( 1000 , x.stats.nscanned , "BA2" )
+assert.eq( 10 , x.stats.n , "BA1" )
+assert.eq( 10 , x.stats.nscanned , "BA2" )
 assert.eq( 0 , x.stats.nscannedObjects , "BA3" )
+assert( x.stats.skipScan , "BA4" )
 
 x = d( "a" , { a : { $gt : 5 } } );
-assert.eq( 398 , x.stats.n , "BB1" )
-assert.eq( 398 , x.stats.nscanned , "BB2" )
+assert.eq( 4 , x.stats.n , "BB1" )
+assert.eq( 4 , x.stats.nscanned , "BB2" )
 assert.eq( 0 , x.stats.nscannedObjects , "BB3" )
 
 x = d( "b" , { a : { $gt : 5 } } );
@@ -0,0 +1,45 @@
+/* bigsection.js
+   group commits bigger than a journal block (1MB) are compressed in several blocks.
+   write some in one go, kill -9, and check recovery puts them all back.
+*/
+
+testname = "bigsection";
+load("jstests/_tst.js");
+
+var path = "/data/db/" + testname;
+
+tst.log("start mongod with dur");
+var conn = startMongodEmpty("--port", 30001, "--dbpath", path, "--dur", "--journalCommitInterval", 300);
+var d = conn.getDB("test");
+
+// random-ish strings so the blocks don't compress to nothing
+function doc(i) {
+    var s = "";
+    for (var k = 0; s.length < 16 * 1024; k++)
+        s += (i * 7919 + k * 104729).toString(36);
+    return { _id: i, s: s };
+}
+
+tst.log("write");
+var n = 600;
+for (var i = 0; i < n; i++)
+    d.foo.insert(doc(i));
+var e = d.runCommand({ getLastError: 1, j: true });
+assert(e.ok && e.err == null, tojson(e));
+d.foo.update({}, { $set: { u: 1 } }, false, true);
+e = d.runCommand({ getLastError: 1, j: true });
+assert(e.ok && e.err == null, tojson(e));
+
+tst.log("kill -9 mongod");
+stopMongod(30001, /*signal*/9);
+
+tst.log("recover");
+conn = startMongodNoReset("--port", 30002, "--dbpath", path, "--dur");
+d = conn.getDB("test");
+assert.eq(n, d.foo.count());
+assert.eq(n, d.foo.count({ u: 1 }));
+for (var i = 0; i < n; i += 97)
+    assert.eq(doc(i).s, d.foo.findOne({ _id: i }).s);
+stopMongod(30002);
+
+tst.success();
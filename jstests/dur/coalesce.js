@@ -0,0 +1,49 @@
+/* coalesce.js
+   overlapping and adjacent write intents are merged before they are journaled.  do updates that
+   write parts of the same documents several times per group commit, check serverStatus reports
+   the bytes coalesced, then kill -9 and check recovery has the last values.
+*/
+
+testname = "coalesce";
+load("jstests/_tst.js");
+
+var path = "/data/db/" + testname;
+
+tst.log("start mongod with dur");
+var conn = startMongodEmpty("--port", 30001, "--dbpath", path, "--dur", "--journalCommitInterval", 200);
+var d = conn.getDB("test");
+
+var n = 200;
+for (var i = 0; i < n; i++)
+    d.foo.insert({ _id: i, a: 0, b: 0, c: 0 });
+d.foo.ensureIndex({ a: 1 });
+
+tst.log("update");
+var r = 0;
+var s;
+assert.soon(function () {
+    r++;
+    for (var i = 0; i < n; i++) {
+        d.foo.update({ _id: i }, { $inc: { a: 1, b: 1 } });
+        d.foo.update({ _id: i }, { $inc: { c: 1 } });
+    }
+    d.runCommand({ getLastError: 1, j: true });
+    s = d.serverStatus().dur;
+    return s.commits > 0 && s.coalescedMB > 0;
+}, "nothing coalesced", 30000, 10);
+printjson(s);
+assert.lte(s.coalescedMB, s.writeIntentMB);
+var e = d.runCommand({ getLastError: 1, j: true });
+assert(e.ok && e.err == null, tojson(e));
+
+tst.log("kill -9 mongod");
+stopMongod(30001, /*signal*/9);
+
+tst.log("recover");
+conn = startMongodNoReset("--port", 30002, "--dbpath", path, "--dur");
+d = conn.getDB("test");
+assert.eq(n, d.foo.count({ a: r, b: r, c: r }));
+assert.eq(n, d.foo.find().hint({ a: 1 }).itcount());
+stopMongod(30002);
+
+tst.success();
@@ -0,0 +1,46 @@
+/* commitlatency.js
+   j:true acknowledgements come from the journal writer thread, and the commit latencies are
+   reported in serverStatus.  then kill -9 and check a recovery replays what was acknowledged.
+*/
+
+testname = "commitlatency";
+load("jstests/_tst.js");
+
+var path = "/data/db/" + testname;
+
+tst.log("start mongod with dur");
+var conn = startMongodEmpty("--port", 30001, "--dbpath", path, "--dur", "--journalCommitInterval", 10);
+var d = conn.getDB("test");
+
+tst.log("j:true writes");
+x = 'x'; while (x.length < 4096) x += x;
+for (var i = 0; i < 200; i++) {
+    d.foo.insert({ _id: i, x: x });
+    var e = d.runCommand({ getLastError: 1, j: true });
+    assert(e.ok && e.err == null, tojson(e));
+}
+
+// the stats are for the last full interval, so keep writing until one is reported
+tst.log("wait for the stats interval");
+var lat;
+var n = 200;
+assert.soon(function () {
+    d.foo.insert({ _id: n++, x: x });
+    d.runCommand({ getLastError: 1, j: true });
+    var s = d.serverStatus().dur;
+    lat = s.commitLatencyMicros;
+    return s.commits > 0 && lat.p50 > 0;
+}, "no commit latencies", 30000, 100);
+printjson(lat);
+assert.lte(lat.p50, lat.p90);
+assert.lte(lat.p90, lat.p99);
+
+tst.log("kill -9 mongod");
+stopMongod(30001, /*signal*/9);
+
+tst.log("recover");
+conn = startMongodNoReset("--port", 30002, "--dbpath", path, "--dur");
+assert.eq(n, conn.getDB("test").foo.count());
+stopMongod(30002);
+
+tst.success();
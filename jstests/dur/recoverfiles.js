@@ -0,0 +1,44 @@
+/* recoverfiles.js
+   recovery applies a section's writes to different data files in parallel.  write to several
+   databases (so several files) in the same group commits, interleaved with a drop, kill -9,
+   and check everything comes back as acknowledged.
+*/
+
+testname = "recoverfiles";
+load("jstests/_tst.js");
+
+var path = "/data/db/" + testname;
+var nDbs = 4;
+var n = 500;
+
+tst.log("start mongod with dur");
+var conn = startMongodEmpty("--port", 30001, "--dbpath", path, "--dur", "--smallfiles",
+                            "--journalCommitInterval", 200);
+
+tst.log("write");
+for (var i = 0; i < n; i++) {
+    for (var k = 0; k < nDbs; k++)
+        conn.getDB("test" + k).foo.insert({ _id: i, k: k, x: "abcdefghij" + i });
+    if (i == n / 2)
+        conn.getDB("test0").dropDatabase();
+}
+for (var k = 0; k < nDbs; k++)
+    conn.getDB("test" + k).foo.update({}, { $inc: { u: 1 } }, false, true);
+var e = conn.getDB("test0").runCommand({ getLastError: 1, j: true });
+assert(e.ok && e.err == null, tojson(e));
+
+tst.log("kill -9 mongod");
+stopMongod(30001, /*signal*/9);
+
+tst.log("recover");
+conn = startMongodNoReset("--port", 30002, "--dbpath", path, "--dur", "--smallfiles");
+assert.eq(n / 2 - 1, conn.getDB("test0").foo.count());
+for (var k = 1; k < nDbs; k++) {
+    var t = conn.getDB("test" + k).foo;
+    assert.eq(n, t.count(), "db " + k);
+    assert.eq(n, t.count({ u: 1 }), "db " + k);
+    assert.eq("abcdefghij" + (n - 1), t.findOne({ _id: n - 1 }).x);
+}
+stopMongod(30002);
+
+tst.success();
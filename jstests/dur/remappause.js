@@ -0,0 +1,52 @@
+/* remappause.js
+   the private views are remapped a chunk at a time, and big sections are written to the data
+   files a file per thread.  write to several databases with durOptions paranoid (which checks
+   the private and write views match after each commit) and always remap, check the remap pauses
+   are reported in serverStatus, then kill -9 and check recovery.
+*/
+
+testname = "remappause";
+load("jstests/_tst.js");
+
+var path = "/data/db/" + testname;
+var nDbs = 3;
+
+tst.log("start mongod with dur");
+var conn = startMongodEmpty("--port", 30001, "--dbpath", path, "--dur", "--smallfiles",
+                            "--durOptions", 8 + 32, "--journalCommitInterval", 100);
+
+x = 'x'; while (x.length < 64 * 1024) x += x;
+
+tst.log("write");
+var n = 0;
+var pause;
+assert.soon(function () {
+    for (var k = 0; k < nDbs; k++)
+        conn.getDB("test" + k).foo.insert({ _id: n, x: x });
+    n++;
+    conn.getDB("test0").runCommand({ getLastError: 1, j: true });
+    var s = conn.getDB("test0").serverStatus().dur;
+    pause = s.remapPauseMicros;
+    return n >= 100 && pause.histogram.length > 0;
+}, "no remap pauses", 30000, 10);
+printjson(pause);
+assert.lte(pause.p50, pause.p90);
+assert.lte(pause.p90, pause.p99);
+for (var k = 0; k < nDbs; k++)
+    conn.getDB("test" + k).foo.update({}, { $set: { u: 1 } }, false, true);
+var e = conn.getDB("test0").runCommand({ getLastError: 1, j: true });
+assert(e.ok && e.err == null, tojson(e));
+
+tst.log("kill -9 mongod");
+stopMongod(30001, /*signal*/9);
+
+tst.log("recover");
+conn = startMongodNoReset("--port", 30002, "--dbpath", path, "--dur", "--smallfiles");
+for (var k = 0; k < nDbs; k++) {
+    var t = conn.getDB("test" + k).foo;
+    assert.eq(n, t.count(), "db " + k);
+    assert.eq(n, t.count({ u: 1 }), "db " + k);
+}
+stopMongod(30002);
+
+tst.success();
@@ -0,0 +1,57 @@
+// Index intersection plans, with setParameter indexIntersection
+
+t = db.jstests_index_intersection;
+t.drop();
+
+function setIntersection( on ) {
+    return db.getSiblingDB( "admin" ).runCommand( { setParameter : 1 , indexIntersection : on } );
+}
+
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { b : 1 } );
+// 600 documents match each of a and b, 20 match both
+for ( i = 0; i < 1200; i++ )
+    t.insert( { a : i < 600 ? 1 : 2 , b : i >= 580 && i < 1180 ? 1 : 2 } );
+assert( !db.getLastError() );
+
+q = { a : 1 , b : 1 };
+assert.eq( 20 , t.find( q ).itcount() );
+assert( !/IndexIntersection/.test( t.find( q ).explain().cursor ) );
+
+res = setIntersection( true );
+assert.commandWorked( res );
+try {
+    db.runCommand( { planCache : t.getName() , clear : true } );
+
+    e = t.find( q ).explain( true );
+    assert.eq( 20 , e.n );
+    assert( /^IndexIntersectionCursor/.test( e.cursor ) , tojson( e ) );
+    // the other index's keys are read, but most of the driving index's documents aren't loaded
+    assert.lte( 1200 , e.nscanned , tojson( e ) );
+    assert.gt( 100 , e.nscannedObjects , tojson( e ) );
+    intersectPlans = 0;
+    for ( i in e.allPlans )
+        if ( /^IndexIntersectionCursor/.test( e.allPlans[ i ].cursor ) )
+            ++intersectPlans;
+    assert.eq( 2 , intersectPlans , tojson( e.allPlans ) );
+
+    // the winner is cached, and used without racing while intersection is on
+    assert.eq( 20 , t.find( q ).itcount() );
+    plans = db.runCommand( { planCache : t.getName() } ).plans;
+    assert.eq( 1 , plans.length , tojson( plans ) );
+    assert.eq( 1 , plans[ 0 ].intersect.length , tojson( plans ) );
+
+    // results while the filter's documents change
+    t.update( { a : 1 , b : 2 } , { $set : { b : 1 } } , false , true );
+    assert.eq( 600 , t.find( q ).itcount() );
+    t.remove( { b : 1 , a : 1 } );
+    assert.eq( 0 , t.find( q ).itcount() );
+}
+finally {
+    assert.commandWorked( setIntersection( false ) );
+}
+
+// a cached intersection plan isn't used once intersection is off
+t.insert( { a : 1 , b : 1 } );
+assert( !/IndexIntersection/.test( t.find( q ).explain().cursor ) );
+assert.eq( 1 , t.find( q ).itcount() );
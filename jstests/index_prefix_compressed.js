@@ -0,0 +1,47 @@
+// v:2 indexes store keys prefix compressed within each bucket; check they index and find the
+// same documents as a v:1 index, and take less space on keys with long common leading strings
+
+t = db.jstests_index_prefix_compressed;
+t.drop();
+t1 = db.jstests_index_prefix_compressed_v1;
+t1.drop();
+
+t.ensureIndex( { t : 1 , p : 1 } , { v : 2 } );
+t1.ensureIndex( { t : 1 , p : 1 } , { v : 1 } );
+assert.eq( 2 , t.getIndexes().filter( function( i ) { return i.name == "t_1_p_1"; } )[ 0 ].v );
+
+function doc( i ) {
+    return { _id : i , t : "tenant-00000000" + ( i % 3 ) ,
+             p : "/org/engineering/projects/p" + Math.floor( i / 100 ) + "/src/file" + i + ".js" };
+}
+
+for ( i = 0; i < 10000; i++ ) {
+    t.insert( doc( i ) );
+    t1.insert( doc( i ) );
+}
+t.insert( { _id : "null" , t : "tenant\u0000x" , p : 1 } );
+t.insert( { _id : "big" , t : "tenant-00000000" , p : new Array( 400 ).join( "x" ) } );
+assert( !db.getLastError() );
+
+assert.lt( t.stats().indexSizes.t_1_p_1 , t1.stats().indexSizes.t_1_p_1 );
+
+for ( i = 0; i < 10000; i += 37 ) {
+    var d = doc( i );
+    assert.eq( i , t.findOne( { t : d.t , p : d.p } )._id );
+}
+assert.eq( "null" , t.findOne( { t : "tenant\u0000x" } )._id );
+assert.eq( 1 , t.find( { t : "tenant-00000000" } ).hint( { t : 1 , p : 1 } ).itcount() );
+assert.eq( t1.find( { t : "tenant-000000001" , p : { $gt : "/org/engineering/projects/p4" } } ).sort( { t : 1 , p : 1 } ).map( function( o ) { return o._id; } ),
+           t.find( { t : "tenant-000000001" , p : { $gt : "/org/engineering/projects/p4" } } ).sort( { t : 1 , p : 1 } ).map( function( o ) { return o._id; } ) );
+
+// deletes merge and rebalance buckets
+t.remove( { _id : { $gte : 2000 , $lt : 9000 } } );
+assert.eq( 3002 , t.find( {} , { _id : 1 } ).hint( { t : 1 , p : 1 } ).itcount() );
+assert( t.validate( true ).valid );
+
+// a bulk build gives the same index
+t.dropIndex( { t : 1 , p : 1 } );
+t.ensureIndex( { t : 1 , p : 1 } , { v : 2 } );
+assert.eq( 3002 , t.find( {} , { _id : 1 } ).hint( { t : 1 , p : 1 } ).itcount() );
+assert.eq( 9500 , t.findOne( { t : doc( 9500 ).t , p : doc( 9500 ).p } )._id );
+assert( t.validate( true ).valid );
@@ -0,0 +1,26 @@
+// wire compression is negotiated through isMaster
+
+t = db.jstests_ismaster_compression;
+t.drop();
+
+// servers don't report compression unless asked
+assert( !( "compression" in db.isMaster() ) , "not asked" );
+
+// unknown compressors are ignored
+res = db.runCommand( { isMaster : 1 , compression : [ "zzz" ] } );
+assert.eq( [] , res.compression , "unknown" );
+
+// from here on replies to this connection are compressed, the shell has to decode them
+res = db.runCommand( { isMaster : 1 , compression : [ "zzz" , "snappy" ] } );
+assert.eq( [ "snappy" ] , res.compression , "snappy" );
+
+big = "";
+while ( big.length < 100000 )
+    big += "compress me ";
+
+for ( i = 0; i < 50; i++ )
+    t.insert( { _id : i , s : big } );
+assert( !db.getLastError() );
+
+assert.eq( 50 , t.find().itcount() );
+t.find().forEach( function( o ) { assert.eq( big , o.s ); } );
@@ -0,0 +1,74 @@
+// count, distinct and unindexed finds over a table scan give the same answers when the scan runs
+// in parallel
+
+t = db.jstests_parallel_scan;
+t.drop();
+
+big = "";
+while ( big.length < 1000 )
+    big += "x";
+for ( i = 0; i < 5000; i++ )
+    t.insert( { _id : i , a : i % 7 , b : { c : [ i % 3 , i % 11 ] } , big : big } );
+t.ensureIndex( { z : 1 } );
+assert( !db.getLastError() );
+assert.gt( t.stats().numExtents , 3 );
+
+function setParams( threads , minBytes ) {
+    var a = db.adminCommand( { setParameter : 1 , parallelScanThreads : threads } );
+    var b = db.adminCommand( { setParameter : 1 , parallelScanMinBytes : minBytes } );
+    assert.commandWorked( a );
+    assert.commandWorked( b );
+    return { threads : a.was , minBytes : b.was };
+}
+
+function results() {
+    return { count : t.count( { a : { $gt : 2 } } ) ,
+             all : t.count( { big : big } ) ,
+             distinctA : t.distinct( "a" ) ,
+             distinctC : t.distinct( "b.c" , { a : { $ne : 4 } } ) ,
+             stats : db.runCommand( { distinct : t.getName() , key : "a" , query : { a : 1 } } ).stats ,
+             // small batches, so most of it comes back through getMore
+             find : t.find( { a : { $gt : 2 } } , { a : 1 } ).batchSize( 200 ).toArray() ,
+             positional : t.find( { "b.c" : 10 } , { "b.c.$" : 1 } ).toArray() ,
+             cursor : t.find( { a : 3 } ).explain().cursor };
+}
+
+old = setParams( 1 , 0 );
+serial = results();
+
+setParams( 4 , 0 );
+parallel = results();
+assert.eq( 4 , parallel.stats.threads , tojson( parallel.stats ) );
+assert.eq( 5000 , parallel.stats.nscanned );
+
+assert.eq( serial.count , parallel.count );
+assert.eq( 5000 , parallel.all );
+// values come back in the order a sequential scan finds them
+assert.eq( serial.distinctA , parallel.distinctA );
+assert.eq( serial.distinctC , parallel.distinctC );
+assert.eq( "BasicCursor" , serial.cursor );
+assert.eq( "ParallelScanCursor" , parallel.cursor );
+assert.eq( serial.find , parallel.find );
+assert.eq( serial.positional , parallel.positional );
+
+// nor is a findOne or a small limit
+assert.eq( "BasicCursor" , t.find( { a : 3 } ).limit( 5 ).explain().cursor );
+
+// a query an index can answer isn't scanned in parallel
+t.ensureIndex( { a : 1 } );
+assert.eq( undefined , db.runCommand( { distinct : t.getName() , key : "a" , query : { a : 1 } } ).stats.threads );
+assert.eq( serial.count , t.count( { a : { $gt : 2 } } ) );
+assert.eq( "BtreeCursor a_1" , t.find( { a : 3 } ).explain().cursor );
+
+// documents removed between getMores aren't returned
+t.dropIndex( { a : 1 } );
+c = t.find( { a : 5 } ).batchSize( 200 );
+for ( i = 0; i < 200; i++ )
+    last = c.next()._id;
+t.remove( { a : 5 , _id : { $gt : last , $mod : [ 2 , 1 ] } } );
+assert( !db.getLastError() );
+rest = c.toArray();
+rest.forEach( function( o ) { assert.eq( 0 , o._id % 2 , tojson( o ) ); } );
+assert.eq( t.count( { a : 5 , _id : { $gt : last } } ) , rest.length );
+
+setParams( old.threads , old.minBytes );
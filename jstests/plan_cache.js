@@ -0,0 +1,74 @@
+// planCache command: list, pin, unpin and clear the query optimizer's cached plans
+
+t = db.jstests_plan_cache;
+t.drop();
+
+t.ensureIndex( { a : 1 } );
+t.ensureIndex( { b : 1 } );
+for ( i = 0; i < 200; i++ )
+    t.insert( { a : i % 10 , b : i } );
+assert( !db.getLastError() );
+
+function planCache( extra ) {
+    var cmd = { planCache : t.getName() };
+    for ( var k in extra )
+        cmd[ k ] = extra[ k ];
+    var res = db.runCommand( cmd );
+    assert.commandWorked( res );
+    return res;
+}
+
+function planFor( res , field ) {
+    for ( var j in res.plans ) {
+        if ( res.plans[ j ].query[ field ] )
+            return res.plans[ j ];
+    }
+    return null;
+}
+
+// a query that races the plans leaves its winner cached, with statistics for later runs
+t.find( { a : 3 , b : { $gt : 50 } } ).itcount();
+for ( i = 0; i < 5; i++ )
+    t.find( { a : 3 , b : { $gt : 50 } } ).itcount();
+p = planFor( planCache() , "a" );
+assert( p , "no plan cached: " + tojson( planCache() ) );
+assert( !p.pinned );
+assert.lte( 5 , p.runs , tojson( p ) );
+assert.lt( 0 , p.nreturned.total , tojson( p ) );
+assert( p.micros.histogram , tojson( p ) );
+
+// pin the other index; the query uses it without trying others
+res = planCache( { pin : { a : 3 , b : { $gt : 50 } } , index : { b : 1 } } );
+assert.eq( { b : 1 } , res.pinned );
+p = planFor( res , "a" );
+assert( p.pinned );
+assert.eq( { b : 1 } , p.index );
+assert.eq( 0 , p.runs );
+assert.eq( 15 , t.find( { a : 3 , b : { $gt : 50 } } ).itcount() );
+assert.eq( 15 , t.find( { a : 3 , b : { $gt : 50 } } ).itcount() );
+p = planFor( planCache() , "a" );
+assert.eq( 2 , p.runs , tojson( p ) );
+// the b index plan scans the b range, not the 20 a : 3 keys
+assert.lt( 2 * 100 , p.nscanned.total , tojson( p ) );
+
+// writes don't reset a pinned plan
+for ( i = 0; i < 150; i++ )
+    t.insert( { a : 1000 + i } );
+assert( planFor( planCache() , "a" ).pinned );
+
+// unpin and clear
+res = planCache( { unpin : { a : 3 , b : { $gt : 50 } } } );
+assert( res.unpinned );
+assert( !planFor( res , "a" ).pinned );
+res = planCache( { clear : { a : 3 , b : { $gt : 50 } } } );
+assert( res.cleared );
+assert.isnull( planFor( res , "a" ) );
+
+t.find( { a : 3 , b : { $gt : 50 } } ).itcount();
+assert( planFor( planCache() , "a" ) );
+assert.eq( 0 , planCache( { clear : true } ).plans.length );
+
+// errors
+assert.commandFailed( db.runCommand( { planCache : t.getName() , pin : { a : 3 } , index : { c : 1 } } ) );
+assert.commandFailed( db.runCommand( { planCache : t.getName() , pin : { z : 3 } } ) );
+assert.commandFailed( db.runCommand( { planCache : "jstests_plan_cache_missing" } ) );
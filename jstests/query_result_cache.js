@@ -0,0 +1,64 @@
+// setParameter queryResultCacheBytes: repeated finds are answered from the cache until the
+// collection is written
+
+t = db.jstests_query_result_cache;
+t.drop();
+
+function stats() {
+    return db.serverStatus().queryResultCache;
+}
+
+old = db.adminCommand( { setParameter : 1 , queryResultCacheBytes : 1024 * 1024 } );
+assert.commandWorked( old );
+
+for( i = 0; i < 50; ++i ) {
+    t.insert( { _id : i , a : i % 5 , b : i } );
+}
+db.getLastError();
+
+function check( query, fields, sort, expected ) {
+    var before = stats();
+    var first = t.find( query, fields ).sort( sort ).toArray();
+    var second = t.find( query, fields ).sort( sort ).toArray();
+    assert.eq( first, second );
+    assert.eq( expected, first.length );
+    var after = stats();
+    assert.eq( before.hits + 1, after.hits, tojson( after ) );
+    return first;
+}
+
+res = check( { a : 1 }, { b : 1 }, { b : -1 }, 10 );
+assert.eq( 46, res[ 0 ].b );
+assert.eq( undefined, res[ 0 ].a );
+// a different projection or sort is a different entry
+assert.eq( 41, check( { a : 1 }, {}, { b : 1 }, 10 )[ 8 ].b );
+
+// every kind of write is seen by the next query
+t.insert( { _id : 100 , a : 1 , b : 100 } );
+assert.eq( 11, t.find( { a : 1 }, { b : 1 } ).sort( { b : -1 } ).itcount() );
+t.update( { _id : 100 }, { $inc : { b : 1 } } ); // in place
+assert.eq( 101, t.find( { a : 1 }, { b : 1 } ).sort( { b : -1 } )[ 0 ].b );
+t.update( { _id : 100 }, { $set : { c : "a longer value that makes the document move" } } );
+assert.eq( 101, t.find( { a : 1 }, { b : 1 } ).sort( { b : -1 } )[ 0 ].b );
+t.remove( { _id : 100 } );
+assert.eq( 46, t.find( { a : 1 }, { b : 1 } ).sort( { b : -1 } )[ 0 ].b );
+t.drop();
+assert.eq( 0, t.find( { a : 1 }, { b : 1 } ).sort( { b : -1 } ).itcount() );
+
+// results that need a getMore aren't cached
+for( i = 0; i < 200; ++i ) {
+    t.insert( { a : 1 } );
+}
+db.getLastError();
+before = stats();
+assert.eq( 200, t.find( { a : 1 } ).itcount() );
+assert.eq( 200, t.find( { a : 1 } ).itcount() );
+assert.eq( before.hits, stats().hits );
+
+// turning it off empties it
+db.adminCommand( { setParameter : 1 , queryResultCacheBytes : 0 } );
+assert.eq( 0, stats().bytes );
+assert.eq( 1, t.find( { a : 1 } ).limit( -1 ).itcount() );
+assert.eq( before.hits, stats().hits );
+
+db.adminCommand( { setParameter : 1 , queryResultCacheBytes : old.was } );
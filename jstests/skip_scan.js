@@ -0,0 +1,66 @@
+// Skip scans: distinct over an index led by the key, and with setParameter indexSkipScan, queries
+// that leave an index's leading field open
+
+t = db.jstests_skip_scan;
+t.drop();
+
+t.ensureIndex( { a : 1 , b : 1 } );
+for ( i = 0; i < 3000; i++ )
+    t.insert( { a : i % 6 , b : i , c : i % 4 } );
+assert( !db.getLastError() );
+
+function distinct( key , query ) {
+    var res = db.runCommand( { distinct : t.getName() , key : key , query : query || {} } );
+    assert.commandWorked( res );
+    return res;
+}
+
+res = distinct( "a" );
+assert.eq( [ 0 , 1 , 2 , 3 , 4 , 5 ] , res.values );
+assert( res.stats.skipScan , tojson( res.stats ) );
+assert.gt( 20 , res.stats.nscanned , tojson( res.stats ) );
+assert.eq( 0 , res.stats.nscannedObjects , tojson( res.stats ) );
+
+// a later field's bounds are seeked past too; values with no key in them are left out
+res = distinct( "a" , { b : { $gte : 2995 } } );
+assert.eq( [ 1 , 2 , 3 , 4 , 5 ] , res.values.sort() );
+assert.gt( 40 , res.stats.nscanned , tojson( res.stats ) );
+res = distinct( "a" , { b : { $in : [ 1 , 2 , 8 ] } } );
+assert.eq( [ 1 , 2 ] , res.values.sort() );
+
+// a query the keys can't answer is run as before
+res = distinct( "a" , { c : 1 } );
+assert.eq( [ 1 , 3 , 5 ] , res.values.sort() );
+assert( !res.stats.skipScan , tojson( res.stats ) );
+
+// nor can a multikey index list values by skipping
+t.insert( { a : [ 10 , 11 ] , b : 0 } );
+res = distinct( "a" );
+assert.eq( [ 0 , 1 , 2 , 3 , 4 , 5 , 10 , 11 ] , res.values.sort( function( x , y ) { return x - y; } ) );
+assert( !res.stats.skipScan , tojson( res.stats ) );
+t.remove( { a : { $gte : 10 } } );
+
+// queries
+q = { b : { $gte : 2990 , $lt : 2996 } };
+assert( /BasicCursor/.test( t.find( q ).explain().cursor ) );
+
+function setSkipScan( on ) {
+    return db.getSiblingDB( "admin" ).runCommand( { setParameter : 1 , indexSkipScan : on } );
+}
+
+t2 = db.jstests_skip_scan2;
+t2.drop();
+t2.ensureIndex( { a : 1 , b : 1 } );
+for ( i = 0; i < 3000; i++ )
+    t2.insert( { a : i % 6 , b : i } );
+assert.commandWorked( setSkipScan( true ) );
+try {
+    e = t2.find( q ).explain();
+    assert.eq( "BtreeCursor a_1_b_1" , e.cursor , tojson( e ) );
+    assert.eq( 6 , e.n );
+    assert.gt( 50 , e.nscanned , tojson( e ) );
+    assert.eq( 6 , t2.find( q ).itcount() );
+}
+finally {
+    assert.commandWorked( setSkipScan( false ) );
+}
@@ -1,4 +1,6 @@
-// Test that a memory exception is triggered for in memory sorts, but not for indexed sorts.
+// Test that a memory exception is triggered for in memory sorts that can fall back on an in order
+// plan, but not for indexed sorts.  Other unindexed sorts continue on disk, with a limit or
+// without, and return the rest of their results through getMore.
 
 t = db.jstests_sortg;
 t.drop();
@@ -37,9 +39,20 @@ function noMemoryException( sortSpec, querySpec ) {
     }
 }
 
-// Unindexed sorts.
-memoryException( {a:1} );
-memoryException( {b:1} );
+// Unindexed sorts spill, and the batches after the first come from getMore.  A batch size bounds
+// the sort as a limit does.
+assert.eq( 100, t.find().sort( {a:1} ).limit( -100 ).itcount() );
+assert.eq( 100, t.find().sort( {b:1} ).limit( 100 ).itcount() );
+assert.eq( 100, t.find().sort( {a:1} ).limit( -100 ).explain( true ).n );
+assert.eq( 140, t.find().sort( {a:1} ).batchSize( 1000 ).itcount() );
+assert.eq( 140, t.find().sort( {b:1} ).itcount() );
+assert.eq( 140, t.find().sort( {a:1} ).batchSize( 1000 ).explain( true ).n );
+assert.eq( 140, t.find( {}, {b:1} ).sort( {a:1} ).batchSize( 1000 ).itcount() );
+c = t.find().sort( {a:-1} );
+for( i = 0; i < 40; ++i ) {
+    assert.eq( big, c.next().a );
+}
+assert.eq( 100, c.itcount() );
 
 // Indexed sorts.
 noMemoryException( {_id:1} );
@@ -0,0 +1,66 @@
+// Unindexed sorts: a limit keeps only the top skip+limit matches, and without one matches beyond
+// the in memory sort limit are sorted on disk.  Results past the first batch come from getMore.
+
+t = db.jstests_sortn;
+t.drop();
+
+for( i = 0; i < 1000; ++i ) {
+    t.save( {a:( i * 7919 ) % 1000, b:i % 10} );
+}
+
+function checkAscending( results, field ) {
+    for( i = 1; i < results.length; ++i ) {
+        assert.lte( results[ i - 1 ][ field ], results[ i ][ field ] );
+    }
+}
+
+// Top k.
+r = t.find().sort( {a:1} ).limit( 10 ).toArray();
+assert.eq( 10, r.length );
+for( i = 0; i < 10; ++i ) {
+    assert.eq( i, r[ i ].a );
+}
+r = t.find().sort( {a:-1} ).skip( 5 ).limit( 5 ).toArray();
+assert.eq( [ 994, 993, 992, 991, 990 ], r.map( function( x ) { return x.a; } ) );
+r = t.find( {b:3} ).sort( {a:1} ).limit( 3 ).toArray();
+assert.eq( 3, r.length );
+checkAscending( r, 'a' );
+assert.eq( 3, r[ 0 ].b );
+assert( t.find().sort( {a:1} ).limit( 10 ).explain().scanAndOrder );
+
+// Past the in memory limit.
+t.drop();
+big = new Array( 1024 * 1024 ).toString();
+for( i = 0; i < 50; ++i ) {
+    t.save( {_id:i, a:( i * 31 ) % 50, b:i % 3, big:big} );
+}
+r = t.find( {}, {a:1, b:1} ).sort( {b:1, a:-1} ).toArray();
+assert.eq( 50, r.length );
+for( i = 1; i < r.length; ++i ) {
+    assert( r[ i - 1 ].b < r[ i ].b || ( r[ i - 1 ].b == r[ i ].b && r[ i - 1 ].a > r[ i ].a ),
+            tojson( r[ i - 1 ] ) + ' ' + tojson( r[ i ] ) );
+}
+r = t.find( {}, {a:1} ).sort( {a:1} ).skip( 45 ).toArray();
+assert.eq( [ 45, 46, 47, 48, 49 ], r.map( function( x ) { return x.a; } ) );
+
+// Whole documents, more than fit in a reply.
+r = t.find().sort( {a:-1} ).toArray();
+assert.eq( 50, r.length );
+for( i = 0; i < r.length; ++i ) {
+    assert.eq( 49 - i, r[ i ].a );
+    assert.eq( big, r[ i ].big );
+}
+
+// A limit past the in memory limit sorts on disk too.
+r = t.find().sort( {a:-1} ).limit( 40 ).toArray();
+assert.eq( 40, r.length );
+for( i = 0; i < r.length; ++i ) {
+    assert.eq( 49 - i, r[ i ].a );
+}
+r = t.find( {}, {a:1} ).sort( {a:-1} ).limit( -35 ).toArray();
+assert.eq( 35, r.length );
+for( i = 0; i < r.length; ++i ) {
+    assert.eq( 49 - i, r[ i ].a );
+}
+
+t.drop();
@@ -0,0 +1,37 @@
+// A getMore on a tailable awaitData cursor waits for an insert into the capped collection, and
+// returns as soon as one happens rather than on its next poll.
+
+t = db.jstests_tailable_awaitdata;
+t.drop();
+db.createCollection( t.getName(), { capped : true, size : 10000 } );
+t.insert( { a : 0 } );
+db.getLastError();
+
+function tail() {
+    return t.find().addOption( DBQuery.Option.tailable ).addOption( DBQuery.Option.awaitData );
+}
+
+// with nothing inserted, the getMore times out after a few seconds with no results
+c = tail();
+assert.eq( 0, c.next().a );
+start = new Date();
+assert( !c.hasNext() );
+assert.gt( new Date() - start, 2000 );
+
+// an insert from another connection wakes the waiting getMore
+c = tail();
+assert.eq( 0, c.next().a );
+p = startParallelShell( 'sleep( 500 ); db.jstests_tailable_awaitdata.insert( { a : 1 } ); db.getLastError();' );
+start = new Date();
+assert( c.hasNext() );
+assert.eq( 1, c.next().a );
+assert.lt( new Date() - start, 2500 );
+p();
+
+// the cursor doesn't hang around a dropped collection
+c = tail();
+c.next();
+c.next();
+p = startParallelShell( 'sleep( 500 ); db.jstests_tailable_awaitdata.drop();' );
+assert( !c.hasNext() );
+p();
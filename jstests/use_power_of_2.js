@@ -84,3 +84,12 @@ t.drop();
 db.runCommand({"create" : coll,  "flags" : 1 });
 
 testStorageSize(t);
+
+/**************** Test 3 *****************************/
+
+//allocations with the flag set look at no more than a couple of deleted records each
+var alloc = t.stats().allocation;
+assert( alloc.n > 0 , "no allocations recorded: " + tojson( alloc ) );
+for ( var k in alloc.chainLength ) {
+    assert( k == "<=1" || k == "<=2" || k == "<=4" , "long chain walked: " + tojson( alloc ) );
+}
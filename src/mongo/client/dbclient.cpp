@@ -721,9 +721,38 @@ namespace mongo {
         }
 #endif
 
+        if ( _wireCompression )
+            _negotiateCompression();
+
         return true;
     }
 
+    void DBClientConnection::_negotiateCompression() {
+        BSONObj info;
+        try {
+            BSONObj cmd = BSON( "isMaster" << 1 << "compression" << BSON_ARRAY( AbstractMessagingPort::compressorName ) );
+            if ( ! runCommand( "admin" , cmd , info ) )
+                return;
+        }
+        catch ( DBException& e ) {
+            log(_logLevel) << "couldn't negotiate compression with " << _serverString << causedBy( e ) << endl;
+            return;
+        }
+
+        // servers that don't know about compression don't return the field
+        BSONElement e = info["compression"];
+        if ( e.type() != Array )
+            return;
+        BSONObjIterator i( e.embeddedObject() );
+        while ( i.more() ) {
+            BSONElement x = i.next();
+            if ( x.type() == String && str::equals( x.valuestr() , AbstractMessagingPort::compressorName ) ) {
+                LOG(1) << "using " << AbstractMessagingPort::compressorName << " wire compression with " << _serverString << endl;
+                p->setCompression( true );
+            }
+        }
+    }
+
 
     inline bool DBClientConnection::runCommand(const string &dbname,
                                                const BSONObj& cmd,
@@ -1218,6 +1247,7 @@ namespace mongo {
 
     AtomicUInt DBClientConnection::_numConnections;
     bool DBClientConnection::_lazyKillCursor = true;
+    bool DBClientConnection::_wireCompression = false;
 
 
     bool serverAlive( const string &uri ) {
@@ -1134,6 +1134,13 @@ namespace mongo {
         
         static void setLazyKillCursor( bool lazy ) { _lazyKillCursor = lazy; }
         static bool getLazyKillCursor() { return _lazyKillCursor; }
+
+        /**
+         * if on, new connections ask the server for wire compression through isMaster,
+         * and use it if the server agrees.  off by default.
+         */
+        static void setWireCompression( bool on ) { _wireCompression = on; }
+        static bool getWireCompression() { return _wireCompression; }
         
     protected:
         friend class SyncClusterConnection;
@@ -1155,9 +1162,11 @@ namespace mongo {
         map< string, pair<string,string> > authCache;
         double _so_timeout;
         bool _connect( string& errmsg );
+        void _negotiateCompression();
 
         static AtomicUInt _numConnections;
         static bool _lazyKillCursor; // lazy means we piggy back kill cursors on next op
+        static bool _wireCompression;
 
 #ifdef MONGO_SSL
         static SSLManager* sslManager();
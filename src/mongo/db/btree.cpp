@@ -85,6 +85,160 @@ namespace mongo {
         throw MsgAssertionException(10287, "btree: key+recloc already in index");
     }
 
+    /* BtreeData_V2 --------------------------------------------------- */
+
+    /**
+     * @return the number of leading bytes of a key's prefix form that it would
+     *  be stored without, or 0 if the key is smaller stored whole.
+     */
+    static int sharedWithPrefix( const char *prefix, int prefixLen, const char *form, int formLen, int keySize ) {
+        int shared = 0;
+        int max = min( prefixLen, formLen );
+        while( shared < max && prefix[ shared ] == form[ shared ] ) {
+            ++shared;
+        }
+        return formLen - shared < keySize ? shared : 0;
+    }
+
+    /** each key's KeyV1 data followed by its prefix form, for choosing a prefix */
+    struct BtreeData_V2::KeyForms {
+        BufBuilder buf;
+        vector<int> ofs;
+        vector<int> size;
+        vector<int> formLen;
+        int n() const { return (int) ofs.size(); }
+        const char *raw( int i ) const { return buf.buf() + ofs[ i ]; }
+        const char *form( int i ) const { return raw( i ) + size[ i ]; }
+        int storedSize( int i, const char *prefix, int prefixLen ) const {
+            int shared = sharedWithPrefix( prefix, prefixLen, form( i ), formLen[ i ], size[ i ] );
+            return shared ? 1 + formLen[ i ] - shared : 1 + size[ i ];
+        }
+    };
+
+    int BtreeData_V2::_keyDataSize( const Key& key ) const {
+        int size = key.dataSize();
+        if ( prefixLen == 0 ) {
+            return 1 + size;
+        }
+        StackBufBuilder form;
+        key.appendPrefixForm( form );
+        int shared = sharedWithPrefix( prefix, prefixLen, form.buf(), form.len(), size );
+        return shared ? 1 + form.len() - shared : 1 + size;
+    }
+
+    void BtreeData_V2::_setKeyData( char *p, const Key& key ) const {
+        int size = key.dataSize();
+        if ( prefixLen ) {
+            StackBufBuilder form;
+            key.appendPrefixForm( form );
+            int shared = sharedWithPrefix( prefix, prefixLen, form.buf(), form.len(), size );
+            if ( shared ) {
+                *p = (char) shared;
+                memcpy( p + 1, form.buf() + shared, form.len() - shared );
+                return;
+            }
+        }
+        *p = 0;
+        memcpy( p + 1, key.data(), size );
+    }
+
+    void BtreeData_V2::_keyForms( KeyForms& f ) const {
+        const _KeyNode *kn = (const _KeyNode *) data;
+        for( int i = 0; i < n; ++i ) {
+            Key key = _keyFromData( data + kn[ i ].keyDataOfs() );
+            f.ofs.push_back( f.buf.len() );
+            f.size.push_back( key.dataSize() );
+            f.buf.appendBuf( key.data(), key.dataSize() );
+            int formOfs = f.buf.len();
+            key.appendPrefixForm( f.buf );
+            f.formLen.push_back( f.buf.len() - formOfs );
+        }
+    }
+
+    int BtreeData_V2::_bestPrefix( const KeyForms& f, string& best ) const {
+        // Candidates are the current prefix, what the first and last keys (and
+        // so all keys) share, and a few keys' own forms for buckets where only
+        // some keys share much.
+        vector<string> candidates;
+        candidates.push_back( string( prefix, prefixLen ) );
+        int nk = f.n();
+        if ( nk > 0 ) {
+            const char *first = f.form( 0 );
+            const char *last = f.form( nk - 1 );
+            int common = 0;
+            while( common < f.formLen[ 0 ] && common < f.formLen[ nk - 1 ] && common < PrefixMax &&
+                   first[ common ] == last[ common ] ) {
+                ++common;
+            }
+            candidates.push_back( string( first, common ) );
+            int picks[] = { 0, nk / 2, nk - 1 };
+            for( int j = 0; j < 3; ++j ) {
+                int i = picks[ j ];
+                candidates.push_back( string( f.form( i ), min( f.formLen[ i ], (int) PrefixMax ) ) );
+            }
+        }
+        int bestSize = -1;
+        for( unsigned c = 0; c < candidates.size(); ++c ) {
+            const string& cand = candidates[ c ];
+            int size = 0;
+            for( int i = 0; i < nk; ++i ) {
+                size += f.storedSize( i, cand.data(), cand.size() );
+            }
+            if ( bestSize < 0 || size < bestSize ) {
+                bestSize = size;
+                best = cand;
+            }
+        }
+        return bestSize;
+    }
+
+    int BtreeData_V2::_compressGain() const {
+        KeyForms f;
+        _keyForms( f );
+        string best;
+        return topSize - _bestPrefix( f, best );
+    }
+
+    void BtreeData_V2::_compress() {
+        KeyForms f;
+        _keyForms( f );
+        string best;
+        if ( _bestPrefix( f, best ) >= topSize ) {
+            return;
+        }
+
+        // rewrite the keys against the new prefix, laid out as _packReadyForMod() does
+        int tdz = BucketSize - ( data - (char *) this );
+        char temp[ BucketSize ];
+        int ofs = tdz;
+        _KeyNode *kn = (_KeyNode *) data;
+        for( int i = 0; i < n; ++i ) {
+            int shared = sharedWithPrefix( best.data(), best.size(), f.form( i ), f.formLen[ i ], f.size[ i ] );
+            if ( shared ) {
+                ofs -= 1 + f.formLen[ i ] - shared;
+                temp[ ofs ] = (char) shared;
+                memcpy( temp + ofs + 1, f.form( i ) + shared, f.formLen[ i ] - shared );
+            }
+            else {
+                ofs -= 1 + f.size[ i ];
+                temp[ ofs ] = 0;
+                memcpy( temp + ofs + 1, f.raw( i ), f.size[ i ] );
+            }
+            kn[ i ].setKeyDataOfsSavingUse( ofs );
+        }
+        memcpy( data + ofs, temp + ofs, tdz - ofs );
+        topSize = tdz - ofs;
+        emptySize = tdz - topSize - n * sizeof( _KeyNode );
+        prefixLen = (unsigned char) best.size();
+        memcpy( prefix, best.data(), prefixLen );
+    }
+
+    void BtreeData_V2::_copyPrefix( const BtreeData_V2& b ) {
+        verify( n == 0 );
+        prefixLen = b.prefixLen;
+        memcpy( prefix, b.prefix, prefixLen );
+    }
+
     /* BucketBasics --------------------------------------------------- */
 
     template< class V >
@@ -327,7 +481,7 @@ namespace mongo {
         KeyNode kn = keyNode(this->n-1);
         recLoc = kn.recordLoc;
         key.assign(kn.key);
-        int keysize = kn.key.dataSize();
+        int keysize = keyDataSizeAt(this->n-1);
 
         massert( 10283 , "rchild not null in btree popBack()", this->nextChild.isNull());
 
@@ -345,9 +499,15 @@ namespace mongo {
     /** add a key.  must be > all existing.  be careful to set next ptr right. */
     template< class V >
     bool BucketBasics<V>::_pushBack(const DiskLoc recordLoc, const Key& key, const Ordering &order, const DiskLoc prevChild) {
-        int bytesNeeded = key.dataSize() + sizeof(_KeyNode);
-        if ( bytesNeeded > this->emptySize )
-            return false;
+        int bytesNeeded = this->_keyDataSize(key) + sizeof(_KeyNode);
+        if ( bytesNeeded > this->emptySize ) {
+            if ( !( this->flags & Packed ) || this->_compressGain() < bytesNeeded - this->emptySize )
+                return false;
+            this->_compress();
+            bytesNeeded = this->_keyDataSize(key) + sizeof(_KeyNode);
+            if ( bytesNeeded > this->emptySize )
+                return false;
+        }
         verify( bytesNeeded <= this->emptySize );
         if( this->n ) {
             const KeyNode klast = keyNode(this->n-1);
@@ -363,10 +523,11 @@ namespace mongo {
         _KeyNode& kn = k(this->n++);
         kn.prevChildBucket = prevChild;
         kn.recordLoc = recordLoc;
-        kn.setKeyDataOfs( (short) _alloc(key.dataSize()) );
+        int keysize = bytesNeeded - sizeof(_KeyNode);
+        kn.setKeyDataOfs( (short) _alloc(keysize) );
         short ofs = kn.keyDataOfs();
         char *p = dataAt(ofs);
-        memcpy(p, key.data(), key.dataSize());
+        this->_setKeyData(p, key);
 
         return true;
     }
@@ -383,11 +544,18 @@ namespace mongo {
     bool BucketBasics<V>::basicInsert(const DiskLoc thisLoc, int &keypos, const DiskLoc recordLoc, const Key& key, const Ordering &order) const {
         check( this->n < 1024 );
         check( keypos >= 0 && keypos <= this->n );
-        int bytesNeeded = key.dataSize() + sizeof(_KeyNode);
+        int bytesNeeded = this->_keyDataSize(key) + sizeof(_KeyNode);
         if ( bytesNeeded > this->emptySize ) {
             _pack(thisLoc, order, keypos);
-            if ( bytesNeeded > this->emptySize )
-                return false;
+            if ( bytesNeeded > this->emptySize ) {
+                // a prefix compressed bucket may make room by choosing a better prefix
+                if ( this->_compressGain() < bytesNeeded - this->emptySize )
+                    return false;
+                thisLoc.btreemod<V>()->_compress();
+                bytesNeeded = this->_keyDataSize(key) + sizeof(_KeyNode);
+                if ( bytesNeeded > this->emptySize )
+                    return false;
+            }
         }
 
         BucketBasics *b;
@@ -415,10 +583,11 @@ namespace mongo {
         _KeyNode& kn = b->k(keypos);
         kn.prevChildBucket.Null();
         kn.recordLoc = recordLoc;
-        kn.setKeyDataOfs((short) b->_alloc(key.dataSize()) );
+        int keysize = bytesNeeded - sizeof(_KeyNode);
+        kn.setKeyDataOfs((short) b->_alloc(keysize) );
         char *p = b->dataAt(kn.keyDataOfs());
-        getDur().declareWriteIntent(p, key.dataSize());
-        memcpy(p, key.data(), key.dataSize());
+        getDur().declareWriteIntent(p, keysize);
+        this->_setKeyData(p, key);
         return true;
     }
 
@@ -441,7 +610,22 @@ namespace mongo {
             if ( mayDropKey( j, refPos ) ) {
                 continue;
             }
-            size += keyNode( j ).key.dataSize() + sizeof( _KeyNode );
+            size += keyDataSizeAt( j ) + sizeof( _KeyNode );
+        }
+        return size;
+    }
+
+    template< class V >
+    int BucketBasics<V>::packedDataSizeIn( const BucketBasics& dest, int refPos ) const {
+        if ( !V::PrefixCompressed ) {
+            return packedDataSize( refPos );
+        }
+        int size = 0;
+        for( int j = 0; j < this->n; ++j ) {
+            if ( mayDropKey( j, refPos ) ) {
+                continue;
+            }
+            size += dest._keyDataSize( keyNode( j ).key ) + sizeof( _KeyNode );
         }
         return size;
     }
@@ -489,7 +673,7 @@ namespace mongo {
                 k( i ) = k( j );
             }
             short ofsold = k(i).keyDataOfs();
-            int sz = keyNode(i).key.dataSize();
+            int sz = keyDataSizeAt(i);
             ofs -= sz;
             this->topSize += sz;
             memcpy(temp+ofs, dataAt(ofsold), sz);
@@ -553,7 +737,7 @@ namespace mongo {
         // TODO I think we only want to do the 90% split on the rhs node of the tree.
         int rightSizeLimit = ( this->topSize + sizeof( _KeyNode ) * this->n ) / ( keypos == this->n ? 10 : 2 );
         for( int i = this->n - 1; i > -1; --i ) {
-            rightSize += keyNode( i ).key.dataSize() + sizeof( _KeyNode );
+            rightSize += keyDataSizeAt( i ) + sizeof( _KeyNode );
             if ( rightSize > rightSizeLimit ) {
                 split = i;
                 break;
@@ -585,10 +769,10 @@ namespace mongo {
         _KeyNode &kn = k( i );
         kn.recordLoc = recordLoc;
         kn.prevChildBucket = prevChildBucket;
-        short ofs = (short) _alloc( key.dataSize() );
+        short ofs = (short) _alloc( this->_keyDataSize( key ) );
         kn.setKeyDataOfs( ofs );
         char *p = dataAt( ofs );
-        memcpy( p, key.data(), key.dataSize() );
+        this->_setKeyData( p, key );
     }
 
     template< class V >
@@ -759,8 +943,8 @@ namespace mongo {
             m = h;
         }
         while ( l <= h ) {
-            KeyNode M = this->keyNode(m);
-            int x = key.woCompare(M.key, order);
+            // probes compare against the stored key; a prefix compressed one isn't decoded
+            int x = this->compareKeyAt(key, m, order);
             if ( x == 0 ) {
                 if( assertIfDup ) {
                     if( k(m).isUnused() ) {
@@ -778,14 +962,14 @@ namespace mongo {
                         }
                     }
                     else {
-                        if( M.recordLoc == recordLoc )
+                        if( k(m).recordLoc == recordLoc )
                             alreadyInIndex();
                         uasserted( ASSERT_ID_DUPKEY , dupKeyError( idx , key ) );
                     }
                 }
 
                 // dup keys allowed.  use recordLoc as if it is part of the key
-                Loc unusedRL = M.recordLoc;
+                Loc unusedRL = k(m).recordLoc;
                 unusedRL.GETOFS() &= ~1; // so we can test equality without the used bit messing us up
                 x = recordLoc.compare(unusedRL);
             }
@@ -803,10 +987,9 @@ namespace mongo {
         // not found
         pos = l;
         if ( pos != this->n ) {
-            Key keyatpos = keyNode(pos).key;
-            wassert( key.woCompare(keyatpos, order) <= 0 );
+            wassert( this->compareKeyAt(key, pos, order) <= 0 );
             if ( pos > 0 ) {
-                if( !( keyNode(pos-1).key.woCompare(key, order) <= 0 ) ) {
+                if( !( this->compareKeyAt(key, pos-1, order) >= 0 ) ) {
                     DEV {
                         log() << key.toString() << endl;
                         log() << keyNode(pos-1).key.toString() << endl;
@@ -821,7 +1004,7 @@ namespace mongo {
 
     template< class V >
     void BtreeBucket<V>::delBucket(const DiskLoc thisLoc, const IndexDetails& id) {
-        ClientCursor::informAboutToDeleteBucket(thisLoc); // slow...
+        ClientCursor::informAboutToDeleteBucket(id.parentNS(), thisLoc); // slow...
         verify( !isHead() );
 
 	DiskLoc ll = this->parent;
@@ -948,7 +1131,7 @@ namespace mongo {
             ll.btree<V>()->childForPos( indexInParent( thisLoc ) ).writing() = this->nextChild;
         }
         BTREE(this->nextChild)->parent.writing() = this->parent;
-        ClientCursor::informAboutToDeleteBucket( thisLoc );
+        ClientCursor::informAboutToDeleteBucket( id.parentNS(), thisLoc );
         deallocBucket( thisLoc, id );
     }
 
@@ -965,7 +1148,8 @@ namespace mongo {
         {
             const BtreeBucket *l = leftNodeLoc.btree<V>();
             const BtreeBucket *r = rightNodeLoc.btree<V>();
-            if ( ( this->headerSize() + l->packedDataSize( pos ) + r->packedDataSize( pos ) + keyNode( leftIndex ).key.dataSize() + sizeof(_KeyNode) > unsigned( V::BucketSize ) ) ) {
+            // r's keys and the separator would be stored relative to l
+            if ( ( this->headerSize() + l->packedDataSize( pos ) + r->packedDataSizeIn( *l, pos ) + l->_keyDataSize( keyNode( leftIndex ).key ) + sizeof(_KeyNode) > unsigned( V::BucketSize ) ) ) {
                 return false;
             }
         }
@@ -984,26 +1168,28 @@ namespace mongo {
         const BtreeBucket *r = BTREE(this->childForPos( leftIndex + 1 ));
 
         int KNS = sizeof( _KeyNode );
-        int rightSizeLimit = ( l->topSize + l->n * KNS + keyNode( leftIndex ).key.dataSize() + KNS + r->topSize + r->n * KNS ) / 2;
+        // Keys that move to r are sized as r would store them.
+        const Key sep = keyNode( leftIndex ).key;
+        int rightSizeLimit = ( l->topSize + l->n * KNS + r->_keyDataSize( sep ) + KNS + r->topSize + r->n * KNS ) / 2;
         // This constraint should be ensured by only calling this function
         // if we go below the low water mark.
         verify( rightSizeLimit < BtreeBucket<V>::bodySize() );
         for( int i = r->n - 1; i > -1; --i ) {
-            rightSize += r->keyNode( i ).key.dataSize() + KNS;
+            rightSize += r->keyDataSizeAt( i ) + KNS;
             if ( rightSize > rightSizeLimit ) {
                 split = l->n + 1 + i;
                 break;
             }
         }
         if ( split == -1 ) {
-            rightSize += keyNode( leftIndex ).key.dataSize() + KNS;
+            rightSize += r->_keyDataSize( sep ) + KNS;
             if ( rightSize > rightSizeLimit ) {
                 split = l->n;
             }
         }
         if ( split == -1 ) {
             for( int i = l->n - 1; i > -1; --i ) {
-                rightSize += l->keyNode( i ).key.dataSize() + KNS;
+                rightSize += r->_keyDataSize( l->keyNode( i ).key ) + KNS;
                 if ( rightSize > rightSizeLimit ) {
                     split = i;
                     break;
@@ -1018,6 +1204,22 @@ namespace mongo {
             split = l->n + 1 + r->n - 2;
         }
 
+        if ( V::PrefixCompressed && split > l->n + 1 ) {
+            // The separator and r's keys before split move to l, where they
+            // may take more room than they did in r.  Only move what fits; the
+            // low water mark leaves room for at least the separator.
+            int room = l->emptySize - l->_keyDataSize( sep ) - KNS;
+            int fit = 0;
+            while( l->n + 1 + fit < split ) {
+                room -= l->_keyDataSize( r->keyNode( fit ).key ) + KNS;
+                if ( room < 0 ) {
+                    break;
+                }
+                ++fit;
+            }
+            split = l->n + 1 + fit;
+        }
+
         return split;
     }
 
@@ -1363,6 +1565,7 @@ namespace mongo {
         int split = this->splitPos( keypos );
         DiskLoc rLoc = addBucket(idx);
         BtreeBucket *r = rLoc.btreemod<V>();
+        r->_copyPrefix( *this ); // so the keys we move take the space they do here
         if ( split_debug )
             out() << "     split:" << split << ' ' << keyNode(split).key.toString() << " n:" << this->n << endl;
         for ( int i = split+1; i < this->n; i++ ) {
@@ -1947,8 +2150,10 @@ namespace mongo {
 
     template class BucketBasics<V0>;
     template class BucketBasics<V1>;
+    template class BucketBasics<V2>;
     template class BtreeBucket<V0>;
     template class BtreeBucket<V1>;
+    template class BtreeBucket<V2>;
     template struct __KeyNode<DiskLoc>;
     template struct __KeyNode<DiskLoc56Bit>;
 
@@ -182,6 +182,20 @@ namespace mongo {
         static const int KeyMax = OldBucketSize / 10;
         // A sentinel value sometimes used to identify a deallocated bucket.
         static const int INVALID_N_SENTINEL = -1;
+        enum { PrefixCompressed = 0 };
+        // most bucket space a key of KeyMax bytes takes
+        static const int KeyDataMax = KeyMax;
+    protected:
+        /* how keys are stored in the body.  these are trivial for the versions that store keys
+           as they are; see BtreeData_V2. */
+        int _keyDataSize(const Key& key) const { return key.dataSize(); }
+        void _setKeyData(char *p, const Key& key) const { memcpy(p, key.data(), key.dataSize()); }
+        Key _keyFromData(const char *p) const { return Key(p); }
+        int _dataSize(const char *p) const { return Key(p).dataSize(); }
+        int _compareKeyData(const Key& key, const char *p, const Ordering &o) const { return key.woCompare(Key(p), o); }
+        int _compressGain() const { return 0; }
+        void _compress() { }
+        void _copyPrefix(const BtreeData_V0&) { }
     };
 
     // a a a ofs ofs ofs ofs
@@ -269,6 +283,9 @@ namespace mongo {
         static const int KeyMax = 1024;
         // A sentinel value sometimes used to identify a deallocated bucket.
         static const unsigned short INVALID_N_SENTINEL = 0xffff;
+        enum { PrefixCompressed = 0 };
+        // most bucket space a key of KeyMax bytes takes
+        static const int KeyDataMax = KeyMax;
     protected:
         /** Parent bucket of this bucket, which isNull() for the root bucket. */
         Loc parent;
@@ -290,10 +307,122 @@ namespace mongo {
         char data[4];
 
         void _init() { }
+
+        /* how keys are stored in the body.  these are trivial for the versions that store keys
+           as they are; see BtreeData_V2. */
+        int _keyDataSize(const Key& key) const { return key.dataSize(); }
+        void _setKeyData(char *p, const Key& key) const { memcpy(p, key.data(), key.dataSize()); }
+        Key _keyFromData(const char *p) const { return Key(p); }
+        int _dataSize(const char *p) const { return Key(p).dataSize(); }
+        int _compareKeyData(const Key& key, const char *p, const Ordering &o) const { return key.woCompare(Key(p), o); }
+        int _compressGain() const { return 0; }
+        void _compress() { }
+        void _copyPrefix(const BtreeData_V1&) { }
+    };
+
+    /**
+     * Same as V1, except that keys are prefix compressed within a bucket.
+     *
+     * The header holds a byte prefix, and each key's data in the body is a
+     * length byte u followed by either
+     *   - u == 0: the key's KeyV1 data, or
+     *   - u > 0: the bytes of the key's prefix form (see KeyV2) after the
+     *     first u, which it shares with the bucket's prefix.
+     * A key is stored the second way only when that is smaller.
+     *
+     * A new bucket has an empty prefix.  The prefix is chosen (and every key
+     * rewritten) by _compress() when the bucket has filled up, so a bucket that
+     * never fills costs one extra byte per key and no decoding.  A key moved to
+     * another bucket is re-encoded against that bucket's prefix, so code that
+     * moves keys between buckets sizes them with the destination's
+     * _keyDataSize().
+     */
+    class BtreeData_V2 {
+    public:
+        typedef DiskLoc56Bit Loc;
+        typedef __KeyNode<Loc> _KeyNode;
+        typedef KeyV2 Key;
+        typedef KeyV2Owned KeyOwned;
+        enum { BucketSize = 8192-16 }; // leave room for Record header
+        static const int KeyMax = 1024;
+        // A sentinel value sometimes used to identify a deallocated bucket.
+        static const unsigned short INVALID_N_SENTINEL = 0xffff;
+        enum { PrefixCompressed = 1, PrefixMax = 128 };
+        // a key stored whole takes a byte more than its size
+        static const int KeyDataMax = KeyMax + 1;
+    protected:
+        /** Parent bucket of this bucket, which isNull() for the root bucket. */
+        Loc parent;
+        /** Given that there are n keys, this is the n index child. */
+        Loc nextChild;
+
+        unsigned short flags;
+
+        /** basicInsert() assumes the next three members are consecutive and in this order: */
+
+        /** Size of the empty region. */
+        unsigned short emptySize;
+        /** Size used for bson storage, including storage of old keys. */
+        unsigned short topSize;
+        /* Number of keys in the bucket. */
+        unsigned short n;
+
+        /** Prefix shared, in part, by the prefix forms of the bucket's keys. */
+        unsigned char prefixLen;
+        char prefix[PrefixMax];
+
+        /* Beginning of the bucket's body */
+        char data[4];
+
+        void _init() { prefixLen = 0; }
+
+        /** @return the size key takes in this bucket */
+        int _keyDataSize(const Key& key) const;
+        /** store key at p, which has _keyDataSize(key) bytes */
+        void _setKeyData(char *p, const Key& key) const;
+        Key _keyFromData(const char *p) const {
+            unsigned char u = *p;
+            if( u == 0 )
+                return Key(p + 1);
+            return Key(prefix, u, p + 1);
+        }
+        int _dataSize(const char *p) const {
+            unsigned char u = *p;
+            if( u == 0 )
+                return 1 + KeyV1(p + 1).dataSize();
+            return 1 + Key::restSize(prefix, u, p + 1);
+        }
+        /** key.woCompare(_keyFromData(p)), without decoding the stored key */
+        int _compareKeyData(const Key& key, const char *p, const Ordering &o) const {
+            unsigned char u = *p;
+            if( u == 0 )
+                return key.woCompare(KeyV1(p + 1), o);
+            return key.compareToStored(prefix, u, p + 1, o);
+        }
+        /**
+         * @return how many bytes _compress() would free.
+         * Preconditions: the bucket is packed
+         */
+        int _compressGain() const;
+        /**
+         * Choose a new prefix for the keys in the bucket and rewrite them.
+         * Preconditions: the bucket is packed and writable
+         * Postconditions: the bucket is packed and topSize is no larger
+         */
+        void _compress();
+        /** Use b's prefix.  Preconditions: this bucket is empty */
+        void _copyPrefix(const BtreeData_V2& b);
+    private:
+        struct KeyForms;
+        /** decode every key in the bucket */
+        void _keyForms(KeyForms& f) const;
+        /** @return the body bytes the keys would take with the best prefix we find, which is put in best */
+        int _bestPrefix(const KeyForms& f, string& best) const;
     };
 
     typedef BtreeData_V0 V0;
     typedef BtreeData_V1 V1;
+    typedef BtreeData_V2 V2;
 
     /**
      * This class adds functionality to BtreeData for managing a single bucket.
@@ -371,7 +500,7 @@ namespace mongo {
             return (char*)&(d->data) - (char*)&(d->parent);
         }
         static int bodySize() { return Version::BucketSize - headerSize(); }
-        static int lowWaterMark() { return bodySize() / 2 - Version::KeyMax - sizeof( _KeyNode ) + 1; } // see comment in btree.cpp
+        static int lowWaterMark() { return bodySize() / 2 - Version::KeyDataMax - sizeof( _KeyNode ) + 1; } // see comment in btree.cpp
 
         // for testing
         int nKeys() const { return this->n; }
@@ -492,6 +621,17 @@ namespace mongo {
 
         /** @return the size the bucket's body would have if we were to call pack() */
         int packedDataSize( int refPos ) const;
+        /**
+         * @return the size the keys pack() would keep take in dest, which is
+         *  packedDataSize() unless keys are stored relative to their bucket
+         */
+        int packedDataSizeIn( const BucketBasics& dest, int refPos ) const;
+        /** @return the bytes of the body used by key i's data */
+        int keyDataSizeAt( int i ) const { return this->_dataSize( this->data + k( i ).keyDataOfs() ); }
+        /** @return key.woCompare( keyAt( i ), o ), cheaper for prefix compressed buckets */
+        int compareKeyAt( const Key& key, int i, const Ordering &o ) const {
+            return this->_compareKeyData( key, this->data + k( i ).keyDataOfs(), o );
+        }
         void setNotPacked() { this->flags &= ~Packed; }
         void setPacked() { this->flags |= Packed; }
         /**
@@ -903,7 +1043,7 @@ namespace mongo {
         Key keyAt(int i) const {
             if( i >= this->n ) 
                 return Key();
-            return Key(this->data + k(i).keyDataOfs());
+            return this->_keyFromData(this->data + k(i).keyDataOfs());
         }
     protected:
 
@@ -1042,6 +1182,12 @@ namespace mongo {
 
         virtual bool ok() { return !bucket.isNull(); }
         virtual bool advance();
+        /**
+         * Advance to the first key in bounds whose first nFields fields differ from the current
+         * key's, seeking rather than reading the keys between: a skip scan, for listing the
+         * distinct values of an index prefix.  Only for a cursor made with a FieldRangeVector.
+         */
+        bool skipPastPrefix( int nFields );
         virtual void noteLocation(); // updates keyAtKeyOfs...
         virtual void checkLocation() = 0;
         virtual bool supportGetMore() { return true; }
@@ -1180,7 +1326,7 @@ namespace mongo {
     template< class V >
     BucketBasics<V>::KeyNode::KeyNode(const BucketBasics<V>& bb, const _KeyNode &k) :
         prevChildBucket(k.prevChildBucket),
-        recordLoc(k.recordLoc), key(bb.data+k.keyDataOfs())
+        recordLoc(k.recordLoc), key(bb._keyFromData(bb.data+k.keyDataOfs()))
     { }
 
 } // namespace mongo;
@@ -187,6 +187,7 @@ namespace mongo {
 
     template class BtreeCursorImpl<V0>;
     template class BtreeCursorImpl<V1>;
+    template class BtreeCursorImpl<V2>;
 
     BtreeCursor* BtreeCursor::make(
         NamespaceDetails *_d, const IndexDetails& _id,
@@ -209,6 +210,9 @@ namespace mongo {
         if( v == 1 ) 
             return new BtreeCursorImpl<V1>( nsd , idxNo , indexDetails );
         
+        if( v == 2 ) 
+            return new BtreeCursorImpl<V2>( nsd , idxNo , indexDetails );
+        
         if( v == 0 ) 
             return new BtreeCursorImpl<V0>( nsd , idxNo , indexDetails );
 
@@ -374,6 +378,20 @@ namespace mongo {
         return ok();
     }
 
+    bool BtreeCursor::skipPastPrefix( int nFields ) {
+        verify( _independentFieldRanges );
+        killCurrentOp.checkForInterrupt();
+        if ( bucket.isNull() )
+            return false;
+
+        // With afterKey set, advanceTo() only compares the first nFields fields, so the bounds
+        // past them are never read.
+        BSONObj key = currKey().getOwned();
+        advanceTo( key, nFields, true, _boundsIterator->cmp(), _boundsIterator->inc() );
+        skipAndCheck();
+        return ok();
+    }
+
     void BtreeCursor::noteLocation() {
         if ( !eof() ) {
             BSONObj o = currKey().getOwned();
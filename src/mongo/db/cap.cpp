@@ -322,6 +322,7 @@ namespace mongo {
     void NamespaceDetails::cappedTruncateAfter(const char *ns, DiskLoc end, bool inclusive) {
         DEV verify( this == nsdetails(ns) );
         verify( cappedLastDelRecLastExtent().isValid() );
+        NamespaceDetailsTransient::get( ns ).bumpWriteVersion();
 
         // We iteratively remove the newest document until the newest document
         // is 'end', then we remove 'end' if requested.
@@ -25,6 +25,7 @@
 namespace mongo {
 
     class AuthenticationInfo;
+    class AbstractMessagingPort;
     
     /**
      * this is the base class for Client and ClientInfo
@@ -42,6 +43,9 @@ namespace mongo {
         virtual bool hasRemote() const = 0;
         virtual HostAndPort getRemote() const = 0;
 
+        /** @return the connection this client talks over, or null for internal clients */
+        virtual AbstractMessagingPort * port() const = 0;
+
         static ClientBasic* getCurrent();
     };
 }
@@ -38,31 +38,44 @@
 
 namespace mongo {
 
-    CCById ClientCursor::clientCursorsById;
-    boost::recursive_mutex& ClientCursor::ccmutex( *(new boost::recursive_mutex()) );
+    // never freed, so cursors outliving static destruction at shutdown don't use a dead mutex
+    ClientCursor::ByIdShard* ClientCursor::byIdShards( new ClientCursor::ByIdShard[NumByIdShards] );
     long long ClientCursor::numberTimedOut = 0;
 
     void aboutToDeleteForSharding( const Database* db , const DiskLoc& dl ); // from s/d_logic.h
 
     /*static*/ void ClientCursor::assertNoCursors() {
-        recursive_scoped_lock lock(ccmutex);
-        if( clientCursorsById.size() ) {
-            log() << "ERROR clientcursors exist but should not at this point" << endl;
-            ClientCursor *cc = clientCursorsById.begin()->second;
-            log() << "first one: " << cc->_cursorid << ' ' << cc->_ns << endl;
-            clientCursorsById.clear();
-            verify(false);
+        for ( int s = 0; s < NumByIdShards; s++ ) {
+            ByIdShard &shard = byIdShards[s];
+            recursive_scoped_lock lock(shard.mutex);
+            if( shard.byId.size() ) {
+                log() << "ERROR clientcursors exist but should not at this point" << endl;
+                ClientCursor *cc = shard.byId.begin()->second;
+                log() << "first one: " << cc->_cursorid << ' ' << cc->_ns << endl;
+                shard.byId.clear();
+                verify(false);
+            }
+        }
+    }
+
+    /*static*/ unsigned ClientCursor::numCursors() {
+        unsigned n = 0;
+        for ( int s = 0; s < NumByIdShards; s++ ) {
+            recursive_scoped_lock lock(byIdShards[s].mutex);
+            n += byIdShards[s].byId.size();
         }
+        return n;
     }
 
 
+    /** the caller holds _nsCursors->mutex */
     void ClientCursor::setLastLoc_inlock(DiskLoc L) {
         verify( _pos != -2 ); // defensive - see ~ClientCursor
 
         if ( L == _lastLoc )
             return;
 
-        CCByLoc& bl = byLoc();
+        CCByLoc& bl = _nsCursors->byLoc;
 
         if ( !_lastLoc.isNull() ) {
             bl.erase( ByLocKey( _lastLoc, _cursorid ) );
@@ -122,25 +135,11 @@ namespace mongo {
             note : we can't iterate byloc because clientcursors may exist with a loc of null in which case
                    they are not in the map.  perhaps they should not exist though in the future?  something to
                    change???
-
-            CCByLoc& bl = db->ccByLoc;
-            for ( CCByLoc::iterator i = bl.begin(); i != bl.end(); ++i ) {
-                ClientCursor *cc = i->second;
-                if ( strncmp(ns, cc->ns.c_str(), len) == 0 ) {
-                    verify( cc->_db == db );
-                    toDelete.push_back(i->second);
-                }
-            }*/
-
-            /*cout << "TEMP after invalidate " << endl;
-            for( auto i = clientCursorsById.begin(); i != clientCursorsById.end(); ++i ) {
-                cout << "  " << i->second->ns << endl;
-            }
-            cout << "TEMP after invalidate done" << endl;*/
+            */
         }
     }
 
-    /* note called outside of locks (other than ccmutex) so care must be exercised */
+    /* note called outside of locks (other than the cursor's id shard lock) so care must be exercised */
     bool ClientCursor::shouldTimeout( unsigned millis ) {
         _idleAgeMillis += millis;
         return _idleAgeMillis > 600000 && _pinValue == 0;
@@ -153,22 +152,22 @@ namespace mongo {
         // two passes so that we don't need to readlock unless we really do some timeouts
         // we assume here that incrementing _idleAgeMillis outside readlock is ok.
         {
-            recursive_scoped_lock lock(ccmutex);
-            {
-                unsigned sz = clientCursorsById.size();
-                static time_t last;
-                if( sz >= 100000 ) { 
-                    if( time(0) - last > 300 ) {
-                        last = time(0);
-                        log() << "warning number of open cursors is very large: " << sz << endl;
+            unsigned sz = 0;
+            for ( int s = 0; s < NumByIdShards; s++ ) {
+                ByIdShard &shard = byIdShards[s];
+                recursive_scoped_lock lock(shard.mutex);
+                sz += shard.byId.size();
+                for ( CCById::iterator i = shard.byId.begin(); i != shard.byId.end(); i++ ) {
+                    if( i->second->shouldTimeout( millis ) ) {
+                        foundSomeToTimeout = true;
                     }
                 }
             }
-            for ( CCById::iterator i = clientCursorsById.begin(); i != clientCursorsById.end();  ) {
-                CCById::iterator j = i;
-                i++;
-                if( j->second->shouldTimeout( millis ) ) {
-                    foundSomeToTimeout = true;
+            static time_t last;
+            if( sz >= 100000 ) { 
+                if( time(0) - last > 300 ) {
+                    last = time(0);
+                    log() << "warning number of open cursors is very large: " << sz << endl;
                 }
             }
         }
@@ -193,32 +192,50 @@ namespace mongo {
     /* must call when a btree bucket going away.
        note this is potentially slow
     */
-    void ClientCursor::informAboutToDeleteBucket(const DiskLoc& b) {
-        recursive_scoped_lock lock(ccmutex);
+    void ClientCursor::informAboutToDeleteBucket(const StringData& ns, const DiskLoc& b) {
         Database *db = cc().database();
-        CCByLoc& bl = db->ccByLoc;
+        NamespaceCursors *cursors = db->findCursorsByLoc( ns );
+        if ( !cursors )
+            return;
+        recursive_scoped_lock lock(cursors->mutex);
+        CCByLoc& bl = cursors->byLoc;
         RARELY if ( bl.size() > 70 ) {
             log() << "perf warning: byLoc.size=" << bl.size() << " in aboutToDeleteBucket\n";
         }
         for ( CCByLoc::iterator i = bl.begin(); i != bl.end(); i++ )
             i->second->_c->aboutToDeleteBucket(b);
     }
-    void aboutToDeleteBucket(const DiskLoc& b) {
-        ClientCursor::informAboutToDeleteBucket(b);
-    }
 
     /* must call this on a delete so we clean up the cursors. */
-    void ClientCursor::aboutToDelete(const DiskLoc& dl) {
+    void ClientCursor::aboutToDelete(const StringData& ns, const DiskLoc& dl) {
         NoPageFaultsAllowed npfa;
 
-        recursive_scoped_lock lock(ccmutex);
-
         Database *db = cc().database();
         verify(db);
 
         aboutToDeleteForSharding( db , dl );
 
-        CCByLoc& bl = db->ccByLoc;
+        // capped cursors the delete has caught up with; deleting a cursor takes its id shard's
+        // lock, which is always taken before a NamespaceCursors lock, so we do that last
+        vector<CursorId> toDelete;
+
+        NamespaceCursors *cursors = db->findCursorsByLoc( ns );
+        if ( cursors ) {
+            recursive_scoped_lock lock(cursors->mutex);
+            advanceCursorsAt_inlock( *cursors, dl, toDelete );
+        }
+
+        for ( vector<CursorId>::iterator i = toDelete.begin(); i != toDelete.end(); ++i ) {
+            recursive_scoped_lock lock( shardFor( *i ).mutex );
+            delete find_inlock( *i, false );
+        }
+    }
+
+    /** move the cursors positioned at dl off it.  the caller holds cursors.mutex */
+    void ClientCursor::advanceCursorsAt_inlock( NamespaceCursors &cursors, const DiskLoc& dl,
+                                               vector<CursorId> &toDelete ) {
+        Database *db = cc().database();
+        CCByLoc& bl = cursors.byLoc;
         CCByLoc::iterator j = bl.lower_bound(ByLocKey::min(dl));
         CCByLoc::iterator stop = bl.upper_bound(ByLocKey::max(dl));
         if ( j == stop )
@@ -263,7 +280,7 @@ namespace mongo {
                    have "caught" the reader.  skipping ahead, the reader would miss postentially
                    important data.
                    */
-                delete cc;
+                toDelete.push_back( cc->_cursorid );
                 continue;
             }
 
@@ -290,13 +307,32 @@ namespace mongo {
             cc->updateLocation();
         }
     }
-    void aboutToDelete(const DiskLoc& dl) { ClientCursor::aboutToDelete(dl); }
+
+    ClientCursor::LockedIterator::LockedIterator() : _shard( 0 ) {
+        for ( int s = 0; s < NumByIdShards; s++ )
+            byIdShards[s].mutex.lock();
+        _i = byIdShards[0].byId.begin();
+        skipShardEnds();
+    }
+
+    ClientCursor::LockedIterator::~LockedIterator() {
+        for ( int s = NumByIdShards - 1; s >= 0; s-- )
+            byIdShards[s].mutex.unlock();
+    }
+
+    void ClientCursor::LockedIterator::skipShardEnds() {
+        while ( _shard < NumByIdShards && _i == byIdShards[_shard].byId.end() ) {
+            if ( ++_shard < NumByIdShards )
+                _i = byIdShards[_shard].byId.begin();
+        }
+    }
 
     void ClientCursor::LockedIterator::deleteAndAdvance() {
         ClientCursor *cc = current();
         CursorId id = cc->cursorid();
         delete cc;
-        _i = clientCursorsById.upper_bound( id );
+        _i = byIdShards[_shard].byId.upper_bound( id );
+        skipShardEnds();
     }
     
     ClientCursor::ClientCursor(int queryOptions, const shared_ptr<Cursor>& c, const string& ns, BSONObj query ) :
@@ -310,11 +346,10 @@ namespace mongo {
 
         verify( _db );
         verify( str::startsWith(_ns, _db->name) );
+        _nsCursors = &_db->cursorsByLoc( _ns );
         if( queryOptions & QueryOption_NoCursorTimeout )
             noTimeout();
-        recursive_scoped_lock lock(ccmutex);
-        _cursorid = allocCursorId_inlock();
-        clientCursorsById.insert( make_pair(_cursorid, this) );
+        registerById();
 
         if ( ! _c->modifiedKeys() ) {
             // store index information so we can decide if we can
@@ -343,9 +378,13 @@ namespace mongo {
         }
 
         {
-            recursive_scoped_lock lock(ccmutex);
-            setLastLoc_inlock( DiskLoc() ); // removes us from bylocation multimap
-            clientCursorsById.erase(_cursorid);
+            ByIdShard &shard = shardFor( _cursorid );
+            recursive_scoped_lock lock(shard.mutex);
+            {
+                recursive_scoped_lock lk(_nsCursors->mutex);
+                setLastLoc_inlock( DiskLoc() ); // removes us from bylocation multimap
+            }
+            shard.byId.erase(_cursorid);
 
             // defensive:
             _cursorid = INVALID_CURSOR_ID;
@@ -448,7 +487,7 @@ namespace mongo {
             //log() << "info: lastloc==curloc " << ns << '\n';
         }
         else {
-            recursive_scoped_lock lock(ccmutex);
+            recursive_scoped_lock lock(_nsCursors->mutex);
             setLastLoc_inlock(cl);
         }
     }
@@ -637,19 +676,19 @@ namespace mongo {
     }
 
     // See SERVER-5726.
-    long long ctmLast = 0; // so we don't have to do find() which is a little slow very often.
-    long long ClientCursor::allocCursorId_inlock() {
+    void ClientCursor::registerById() {
         long long ctm = curTimeMillis64();
         dassert( ctm );
-        long long x;
         while ( 1 ) {
-            x = (((long long)rand()) << 32);
+            long long x = (((long long)rand()) << 32);
             x = x ^ ctm;
-            if ( ctm != ctmLast || ClientCursor::find_inlock(x, false) == 0 )
-                break;
+            ByIdShard &shard = shardFor( x );
+            recursive_scoped_lock lock(shard.mutex);
+            if ( shard.byId.insert( make_pair( x, this ) ).second ) {
+                _cursorid = x;
+                return;
+            }
         }
-        ctmLast = ctm;
-        return x;
     }
 
     void ClientCursor::storeOpForSlave( DiskLoc last ) {
@@ -672,19 +711,24 @@ namespace mongo {
 
 
     void ClientCursor::appendStats( BSONObjBuilder& result ) {
-        recursive_scoped_lock lock(ccmutex);
-        result.appendNumber("totalOpen", clientCursorsById.size() );
-        result.appendNumber("clientCursors_size", (int) numCursors());
-        result.appendNumber("timedOut" , numberTimedOut);
+        size_t open = 0;
         unsigned pinned = 0;
         unsigned notimeout = 0;
-        for ( CCById::iterator i = clientCursorsById.begin(); i != clientCursorsById.end(); i++ ) {
-            unsigned p = i->second->_pinValue;
-            if( p >= 100 )
-                pinned++;
-            else if( p > 0 )
-                notimeout++;
+        for ( int s = 0; s < NumByIdShards; s++ ) {
+            ByIdShard &shard = byIdShards[s];
+            recursive_scoped_lock lock(shard.mutex);
+            open += shard.byId.size();
+            for ( CCById::iterator i = shard.byId.begin(); i != shard.byId.end(); i++ ) {
+                unsigned p = i->second->_pinValue;
+                if( p >= 100 )
+                    pinned++;
+                else if( p > 0 )
+                    notimeout++;
+            }
         }
+        result.appendNumber("totalOpen", open );
+        result.appendNumber("clientCursors_size", (int) open);
+        result.appendNumber("timedOut" , numberTimedOut);
         if( pinned ) 
             result.append("pinned", pinned);
         if( notimeout )
@@ -775,16 +819,24 @@ namespace mongo {
     }
 
     void ClientCursor::find( const string& ns , set<CursorId>& all ) {
-        recursive_scoped_lock lock(ccmutex);
-
-        for ( CCById::iterator i=clientCursorsById.begin(); i!=clientCursorsById.end(); ++i ) {
-            if ( i->second->_ns == ns )
-                all.insert( i->first );
+        for ( int s = 0; s < NumByIdShards; s++ ) {
+            ByIdShard &shard = byIdShards[s];
+            recursive_scoped_lock lock(shard.mutex);
+            for ( CCById::iterator i=shard.byId.begin(); i!=shard.byId.end(); ++i ) {
+                if ( i->second->_ns == ns )
+                    all.insert( i->first );
+            }
         }
     }
 
+    int ClientCursor::queryOptionsFor( CursorId id ) {
+        recursive_scoped_lock lock( shardFor( id ).mutex );
+        ClientCursor *cursor = find_inlock( id, false );
+        return cursor ? cursor->_queryOptions : 0;
+    }
+
     bool ClientCursor::erase( CursorId id ) {
-        recursive_scoped_lock lock( ccmutex );
+        recursive_scoped_lock lock( shardFor( id ).mutex );
         ClientCursor *cursor = find_inlock( id );
         if ( ! cursor )
             return false;
@@ -73,6 +73,16 @@ namespace mongo {
     typedef map<CursorId, ClientCursor*> CCById;
     typedef map<ByLocKey, ClientCursor*> CCByLoc;
 
+    /**
+     * The ClientCursors open on one namespace, by the record or btree bucket each is positioned
+     * on, so that a delete only has to look at the cursors of the namespace it deletes from.
+     * Owned by the Database, see Database::cursorsByLoc().
+     */
+    struct NamespaceCursors : boost::noncopyable {
+        boost::recursive_mutex mutex; // recursive: aboutToDelete() moves cursors while holding it
+        CCByLoc byLoc;
+    };
+
     extern BSONObj id_obj;
 
     class ClientCursor : private boost::noncopyable {
@@ -90,7 +100,7 @@ namespace mongo {
         public:
             Pin( long long cursorid ) :
                 _cursorid( INVALID_CURSOR_ID ) {
-                recursive_scoped_lock lock( ccmutex );
+                recursive_scoped_lock lock( shardFor( cursorid ).mutex );
                 ClientCursor *cursor = ClientCursor::find_inlock( cursorid, true );
                 if ( cursor ) {
                     uassert( 12051, "clientcursor already in use? driver problem?",
@@ -154,22 +164,25 @@ namespace mongo {
         };
 
         /**
-         * Iterates through all ClientCursors, under its own ccmutex lock.
+         * Iterates through all ClientCursors, holding the lock of every shard of the id registry.
          * Also supports deletion on the fly.
          */
         class LockedIterator : boost::noncopyable {
         public:
-            LockedIterator() : _lock( ccmutex ), _i( clientCursorsById.begin() ) {}
-            bool ok() const { return _i != clientCursorsById.end(); }
+            LockedIterator();
+            ~LockedIterator();
+            bool ok() const { return _shard < NumByIdShards; }
             ClientCursor *current() const { return _i->second; }
-            void advance() { ++_i; }
+            void advance() { ++_i; skipShardEnds(); }
             /**
              * Delete 'current' and advance. Properly handles cascading deletions that may occur
              * when one ClientCursor is directly deleted.
              */
             void deleteAndAdvance();
         private:
-            recursive_scoped_lock _lock;
+            /** while at the end of a shard, move on to the start of the next one */
+            void skipShardEnds();
+            int _shard;
             CCById::const_iterator _i;
         };
         
@@ -303,9 +316,11 @@ namespace mongo {
     private:
         void setLastLoc_inlock(DiskLoc);
 
+        /** the caller holds shardFor( id ).mutex */
         static ClientCursor* find_inlock(CursorId id, bool warn = true) {
-            CCById::iterator it = clientCursorsById.find(id);
-            if ( it == clientCursorsById.end() ) {
+            CCById &byId = shardFor( id ).byId;
+            CCById::iterator it = byId.find(id);
+            if ( it == byId.end() ) {
                 if ( warn )
                     OCCASIONALLY out() << "ClientCursor::find(): cursor not found in map " << id << " (ok after a drop)\n";
                 return 0;
@@ -321,7 +336,7 @@ namespace mongo {
 
     public:
         static ClientCursor* find(CursorId id, bool warn = true) {
-            recursive_scoped_lock lock(ccmutex);
+            recursive_scoped_lock lock( shardFor( id ).mutex );
             ClientCursor *c = find_inlock(id, warn);
             // if this asserts, your code was not thread safe - you either need to set no timeout
             // for the cursor or keep a ClientCursor::Pointer in scope for it.
@@ -329,6 +344,9 @@ namespace mongo {
             return c;
         }
 
+        /** @return the query options of cursor id, 0 if there is no such cursor */
+        static int queryOptionsFor( CursorId id );
+
         /**
          * Deletes the cursor with the provided @param 'id' if one exists.
          * @throw if the cursor with the provided id is pinned.
@@ -370,9 +388,11 @@ namespace mongo {
         static void idleTimeReport(unsigned millis);
 
         static void appendStats( BSONObjBuilder& result );
-        static unsigned numCursors() { return clientCursorsById.size(); }
-        static void informAboutToDeleteBucket(const DiskLoc& b);
-        static void aboutToDelete(const DiskLoc& dl);
+        static unsigned numCursors();
+        /** b is a bucket of an index on ns */
+        static void informAboutToDeleteBucket(const StringData& ns, const DiskLoc& b);
+        /** dl is a record of ns */
+        static void aboutToDelete(const StringData& ns, const DiskLoc& dl);
         static void find( const string& ns , set<CursorId>& all );
 
 
@@ -382,8 +402,11 @@ namespace mongo {
         // setting this prevents timeout of the cursor in question.
         void noTimeout() { _pinValue++; }
 
-        CCByLoc& byLoc() { return _db->ccByLoc; }
-        
+        /** give this cursor an unused id and add it to the id registry */
+        void registerById();
+        static void advanceCursorsAt_inlock( NamespaceCursors &cursors, const DiskLoc& dl,
+                                             vector<CursorId> &toDelete );
+
         Record* _recordForYield( RecordNeeds need );
 
     private:
@@ -392,6 +415,7 @@ namespace mongo {
 
         const string _ns;
         Database * _db;
+        NamespaceCursors * _nsCursors;   // _db's registry for _ns
 
         const shared_ptr<Cursor> _c;
         map<string,int> _indexedFields;  // map from indexed field to offset in key object
@@ -422,10 +446,22 @@ namespace mongo {
 
     private: // static members
 
-        static CCById clientCursorsById;
-        static long long numberTimedOut;
-        static boost::recursive_mutex& ccmutex;   // must use this for all statics above!
-        static CursorId allocCursorId_inlock();
+        /**
+         * Cursors by id.  The registry is split over several maps, by a hash of the id, so that
+         * finding, pinning and erasing different cursors rarely wait on one another.
+         */
+        struct ByIdShard : boost::noncopyable {
+            boost::recursive_mutex mutex;
+            CCById byId;
+        };
+        enum { NumByIdShards = 16 };
+        static ByIdShard* byIdShards;             // never freed, see clientcursor.cpp
+        static ByIdShard& shardFor( CursorId id ) {
+            unsigned long long x = id;
+            return byIdShards[ ( x ^ ( x >> 32 ) ) % NumByIdShards ];
+        }
+
+        static long long numberTimedOut;           // under a LockedIterator
 
     };
 
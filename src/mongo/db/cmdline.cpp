@@ -22,6 +22,7 @@
 #include "../util/password.h"
 #include "../util/processinfo.h"
 #include "../util/net/listen.h"
+#include "../client/dbclientinterface.h"
 #include "../bson/util/builder.h"
 #include "security_common.h"
 #include "mongo/util/mongoutils/str.h"
@@ -72,6 +73,7 @@ namespace mongo {
         ("bind_ip", po::value<string>(&cmdLine.bind_ip), "comma separated list of ip addresses to listen on - all local ips by default")
         ("maxConns",po::value<int>(), maxConnInfoBuilder.str().c_str())
         ("objcheck", "inspect client data for validity on receipt")
+        ("wireCompression", "ask servers we connect to for snappy compressed messages")
         ("logpath", po::value<string>() , "log file to send write to instead of stdout - has to be a file, not directory" )
         ("logappend" , "append to logpath instead of over-writing" )
         ("pidfilepath", po::value<string>(), "full path to pidfile (if not set, no pidfile is created)")
@@ -264,6 +266,11 @@ namespace mongo {
             cmdLine.objcheck = true;
         }
 
+        if (params.count("wireCompression")) {
+            cmdLine.wireCompression = true;
+            DBClientConnection::setWireCompression( true );
+        }
+
         if (params.count("bind_ip")) {
             // passing in wildcard is the same as default behavior; remove and warn
             if ( cmdLine.bind_ip ==  "0.0.0.0" ) {
@@ -102,6 +102,7 @@ namespace mongo {
         int durOptions;          // --durOptions <n> for debugging
 
         bool objcheck;         // --objcheck
+        bool wireCompression;  // --wireCompression request compression on outgoing connections
 
         long long oplogSize;   // --oplogSize
         int defaultProfile;    // --profile
@@ -112,6 +113,8 @@ namespace mongo {
         double syncdelay;      // seconds between fsyncs
 
         bool noUnixSocket;     // --nounixsocket
+        bool epoll;            // --epoll multiplex client connections over a worker pool
+        int epollWorkers;      // --epollWorkers size of that pool, 0 means pick from core count
         bool doFork;           // --fork
         string socket;         // UNIX domain socket directory
 
@@ -158,9 +161,9 @@ namespace mongo {
         port(DefaultDBPort), rest(false), jsonp(false), quiet(false),
         noTableScan(false), prealloc(true), preallocj(true), smallfiles(sizeof(int*) == 4),
         configsvr(false), quota(false), quotaFiles(8), cpu(false),
-        durOptions(0), objcheck(false), oplogSize(0), defaultProfile(0),
+        durOptions(0), objcheck(false), wireCompression(false), oplogSize(0), defaultProfile(0),
         slowMS(100), defaultLocalThresholdMillis(10), pretouch(0), moveParanoia( true ),
-        syncdelay(60), noUnixSocket(false), doFork(0), socket("/tmp") 
+        syncdelay(60), noUnixSocket(false), epoll(false), epollWorkers(0), doFork(0), socket("/tmp") 
     {
         started = time(0);
 
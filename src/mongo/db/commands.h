@@ -168,4 +168,11 @@ namespace mongo {
 
     bool _runCommands(const char *ns, BSONObj& jsobj, BufBuilder &b, BSONObjBuilder& anObjBuilder, bool fromRepl, int queryOptions);
 
+    /**
+     * isMaster side of wire compression negotiation.  if the client listed a compressor
+     * we support in { compression : [ ... ] }, turn it on for the client's connection
+     * and tell the client which one we picked.
+     */
+    void negotiateWireCompression( const BSONObj& cmdObj , BSONObjBuilder& result );
+
 } // namespace mongo
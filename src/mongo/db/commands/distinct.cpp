@@ -18,11 +18,58 @@
 //#include "pch.h"
 #include "../commands.h"
 #include "../instance.h"
+#include "../btree.h"
 #include "../clientcursor.h"
+#include "../parallel_scan.h"
+#include "../queryutil.h"
 #include "../../util/timer.h"
 
 namespace mongo {
 
+    /** the distinct values of a key over a table scan, see ParallelCollectionScan */
+    class ParallelDistinct : public ParallelCollectionScan {
+    public:
+        /** @param add called for each value in the order a sequential scan would find them */
+        ParallelDistinct( const char *ns, const BSONObj &query, const string &key,
+                          const boost::function<void(const BSONElement&)> &add ) :
+            ParallelCollectionScan( ns, query ), _key( key ), _add( add ), _n() {
+        }
+        long long n() const { return _n; }
+    private:
+        class DistinctPart : public Part {
+        public:
+            DistinctPart( const string &key ) : n(), _key( key ) { }
+            virtual void match( const DiskLoc &loc, const BSONObj &obj ) {
+                ++n;
+                BSONElementSet temp;
+                obj.getFieldsDotted( _key, temp );
+                for ( BSONElementSet::iterator i = temp.begin(); i != temp.end(); ++i ) {
+                    if ( _seen.count( *i ) )
+                        continue;
+                    bytes += i->size();
+                    uassert( 10044, "distinct too big, 16mb cap", bytes < BSONObjMaxUserSize );
+                    values.push_back( i->wrap() );
+                    _seen.insert( values.back().firstElement() );
+                }
+            }
+            long long n;
+            vector<BSONObj> values;   // first occurrences in this range, in order
+        private:
+            const string &_key;
+            BSONElementSet _seen;
+        };
+        virtual Part* newPart() { return new DistinctPart( _key ); }
+        virtual void merge( Part &part ) {
+            DistinctPart &p = static_cast<DistinctPart&>( part );
+            _n += p.n;
+            for ( vector<BSONObj>::const_iterator i = p.values.begin(); i != p.values.end(); ++i )
+                _add( i->firstElement() );
+        }
+        string _key;
+        boost::function<void(const BSONElement&)> _add;
+        long long _n;
+    };
+
     class DistinctCommand : public Command {
     public:
         DistinctCommand() : Command("distinct") {}
@@ -61,9 +108,20 @@ namespace mongo {
                 return true;
             }
 
+            // an index led by the key skips from each value to the next
+            shared_ptr<BtreeCursor> skipCursor( skipScanCursor( ns.c_str(), d, key, query ) );
+
+            // a table scan is run in parallel, see below
+            bool parallel = !skipCursor &&
+                    ParallelCollectionScan::worthwhile( ns.c_str(), d, query );
+
             shared_ptr<Cursor> cursor;
-            if ( ! query.isEmpty() ) {
-                cursor = NamespaceDetailsTransient::getCursor(ns.c_str() , query , BSONObj() );
+            if ( skipCursor ) {
+                cursor = skipCursor;
+            }
+            else if ( ! query.isEmpty() ) {
+                if ( ! parallel )
+                    cursor = NamespaceDetailsTransient::getCursor(ns.c_str() , query , BSONObj() );
             }
             else {
 
@@ -85,11 +143,29 @@ namespace mongo {
 
                 }
 
-                if ( ! cursor.get() )
+                if ( ! cursor.get() && ! parallel )
                     cursor = NamespaceDetailsTransient::getCursor(ns.c_str() , query , BSONObj() );
 
             }
 
+            if ( ! cursor.get() ) {
+                ParallelDistinct scan( ns.c_str(), query, key,
+                                       boost::bind( &DistinctCommand::addValue, _1,
+                                                    boost::ref( values ), boost::ref( bb ),
+                                                    boost::ref( arr ), bufSize ) );
+                scan.run();
+                verify( start == bb.buf() );
+                result.appendArray( "values" , arr.done() );
+                BSONObjBuilder b;
+                b.appendNumber( "n" , scan.n() );
+                b.appendNumber( "nscanned" , scan.nscanned() );
+                b.appendNumber( "nscannedObjects" , scan.nscanned() );
+                b.appendNumber( "timems" , t.millis() );
+                b.append( "cursor" , "BasicCursor" );
+                b.append( "threads" , scan.threads() );
+                result.append( "stats" , b.obj() );
+                return true;
+            }
             
             verify( cursor );
             string cursorName = cursor->toString();
@@ -100,7 +176,9 @@ namespace mongo {
                 nscanned++;
                 bool loadedRecord = false;
 
+                bool matched = false;
                 if ( cursor->currentMatches( &md ) && !cursor->getsetdup( cursor->currLoc() ) ) {
+                    matched = true;
                     n++;
 
                     BSONObj holder;
@@ -108,25 +186,18 @@ namespace mongo {
                     loadedRecord = ! cc->getFieldsDotted( key , temp, holder );
 
                     for ( BSONElementSet::iterator i=temp.begin(); i!=temp.end(); ++i ) {
-                        BSONElement e = *i;
-                        if ( values.count( e ) )
-                            continue;
-
-                        int now = bb.len();
-
-                        uassert(10044,  "distinct too big, 16mb cap", ( now + e.size() + 1024 ) < bufSize );
-
-                        arr.append( e );
-                        BSONElement x( start + now );
-
-                        values.insert( x );
+                        addValue( *i, values, bb, arr, bufSize );
                     }
                 }
 
                 if ( loadedRecord || md.hasLoadedRecord() )
                     nscannedObjects++;
 
-                cursor->advance();
+                // other keys with the same value can only repeat it
+                if ( skipCursor && matched )
+                    skipCursor->skipPastPrefix( 1 );
+                else
+                    cursor->advance();
 
                 if (!cc->yieldSometimes( ClientCursor::MaybeCovered )) {
                     cc.release();
@@ -143,16 +214,69 @@ namespace mongo {
             {
                 BSONObjBuilder b;
                 b.appendNumber( "n" , n );
-                b.appendNumber( "nscanned" , nscanned );
+                // a skip scan also reads keys while seeking
+                b.appendNumber( "nscanned" , skipCursor ? skipCursor->nscanned() : nscanned );
                 b.appendNumber( "nscannedObjects" , nscannedObjects );
                 b.appendNumber( "timems" , t.millis() );
                 b.append( "cursor" , cursorName );
+                if ( skipCursor )
+                    b.append( "skipScan" , true );
                 result.append( "stats" , b.obj() );
             }
 
             return true;
         }
 
+    private:
+        /**
+         * @return a cursor over a non-multikey index whose first field is key, which has one key
+         * per document holding its value, if the query can be matched on that index's keys alone.
+         * Skipping from each matching key to the next value lists the distinct values while
+         * reading a few keys per value.
+         */
+        static BtreeCursor* skipScanCursor( const char *ns, NamespaceDetails *d, const string &key,
+                                            const BSONObj &query ) {
+            NamespaceDetails::IndexIterator ii = d->ii();
+            while ( ii.more() ) {
+                int idxNo = ii.pos();
+                IndexDetails& idx = ii.next();
+                BSONObj keyPattern = idx.keyPattern();
+                if ( d->isMultikey( idxNo ) || idx.getSpec().getType() ||
+                     key != keyPattern.firstElementFieldName() )
+                    continue;
+
+                shared_ptr<CoveredIndexMatcher> matcher( new CoveredIndexMatcher( query,
+                                                                                  keyPattern ) );
+                if ( matcher->needRecord() )
+                    continue;
+
+                FieldRangeSet frs( ns, query, true, true );
+                if ( !frs.matchPossible() )
+                    return 0;
+                shared_ptr<FieldRangeVector> frv( new FieldRangeVector( frs, idx.getSpec(), 1 ) );
+                BtreeCursor *c = BtreeCursor::make( d, idxNo, idx, frv, 0, 1 );
+                c->setMatcher( matcher );
+                return c;
+            }
+            return 0;
+        }
+
+        /** append e to arr if it isn't in values yet.  values point into bb, which can't grow */
+        static void addValue( const BSONElement &e, BSONElementSet &values, BufBuilder &bb,
+                              BSONArrayBuilder &arr, int bufSize ) {
+            if ( values.count( e ) )
+                return;
+
+            int now = bb.len();
+
+            uassert(10044,  "distinct too big, 16mb cap", ( now + e.size() + 1024 ) < bufSize );
+
+            arr.append( e );
+            BSONElement x( bb.buf() + now );
+
+            values.insert( x );
+        }
+
     } distinctCmd;
 
 }
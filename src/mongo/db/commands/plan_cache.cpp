@@ -0,0 +1,168 @@
+/** @file plan_cache.cpp
+    the planCache command: look at and manage the query optimizer's cached plans
+*/
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "mongo/db/commands.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/db/pdfile.h"
+#include "mongo/db/queryoptimizer.h"
+#include "mongo/db/queryutil.h"
+
+namespace mongo {
+
+    class PlanCacheCmd : public Command {
+    public:
+        PlanCacheCmd() : Command( "planCache" ) { }
+        virtual LockType locktype() const { return READ; }
+        virtual bool slaveOk() const { return true; }
+        virtual bool logTheOp() { return false; }
+        virtual void help( stringstream& help ) const {
+            help << "the query optimizer's cached plans for a collection, with statistics for the\n"
+                "queries each has answered\n"
+                "{ planCache : <collection> }\n"
+                "{ planCache : <collection>, pin : <query>, [sort : <sort>], [index : <key pattern>] }\n"
+                "  use the index for queries of the same pattern without trying others; by default\n"
+                "  the index cached for the pattern.  pins are lost when the indexes change\n"
+                "{ planCache : <collection>, unpin : <query>, [sort : <sort>] }\n"
+                "{ planCache : <collection>, clear : <query> | true, [sort : <sort>] }\n";
+        }
+
+        virtual bool run( const string& db, BSONObj& cmdObj, int, string& errmsg,
+                          BSONObjBuilder& result, bool fromRepl ) {
+            string ns = db + "." + cmdObj.firstElement().valuestrsafe();
+            NamespaceDetails *d = nsdetails( ns.c_str() );
+            if ( !d ) {
+                errmsg = "ns not found";
+                return false;
+            }
+            BSONObj sort = cmdObj.getObjectField( "sort" );
+
+            BSONElement pin = cmdObj["pin"];
+            BSONElement unpin = cmdObj["unpin"];
+            BSONElement clear = cmdObj["clear"];
+            if ( pin.type() == Object ) {
+                if ( !pinPlan( ns, d, pin.embeddedObject(), sort, cmdObj["index"], errmsg,
+                               result ) )
+                    return false;
+            }
+            else if ( unpin.type() == Object ) {
+                vector<QueryPattern> patterns = patternsFor( ns, unpin.embeddedObject(), sort );
+                SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+                NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns.c_str() );
+                bool any = false;
+                for ( unsigned i = 0; i < patterns.size(); i++ )
+                    any = nsdt.unpinCachedQueryPlan( patterns[ i ] ) || any;
+                result.append( "unpinned", any );
+            }
+            else if ( clear.type() == Object ) {
+                vector<QueryPattern> patterns = patternsFor( ns, clear.embeddedObject(), sort );
+                SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+                NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns.c_str() );
+                bool any = false;
+                for ( unsigned i = 0; i < patterns.size(); i++ )
+                    any = nsdt.clearCachedQueryPlan( patterns[ i ] ) || any;
+                result.append( "cleared", any );
+            }
+            else if ( clear.trueValue() ) {
+                SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+                NamespaceDetailsTransient::get_inlock( ns.c_str() ).clearQueryCache( true );
+            }
+            else if ( !pin.eoo() || !unpin.eoo() || !clear.eoo() ) {
+                errmsg = "pin, unpin and clear take a query";
+                return false;
+            }
+
+            SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            NamespaceDetailsTransient::get_inlock( ns.c_str() ).appendPlanCache( result );
+            return true;
+        }
+
+    private:
+        /**
+         * the patterns a plan for query may be cached under: which one the optimizer uses depends
+         * on whether the plan's index is multikey.
+         */
+        static vector<QueryPattern> patternsFor( const string &ns, const BSONObj &query,
+                                                 const BSONObj &sort ) {
+            vector<QueryPattern> patterns;
+            patterns.push_back( FieldRangeSet( ns.c_str(), query, true, true ).pattern( sort ) );
+            patterns.push_back( FieldRangeSet( ns.c_str(), query, false, true ).pattern( sort ) );
+            return patterns;
+        }
+
+        static bool pinPlan( const string &ns, NamespaceDetails *d, const BSONObj &query,
+                             const BSONObj &sort, const BSONElement &index, string &errmsg,
+                             BSONObjBuilder &result ) {
+            vector<QueryPattern> patterns = patternsFor( ns, query, sort );
+            BSONObj indexKey;
+            if ( index.type() == Object ) {
+                indexKey = index.embeddedObject();
+            }
+            else if ( !index.eoo() ) {
+                errmsg = "index must be a key pattern";
+                return false;
+            }
+            else {
+                SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+                NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns.c_str() );
+                for ( unsigned i = 0; i < patterns.size() && indexKey.isEmpty(); i++ )
+                    indexKey = nsdt.cachedQueryPlanForPattern( patterns[ i ] ).indexKey();
+                if ( indexKey.isEmpty() ) {
+                    errmsg = "no plan cached for the query's pattern, specify an index";
+                    return false;
+                }
+            }
+
+            int idxNo = -1;
+            if ( !str::equals( indexKey.firstElementFieldName(), "$natural" ) ) {
+                idxNo = d->findIndexByKeyPattern( indexKey );
+                if ( idxNo < 0 ) {
+                    errmsg = "index not found";
+                    return false;
+                }
+            }
+
+            // the plan is run as the only candidate, and may or may not return results in order
+            FieldRangeSetPair frsp( ns.c_str(), query );
+            scoped_ptr<QueryPlan> plan( QueryPlan::make( d, idxNo, frsp, 0, query, sort ) );
+            if ( plan->utility() == QueryPlan::Unhelpful ||
+                 plan->utility() == QueryPlan::Disallowed ) {
+                errmsg = "the index can't be used for the query";
+                return false;
+            }
+            CandidatePlanCharacter character( !plan->scanAndOrderRequired(),
+                                              plan->scanAndOrderRequired() );
+
+            SimpleMutex::scoped_lock lk( NamespaceDetailsTransient::_qcMutex );
+            NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns.c_str() );
+            for ( unsigned i = 0; i < patterns.size(); i++ ) {
+                CachedQueryPlan cached = nsdt.cachedQueryPlanForPattern( patterns[ i ] );
+                long long nScanned =
+                        cached.indexKey().woCompare( indexKey ) == 0 ? cached.nScanned() : 0;
+                nsdt.pinCachedQueryPlan( patterns[ i ],
+                                         CachedQueryPlan( indexKey, nScanned, character, true ) );
+            }
+            result.append( "pinned", indexKey );
+            return true;
+        }
+    } planCacheCmd;
+
+} // namespace mongo
@@ -23,6 +23,7 @@
 #include "mongo/db/compact.h"
 
 #include "mongo/db/background.h"
+#include "mongo/db/clientcursor.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/curop-inl.h"
@@ -30,6 +31,7 @@
 #include "mongo/db/index.h"
 #include "mongo/db/index_update.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/db/record_compression.h"
 #include "mongo/util/concurrency/task.h"
 #include "mongo/util/timer.h"
 #include "mongo/util/touch_pages.h"
@@ -96,7 +98,13 @@ namespace mongo {
 
                     if( !validate || objOld.valid() ) {
                         nrecords++;
+                        const char *stored = objOld.objdata();
                         unsigned sz = objOld.objsize();
+                        if( recOld->compressed() ) {
+                            // move the compressed bytes as they are
+                            stored = recOld->data();
+                            sz = - reinterpret_cast<const CompressedRecordHeader*>( stored )->negLen;
+                        }
 
                         oldObjSize += sz;
                         oldObjSizeWithPadding += recOld->netLength();
@@ -117,7 +125,9 @@ namespace mongo {
                         datasize += recNew->netLength();
                         recNew = (Record *) getDur().writingPtr(recNew, lenWHdr);
                         addRecordToRecListInExtent(recNew, loc);
-                        memcpy(recNew->data(), objOld.objdata(), sz);
+                        memcpy(recNew->data(), stored, sz);
+                        if( recOld->compressed() )
+                            compressedRecordWritten( recNew );
 
                         {
                             // extract keys for all indexes we will be rebuilding
@@ -331,6 +341,193 @@ namespace mongo {
         return ok;
     }
 
+    /* online compaction --------------------------------------------------------------------
+
+       instead of rewriting the whole collection under the write lock, pick the extents that are
+       mostly free space and move their records into space elsewhere, a batch at a time, yielding
+       the lock between batches.  indexes are fixed up for each record as it moves, so they stay
+       usable throughout.  each extent goes to the freelist as soon as it is empty.
+
+       while an extent drains it is in DrainingExtents: its free space is taken off the deleted
+       lists up front, and space freed in it later (by the moves, or by users' deletes) is not put
+       back, so nothing new is allocated in it.  a BackgroundOperation keeps the collection and its
+       indexes from being dropped or added to while we yield.
+    */
+
+    /** @return bytes on the deleted lists per extent.  yields between buckets */
+    static map<DiskLoc,long long> deletedSpaceByExtent(const char *ns) {
+        map<DiskLoc,long long> space;
+        for( int b = 0; b < Buckets; b++ ) {
+            NamespaceDetails *d = nsdetails(ns);
+            for( DiskLoc L = d->deletedList[b]; !L.isNull(); L = L.drec()->nextDeleted() ) {
+                DeletedRecord *r = L.drec();
+                space[ r->myExtentLoc(L) ] += r->lengthWithHeaders();
+            }
+            ClientCursor::staticYield(-1, ns, 0);
+        }
+        return space;
+    }
+
+    /** take the deleted records in the draining extents off the deleted lists */
+    static void unlinkDeletedSpace(const char *ns, const set<DiskLoc>& draining) {
+        for( int b = 0; b < Buckets; b++ ) {
+            NamespaceDetails *d = nsdetails(ns);
+            DiskLoc *prev = &d->deletedList[b];
+            while( !prev->isNull() ) {
+                DiskLoc L = *prev;
+                DeletedRecord *r = L.drec();
+                DiskLoc ext = r->myExtentLoc(L);
+                if( draining.count(ext) ) {
+                    *getDur().writing(prev) = r->nextDeleted();
+                    verify( DrainingExtents::orphan(ext, L) );
+                }
+                else {
+                    prev = &r->nextDeleted();
+                }
+            }
+            getDur().commitIfNeeded();
+            ClientCursor::staticYield(-1, ns, 0);
+        }
+    }
+
+    /** copy the record at oldLoc to newly allocated space and repoint the indexes at the copy */
+    static void moveRecord(const char *ns, NamespaceDetails *d, const DiskLoc oldLoc) {
+        Record *r = oldLoc.rec();
+        const int len = r->compressed() ?
+            - reinterpret_cast<const CompressedRecordHeader*>( r->data() )->negLen :
+            BSONObj( r->data() ).objsize();
+        const int lenWHdr = d->getRecordAllocationSize( len + Record::HeaderSize );
+
+        DiskLoc loc = allocateSpaceForANewRecord(ns, d, lenWHdr, false);
+        uassert(16416, "compact error out of space moving a record", !loc.isNull());
+        Record *recNew = (Record *) getDur().writingPtr(loc.rec(), lenWHdr);
+        addRecordToRecListInExtent(recNew, loc);
+        memcpy(recNew->data(), r->data(), len);
+        {
+            NamespaceDetails::Stats *s = getDur().writing(&d->stats);
+            s->datasize += recNew->netLength();
+            s->nrecords++;
+        }
+        if( recNew->compressed() ) {
+            const CompressedRecordHeader *h = (const CompressedRecordHeader *) recNew->data();
+            d->noteCompressedRecord( -h->negLen, h->objsize, 1 );
+            compressedRecordWritten( recNew );
+        }
+
+        unindexRecord(d, r, oldLoc);
+        indexRecordUsingTwoSteps(ns, d, BSONObj::make(recNew), loc, false);
+
+        ClientCursor::aboutToDelete(ns, oldLoc);
+        theDataFileMgr._deleteRecord(d, ns, r, oldLoc);
+    }
+
+    /** unlink the now empty extent from the collection and give it to the database's freelist */
+    static void freeEmptyExtent(NamespaceDetails *d, const DiskLoc extLoc) {
+        Extent *e = extLoc.ext();
+        verify( e->firstRecord.isNull() && e->lastRecord.isNull() );
+        if( e->xprev.isNull() )
+            d->firstExtent.writing() = e->xnext;
+        else
+            getDur().writingDiskLoc( e->xprev.ext()->xnext ) = e->xnext;
+        if( e->xnext.isNull() )
+            d->lastExtent.writing() = e->xprev;
+        else
+            getDur().writingDiskLoc( e->xnext.ext()->xprev ) = e->xprev;
+        getDur().writing(e)->markEmpty();
+        freeExtents( extLoc, extLoc );
+    }
+
+    /** drain and free the extents in 'group' */
+    static void compactOnlineGroup(const char *ns, const vector<DiskLoc>& group, int batchSize,
+                                   ProgressMeterHolder& pm, long long& moved, int& freedExtents,
+                                   long long& freedBytes) {
+        set<DiskLoc> draining( group.begin(), group.end() );
+        for( set<DiskLoc>::iterator i = draining.begin(); i != draining.end(); i++ )
+            DrainingExtents::add(*i);
+
+        try {
+            unlinkDeletedSpace(ns, draining);
+
+            for( unsigned i = 0; i < group.size(); i++ ) {
+                while( 1 ) {
+                    NamespaceDetails *d = nsdetails(ns);
+                    uassert( 16432, str::stream() << "collection " << ns << " dropped during compact", d );
+                    Extent *e = group[i].ext();
+                    for( int n = 0; n < batchSize && !e->firstRecord.isNull(); n++ ) {
+                        moveRecord(ns, d, e->firstRecord);
+                        moved++;
+                    }
+                    if( e->firstRecord.isNull() ) {
+                        DrainingExtents::remove(group[i]);
+                        draining.erase(group[i]);
+                        freedBytes += e->length;
+                        freeEmptyExtent(d, group[i]);
+                        freedExtents++;
+                        getDur().commitIfNeeded();
+                        break;
+                    }
+                    getDur().commitIfNeeded();
+                    killCurrentOp.checkForInterrupt(false);
+                    ClientCursor::staticYield(-1, ns, 0);
+                }
+                pm.hit();
+            }
+        }
+        catch(...) {
+            // hand back the space of the extents we didn't finish, unless the collection went
+            NamespaceDetails *d = nsdetails(ns);
+            for( set<DiskLoc>::iterator i = draining.begin(); i != draining.end(); i++ ) {
+                vector<DiskLoc> orphans = DrainingExtents::remove(*i);
+                for( unsigned j = 0; d && j < orphans.size(); j++ )
+                    d->addDeletedRec(orphans[j].drec(), orphans[j]);
+            }
+            throw;
+        }
+    }
+
+    bool compactOnline(const string& ns, string& errmsg, BSONObjBuilder& result, double maxFill,
+                       int batchSize) {
+        Lock::DBWrite lk(ns);
+        Client::Context ctx(ns);
+        NamespaceDetails *d = nsdetails(ns.c_str());
+        massert( 16417, str::stream() << "namespace " << ns << " does not exist", d );
+        massert( 16418, "cannot compact capped collection", !d->isCapped() );
+        BackgroundOperation::assertNoBgOpInProgForNs(ns.c_str());
+        BackgroundOperation op(ns.c_str());
+
+        log() << "compact " << ns << " online begin, maxFill:" << maxFill << endl;
+        map<DiskLoc,long long> space = deletedSpaceByExtent(ns.c_str());
+
+        vector<DiskLoc> targets;
+        d = nsdetails(ns.c_str());
+        for( DiskLoc L = d->firstExtent; !L.isNull() && L != d->lastExtent; L = L.ext()->xnext ) {
+            Extent *e = L.ext();
+            if( e->length - space[L] <= maxFill * e->length )
+                targets.push_back(L);
+        }
+        log() << "compact " << ns << " online draining " << targets.size() << " extents" << endl;
+
+        ProgressMeterHolder pm( cc().curop()->setMessage( "compact online extent" , targets.size() ) );
+        long long moved = 0;
+        int freedExtents = 0;
+        long long freedBytes = 0;
+        // take extents a few at a time so the space set aside in DrainingExtents stays small
+        const unsigned GroupSize = 8;
+        for( unsigned i = 0; i < targets.size(); i += GroupSize ) {
+            vector<DiskLoc> group( targets.begin() + i,
+                                   targets.begin() + min( (size_t) i + GroupSize, targets.size() ) );
+            compactOnlineGroup(ns.c_str(), group, batchSize, pm, moved, freedExtents, freedBytes);
+        }
+        pm.finished();
+
+        result.append("extentsFreed", freedExtents);
+        result.appendNumber("bytesFreed", freedBytes);
+        result.appendNumber("recordsMoved", moved);
+        log() << "compact " << ns << " online end, moved " << moved << " records, freed "
+              << freedExtents << " of " << targets.size() << " extents" << endl;
+        return true;
+    }
+
     bool isCurrentlyAReplSetPrimary();
 
     class CompactCmd : public Command {
@@ -346,7 +543,11 @@ namespace mongo {
                 "{ compact : <collection_name>, [force:<bool>], [validate:<bool>],\n"
                 "  [paddingFactor:<num>], [paddingBytes:<num>] }\n"
                 "  force - allows to run on a replica set primary\n"
-                "  validate - check records are noncorrupt before adding to newly compacting extents. slower but safer (defaults to true in this version)\n";
+                "  validate - check records are noncorrupt before adding to newly compacting extents. slower but safer (defaults to true in this version)\n"
+                "{ compact : <collection_name>, online:true, [maxFill:<num>], [batchSize:<num>] }\n"
+                "  online - move records out of mostly empty extents and free them, yielding between batches. may run on a primary\n"
+                "  maxFill - only drain extents at most this full (default 0.5)\n"
+                "  batchSize - records moved per lock acquisition (default 100)\n";
         }
         virtual bool requiresAuth() { return true; }
         CompactCmd() : Command("compact") { }
@@ -358,7 +559,8 @@ namespace mongo {
                 return false;
             }
 
-            if( isCurrentlyAReplSetPrimary() && !cmdObj["force"].trueValue() ) { 
+            bool online = cmdObj["online"].trueValue();
+            if( !online && isCurrentlyAReplSetPrimary() && !cmdObj["force"].trueValue() ) { 
                 errmsg = "will not run compact on an active replica set primary as this is a slow blocking operation. use force:true to force";
                 return false;
             }
@@ -390,6 +592,16 @@ namespace mongo {
                 }
             }
 
+            if( online ) {
+                double maxFill = cmdObj.hasElement("maxFill") ? cmdObj["maxFill"].Number() : 0.5;
+                int batchSize = cmdObj.hasElement("batchSize") ? (int) cmdObj["batchSize"].Number() : 100;
+                if( maxFill <= 0 || maxFill >= 1 || batchSize < 1 ) {
+                    errmsg = "maxFill must be between 0 and 1, batchSize at least 1";
+                    return false;
+                }
+                return compactOnline(ns, errmsg, result, maxFill, batchSize);
+            }
+
             double pf = 1.0;
             int pb = 0;
             if( cmdObj.hasElement("paddingFactor") ) {
@@ -197,6 +197,7 @@ namespace mongo {
             unsigned long long total = curTimeMicros64() - startTime();
             return (int) (total / 1000);
         }
+        unsigned long long elapsedMicros() { return curTimeMicros64() - startTime(); }
         int elapsedSeconds() { return elapsedMillis() / 1000; }
         void setQuery(const BSONObj& query) { _query.set( query ); }
         Client * getClient() const { return _client; }
@@ -34,7 +34,7 @@ namespace mongo {
      * concept and is for the user's cursor.
      *
      * WARNING concurrency: the vfunctions below are called back from within a
-     * ClientCursor::ccmutex.  Don't cause a deadlock, you've been warned.
+     * NamespaceCursors::mutex.  Don't cause a deadlock, you've been warned.
      *
      * Two general techniques may be used to ensure a Cursor is in a consistent state after a write.
      *     - The Cursor may be advanced before the document at its current position is deleted.
@@ -40,14 +40,16 @@
 
 #define MONGOD_CONCURRENCY_LEVEL_GLOBAL 0
 #define MONGOD_CONCURRENCY_LEVEL_DB 1
+#define MONGOD_CONCURRENCY_LEVEL_COLLECTION 2
 
 #ifndef MONGOD_CONCURRENCY_LEVEL
-#define MONGOD_CONCURRENCY_LEVEL MONGOD_CONCURRENCY_LEVEL_DB
+#define MONGOD_CONCURRENCY_LEVEL MONGOD_CONCURRENCY_LEVEL_COLLECTION
 #endif
 
 namespace mongo { 
 
     static const bool DB_LEVEL_LOCKING_ENABLED = ( ( MONGOD_CONCURRENCY_LEVEL ) >= MONGOD_CONCURRENCY_LEVEL_DB );
+    static const bool COLLECTION_LEVEL_LOCKING_ENABLED = ( ( MONGOD_CONCURRENCY_LEVEL ) >= MONGOD_CONCURRENCY_LEVEL_COLLECTION );
 
     inline LockState& lockState() { 
         return cc().lockState();
@@ -83,6 +85,9 @@ namespace mongo {
     */
     static mapsf<string,WrapperForRWLock*> dblocks;
 
+    /* ns->lock for DBWrite's collection level locking.  like dblocks, never deleted. */
+    static mapsf<string,WrapperForRWLock*> collectionLocks;
+
     /* we don't want to touch dblocks too much as a mutex is involved.  thus party for that, 
        this is here...
     */
@@ -205,9 +210,28 @@ namespace mongo {
         b.append("admin", nestableLocks[Lock::admin]->stats.report());
         b.append("local", nestableLocks[Lock::local]->stats.report());
         {
+            // collection locks are reported under their database: { db : { ..., collections : { coll : {...} } } }
+            map<string,BSONObj> colls;
+            {
+                mapsf<string,WrapperForRWLock*>::ref r(collectionLocks);
+                for( map<string,WrapperForRWLock*>::const_iterator i = r.r.begin(); i != r.r.end(); i++ ) {
+                    colls[i->first] = i->second->stats.report();
+                }
+            }
+
             mapsf<string,WrapperForRWLock*>::ref r(dblocks);
             for( map<string,WrapperForRWLock*>::const_iterator i = r.r.begin(); i != r.r.end(); i++ ) {
-                b.append(i->first, i->second->stats.report());
+                BSONObjBuilder d( b.subobjStart(i->first) );
+                d.appendElements(i->second->stats.report());
+                string prefix = i->first + '.';
+                map<string,BSONObj>::const_iterator c = colls.lower_bound(prefix);
+                if( c != colls.end() && str::startsWith(c->first, prefix) ) {
+                    BSONObjBuilder cb( d.subobjStart("collections") );
+                    for( ; c != colls.end() && str::startsWith(c->first, prefix); c++ )
+                        cb.append(c->first.substr(prefix.size()), c->second);
+                    cb.done();
+                }
+                d.done();
             }
         }
         result.append("locks", b.obj());
@@ -269,9 +293,20 @@ namespace mongo {
             msgasserted(16105, str::stream() << "expected to be write locked for " << ns);
         }
     }
+    void Lock::assertCatalogWriteLocked(const StringData& ns) { 
+        assertWriteLocked(ns);
+        LockState &ls = lockState();
+        if( ls.threadState() == 'w' && ls.otherIntent() && nsToDatabase(ns.data()) == ls.otherName() ) { 
+            ls.dump();
+            msgasserted(16433, str::stream() << "expected " << ns << "'s database to be write locked, not only a collection in it");
+        }
+    }
     bool Lock::dbLevelLockingEnabled() {
         return DB_LEVEL_LOCKING_ENABLED;
     }
+    bool Lock::collectionLevelLockingEnabled() {
+        return COLLECTION_LEVEL_LOCKING_ENABLED;
+    }
 
     RWLockRecursive &Lock::ParallelBatchWriterMode::_batchLock = *(new RWLockRecursive("special"));
     void Lock::ParallelBatchWriterMode::iAmABatchParticipant() {
@@ -500,7 +535,7 @@ namespace mongo {
         }
     }
 
-    void Lock::DBWrite::lockOther(const string& db) {
+    void Lock::DBWrite::lockOther(const string& db, bool intent) {
         fassert( 16252, !db.empty() );
         LockState& ls = lockState();
 
@@ -509,6 +544,8 @@ namespace mongo {
             // nested. if/when we do temprelease with DBWrite we will need to increment here
             // (so we can not release or assert if nested).
             massert(16106, str::stream() << "internal error tried to lock two databases at the same time. old:" << ls.otherName() << " new:" << db , db == ls.otherName() );
+            massert(16411, str::stream() << "can't lock " << _what << " while only " << ls.collectionLock()->name() << " is locked",
+                    ls.collectionLock() == 0 || ls.collectionLock()->name() == _what );
             return;
         }
 
@@ -521,16 +558,45 @@ namespace mongo {
             WrapperForRWLock*& lock = r[db];
             if( lock == 0 )
                 lock = new WrapperForRWLock(db.c_str());
-            ls.lockedOther( db , 1 , lock );
+            ls.lockedOther( db , 1 , lock , intent );
         }
         else { 
             DEV OCCASIONALLY { dassert( dblocks.get(db) == ls.otherLock() ); }
-            ls.lockedOther(1);
+            ls.lockedOther( 1 , intent );
         }
         
         fassert(16134,_weLocked==0);
-        ls.otherLock()->lock();
+        if( intent )
+            ls.otherLock()->lock_w();
+        else
+            ls.otherLock()->lock();
         _weLocked = ls.otherLock();
+        _weLockedIntent = intent;
+    }
+
+    /** @return true if ns can be locked by itself for writing its documents; see DBWrite() */
+    static bool lockableCollection(const string& ns) {
+        NamespaceString s(ns);
+        return !s.coll.empty() && !s.isSystem() && s.coll.find('$') == string::npos;
+    }
+
+    void Lock::DBWrite::lockCollection(const string& ns) {
+        LockState& ls = lockState();
+        fassert(16412,_collLocked==0);
+        WrapperForRWLock *lock;
+        {
+            mapsf<string,WrapperForRWLock*>::ref r(collectionLocks);
+            WrapperForRWLock*& l = r[ns];
+            if( l == 0 )
+                l = new WrapperForRWLock(ns.c_str());
+            lock = l;
+        }
+        ls.lockedCollection( lock );
+        Timer t;
+        lock->lock();
+        lock->stats.recordAcquireTimeMicros( 'W', t.micros() );
+        _collLocked = lock;
+        _collTimer.reset();
     }
 
     static Lock::Nestable n(const char *db) { 
@@ -549,6 +615,8 @@ namespace mongo {
         _locked_W=false;
         _locked_w=false; 
         _weLocked=0;
+        _weLockedIntent=false;
+        _collLocked=0;
 
 
         massert( 16186 , "can't get a DBWrite while having a read lock" , ! ls.hasAnyReadLock() );
@@ -565,6 +633,15 @@ namespace mongo {
                 _locked_W = true;
                 return;
             } 
+            if( !nested && _collectionLevel && COLLECTION_LEVEL_LOCKING_ENABLED &&
+                ls.threadState() == 0 && lockableCollection(ns) ) {
+                // db for intent, then the collection.  drops, renames etc. still need the db W lock
+                // so they wait for us; other collections' writers don't.
+                lockOther(db, true);
+                lockTop(ls);
+                lockCollection(ns);
+                return;
+            }
             if( !nested )
                 lockOther(db);
             lockTop(ls);
@@ -603,8 +680,8 @@ namespace mongo {
         }
     }
 
-    Lock::DBWrite::DBWrite( const StringData& ns ) 
-        : ScopedLock( 'w' ), _what(ns.data()), _nested(false) {
+    Lock::DBWrite::DBWrite( const StringData& ns, bool collectionLevel ) 
+        : ScopedLock( 'w' ), _what(ns.data()), _nested(false), _collectionLevel(collectionLevel) {
         lockDB( _what );
     }
 
@@ -623,13 +700,21 @@ namespace mongo {
     }
 
     void Lock::DBWrite::unlockDB() {
+        if( _collLocked ) {
+            _collLocked->stats.recordLockTimeMicros( 'W', _collTimer.micros() );
+            _collLocked->unlock();
+            _collLocked = 0;
+        }
         if( _weLocked ) {
             if ( _nested )
                 lockState().unlockedNestable();
             else
                 lockState().unlockedOther();
     
-            _weLocked->unlock();
+            if( _weLockedIntent )
+                _weLocked->unlock_w();
+            else
+                _weLocked->unlock();
         }
         if( _locked_w ) {
             if (DB_LEVEL_LOCKING_ENABLED) {
@@ -698,6 +783,8 @@ namespace mongo {
             // nested. prev could be read or write. if/when we do temprelease with DBRead/DBWrite we will need to increment/decrement here
             // (so we can not release or assert if nested).  temprelease we should avoid if we can though, it's a bit of an anti-pattern.
             massert(16099, str::stream() << "internal error tried to lock two databases at the same time. old:" << ls.otherName() << " new:" << db, db == ls.otherName() );
+            massert(16413, str::stream() << "can't lock " << _what << " while only " << ls.collectionLock()->name() << " is locked",
+                    ls.collectionLock() == 0 || ls.collectionLock()->name() == _what );
             return;
         }
 
@@ -47,8 +47,12 @@ namespace mongo {
         static bool atLeastReadLocked(const StringData& ns); // true if this db is locked
         static void assertAtLeastReadLocked(const StringData& ns);
         static void assertWriteLocked(const StringData& ns);
+        /** for changes to the catalog (namespaces, indexes, user flags) which a writer
+            holding only a collection lock (see DBWrite) mustn't make */
+        static void assertCatalogWriteLocked(const StringData& ns);
 
         static bool dbLevelLockingEnabled(); 
+        static bool collectionLevelLockingEnabled();
         
         static LockStat* globalLockStat();
         static LockStat* nestableLockStat( Nestable db );
@@ -151,14 +155,16 @@ namespace mongo {
             /**
              * flow
              *   1) lockDB
-             *      a) lockTop
-             *      b) lockNestable or lockOther
+             *      a) lockOther (intent only if collection level)
+             *      b) lockTop
+             *      c) lockNestable or lockCollection
              *   2) unlockDB
              */
 
             void lockTop(LockState&);
             void lockNestable(Nestable db);
-            void lockOther(const string& db);
+            void lockOther(const string& db, bool intent = false);
+            void lockCollection(const string& ns);
             void lockDB(const string& ns);
             void unlockDB();
 
@@ -167,9 +173,20 @@ namespace mongo {
             void _relock();
 
         public:
-            DBWrite(const StringData& dbOrNs);
+            /**
+             * @param collectionLevel if dbOrNs is a (non system) collection, lock only it
+             *        exclusively and its database for intent to write, so writers of other
+             *        collections in the database can run at the same time.  only for writing
+             *        documents of a collection that exists: creating or dropping collections or
+             *        indexes changes the database's catalog and needs the database locked.
+             *        has no effect if we are locked already.
+             */
+            DBWrite(const StringData& dbOrNs, bool collectionLevel = false);
             virtual ~DBWrite();
 
+            /** @return true if only our collection is locked, see collectionLevel above */
+            bool collectionLocked() const { return _collLocked != 0; }
+
             class UpgradeToExclusive : private boost::noncopyable {
             public:
                 UpgradeToExclusive();
@@ -184,8 +201,12 @@ namespace mongo {
             bool _locked_w;
             bool _locked_W;
             WrapperForRWLock *_weLocked;
+            bool _weLockedIntent;
+            WrapperForRWLock *_collLocked;
+            Timer _collTimer;
             const string _what;
             bool _nested;
+            const bool _collectionLevel;
         };
 
         // lock this database for reading. do not shared_lock globally first, that is handledin herein. 
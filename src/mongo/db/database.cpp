@@ -23,6 +23,7 @@
 #include "introspect.h"
 #include "clientcursor.h"
 #include "databaseholder.h"
+#include "record_compression.h"
 
 #include <boost/filesystem/operations.hpp>
 
@@ -54,15 +55,50 @@ namespace mongo {
         size_t n = _files.size();
         for ( size_t i = 0; i < n; i++ )
             delete _files[i];
-        if( ccByLoc.size() ) {
-            log() << "\n\n\nWARNING: ccByLoc not empty on database close! " << ccByLoc.size() << ' ' << name << endl;
+        dataFilesUnmapped();
+        for ( map<string, NamespaceCursors*>::iterator i = _cursorsByLoc.begin();
+              i != _cursorsByLoc.end(); ++i ) {
+            if( i->second->byLoc.size() ) {
+                log() << "\n\n\nWARNING: ccByLoc not empty on database close! " << i->second->byLoc.size() << ' ' << i->first << endl;
+            }
+            delete i->second;
+        }
+    }
+
+    NamespaceCursors& Database::cursorsByLoc( const StringData& ns ) {
+        SimpleMutex::scoped_lock lk( _cursorsMutex );
+        NamespaceCursors *&cursors = _cursorsByLoc[ string( ns.data(), ns.size() ) ];
+        if ( !cursors )
+            cursors = new NamespaceCursors();
+        return *cursors;
+    }
+
+    NamespaceCursors* Database::findCursorsByLoc( const StringData& ns ) {
+        SimpleMutex::scoped_lock lk( _cursorsMutex );
+        map<string, NamespaceCursors*>::const_iterator i =
+                _cursorsByLoc.find( string( ns.data(), ns.size() ) );
+        return i == _cursorsByLoc.end() ? 0 : i->second;
+    }
+
+    void Database::dropCursorsByLoc( const StringData& ns ) {
+        SimpleMutex::scoped_lock lk( _cursorsMutex );
+        map<string, NamespaceCursors*>::iterator i = _cursorsByLoc.find( string( ns.data(), ns.size() ) );
+        if ( i == _cursorsByLoc.end() )
+            return;
+        if( i->second->byLoc.size() ) {
+            // someone still points at it, better a few bytes than a crash
+            log() << "WARNING: ccByLoc not empty on drop " << i->second->byLoc.size() << ' ' << i->first << endl;
+            return;
         }
+        delete i->second;
+        _cursorsByLoc.erase( i );
     }
 
     Database::Database(const char *nm, bool& newDb, const string& _path )
-        : name(nm), path(_path), namespaceIndex( path, name ),
+        : name(nm), path(_path), _allocMutex("dbAlloc"), _cursorsMutex("dbCursors"), namespaceIndex( path, name ),
           profileName(name + ".system.profile")
     {
+        _files.reserve( DiskLoc::MaxFiles );
         try {
             {
                 // check db name is valid
@@ -112,6 +148,7 @@ namespace mongo {
                 delete _files[i];
             }
             _files.clear();
+            _nFiles.store( 0 );
             throw;
         }
     }
@@ -190,6 +227,7 @@ namespace mongo {
             massert( 15924 , str::stream() << "getFile(): bad file number value " << n << " (corrupt db?): run repair", false);
         }
 
+        RecursiveMutex::scoped_lock lk( _allocMutex );
         {
             if( n < (int) _files.size() && _files[n] ) {
                 dlog(2) << "openExistingFile " << n << " is already open" << endl;
@@ -215,6 +253,7 @@ namespace mongo {
                 _files.push_back(0);
             }
             _files[n] = df;
+            _nFiles.store( _files.size() );
         }
 
         return true;
@@ -231,7 +270,6 @@ namespace mongo {
         }
     }
 
-    // todo: this is called a lot. streamline the common case
     MongoDataFile* Database::getFile( int n, int sizeNeeded , bool preallocateOnly) {
         verify(this);
         DEV assertDbAtLeastReadLocked(this);
@@ -246,6 +284,15 @@ namespace mongo {
                 out() << "getFile(): n=" << n << endl;
             }
         }
+        if ( !preallocateOnly && n < (int) _nFiles.load() ) {
+            // the common case: already open.  slots below _nFiles are never reallocated or cleared
+            // while the db is open, so no mutex
+            MongoDataFile* p = _files[n];
+            if ( p )
+                return p;
+        }
+
+        RecursiveMutex::scoped_lock lk( _allocMutex );
         MongoDataFile* p = 0;
         if ( !preallocateOnly ) {
             while ( n >= (int) _files.size() ) {
@@ -282,11 +329,14 @@ namespace mongo {
             else
                 _files[n] = p;
         }
+        if ( !preallocateOnly )
+            _nFiles.store( _files.size() );
         return preallocateOnly ? 0 : p;
     }
 
     MongoDataFile* Database::addAFile( int sizeNeeded, bool preallocateNextFile ) {
         assertDbWriteLocked(this);
+        RecursiveMutex::scoped_lock lk( _allocMutex );
         int n = (int) _files.size();
         MongoDataFile *ret = getFile( n, sizeNeeded );
         if ( preallocateNextFile )
@@ -351,6 +401,7 @@ namespace mongo {
 
 
     Extent* Database::allocExtent( const char *ns, int size, bool capped, bool enforceQuota ) {
+        RecursiveMutex::scoped_lock lk( _allocMutex );
         // todo: when profiling, these may be worth logging into profile collection
         bool fromFreeList = true;
         Extent *e = DataFileMgr::allocFromFreeList( ns, size, capped );
@@ -392,7 +443,7 @@ namespace mongo {
 
     int Database::numFiles() const { 
         DEV assertDbAtLeastReadLocked(this);
-        return (int) _files.size(); 
+        return (int) _nFiles.load(); 
     }
 
     void Database::flushFiles( bool sync ) {
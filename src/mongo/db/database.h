@@ -21,14 +21,13 @@
 #include "mongo/db/cmdline.h"
 #include "mongo/db/namespace_details.h"
 #include "mongo/db/record.h"
+#include "mongo/platform/atomic_word.h"
 
 namespace mongo {
 
     class Extent;
     class MongoDataFile;
-    class ClientCursor;
-    struct ByLocKey;
-    typedef map<ByLocKey, ClientCursor*> CCByLoc;
+    struct NamespaceCursors;
 
     /**
      * Database represents a database database
@@ -114,6 +113,14 @@ namespace mongo {
         const RecordStats& recordStats() const { return _recordStats; }
         RecordStats& recordStats() { return _recordStats; }
 
+        /** @return the registry of the cursors open on ns, by position; see ClientCursor */
+        NamespaceCursors& cursorsByLoc( const StringData& ns );
+        /** @return ns's registry, 0 if no cursor was ever opened on it.  for the delete paths,
+            which shouldn't make one for every namespace they delete from */
+        NamespaceCursors* findCursorsByLoc( const StringData& ns );
+        /** ns was dropped or renamed, after ClientCursor::invalidate(): forget its registry */
+        void dropCursorsByLoc( const StringData& ns );
+
     private:
         /**
          * @throws DatabaseDifferCaseCode if the name is a duplicate based on
@@ -136,14 +143,27 @@ namespace mongo {
         // must be in the dbLock when touching this (and write locked when writing to of course)
         // however during Database object construction we aren't, which is ok as it isn't yet visible
         //   to others and we are in the dbholder lock then.
+        // reserved up front: writers holding only a collection lock (see Lock::DBWrite) may add a
+        // file while others look files up, so it must never reallocate.  changed only under
+        // _allocMutex; lookups of an open file read it without the mutex, up to _nFiles.
         vector<MongoDataFile*> _files;
+        AtomicUInt32 _nFiles; // _files.size(), stored after the new slots are filled in
+
+        // serializes allocating extents and opening/adding files between writers of different
+        // collections.  recursive as allocExtent holds it across suitableFile -> addAFile -> getFile
+        RecursiveMutex _allocMutex;
+
+        // guards the map itself; each NamespaceCursors has its own mutex.  entries live until their
+        // namespace is dropped, which kills its cursors first, so a ClientCursor may keep a
+        // pointer to its namespace's
+        SimpleMutex _cursorsMutex;
+        map<string, NamespaceCursors*> _cursorsByLoc;
 
     public: // this should be private later
 
         NamespaceIndex namespaceIndex;
         int profile; // 0=off.
         const string profileName; // "alleyinsider.system.profile"
-        CCByLoc ccByLoc;
         int magic; // used for making sure the object is still loaded in memory
 
     private:
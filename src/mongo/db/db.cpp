@@ -42,6 +42,7 @@
 #include "mongo/db/stats/counters.h"
 #include "mongo/db/stats/snapshots.h"
 #include "mongo/db/ttl.h"
+#include "mongo/s/d_logic.h"
 #include "mongo/s/d_writeback.h"
 #include "mongo/scripting/engine.h"
 #include "mongo/util/background.h"
@@ -228,12 +229,66 @@ namespace mongo {
             }
         }
 
+        virtual bool mayWaitLong( Message& m ) {
+            // an awaitData tail waits up to 4 seconds for inserts, an exhaust cursor keeps
+            // sending until it runs out, forever for a tail
+            const int waits = QueryOption_AwaitData | QueryOption_Exhaust;
+            int op = m.operation();
+            int len = m.header()->dataLen();
+            const char *data = m.singleData()->_data;
+            if ( op == dbQuery )
+                return len >= 4 && ( *(const int *) data & waits );
+            if ( op != dbGetMore )
+                return false;
+            // 0, ns, ntoreturn, cursorid - the message isn't validated yet
+            const char *ns = data + 4;
+            const char *nsEnd = (const char *) memchr( ns , 0 , std::max( len - 4 , 0 ) );
+            if ( ! nsEnd || nsEnd + 1 + 4 + 8 > data + len )
+                return false;
+            long long cursorid;
+            memcpy( &cursorid , nsEnd + 1 + 4 , sizeof( cursorid ) );
+            return ClientCursor::queryOptionsFor( cursorid ) & waits;
+        }
+
         virtual void disconnected( AbstractMessagingPort* p ) {
             Client * c = currentClient.get();
             if( c ) c->shutdown();
             globalScriptEngine->threadDone();
         }
 
+        /** the thread local state of a connection while it waits for its next message */
+        class ConnState : public ConnectionState {
+        public:
+            ConnState() : client(0), sharding(0) {}
+            ~ConnState() {
+                // only still set if the connection is being torn down
+                delete sharding;
+                delete client;
+            }
+            Client * client;
+            ShardedConnectionInfo * sharding;
+        };
+
+        virtual bool supportsMultiplexing() const { return true; }
+
+        virtual ConnectionState* detachConnection( AbstractMessagingPort* p ) {
+            ConnState * s = new ConnState();
+            s->client = currentClient.release();
+            s->sharding = ShardedConnectionInfo::release();
+            return s;
+        }
+
+        virtual void attachConnection( AbstractMessagingPort* p , ConnectionState* state ) {
+            ConnState * s = static_cast<ConnState*>( state );
+            verify( currentClient.get() == 0 );
+            currentClient.reset( s->client );
+            ShardedConnectionInfo::set( s->sharding );
+            if ( s->client )
+                setThreadName( s->client->desc().c_str() );
+            s->client = 0;
+            s->sharding = 0;
+        }
+
     };
 
     void listen(int port) {
@@ -241,6 +296,8 @@ namespace mongo {
         MessageServer::Options options;
         options.port = port;
         options.ipList = cmdLine.bind_ip;
+        options.epoll = cmdLine.epoll;
+        options.workerThreads = cmdLine.epollWorkers;
 
         MessageServer * server = createServer( options , new MyMessageHandler() );
         server->setAsTimeTracker();
@@ -637,6 +694,10 @@ static int mongoDbMain(int argc, char* argv[]) {
     ("dbpath", po::value<string>() , dbpathBuilder.str().c_str())
     ("diaglog", po::value<int>(), "0=off 1=W 2=R 3=both 7=W+some reads")
     ("directoryperdb", "each database will be stored in a separate directory")
+#if defined(__linux__)
+    ("epoll", "serve connections from an epoll loop and a pool of worker threads instead of a thread per connection")
+    ("epollWorkers", po::value<int>(), "number of worker threads with --epoll (default 4 per core)")
+#endif
     ("ipv6", "enable IPv6 support (disabled by default)")
     ("journal", "enable journaling")
     ("journalCommitInterval", po::value<unsigned>(), "how often to group/batch commit (ms)")
@@ -1013,6 +1074,22 @@ static int mongoDbMain(int argc, char* argv[]) {
         if (params.count("ipv6")) {
             enableIPv6();
         }
+        if (params.count("epoll")) {
+#ifdef MONGO_SSL
+            if ( cmdLine.sslOnNormalPorts ) {
+                out() << "--epoll can't be used with --sslOnNormalPorts" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+#endif
+            cmdLine.epoll = true;
+        }
+        if (params.count("epollWorkers")) {
+            cmdLine.epollWorkers = params["epollWorkers"].as<int>();
+            if ( cmdLine.epollWorkers < 1 ) {
+                out() << "--epollWorkers has to be at least 1" << endl;
+                dbexit( EXIT_BADOPTIONS );
+            }
+        }
         if (params.count("noMoveParanoia")) {
             cmdLine.moveParanoia = false;
         }
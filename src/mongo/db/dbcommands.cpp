@@ -49,7 +49,10 @@
 #include "../s/d_writeback.h"
 #include "dur_stats.h"
 #include "../server.h"
+#include "mongo/db/index_intersection.h"
 #include "mongo/db/index_update.h"
+#include "mongo/db/parallel_scan.h"
+#include "mongo/db/query_result_cache.h"
 #include "mongo/db/repl/bgsync.h"
 
 namespace mongo {
@@ -66,6 +69,37 @@ namespace mongo {
             dur::setAgeOutJournalFiles(r);
             return true;
         }
+        e = cmdObj["indexIntersection"];
+        if( !e.eoo() ) {
+            result.append( "was", indexIntersection );
+            indexIntersection = e.trueValue();
+            return true;
+        }
+        e = cmdObj["indexSkipScan"];
+        if( !e.eoo() ) {
+            result.append( "was", indexSkipScan );
+            indexSkipScan = e.trueValue();
+            return true;
+        }
+        e = cmdObj["parallelScanThreads"];
+        if( !e.eoo() ) {
+            result.append( "was", parallelScanThreads );
+            parallelScanThreads = e.numberInt();
+            return true;
+        }
+        e = cmdObj["parallelScanMinBytes"];
+        if( !e.eoo() ) {
+            result.append( "was", parallelScanMinBytes );
+            parallelScanMinBytes = e.numberLong();
+            return true;
+        }
+        e = cmdObj["queryResultCacheBytes"];
+        if( !e.eoo() ) {
+            result.append( "was", queryResultCacheBytes );
+            queryResultCacheBytes = e.numberLong();
+            QueryResultCache::shrink();
+            return true;
+        }
         return false;
     }
 
@@ -566,6 +600,12 @@ namespace mongo {
                 bb.done();
             }
 
+            {
+                BSONObjBuilder bb( result.subobjStart( "queryResultCache" ) );
+                QueryResultCache::appendStats( bb );
+                bb.done();
+            }
+
             {
                 BSONObjBuilder bb( result.subobjStart( "network" ) );
                 networkCounter.append( bb );
@@ -1345,6 +1385,18 @@ namespace mongo {
                 result.append( "capped" , nsd->isCapped() );
                 result.appendNumber( "max" , nsd->maxCappedDocs() );
             }
+            else {
+                if ( nsd->uncompressedSize() ) {
+                    BSONObjBuilder compression( result.subobjStart( "compression" ) );
+                    compression.appendNumber( "compressedSize" , nsd->compressedSize() / scale );
+                    compression.appendNumber( "uncompressedSize" , nsd->uncompressedSize() / scale );
+                    compression.append( "ratio" , double( nsd->compressedSize() ) / double( nsd->uncompressedSize() ) );
+                    compression.done();
+                }
+                BSONObjBuilder alloc( result.subobjStart( "allocation" ) );
+                NamespaceDetailsTransient::get( ns.c_str() ).allocationStats().append( alloc );
+                alloc.done();
+            }
 
             if ( verbose )
                 result.appendArray( "extents" , extents.arr() );
@@ -1362,7 +1414,8 @@ namespace mongo {
         virtual void help( stringstream &help ) const {
             help << 
                 "Sets collection options.\n"
-                "Example: { collMod: 'foo', usePowerOf2Sizes:true }";
+                "Example: { collMod: 'foo', usePowerOf2Sizes:true }\n"
+                "         { collMod: 'foo', compressRecords:true } snappy compresses new records";
         }
 
         bool run(const string& dbname, BSONObj& jsobj, int, string& errmsg, BSONObjBuilder& result, bool fromRepl ) {
@@ -1392,6 +1445,21 @@ namespace mongo {
                         nsd->clearUserFlag( NamespaceDetails::Flag_UsePowerOf2Sizes );
                     }
                 }
+                else if ( str::equals( "compressRecords", e.fieldName() ) ) {
+                    if ( nsd->isCapped() || NamespaceString( ns ).isSystem() ) {
+                        errmsg = "can't compress records of capped or system collections";
+                        ok = false;
+                        continue;
+                    }
+                    result.appendBool( "compressRecords_old" , nsd->isUserFlagSet( NamespaceDetails::Flag_CompressRecords ) );
+                    if ( e.trueValue() ) {
+                        nsd->setUserFlag( NamespaceDetails::Flag_CompressRecords );
+                    }
+                    else {
+                        // records already compressed stay so until they are rewritten
+                        nsd->clearUserFlag( NamespaceDetails::Flag_CompressRecords );
+                    }
+                }
                 else {
                     errmsg = str::stream() << "unknown command: " << e.fieldName();
                     ok = false;
@@ -134,6 +134,7 @@ namespace mongo {
             help << "get administrative option(s)\nexample:\n";
             help << "{ getParameter:1, notablescan:1 }\n";
             help << "supported so far:\n";
+            help << "  queryResultCacheBytes\n";
             help << "  quiet\n";
             help << "  notablescan\n";
             help << "  logLevel\n";
@@ -182,9 +183,14 @@ namespace mongo {
             help << "set administrative option(s)\n";
             help << "{ setParameter:1, <param>:<value> }\n";
             help << "supported so far:\n";
+            help << "  indexIntersection\n";
+            help << "  indexSkipScan\n";
             help << "  journalCommitInterval\n";
             help << "  logLevel\n";
             help << "  notablescan\n";
+            help << "  parallelScanMinBytes\n";
+            help << "  parallelScanThreads\n";
+            help << "  queryResultCacheBytes\n";
             help << "  quiet\n";
             help << "  syncdelay\n";
         }
@@ -472,4 +478,27 @@ namespace mongo {
 
     } getLogCmd;
 
+    void negotiateWireCompression( const BSONObj& cmdObj , BSONObjBuilder& result ) {
+        BSONElement e = cmdObj["compression"];
+        if ( e.type() != Array )
+            return;
+
+        ClientBasic * c = ClientBasic::getCurrent();
+        AbstractMessagingPort * p = c ? c->port() : 0;
+        if ( ! p )
+            return;
+
+        BSONArrayBuilder arr( result.subarrayStart( "compression" ) );
+        BSONObjIterator i( e.embeddedObject() );
+        while ( i.more() ) {
+            BSONElement x = i.next();
+            if ( x.type() == String && str::equals( x.valuestr() , AbstractMessagingPort::compressorName ) ) {
+                p->setCompression( true );
+                arr.append( AbstractMessagingPort::compressorName );
+                break;
+            }
+        }
+        arr.done();
+    }
+
 }
@@ -44,8 +44,8 @@
      READLOCK mmmutex
        commitJob.reset()
      UNLOCK dbMutex                                     // now other threads can write
-       WRITETOJOURNAL()
-       WRITETODATAFILES()
+       WRITETOJOURNAL()                                 // compress; the journal writer thread appends and fsyncs
+       WRITETODATAFILES()                               // of the previous commit, once it is in the journal
      UNLOCK mmmutex
      UNLOCK groupCommitMutex
 
@@ -63,6 +63,7 @@
 #include "client.h"
 #include "dur.h"
 #include "dur_journal.h"
+#include "dur_journalimpl.h"
 #include "dur_commitjob.h"
 #include "dur_recover.h"
 #include "dur_stats.h"
@@ -83,8 +84,9 @@ namespace mongo {
         void assertNothingSpooled();
         void unspoolWriteIntents();
 
+        extern Journal j;
+
         void PREPLOGBUFFER(JSectHeader& outParm, AlignedBuilder&);
-        void WRITETOJOURNAL(JSectHeader h, AlignedBuilder& uncompressed);
         void WRITETODATAFILES(const JSectHeader& h, AlignedBuilder& uncompressed);
 
         /** declared later in this file
@@ -100,6 +102,50 @@ namespace mongo {
             memset(this, 0, sizeof(*this));
         }
 
+        void LatencyHistogram::note(unsigned long long micros) {
+            unsigned i = 0;
+            while( micros > 1 && i < Buckets - 1 ) {
+                micros >>= 1;
+                i++;
+            }
+            _n[i]++;
+        }
+
+        unsigned long long LatencyHistogram::percentile(unsigned pct) const {
+            unsigned long long n = 0;
+            for( unsigned i = 0; i < Buckets; i++ )
+                n += _n[i];
+            if( n == 0 )
+                return 0;
+            unsigned long long want = (n * pct + 99) / 100, seen = 0;
+            for( unsigned i = 0; i < Buckets; i++ ) {
+                seen += _n[i];
+                if( seen >= want )
+                    return 2ULL << i;
+            }
+            return 2ULL << (Buckets - 1);
+        }
+
+        void LatencyHistogram::add(const LatencyHistogram& other) {
+            for( unsigned i = 0; i < Buckets; i++ )
+                _n[i] += other._n[i];
+        }
+
+        BSONObj LatencyHistogram::asObj() const {
+            BSONObjBuilder b;
+            b << "p50" << (long long) percentile(50) <<
+                 "p90" << (long long) percentile(90) <<
+                 "p99" << (long long) percentile(99);
+            int used = Buckets;
+            while( used > 0 && _n[used - 1] == 0 )
+                used--;
+            BSONArrayBuilder h( b.subarrayStart( "histogram" ) );
+            for( int i = 0; i < used; i++ )
+                h.append( _n[i] );
+            h.done();
+            return b.obj();
+        }
+
         Stats::Stats() {
             _a.reset();
             _b.reset();
@@ -140,6 +186,8 @@ namespace mongo {
                        "journaledMB" << _journaledBytes / 1000000.0 <<
                        "writeToDataFilesMB" << _writeToDataFilesBytes / 1000000.0 <<
                        "compression" << _journaledBytes / (_uncompressedBytes+1.0) <<
+                       "writeIntentMB" << _intentBytes / 1000000.0 <<
+                       "coalescedMB" << _intentBytesCoalesced / 1000000.0 <<
                        "commitsInWriteLock" << _commitsInWriteLock <<
                        "earlyCommits" << _earlyCommits << 
                        "timeMs" <<
@@ -148,7 +196,9 @@ namespace mongo {
                              "writeToJournal" << (unsigned) (_writeToJournalMicros/1000) <<
                              "writeToDataFiles" << (unsigned) (_writeToDataFilesMicros/1000) <<
                              "remapPrivateView" << (unsigned) (_remapPrivateViewMicros/1000)
-                           );
+                           ) <<
+                       "commitLatencyMicros" << _commitLatency.asObj() <<
+                       "remapPauseMicros" << _remapPause.asObj();
             /*int r = getAgeOutJournalFiles();
             if( r == -1 )
                 b << "ageOutJournalFiles" << "mutex timeout";
@@ -443,7 +493,8 @@ namespace mongo {
 
         extern size_t privateMapBytes;
 
-        static void _REMAPPRIVATEVIEW() {
+        /** @return number of chunks remapped */
+        static unsigned long long _REMAPPRIVATEVIEW() {
             // todo: Consider using ProcessInfo herein and watching for getResidentSize to drop.  that could be a way 
             //       to assure very good behavior here.
 
@@ -455,10 +506,11 @@ namespace mongo {
             verify( Lock::isW() );
             verify( !commitJob.hasWritten() );
 
-            // we want to remap all private views about every 2 seconds.  there could be ~1000 views so
-            // we do a little each pass; beyond the remap time, more significantly, there will be copy on write
-            // faults after remapping, so doing a little bit at a time will avoid big load spikes on
-            // remapping.
+            // we want to remap all the private views written about every 2 seconds.  beyond the remap
+            // time, more significantly, there will be copy on write faults after remapping, so doing a
+            // little bit at a time will avoid big load spikes on remapping.  the unit of work is a
+            // MongoMMF::RemapChunkSize chunk written since its last remap, not a whole file, so that
+            // one big file does not make for a long pause in the write lock.
             unsigned long long now = curTimeMicros64();
             double fraction = (now-lastRemap)/2000000.0;
             if( cmdLine.durOptions & CmdLine::DurAlwaysRemap )
@@ -478,7 +530,7 @@ namespace mongo {
             set<MongoFile*>& files = MongoFile::getAllFiles();
             unsigned sz = files.size();
             if( sz == 0 )
-                return;
+                return 0;
 
             {
                 // be careful not to use too much memory if the write rate is 
@@ -490,36 +542,50 @@ namespace mongo {
                 privateMapBytes = 0;
             }
 
-            unsigned ntodo = (unsigned) (sz * fraction);
+            unsigned long long dirty = 0;
+            for( set<MongoFile*>::iterator i = files.begin(); i != files.end(); i++ ) {
+                if( (*i)->isMongoMMF() )
+                    dirty += ((MongoMMF*) *i)->dirtyChunks();
+            }
+            if( dirty == 0 )
+                return 0;
+
+            unsigned long long ntodo = (unsigned long long) (dirty * fraction);
             if( ntodo < 1 ) ntodo = 1;
-            if( ntodo > sz ) ntodo = sz;
+            if( ntodo > dirty ) ntodo = dirty;
 
             const set<MongoFile*>::iterator b = files.begin();
             const set<MongoFile*>::iterator e = files.end();
             set<MongoFile*>::iterator i = b;
             // skip to our starting position
-            for( unsigned x = 0; x < startAt; x++ ) {
+            if( startAt >= sz )
+                startAt = 0;
+            for( unsigned x = 0; x < startAt; x++ )
                 i++;
-                if( i == e ) i = b;
-            }
             unsigned startedAt = startAt;
-            startAt = (startAt + ntodo) % sz; // mark where to start next time
 
+            // go round from there until the budget is spent, leaving startAt at the file we stop
+            // in so that its remaining chunks are next
             Timer t;
-            for( unsigned x = 0; x < ntodo; x++ ) {
+            unsigned long long done = 0;
+            for( unsigned x = 0; x < sz; x++ ) {
                 dassert( i != e );
                 if( (*i)->isMongoMMF() ) {
                     MongoMMF *mmf = (MongoMMF*) *i;
                     verify(mmf);
-                    if( mmf->willNeedRemap() ) {
-                        mmf->willNeedRemap() = false;
-                        mmf->remapThePrivateView();
-                    }
-                    i++;
-                    if( i == e ) i = b;
+                    done += mmf->remapDirtyChunks( (unsigned) min(ntodo - done, (unsigned long long) UINT_MAX) );
+                    if( done >= ntodo )
+                        break;
+                }
+                i++;
+                startAt++;
+                if( i == e ) {
+                    i = b;
+                    startAt = 0;
                 }
             }
-            LOG(2) << "journal REMAPPRIVATEVIEW done startedAt: " << startedAt << " n:" << ntodo << ' ' << t.millis() << "ms" << endl;
+            LOG(2) << "journal REMAPPRIVATEVIEW done startedAt: " << startedAt << " chunks:" << done << " of " << dirty << ' ' << t.millis() << "ms" << endl;
+            return done;
         }
 
         /** We need to remap the private views periodically. otherwise they would become very large.
@@ -527,18 +593,224 @@ namespace mongo {
         */
         void REMAPPRIVATEVIEW() {
             Timer t;
-            _REMAPPRIVATEVIEW();
-            stats.curr->_remapPrivateViewMicros += t.micros();
+            unsigned long long chunks = _REMAPPRIVATEVIEW();
+            unsigned long long micros = t.micros();
+            stats.curr->_remapPrivateViewMicros += micros;
+            // a pass with nothing to remap isn't a pause worth reporting
+            if( chunks )
+                stats.curr->_remapPause.note(micros);
+        }
+
+        /** The journal is written a commit behind the commit thread.  Once a group commit has built and
+            compressed its section, the journal writer thread appends and fsyncs it while the commit thread
+            goes on -- the next group commit can gather and compress its section as the last one's fsync is
+            still in flight.  Hence two of each buffer: the section in flight, and the next.
+
+            A section's writes to the data files must follow it into the journal, and come before those of
+            the next section, so the commit thread does them, under its locks, when it next calls finish():
+            with the next section ready, when there is nothing to commit, and before a remap or a file
+            closes (those commit in _groupCommit).  getlasterror j:true is acknowledged by the writer as
+            soon as the section is on disk.
+
+            concurrency: groupCommitMutex, except for the writer thread's part
+        */
+        class JournalPipeline : boost::noncopyable {
+        public:
+            JournalPipeline() : _m("JournalPipeline"), _next(0), _inFlight(false), _written(false),
+                _submitting(false), _submittingSeq(0), _commitNumber(0), _began(0), _uncompressedLen(0) {
+                _writerStats.reset();
+                for( int i = 0; i < 2; i++ ) {
+                    // grown as needed, but not shrunk, so we don't regrow them on every commit
+                    _uncompressed[i] = new AlignedBuilder(4 * 1024 * 1024);
+                    _compressed[i] = new AlignedBuilder(32 * 1024 * 1024);
+                }
+            }
+
+            /** the buffer to build the next section in with PREPLOGBUFFER */
+            AlignedBuilder& builder() { return *_uncompressed[_next]; }
+
+            /** compress the section in builder(), finish() the one before, and hand this one to the
+                journal writer.  returns without waiting for the journal.
+                @param commitNumber acknowledged for getlasterror j:true once the section is on disk
+                @param began curTimeMicros64() at the start of the commit, for the latency stats
+            */
+            void submit(const JSectHeader& h, NotifyAll::When commitNumber, unsigned long long began);
+
+            /** wait for the section in flight, if any, to be in the journal, then write it to the data files */
+            void finish();
+
+            /** see sectionAwaitingDataFiles() */
+            bool awaitingDataFiles(unsigned long long& seqNumber);
+
+            /** thread: the journal writer, which appends each submitted section in turn */
+            void writer();
+
+        private:
+            void _write();
+
+            /** the writer thread's stats.  stats.curr belongs to the commit thread, which adds these to it
+                in finish().  under _m.  plain old data
+            */
+            struct WriterStats {
+                unsigned long long journaledBytes;
+                unsigned long long uncompressedBytes;
+                unsigned long long writeToJournalMicros;
+                LatencyHistogram commitLatency;
+                void reset() { memset(this, 0, sizeof(*this)); }
+            };
+
+            mongo::mutex _m;
+            boost::condition _c;         // signalled as a section is handed over, and when it is written
+            int _next;                   // buffers for the next section; the other pair is in flight
+            bool _inFlight;              // submitted and not yet finished
+            bool _written;               // the section in flight is in the journal
+            bool _submitting;            // a section is being compressed, before it is in flight
+            unsigned long long _submittingSeq;
+
+            // the section in flight
+            JSectHeader _h;
+            NotifyAll::When _commitNumber;
+            unsigned long long _began;
+            unsigned _uncompressedLen;   // a check that no one touched the builder meanwhile
+
+            WriterStats _writerStats;
+
+            AlignedBuilder *_uncompressed[2];
+            AlignedBuilder *_compressed[2];
+        };
+
+        static JournalPipeline& journalPipeline = *(new JournalPipeline()); // don't destroy
+
+        void JournalPipeline::submit(const JSectHeader& h, NotifyAll::When commitNumber,
+                                     unsigned long long began) {
+            {
+                scoped_lock lk(_m);
+                _submitting = true;
+                _submittingSeq = h.seqNumber;
+            }
+            {
+                Timer t;
+                j.prepare(h, *_uncompressed[_next], *_compressed[_next]);
+                stats.curr->_writeToJournalMicros += t.micros();
+            }
+
+            finish();
+
+            scoped_lock lk(_m);
+            _h = h;
+            _commitNumber = commitNumber;
+            _began = began;
+            _uncompressedLen = _uncompressed[_next]->len();
+            _next ^= 1;
+            _submitting = false;
+            _written = false;
+            _inFlight = true;
+            _c.notify_all();
         }
 
-        // this is a pseudo-local variable in the groupcommit functions 
-        // below.  however we don't truly do that so that we don't have to 
-        // reallocate, and more importantly regrow it, on every single commit.
-        static AlignedBuilder __theBuilder(4 * 1024 * 1024);
+        void JournalPipeline::finish() {
+            WriterStats w;
+            {
+                scoped_lock lk(_m);
+                if( !_inFlight )
+                    return;
+                while( !_written )
+                    _c.wait(lk.boost());
+                w = _writerStats;
+                _writerStats.reset();
+            }
+            stats.curr->_journaledBytes += w.journaledBytes;
+            stats.curr->_uncompressedBytes += w.uncompressedBytes;
+            stats.curr->_writeToJournalMicros += w.writeToJournalMicros;
+            stats.curr->_commitLatency.add(w.commitLatency);
+
+            // note the higher-up-the-chain locking of filesLockedFsync is important here, 
+            // as we are not in Lock::GlobalRead anymore. private view readers won't see 
+            // anything as we do this, but external viewers of the datafiles will see them 
+            // mutating.
+            AlignedBuilder& ab = *_uncompressed[_next ^ 1];
+            verify( _uncompressedLen == ab.len() ); // if this fails, our locking is wrong
+            WRITETODATAFILES(_h, ab);
+            verify( _uncompressedLen == ab.len() );
+            ab.reset();
+
+            scoped_lock lk(_m);
+            _inFlight = false;
+        }
+
+        bool JournalPipeline::awaitingDataFiles(unsigned long long& seqNumber) {
+            scoped_lock lk(_m);
+            // the one in flight is the older
+            if( _inFlight ) {
+                seqNumber = _h.seqNumber;
+                return true;
+            }
+            if( _submitting ) {
+                seqNumber = _submittingSeq;
+                return true;
+            }
+            return false;
+        }
+
+        void JournalPipeline::_write() {
+            int i;
+            {
+                scoped_lock lk(_m);
+                while( !_inFlight || _written )
+                    _c.wait(lk.boost());
+                i = _next ^ 1;
+            }
+
+            // submit() doesn't touch the section in flight, nor finish() until we are done
+            Timer t;
+            j.append(*_compressed[i]);
+            unsigned long long micros = t.micros();
+
+            // data is now in the journal, which is sufficient for acknowledging getLastError.
+            // (ok to crash after that)
+            commitJob.notifyCommitted(_commitNumber);
+            unsigned long long latency = curTimeMicros64() - _began;
+
+            scoped_lock lk(_m);
+            _writerStats.journaledBytes += _compressed[i]->len();
+            _writerStats.uncompressedBytes += _uncompressedLen;
+            _writerStats.writeToJournalMicros += micros;
+            _writerStats.commitLatency.note(latency);
+            _written = true;
+            _c.notify_all();
+        }
+
+        void JournalPipeline::writer() {
+            Client::initThread("journalWriter");
+            while( 1 ) {
+                try {
+                    _write();
+                }
+                catch(DBException& e ) {
+                    log() << "dbexception in journal writer causing immediate shutdown: " << e.toString() << endl;
+                    mongoAbort("jw1");
+                }
+                catch(std::ios_base::failure& e) {
+                    log() << "ios_base exception in journal writer causing immediate shutdown: " << e.what() << endl;
+                    mongoAbort("jw2");
+                }
+                catch(std::exception& e) {
+                    log() << "exception in journal writer causing immediate shutdown: " << e.what() << endl;
+                    mongoAbort("jw3");
+                }
+            }
+        }
+
+        bool sectionAwaitingDataFiles(unsigned long long& seqNumber) {
+            return journalPipeline.awaitingDataFiles(seqNumber);
+        }
+
+        static void journalWriterThread() {
+            journalPipeline.writer();
+        }
 
         static bool _groupCommitWithLimitedLocks() {
             unspoolWriteIntents(); // in case we were doing some writing ourself (likely impossible with limitedlocks version)
-            AlignedBuilder &ab = __theBuilder;
 
             verify( ! Lock::isLocked() );
 
@@ -550,20 +822,26 @@ namespace mongo {
 
             SimpleMutex::scoped_lock lk2(commitJob.groupCommitMutex);
 
+            unsigned long long began = curTimeMicros64();
             commitJob.commitingBegin(); // increments the commit epoch for getlasterror j:true
 
             if( !commitJob.hasWritten() ) {
-                // getlasterror request could have came after the data was already committed
+                // getlasterror request could have came after the data was already committed.
+                // it may be in the section still in flight though, which we wait for outside
+                // the readlock.
+                LockMongoFilesShared lk3;
+                lk1.reset();
+                journalPipeline.finish();
                 commitJob.committingNotifyCommitted();
                 return true;
             }
 
             JSectHeader h;
-            PREPLOGBUFFER(h,ab); // need to be in readlock (writes excluded) for this
+            PREPLOGBUFFER(h,journalPipeline.builder()); // need to be in readlock (writes excluded) for this
 
             LockMongoFilesShared lk3;
 
-            unsigned abLen = ab.len();
+            NotifyAll::When commitNumber = commitJob.commitNumber();
             commitJob.committingReset(); // must be reset before allowing anyone to write
             DEV verify( !commitJob.hasWritten() );
 
@@ -572,20 +850,9 @@ namespace mongo {
 
             // ****** now other threads can do writes ******
 
-            WRITETOJOURNAL(h, ab);
-            verify( abLen == ab.len() ); // a check that no one touched the builder while we were doing work. if so, our locking is wrong.
-
-            // data is now in the journal, which is sufficient for acknowledging getLastError.
-            // (ok to crash after that)
-            commitJob.committingNotifyCommitted();
-
-            // note the higher-up-the-chain locking of filesLockedFsync is important here, 
-            // as we are not in Lock::GlobalRead anymore. private view readers won't see 
-            // anything as we do this, but external viewers of the datafiles will see them 
-            // mutating.
-            WRITETODATAFILES(h, ab);
-            verify( abLen == ab.len() ); // check again wasn't modded
-            ab.reset();
+            // compress the section, write the previous one to the data files once it is in the
+            // journal, and leave this one to the journal writer: we don't wait for its fsync
+            journalPipeline.submit(h, commitNumber, began);
 
             // can't : d.dbMutex._remapPrivateViewRequested = true;
             // (writes have happened we released)
@@ -626,36 +893,33 @@ namespace mongo {
             unspoolWriteIntents(); // in case we were doing some writing ourself
 
             {
-                AlignedBuilder &ab = __theBuilder;
-
                 // we need to make sure two group commits aren't running at the same time
                 // (and we are only read locked in the dbMutex, so it could happen)
                 SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
 
+                unsigned long long began = curTimeMicros64();
                 commitJob.commitingBegin();
 
+                // a limited locks commit's section may still be on its way to the data files;
+                // it goes first, and must be there before we remap
+                journalPipeline.finish();
+
                 if( !commitJob.hasWritten() ) {
                     // getlasterror request could have came after the data was already committed
                     commitJob.committingNotifyCommitted();
                 }
                 else {
                     JSectHeader h;
-                    PREPLOGBUFFER(h,ab);
+                    PREPLOGBUFFER(h,journalPipeline.builder());
 
                     // todo : write to the journal outside locks, as this write can be slow.
                     //        however, be careful then about remapprivateview as that cannot be done 
                     //        if new writes are then pending in the private maps.
-                    WRITETOJOURNAL(h, ab);
-
-                    // data is now in the journal, which is sufficient for acknowledging getLastError.
-                    // (ok to crash after that)
-                    commitJob.committingNotifyCommitted();
-
-                    WRITETODATAFILES(h, ab);
+                    journalPipeline.submit(h, commitJob.commitNumber(), began);
+                    journalPipeline.finish();
                     debugValidateAllMapsMatch();
 
                     commitJob.committingReset();
-                    ab.reset();
                 }
             }
 
@@ -788,7 +1052,11 @@ namespace mongo {
                 unsigned oneThird = (ms / 3) + 1; // +1 so never zero
 
                 try {
-                    stats.rotate();
+                    {
+                        // the commit thread adds the journal writer's stats to stats.curr under this
+                        SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
+                        stats.rotate();
+                    }
 
                     // commit sooner if one or more getLastError j:true is pending
                     sleepmillis(oneThird);
@@ -839,6 +1107,7 @@ namespace mongo {
 #endif
 
             DurableInterface::enableDurability();
+            boost::thread w(journalWriterThread);
 
             journalMakeDir();
             try {
@@ -107,6 +107,82 @@ namespace mongo {
             dassert(contains(other));
         }
 
+        struct StartsBefore {
+            bool operator()(const WriteIntent& a, const WriteIntent& b) const { return a.start() < b.start(); }
+        };
+
+        /** sort by start address.  LSD radix sort a byte at a time, skipping the bytes all the
+            intents have in common - usually the high ones - so there are only a few passes.
+            a big commit can have a lot of intents, few enough go to std::sort.
+        */
+        static void sortByStart(vector<WriteIntent>& v, vector<WriteIntent>& buf) {
+            const size_t n = v.size();
+            if( n < 256 ) {
+                sort(v.begin(), v.end(), StartsBefore());
+                return;
+            }
+
+            enum { KeyBytes = sizeof(size_t) };
+            unsigned counts[KeyBytes][256];
+            memset(counts, 0, sizeof(counts));
+            for( size_t i = 0; i < n; i++ ) {
+                size_t k = (size_t) v[i].start();
+                for( unsigned b = 0; b < KeyBytes; b++ )
+                    counts[b][(k >> (b * 8)) & 0xff]++;
+            }
+
+            buf.resize(n);
+            WriteIntent *from = &v[0];
+            WriteIntent *to = &buf[0];
+            for( unsigned b = 0; b < KeyBytes; b++ ) {
+                unsigned *c = counts[b];
+                if( c[((size_t) from[0].start() >> (b * 8)) & 0xff] == n )
+                    continue; // all the same
+                unsigned ofs = 0;
+                for( unsigned d = 0; d < 256; d++ ) {
+                    unsigned x = c[d];
+                    c[d] = ofs;
+                    ofs += x;
+                }
+                for( size_t i = 0; i < n; i++ ) {
+                    size_t k = (size_t) from[i].start();
+                    to[ c[(k >> (b * 8)) & 0xff]++ ] = from[i];
+                }
+                swap(from, to);
+            }
+            if( from != &v[0] )
+                v.swap(buf);
+        }
+
+        const vector<WriteIntent>& CommitJob::getIntentsMerged() {
+            groupCommitMutex.dassertLocked();
+            vector<WriteIntent>& v = _intentsAndDurOps._intents;
+            sortByStart(v, _intentsAndDurOps._sortBuffer);
+
+            // the Already cache only catches the same start pointer; here we catch partial
+            // overlaps and adjacent ranges, e.g. from btree splits and multi field updates
+            unsigned long long declared = 0, merged = 0;
+            size_t n = 0;
+            for( size_t i = 0; i < v.size(); i++ ) {
+                declared += v[i].length();
+                if( n > 0 && v[i].start() <= v[n-1].end() ) {
+                    v[n-1].absorb(v[i]);
+                }
+                else {
+                    if( n > 0 )
+                        merged += v[n-1].length();
+                    v[n++] = v[i];
+                }
+            }
+            if( n > 0 )
+                merged += v[n-1].length();
+            v.resize(n);
+
+            stats.curr->_intentBytes += declared;
+            stats.curr->_intentBytesCoalesced += declared - merged;
+            return v;
+        }
+
         void IntentsAndDurOps::clear() {
             assertLockedForCommitting();
             commitJob.groupCommitMutex.dassertLocked();
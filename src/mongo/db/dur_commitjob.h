@@ -90,6 +90,7 @@ namespace mongo {
         class IntentsAndDurOps : boost::noncopyable {
         public:
             vector<WriteIntent> _intents;
+            vector<WriteIntent> _sortBuffer; // for sorting _intents, kept between commits for its capacity
             Already<127> _alreadyNoted;
             vector< shared_ptr<DurOp> > _durOps; // all the ops other than basic writes
 
@@ -160,6 +161,10 @@ namespace mongo {
                 groupCommitMutex.dassertLocked();
                 _notify.notifyAll(_commitNumber); 
             }
+            /** the number of the commit in progress, to acknowledge it later with notifyCommitted() */
+            NotifyAll::When commitNumber() const { return _commitNumber; }
+            /** the journal writer thread calls this when a section it wrote reaches the journal */
+            void notifyCommitted(NotifyAll::When commitNumber) { _notify.notifyAll(commitNumber); }
             /** we use the commitjob object over and over, calling reset() rather than reconstructing */
             void committingReset() {
                 groupCommitMutex.dassertLocked();
@@ -170,14 +175,10 @@ namespace mongo {
             /** we check how much written and if it is getting to be a lot, we commit sooner. */
             size_t bytes() const { return _bytes; }
 
-            /** used in prepbasicwrites. sorted so that overlapping and duplicate items 
-             * can be merged.  we sort here so the caller receives something they must 
-             * keep const from their pov. */
-            const vector<WriteIntent>& getIntentsSorted() {
-                groupCommitMutex.dassertLocked();
-                sort(_intentsAndDurOps._intents.begin(), _intentsAndDurOps._intents.end());
-                return _intentsAndDurOps._intents;
-            }
+            /** used in prepbasicwrites.  the intents sorted by start address, with overlapping and
+             * adjacent ones merged, so each byte written is journaled once.  we do it here so the
+             * caller receives something they must keep const from their pov. */
+            const vector<WriteIntent>& getIntentsMerged();
 
             bool _hasWritten;
 
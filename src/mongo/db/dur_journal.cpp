@@ -34,6 +34,8 @@
 #include "../util/checksum.h"
 #include "../util/concurrency/race.h"
 #include "../util/compress.h"
+#include "../util/concurrency/thread_pool.h"
+#include "../util/processinfo.h"
 #include "../util/progress_meter.h"
 #include "../server.h"
 #include "../util/mmap.h"
@@ -126,6 +128,21 @@ namespace mongo {
             return false;
         }
 
+        void JSectBlock::setHash(const void *data) {
+            Checksum c;
+            c.gen(data, len);
+            memcpy(hash, c.bytes, sizeof(hash));
+        }
+
+        bool JSectBlock::checkHash(const void *data) const {
+            Checksum c;
+            c.gen(data, len);
+            if( memcmp(hash, c.bytes, sizeof(hash)) == 0 )
+                return true;
+            log() << "journal block checkHash mismatch, got: " << toHex(c.bytes, 16) << " expected: " << toHex(hash,16) << endl;
+            return false;
+        }
+
         JHeader::JHeader(string fname) {
             magic[0] = 'j'; magic[1] = '\n';
             _version = CurrentVersion;
@@ -580,7 +597,13 @@ namespace mongo {
         }
 
         void Journal::preFlush() {
-            j._preFlushTime = Listener::getElapsedTimeMillis();
+            unsigned long long t = Listener::getElapsedTimeMillis();
+            // a journaled section whose data file writes are still to come may miss this flush, and
+            // recovery must not skip it
+            unsigned long long seq;
+            if( sectionAwaitingDataFiles(seq) && seq < t )
+                t = seq;
+            j._preFlushTime = t;
         }
 
         void Journal::postFlush() {
@@ -669,69 +692,123 @@ namespace mongo {
             }
         }
 
-        /** write (append) the buffer we have built to the journal and fsync it.
-            outside of dbMutex lock as this could be slow.
-            @param uncompressed - a buffer that will be written to the journal after compression
-            will not return until on disk
-        */
-        void WRITETOJOURNAL(JSectHeader h, AlignedBuilder& uncompressed) {
-            Timer t;
-            j.journal(h, uncompressed);
-            stats.curr->_writeToJournalMicros += t.micros();
+        /** compress one block of a section, in place in the journal buffer, and checksum it */
+        static void compressBlock(const char *in, unsigned len, char *out, JSectBlock *block) {
+            size_t compressedLength = 0;
+            rawCompress(in, len, out, &compressedLength);
+            block->len = (unsigned) compressedLength;
+            block->uncompressedLen = len;
+            block->setHash(out);
         }
-        void Journal::journal(const JSectHeader& h, const AlignedBuilder& uncompressed) {
+
+        ThreadPool* groupCommitWorkers() {
+            static ThreadPool *pool = 0; // don't destroy, there is no joining it at exit
+            static bool init = false;
+            if( !init ) {
+                unsigned cores = ProcessInfo().getNumCores();
+                if( cores > 1 )
+                    pool = new ThreadPool(std::min(cores, 8U) - 1); // and the committing thread
+                init = true;
+            }
+            return pool;
+        }
+
+        /** compress the buffer we have built for the journal.  the journal writer thread appends it
+            and fsyncs it, see JournalPipeline in dur.cpp.  outside of dbMutex lock as this could be slow.
+        */
+        void Journal::prepare(const JSectHeader& h, const AlignedBuilder& uncompressed, AlignedBuilder& b) {
             RACECHECK
-            static AlignedBuilder b(32*1024*1024);
             /* buffer to journal will be
                JSectHeader
-               compressed operations
+               JSectBlocks, the table of blocks
+               compressed blocks
                JSectFooter
             */
-            const unsigned headTailSize = sizeof(JSectHeader) + sizeof(JSectFooter);
-            const unsigned max = maxCompressedLength(uncompressed.len()) + headTailSize;
-            b.reset(max);
+            const unsigned len = uncompressed.len();
+            const unsigned nBlocks = len == 0 ? 1 : (len + JSectBlockSize - 1) / JSectBlockSize;
+            const unsigned maxBlock = (maxCompressedLength(std::min(len, JSectBlockSize)) + 7) & ~7;
+            const unsigned tableLen = sizeof(JSectBlocks) + nBlocks * sizeof(JSectBlock);
+            const unsigned headTailSize = sizeof(JSectHeader) + tableLen + sizeof(JSectFooter);
+            b.reset(headTailSize + nBlocks * maxBlock);
 
             {
                 dassert( h.sectionLen() == (unsigned) 0xffffffff ); // we will backfill later
                 b.appendStruct(h);
-            }
-
-            size_t compressedLength = 0;
-            rawCompress(uncompressed.buf(), uncompressed.len(), b.cur(), &compressedLength);
-            verify( compressedLength < 0xffffffff );
-            verify( compressedLength < max );
-            b.skip(compressedLength);
+                b.appendNum(nBlocks);
+                b.skip(nBlocks * sizeof(JSectBlock)); // filled in as each block is compressed
+            }
+            JSectBlock *blocks = (JSectBlock *) b.atOfs(sizeof(JSectHeader) + sizeof(JSectBlocks));
+
+            // each block is compressed to a maxBlock slot of its own, then we close up the gaps.
+            // all but the first block go to the pool, if the section is big enough to have them.
+            const unsigned dataOfs = b.len();
+            dassert( dataOfs % 8 == 0 );
+            ThreadPool *pool = nBlocks > 1 ? groupCommitWorkers() : 0;
+            for( unsigned i = nBlocks; i-- > 0; ) {
+                const char *in = uncompressed.buf() + i * JSectBlockSize;
+                unsigned inLen = std::min(len - i * JSectBlockSize, JSectBlockSize);
+                char *out = b.atOfs(dataOfs + i * maxBlock);
+                if( pool && i > 0 )
+                    pool->schedule(compressBlock, in, inLen, out, &blocks[i]);
+                else
+                    compressBlock(in, inLen, out, &blocks[i]);
+            }
+            if( pool )
+                pool->join();
+
+            unsigned ofs = dataOfs;
+            for( unsigned i = 0; i < nBlocks; i++ ) {
+                verify( blocks[i].len <= maxBlock );
+                if( ofs != dataOfs + i * maxBlock )
+                    memmove(b.atOfs(ofs), b.atOfs(dataOfs + i * maxBlock), blocks[i].len);
+                ofs += blocks[i].lenWithPadding();
+            }
+            b.skip(ofs - dataOfs);
 
             // footer
-            unsigned L = 0xffffffff;
             {
                 // pad to alignment, and set the total section length in the JSectHeader
                 verify( 0xffffe000 == (~(Alignment-1)) );
                 unsigned lenUnpadded = b.len() + sizeof(JSectFooter);
-                L = (lenUnpadded + Alignment-1) & (~(Alignment-1));
+                unsigned L = (lenUnpadded + Alignment-1) & (~(Alignment-1));
                 dassert( L >= lenUnpadded );
 
                 ((JSectHeader*)b.atOfs(0))->setSectionLen(lenUnpadded);
 
-                JSectFooter f(b.buf(), b.len()); // computes checksum
+                JSectFooter f(b.buf(), sizeof(JSectHeader) + tableLen); // computes checksum
                 b.appendStruct(f);
                 dassert( b.len() == lenUnpadded );
 
                 b.skip(L - lenUnpadded);
                 dassert( b.len() % Alignment == 0 );
             }
+        }
 
+        /** write (append) a prepared section to the journal and fsync it.
+            will not return until on disk
+        */
+        void Journal::append(AlignedBuilder& b) {
+            RACECHECK
             try {
                 SimpleMutex::scoped_lock lk(_curLogFileMutex);
 
-                // must already be open -- so that _curFileId is correct for previous buffer building
+                // must already be open -- so that _curFileId is correct for the header check below
                 verify( _curLogFile );
 
-                stats.curr->_uncompressedBytes += uncompressed.len();
-                unsigned w = b.len();
-                _written += w;
-                verify( w <= L );
-                stats.curr->_journaledBytes += L;
+                JSectHeader *h = (JSectHeader*) b.atOfs(0);
+                if( h->fileId != _curFileId ) {
+                    // the previous section's append rotated the file while this one was being
+                    // built.  recovery stops at a section that doesn't match its file.
+                    h->fileId = _curFileId;
+                    unsigned footerOfs = h->sectionLen() - sizeof(JSectFooter);
+                    const JSectBlocks *t = (const JSectBlocks *) b.atOfs(sizeof(JSectHeader));
+                    JSectFooter f(b.buf(), sizeof(JSectHeader) + t->tableLen()); // the checksum covers the header
+                    memcpy(b.atOfs(footerOfs), &f, sizeof(f));
+                }
+
+                unsigned L = b.len();
+                dassert( L % Alignment == 0 );
+                _written += L;
                 _curLogFile->synchronousAppend((const void *) b.buf(), L);
                 _rotate();
             }
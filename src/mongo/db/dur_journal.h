@@ -21,6 +21,10 @@
 namespace mongo {
     class AlignedBuilder;
 
+    namespace threadpool {
+        class ThreadPool;
+    }
+
     namespace dur {
 
         /** true if ok to cleanup journal files at termination. otherwise, files journal will be retained.
@@ -54,6 +58,17 @@ namespace mongo {
 
         unsigned long long getLastDataFileFlushTime();
 
+        /** @return true if a group commit's section is on its way to the journal or in it, but not yet
+            written to the data files; seqNumber is then that section's.  any thread.
+        */
+        bool sectionAwaitingDataFiles(unsigned long long& seqNumber);
+
+        /** threads the group commit can spread its work over - compressing the journal blocks,
+            writing to the data files - or 0 if there is a single core.  only the group committing
+            thread uses them, one job at a time, under groupCommitMutex.
+        */
+        threadpool::ThreadPool* groupCommitWorkers();
+
         /** never throws.
             @param anyFiles by default we only look at j._* files. If anyFiles is true, return true
                    if there are any files in the journal directory. acquirePathLock() uses this to
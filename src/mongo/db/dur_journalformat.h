@@ -39,8 +39,10 @@ namespace mongo {
 #if defined(_NOCOMPRESS)
             enum { CurrentVersion = 0x4148 };
 #else
-            enum { CurrentVersion = 0x4149 };
+            enum { CurrentVersion = 0x414a };
 #endif
+            // sections compressed whole rather than in JSectBlocks.  we still recover these.
+            enum { WholeSectionVersion = 0x4149 };
             unsigned short _version;
 
             // these are just for diagnostic ease (make header more useful as plain text)
@@ -55,7 +57,9 @@ namespace mongo {
             char reserved3[8026]; // 8KB total for the file header
             char txt2[2];         // "\n\n" at the end
 
-            bool versionOk() const { return _version == CurrentVersion; }
+            bool versionOk() const { return _version == CurrentVersion || _version == WholeSectionVersion; }
+            /** @return true if the file's sections are compressed in JSectBlocks */
+            bool blocked() const { return _version == CurrentVersion; }
             bool valid() const { return magic[0] == 'j' && txt2[1] == '\n' && fileId; }
         };
 
@@ -148,6 +152,32 @@ namespace mongo {
             bool magicOk() const { return *((unsigned*)magic) == 0x0a0a0a0a; }
         };
 
+        /** A section's data is compressed in blocks of up to JSectBlockSize bytes each, so they can be
+            compressed (and checked, and uncompressed) in parallel.  After the JSectHeader is the table of
+            blocks, then each block's compressed data, padded to 8 bytes.  The JSectFooter's hash covers
+            just the JSectHeader and the table; each block has its own.
+        */
+        const unsigned JSectBlockSize = 1024 * 1024;
+
+        struct JSectBlocks {
+            unsigned n;
+            // JSectBlock blocks[n] follows
+
+            unsigned tableLen() const;
+        };
+
+        struct JSectBlock {
+            unsigned len;                // compressed, without padding
+            unsigned uncompressedLen;
+            unsigned char hash[16];      // of the compressed data
+
+            unsigned lenWithPadding() const { return (len + 7) & ~7; }
+            void setHash(const void *data);
+            bool checkHash(const void *data) const;
+        };
+
+        inline unsigned JSectBlocks::tableLen() const { return sizeof(JSectBlocks) + n * sizeof(JSectBlock); }
+
         /** declares "the next entry(s) are for this database / file path prefix" */
         struct JDbContext {
             JDbContext() : sentinel(JEntry::OpCode_DbContext) { }
@@ -41,9 +41,16 @@ namespace mongo {
              */
             void rotate();
 
-            /** append to the journal file
+            /** compress a section built by PREPLOGBUFFER into out, with its footer, ready to append().
+                thread: the group committing one
             */
-            void journal(const JSectHeader& h, const AlignedBuilder& b);
+            void prepare(const JSectHeader& h, const AlignedBuilder& uncompressed, AlignedBuilder& out);
+
+            /** append a prepared section to the journal file and fsync it.  will not return until on disk.
+                the file may have rotated since the section was prepared, if so we fix up its header.
+                thread: the journal writer
+            */
+            void append(AlignedBuilder& section);
 
             boost::filesystem::path getFilePathFor(int filenumber) const;
 
@@ -64,12 +64,8 @@ namespace mongo {
             size_t ofs = 1;
             MongoMMF *mmf = findMMF_inlock(i->start(), /*out*/ofs);
 
-            if( unlikely(!mmf->willNeedRemap()) ) {
-                // tag this mmf as needed a remap of its private view later.
-                // usually it will already be dirty/already set, so we do the if above first
-                // to avoid possibility of cpu cache line contention
-                mmf->willNeedRemap() = true;
-            }
+            // tag the range as needing a remap of the private view later
+            mmf->noteWrite(ofs, i->length());
 
             // since we have already looked up the mmf, we go ahead and remember the write view location
             // so we don't have to find the MongoMMF again later in WRITETODATAFILES()
@@ -116,9 +112,9 @@ namespace mongo {
 
         void assertNothingSpooled();
 
-        /** basic write ops / write intents.  note there is no particular order to these : if we have
-            two writes to the same location during the group commit interval, it is likely
-            (although not assured) that it is journaled here once.
+        /** basic write ops / write intents.  these are in order of address, with overlapping and
+            adjacent ones merged, so a location written several times during the group commit
+            interval is journaled here once.
         */
         static void prepBasicWrites(AlignedBuilder& bb) {
             scoped_lock lk(privateViews._mutex());
@@ -128,23 +124,12 @@ namespace mongo {
             RelativePath lastDbPath;
 
             assertNothingSpooled();
-            const vector<WriteIntent>& _intents = commitJob.getIntentsSorted();
+            const vector<WriteIntent>& _intents = commitJob.getIntentsMerged();
             verify( !_intents.empty() );
 
-            WriteIntent last;
-            for( vector<WriteIntent>::const_iterator i = _intents.begin(); i != _intents.end(); i++ ) { 
-                if( i->start() < last.end() ) { 
-                    // overlaps
-                    last.absorb(*i);
-                }
-                else { 
-                    // discontinuous
-                    if( i != _intents.begin() )
-                        prepBasicWrite_inlock(bb, &last, lastDbPath);
-                    last = *i;
-                }
+            for( vector<WriteIntent>::const_iterator i = _intents.begin(); i != _intents.end(); i++ ) {
+                prepBasicWrite_inlock(bb, &*i, lastDbPath);
             }
-            prepBasicWrite_inlock(bb, &last, lastDbPath);
         }
 
         static void resetLogBuffer(/*out*/JSectHeader& h, AlignedBuilder& bb) {
@@ -37,6 +37,9 @@
 #include "curop.h"
 #include "mongommf.h"
 #include "../util/compress.h"
+#include "../util/concurrency/thread_pool.h"
+#include "../util/processinfo.h"
+#include "../util/timer.h"
 #include <sys/stat.h>
 #include <fcntl.h>
 #include "dur_commitjob.h"
@@ -62,6 +65,17 @@ namespace mongo {
             shared_ptr<DurOp> op;
         };
 
+        /** a section's basic writes to one data file, which a worker applies in order */
+        struct FileWrites {
+            FileWrites(MongoMMF *f, bool r) : mmf(f), recovering(r), bytes(0), failed(false) { }
+            MongoMMF *mmf;
+            bool recovering;
+            vector<const ParsedJournalEntry*> entries;
+            unsigned long long bytes;
+            bool failed;
+            string error;
+        };
+
         void removeJournalFiles();
         boost::filesystem::path getJournalDir();
 
@@ -101,13 +115,17 @@ namespace mongo {
             const bool _doDurOps;
             string _uncompressed;
         public:
-            JournalSectionIterator(const JSectHeader& h, const void *compressed, unsigned compressedLen, bool doDurOpsRecovering) :
+            /** @param blocked compressed in JSectBlocks, see JHeader::blocked() */
+            JournalSectionIterator(const JSectHeader& h, const void *compressed, unsigned compressedLen, bool doDurOpsRecovering,
+                                   bool blocked) :
                 _h(h),
                 _lastDbName(0)
                 , _doDurOps(doDurOpsRecovering)
             {
                 verify( doDurOpsRecovering );
-                bool ok = uncompress((const char *)compressed, compressedLen, &_uncompressed);
+                bool ok = blocked ?
+                    uncompressBlocks((const char *)compressed, compressedLen) :
+                    uncompress((const char *)compressed, compressedLen, &_uncompressed);
                 if( !ok ) { 
                     // it should always be ok (i think?) as there is a previous check to see that the JSectFooter is ok
                     log() << "couldn't uncompress journal section" << endl;
@@ -129,6 +147,35 @@ namespace mongo {
 
             bool atEof() const { return _entries->atEof(); }
 
+            /** the block table is checked against the JSectFooter by the caller, each block here */
+            bool uncompressBlocks(const char *p, unsigned len) {
+                const JSectBlocks *t = (const JSectBlocks *) p;
+                verify( len >= t->tableLen() );
+                const JSectBlock *blocks = (const JSectBlock *) (t + 1);
+                size_t total = 0;
+                for( unsigned i = 0; i < t->n; i++ )
+                    total += blocks[i].uncompressedLen;
+                _uncompressed.resize(total);
+                char *out = total ? &_uncompressed[0] : 0;
+
+                const char *data = p + t->tableLen();
+                const char *end = p + len;
+                size_t ofs = 0;
+                for( unsigned i = 0; i < t->n; i++ ) {
+                    const JSectBlock& b = blocks[i];
+                    if( b.len > (size_t) (end - data) || !b.checkHash(data) ) {
+                        msgasserted(16430, str::stream() << "journal section block " << i << " of " << t->n << " is corrupt");
+                    }
+                    size_t n;
+                    if( !uncompressedLength(data, b.len, &n) || n != b.uncompressedLen ||
+                        !rawUncompress(data, b.len, out + ofs) )
+                        return false;
+                    ofs += n;
+                    data += std::min((size_t) b.lenWithPadding(), (size_t) (end - data));
+                }
+                return true;
+            }
+
             unsigned long long seqNumber() const { return _h.seqNumber; }
 
             /** get the next entry from the log.  this function parses and combines JDbContext and JEntry's.
@@ -214,7 +261,7 @@ namespace mongo {
             _mmfs.clear();
         }
 
-        void RecoveryJob::write(const ParsedJournalEntry& entry) {
+        MongoMMF* RecoveryJob::fileFor(const ParsedJournalEntry& entry) {
             //TODO(mathias): look into making some of these dasserts
             verify(entry.e);
             verify(entry.dbName);
@@ -227,32 +274,95 @@ namespace mongo {
                 file = finder.findByPath(fn);
             }
 
-            MongoMMF* mmf;
             if (file) {
                 verify(file->isMongoMMF());
-                mmf = (MongoMMF*)file;
+                return (MongoMMF*)file;
             }
-            else {
-                if( !_recovering ) {
-                    log() << "journal error applying writes, file " << fn << " is not open" << endl;
-                    verify(false);
-                }
-                boost::shared_ptr<MongoMMF> sp (new MongoMMF);
-                verify(sp->open(fn, false));
-                _mmfs.push_back(sp);
-                mmf = sp.get();
+            if( !_recovering ) {
+                log() << "journal error applying writes, file " << fn << " is not open" << endl;
+                verify(false);
             }
+            boost::shared_ptr<MongoMMF> sp (new MongoMMF);
+            verify(sp->open(fn, false));
+            _mmfs.push_back(sp);
+            return sp.get();
+        }
 
+        /** @return bytes written.  thread: any, the file is open */
+        unsigned long long RecoveryJob::write(MongoMMF *mmf, const ParsedJournalEntry& entry, bool recovering) {
             if ((entry.e->ofs + entry.e->len) <= mmf->length()) {
                 verify(mmf->view_write());
                 verify(entry.e->srcData());
 
                 void* dest = (char*)mmf->view_write() + entry.e->ofs;
                 memcpy(dest, entry.e->srcData(), entry.e->len);
-                stats.curr->_writeToDataFilesBytes += entry.e->len;
+                return entry.e->len;
+            }
+            massert(13622, "Trying to write past end of file in WRITETODATAFILES", recovering);
+            return 0;
+        }
+
+        void RecoveryJob::write(const ParsedJournalEntry& entry) {
+            unsigned long long n = write(fileFor(entry), entry, _recovering);
+            stats.curr->_writeToDataFilesBytes += n;
+            _appliedBytes += n;
+        }
+
+        /** thread: a worker in the pool given applyWrites() */
+        void RecoveryJob::applyFileWrites(FileWrites *w) {
+            try {
+                for( unsigned i = 0; i < w->entries.size(); i++ )
+                    w->bytes += write(w->mmf, *w->entries[i], w->recovering);
+            }
+            catch(std::exception& e) {
+                w->error = e.what();
+                w->failed = true;
+            }
+        }
+
+        void RecoveryJob::applyWrites(vector<ParsedJournalEntry>::const_iterator begin,
+                                      vector<ParsedJournalEntry>::const_iterator end,
+                                      threadpool::ThreadPool *pool) {
+            // group by file.  the entries of a JDbContext share their dbName pointer, so
+            // consecutive ones to the same file are usual; we look each file up once per run
+            vector< shared_ptr<FileWrites> > files;
+            map<MongoMMF*, FileWrites*> byFile;
+            const char *lastDbName = 0;
+            int lastFileNo = -1;
+            FileWrites *w = 0;
+            for( vector<ParsedJournalEntry>::const_iterator i = begin; i != end; ++i ) {
+                if( i->dbName != lastDbName || i->e->getFileNo() != lastFileNo ) {
+                    lastDbName = i->dbName;
+                    lastFileNo = i->e->getFileNo();
+                    MongoMMF *mmf = fileFor(*i);
+                    FileWrites*& f = byFile[mmf];
+                    if( f == 0 ) {
+                        f = new FileWrites(mmf, _recovering);
+                        files.push_back(shared_ptr<FileWrites>(f));
+                    }
+                    w = f;
+                }
+                w->entries.push_back(&*i);
             }
+
+            if( files.size() == 1 )
+                applyFileWrites(files[0].get());
             else {
-                massert(13622, "Trying to write past end of file in WRITETODATAFILES", _recovering);
+                for( unsigned i = 0; i < files.size(); i++ )
+                    pool->schedule(&RecoveryJob::applyFileWrites, files[i].get());
+                pool->join();
+            }
+
+            string error;
+            for( unsigned i = 0; i < files.size(); i++ ) {
+                stats.curr->_writeToDataFilesBytes += files[i]->bytes;
+                _appliedBytes += files[i]->bytes;
+                if( files[i]->failed && error.empty() )
+                    error = files[i]->error;
+            }
+            if( !error.empty() ) {
+                log() << "journal error applying writes: " << error << endl;
+                msgasserted(16431, str::stream() << "journal error applying writes: " << error);
             }
         }
 
@@ -287,21 +397,40 @@ namespace mongo {
             }
         }
 
-        void RecoveryJob::applyEntries(const vector<ParsedJournalEntry> &entries) {
+        void RecoveryJob::applyEntries(const vector<ParsedJournalEntry> &entries, threadpool::ThreadPool *pool) {
             bool apply = (cmdLine.durOptions & CmdLine::DurScanOnly) == 0;
             bool dump = cmdLine.durOptions & CmdLine::DurDumpJournal;
             if( dump )
                 log() << "BEGIN section" << endl;
 
-            for( vector<ParsedJournalEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i ) {
-                applyEntry(*i, apply, dump);
+            if( apply && !dump && pool ) {
+                // writes to different files commute, up to the next DurOp, which may create or
+                // drop them
+                vector<ParsedJournalEntry>::const_iterator i = entries.begin();
+                while( i != entries.end() ) {
+                    vector<ParsedJournalEntry>::const_iterator j = i;
+                    while( j != entries.end() && j->e )
+                        ++j;
+                    if( i != j )
+                        applyWrites(i, j, pool);
+                    if( j == entries.end() )
+                        break;
+                    applyEntry(*j, apply, dump);
+                    i = j + 1;
+                }
+            }
+            else {
+                for( vector<ParsedJournalEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i ) {
+                    applyEntry(*i, apply, dump);
+                }
             }
 
             if( dump )
                 log() << "END section" << endl;
         }
 
-        void RecoveryJob::processSection(const JSectHeader *h, const void *p, unsigned len, const JSectFooter *f) {
+        void RecoveryJob::processSection(const JSectHeader *h, const void *p, unsigned len, const JSectFooter *f,
+                                         threadpool::ThreadPool *pool) {
             scoped_lock lk(_mx);
             RACECHECK
 
@@ -325,7 +454,15 @@ namespace mongo {
 
             auto_ptr<JournalSectionIterator> i;
             if( _recovering ) {
-                i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, p, len, _recovering));
+                if( _blocked ) {
+                    // the footer covers the block table, which must be ok before we go by it
+                    const JSectBlocks *t = (const JSectBlocks *) p;
+                    if( len < sizeof(JSectBlocks) || t->n > (len - sizeof(JSectBlocks)) / sizeof(JSectBlock) ||
+                        !f->checkHash(h, sizeof(JSectHeader) + t->tableLen()) ) {
+                        msgasserted(13594, "journal checksum doesn't match");
+                    }
+                }
+                i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, p, len, _recovering, _blocked));
             }
             else { 
                 i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, /*after header*/p, /*w/out header*/len));
@@ -352,7 +489,7 @@ namespace mongo {
             }
 
             // after the entries check the footer checksum
-            if( _recovering ) {
+            if( _recovering && !_blocked ) {
                 verify( ((const char *)h) + sizeof(JSectHeader) == p );
                 if( !f->checkHash(h, len + sizeof(JSectHeader)) ) { 
                     msgasserted(13594, "journal checksum doesn't match");
@@ -360,7 +497,7 @@ namespace mongo {
             }
 
             // got all the entries for one group commit.  apply them:
-            applyEntries(entries);
+            applyEntries(entries, pool);
         }
 
         /** apply a specific journal file, that is already mmap'd
@@ -394,6 +531,7 @@ namespace mongo {
                         uasserted(13536, str::stream() << "journal version number mismatch " << h._version);
                     }
                     fileId = h.fileId;
+                    _blocked = h.blocked();
                     if(cmdLine.durOptions & CmdLine::DurDumpJournal) { 
                         log() << "JHeader::fileId=" << fileId << endl;
                     }
@@ -415,7 +553,8 @@ namespace mongo {
                     const char *hdr = (const char *) br.skip(h.sectionLenWithPadding());
                     const char *data = hdr + sizeof(JSectHeader);
                     const char *footer = data + dataLen;
-                    processSection((const JSectHeader*) hdr, data, dataLen, (const JSectFooter*) footer);
+                    processSection((const JSectHeader*) hdr, data, dataLen, (const JSectFooter*) footer, _pool);
+                    _sectionBytes += h.sectionLenWithPadding();
 
                     // ctrl c check
                     killCurrentOp.checkForInterrupt(false);
@@ -430,6 +569,15 @@ namespace mongo {
             return false; // non-abrupt end
         }
 
+        /** so restart times can be estimated from the journal size */
+        static void logThroughput(const string& what, unsigned long long sectionBytes,
+                                  unsigned long long appliedBytes, int ms) {
+            double secs = std::max(ms, 1) / 1000.0;
+            log() << "recover " << what << ": " << sectionBytes / 1000000.0 << "MB of journal sections, "
+                  << appliedBytes / 1000000.0 << "MB written to the data files in " << ms << "ms ("
+                  << sectionBytes / 1000000.0 / secs << "MB/s of journal)" << endl;
+        }
+
         /** apply a specific journal file */
         bool RecoveryJob::processFile(boost::filesystem::path journalfile) {
             log() << "recover " << journalfile.string() << endl;
@@ -447,7 +595,12 @@ namespace mongo {
             MemoryMappedFile f;
             void *p = f.mapWithOptions(journalfile.string().c_str(), MongoFile::READONLY | MongoFile::SEQUENTIAL);
             massert(13544, str::stream() << "recover error couldn't open " << journalfile.string(), p);
-            return processFileBuffer(p, (unsigned) f.length());
+
+            Timer t;
+            unsigned long long sectionsBefore = _sectionBytes, appliedBefore = _appliedBytes;
+            bool abruptEnd = processFileBuffer(p, (unsigned) f.length());
+            logThroughput(journalfile.leaf(), _sectionBytes - sectionsBefore, _appliedBytes - appliedBefore, t.millis());
+            return abruptEnd;
         }
 
         /** @param files all the j._0 style files we need to apply for recovery */
@@ -459,16 +612,32 @@ namespace mongo {
             _lastDataSyncedFromLastRun = journalReadLSN();
             log() << "recover lsn: " << _lastDataSyncedFromLastRun << endl;
 
-            for( unsigned i = 0; i != files.size(); ++i ) {
-	      bool abruptEnd = processFile(files[i]);
-                if( abruptEnd && i+1 < files.size() ) {
-                    log() << "recover error: abrupt end to file " << files[i].string() << ", yet it isn't the last journal file" << endl;
-                    close();
-                    uasserted(13535, "recover abrupt journal file end");
+            // sections are applied one after the other, but each one's writes to different
+            // files on several threads
+            unsigned threads = std::min(ProcessInfo().getNumCores(), 8U);
+            scoped_ptr<ThreadPool> pool( threads > 1 ? new ThreadPool(threads) : 0 );
+            _pool = pool.get();
+
+            Timer t;
+            _sectionBytes = _appliedBytes = 0;
+            try {
+                for( unsigned i = 0; i != files.size(); ++i ) {
+                    bool abruptEnd = processFile(files[i]);
+                    if( abruptEnd && i+1 < files.size() ) {
+                        log() << "recover error: abrupt end to file " << files[i].string() << ", yet it isn't the last journal file" << endl;
+                        close();
+                        uasserted(13535, "recover abrupt journal file end");
+                    }
                 }
             }
+            catch(...) {
+                _pool = 0;
+                throw;
+            }
+            _pool = 0;
 
             close();
+            logThroughput("total", _sectionBytes, _appliedBytes, t.millis());
 
             if( cmdLine.durOptions & CmdLine::DurScanOnly ) {
                 uasserted(13545, str::stream() << "--durOptions " << (int) CmdLine::DurScanOnly << " (scan only) specified");
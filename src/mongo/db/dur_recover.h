@@ -9,28 +9,45 @@
 namespace mongo {
     class MongoMMF;
 
+    namespace threadpool {
+        class ThreadPool;
+    }
+
     namespace dur {
         struct ParsedJournalEntry;
+        struct FileWrites;
 
         /** call go() to execute a recovery from existing journal files.
          */
         class RecoveryJob : boost::noncopyable {
         public:
             RecoveryJob() : _lastDataSyncedFromLastRun(0), 
-                _mx("recovery"), _recovering(false) { _lastSeqMentionedInConsoleLog = 1; }
+                _mx("recovery"), _recovering(false), _blocked(false), _pool(0), _sectionBytes(0), _appliedBytes(0) {
+                _lastSeqMentionedInConsoleLog = 1;
+            }
             void go(vector<boost::filesystem::path>& files);
             ~RecoveryJob();
 
-            /** @param data data between header and footer. compressed if recovering. */
-            void processSection(const JSectHeader *h, const void *data, unsigned len, const JSectFooter *f);
+            /** @param data data between header and footer. compressed if recovering.
+                @param pool if given, writes to different data files are applied in parallel with it
+            */
+            void processSection(const JSectHeader *h, const void *data, unsigned len, const JSectFooter *f,
+                                threadpool::ThreadPool *pool = 0);
 
             void close(); // locks and calls _close()
 
             static RecoveryJob & get() { return _instance; }
         private:
             void write(const ParsedJournalEntry& entry); // actually writes to the file
+            MongoMMF* fileFor(const ParsedJournalEntry& entry); // opens it if need be
+            static unsigned long long write(MongoMMF *mmf, const ParsedJournalEntry& entry, bool recovering);
+            static void applyFileWrites(FileWrites *w);
             void applyEntry(const ParsedJournalEntry& entry, bool apply, bool dump);
-            void applyEntries(const vector<ParsedJournalEntry> &entries);
+            void applyEntries(const vector<ParsedJournalEntry> &entries, threadpool::ThreadPool *pool);
+            /** basic writes to different files in parallel, each file's in order */
+            void applyWrites(vector<ParsedJournalEntry>::const_iterator begin,
+                             vector<ParsedJournalEntry>::const_iterator end,
+                             threadpool::ThreadPool *pool);
             bool processFileBuffer(const void *, unsigned len);
             bool processFile(boost::filesystem::path journalfile);
             void _close(); // doesn't lock
@@ -43,6 +60,11 @@ namespace mongo {
             mongo::mutex _mx; // protects _mmfs
         private:
             bool _recovering; // are we in recovery or WRITETODATAFILES
+            bool _blocked;    // the journal file's sections are compressed in blocks, see JHeader::blocked()
+            threadpool::ThreadPool *_pool;      // to recover with, if we apply writes in parallel
+            // for the throughput logged
+            unsigned long long _sectionBytes;   // of the journal, processed
+            unsigned long long _appliedBytes;   // written to the data files
 
             static RecoveryJob &_instance;
         };
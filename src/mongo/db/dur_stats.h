@@ -3,8 +3,25 @@
 namespace mongo {
     namespace dur {
 
+        /** micros in power of 2 buckets: bucket i counts those under 2^(i+1) (and not under 2^i).
+            plain old data, so S::reset() clears it
+        */
+        struct LatencyHistogram {
+            enum { Buckets = 32 };
+            unsigned _n[Buckets];
+
+            void note(unsigned long long micros);
+            void add(const LatencyHistogram& other);
+            /** @return the latency under which pct percent of those noted were, to a power of 2 */
+            unsigned long long percentile(unsigned pct) const;
+            /** percentiles, and the bucket counts up to the highest in use */
+            BSONObj asObj() const;
+        };
+
         /** journaling stats.  the model here is that the commit thread is the only writer, and that reads are
             uncommon (from a serverStatus command and such).  Thus, there should not be multicore chatter overhead.
+            the journal writer thread keeps its own counters, which the commit thread adds in under groupCommitMutex
+            (see JournalPipeline in dur.cpp); rotate() is under groupCommitMutex too.
         */
         struct Stats {
             Stats();
@@ -22,6 +39,8 @@ namespace mongo {
                 unsigned long long _journaledBytes;
                 unsigned long long _uncompressedBytes;
                 unsigned long long _writeToDataFilesBytes;
+                unsigned long long _intentBytes;          // declared write intents, before merging
+                unsigned long long _intentBytesCoalesced; // of those, not journaled as overlapping others
 
                 unsigned long long _prepLogBufferMicros;
                 unsigned long long _writeToJournalMicros;
@@ -36,6 +55,11 @@ namespace mongo {
                 unsigned _commitsInWriteLock;
 
                 unsigned _dtMillis;
+
+                // from the start of a commit until its section is in the journal
+                LatencyHistogram _commitLatency;
+                // REMAPPRIVATEVIEW passes that remapped something, which are done in the write lock
+                LatencyHistogram _remapPause;
             };
             S *curr;
         private:
@@ -19,6 +19,7 @@
 #include "pch.h"
 #include "dur_commitjob.h"
 #include "dur_stats.h"
+#include "dur_journal.h"
 #include "dur_recover.h"
 #include "../util/timer.h"
 
@@ -27,10 +28,17 @@ namespace mongo {
 
         void debugValidateAllMapsMatch();
 
+        /** below this a section's writes aren't worth handing out to the group commit workers */
+        const unsigned ParallelWriteToDataFilesBytes = 1024 * 1024;
+
         static void WRITETODATAFILES_Impl1(const JSectHeader& h, AlignedBuilder& uncompressed) {
             LockMongoFilesShared lk;
             LOG(3) << "journal WRITETODATAFILES 1" << endl;
-            RecoveryJob::get().processSection(&h, uncompressed.buf(), uncompressed.len(), 0);
+            // writes to different MongoMMFs go to different workers, each file's in order
+            threadpool::ThreadPool *pool = 0;
+            if( uncompressed.len() >= ParallelWriteToDataFilesBytes )
+                pool = groupCommitWorkers();
+            RecoveryJob::get().processSection(&h, uncompressed.buf(), uncompressed.len(), 0, pool);
             LOG(3) << "journal WRITETODATAFILES 2" << endl;
         }
 
@@ -68,8 +76,7 @@ namespace mongo {
             that which is going to be a remapped on its private view - but that might not be all
             views.
 
-            (2) todo should we do this using N threads?  would be quite easy
-                see Hackenberg paper table 5 and 6.  2 threads might be a good balance.
+            (2) big sections are written using the group commit workers, a data file per worker.
 
             (3) with enough work, we could do this outside the read lock.  it's a bit tricky though.
                 - we couldn't do it from the private views then as they may be changing.  would have to then
@@ -25,6 +25,9 @@
 #include "extsort.h"
 #include "namespace-inl.h"
 #include "../util/file.h"
+#include "../util/compress.h"
+#include "../util/processinfo.h"
+#include "../util/concurrency/thread_pool.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -36,9 +39,6 @@
 
 namespace mongo {
 
-    HLMutex BSONObjExternalSorter::_extSortMutex("s");
-    IndexInterface *BSONObjExternalSorter::extSortIdxInterface;
-    Ordering BSONObjExternalSorter::extSortOrder( Ordering::make(BSONObj()) );
     unsigned long long BSONObjExternalSorter::_compares = 0;
     unsigned long long BSONObjExternalSorter::_uniqueNumber = 0;
     static SimpleMutex _uniqueNumberMutex( "uniqueNumberMutex" );
@@ -54,14 +54,14 @@ namespace mongo {
     }
 
     /*static*/
-    int BSONObjExternalSorter::extSortComp( const void *lv, const void *rv ) {
-        DEV RARELY {
-            _extSortMutex.dassertLocked(); // must be as we use a global var
-        }
-        Data * l = (Data*)lv;
-        Data * r = (Data*)rv;
-        return _compare(*extSortIdxInterface, *l, *r, extSortOrder);
-    };
+    void BSONObjExternalSorter::_sortChunk( Data **begin, Data **end, RunCmp cmp ) {
+        std::sort( begin, end, cmp );
+    }
+
+    /*static*/
+    void BSONObjExternalSorter::_mergeChunks( Data **begin, Data **middle, Data **end, RunCmp cmp ) {
+        std::inplace_merge( begin, middle, end, cmp );
+    }
 
     BSONObjExternalSorter::BSONObjExternalSorter( IndexInterface &i, const BSONObj & order , long maxFileSize )
         : _idxi(i), _order( order.getOwned() ) , _maxFilesize( maxFileSize ) ,
@@ -96,27 +96,85 @@ namespace mongo {
         wassert( removed == 1 + _files.size() );
     }
 
-    void BSONObjExternalSorter::_sortInMem() {
-        // extSortComp needs to use glpbals
-        // qsort_r only seems available on bsd, which is what i really want to use
-        HLMutex::scoped_lock lk(_extSortMutex);
-        extSortIdxInterface = &_idxi;
-        extSortOrder = Ordering::make(_order);
-        _cur->sort( BSONObjExternalSorter::extSortComp );
+    void BSONObjExternalSorter::_sortInMem( ProgressMeter* pm ) {
+        // we sort pointers rather than the pairs themselves: swapping a pair would bump two
+        // atomic BSONObj refcounts
+        const int n = _cur->size();
+        _sortedRun.resize( n );
+        for ( int i = 0; i < n; i++ )
+            _sortedRun[i] = &(*_cur)[i];
+        if ( n == 0 )
+            return;
+
+        int chunks = ProcessInfo().getNumCores();
+        if ( chunks > 16 )
+            chunks = 16;
+        if ( chunks > n / MinChunkSize )
+            chunks = n / MinChunkSize;
+        if ( chunks < 1 )
+            chunks = 1;
+
+        Data **begin = &_sortedRun[0];
+        RunCmp cmp( _idxi, _order );
+        if ( chunks == 1 ) {
+            std::sort( begin, begin + n, cmp );
+            if ( pm )
+                pm->hit( n );
+            return;
+        }
+
+        // sort one chunk per thread, then merge neighbouring chunks pairwise, a round at a time
+        int rounds = 0;
+        for ( int c = 1; c < chunks; c *= 2 )
+            rounds++;
+        if ( pm )
+            pm->setTotalWhileRunning( (unsigned long long) n * ( 1 + rounds ) );
+
+        vector<Data**> bounds;
+        for ( int c = 0; c <= chunks; c++ )
+            bounds.push_back( begin + (long long) n * c / chunks );
+
+        ThreadPool pool( chunks );
+        for ( int c = 0; c < chunks; c++ )
+            pool.schedule( &BSONObjExternalSorter::_sortChunk, bounds[c], bounds[c+1], cmp );
+        pool.join();
+        killCurrentOp.checkForInterrupt();
+        if ( pm )
+            pm->hit( n );
+
+        while ( bounds.size() > 2 ) {
+            vector<Data**> merged;
+            for ( unsigned i = 0; i + 1 < bounds.size(); i += 2 ) {
+                merged.push_back( bounds[i] );
+                if ( i + 2 < bounds.size() )
+                    pool.schedule( &BSONObjExternalSorter::_mergeChunks, bounds[i], bounds[i+1], bounds[i+2], cmp );
+            }
+            merged.push_back( bounds.back() );
+            pool.join();
+            killCurrentOp.checkForInterrupt();
+            if ( pm )
+                pm->hit( n );
+            bounds.swap( merged );
+        }
     }
 
-    void BSONObjExternalSorter::sort() {
+    void BSONObjExternalSorter::sort( ProgressMeter* pm ) {
         uassert( 10048 ,  "already sorted" , ! _sorted );
 
         _sorted = true;
 
         if ( _cur && _files.size() == 0 ) {
-            _sortInMem();
+            if ( pm )
+                pm->setTotalWhileRunning( _cur->size() );
+            _sortInMem( pm );
             log(1) << "\t\t not using file.  size:" << _curSizeSoFar << " _compares:" << _compares << endl;
             return;
         }
 
         if ( _cur ) {
+            if ( pm )
+                pm->setTotalWhileRunning( _cur->size() );
+            _sortInMem( pm );
             finishMap();
         }
 
@@ -158,7 +216,8 @@ namespace mongo {
         if ( _cur->size() == 0 )
             return;
 
-        _sortInMem();
+        if ( (int) _sortedRun.size() != _cur->size() ) // sort() may have sorted it already
+            _sortInMem();
 
         stringstream ss;
         ss << _root.string() << "/file." << _files.size();
@@ -173,20 +232,43 @@ namespace mongo {
         out.open( file.c_str() , ios_base::out | ios_base::binary );
         assertStreamGood( 10051 ,  (string)"couldn't open file: " + file , out );
 
+        // each block is its uncompressed and compressed lengths then the snappy bytes
+        BufBuilder block( SpillBlockSize + 1024 );
+        string compressed;
+        long long rawBytes = 0;
+        long long diskBytes = 0;
         int num = 0;
-        for ( InMemory::iterator i=_cur->begin(); i != _cur->end(); ++i ) {
-            Data p = *i;
-            out.write( p.first.objdata() , p.first.objsize() );
-            out.write( (char*)(&p.second) , sizeof( DiskLoc ) );
-            num++;
+        for ( unsigned i = 0; i <= _sortedRun.size(); i++ ) {
+            if ( i < _sortedRun.size() ) {
+                const Data& p = *_sortedRun[i];
+                block.appendBuf( p.first.objdata() , p.first.objsize() );
+                block.appendBuf( &p.second , sizeof( DiskLoc ) );
+                num++;
+                if ( block.len() < SpillBlockSize )
+                    continue;
+            }
+            if ( block.len() == 0 )
+                break;
+            compressed.resize( maxCompressedLength( block.len() ) );
+            size_t len;
+            rawCompress( block.buf() , block.len() , &compressed[0] , &len );
+            int lengths[2] = { block.len() , (int) len };
+            out.write( reinterpret_cast<const char*>( lengths ) , sizeof( lengths ) );
+            out.write( compressed.data() , len );
+            rawBytes += block.len();
+            diskBytes += sizeof( lengths ) + len;
+            block.reset();
         }
+        assertStreamGood( 16422 , (string)"couldn't write file: " + file , out );
 
+        _sortedRun.clear();
         _cur->clear();
 
         _files.push_back( file );
         out.close();
 
-        log(2) << "Added file: " << file << " with " << num << "objects for external sort" << endl;
+        log(2) << "Added file: " << file << " with " << num << "objects for external sort, "
+               << rawBytes << " bytes compressed to " << diskBytes << endl;
     }
 
     // ---------------------------------
@@ -196,13 +278,42 @@ namespace mongo {
 
         for ( list<string>::iterator i=sorter->_files.begin(); i!=sorter->_files.end(); i++ ) {
             _files.push_back( new FileIterator( *i ) );
-            _stash.push_back( pair<Data,bool>( Data( BSONObj() , DiskLoc() ) , false ) );
+            _heads.push_back( Data( BSONObj() , DiskLoc() ) );
+            _live.push_back( false );
         }
 
-        if ( _files.size() == 0 && sorter->_cur ) {
-            _in = sorter->_cur;
-            _it = sorter->_cur->begin();
+        if ( _files.size() == 0 ) {
+            if ( sorter->_cur ) {
+                _in = sorter->_cur;
+                _it = sorter->_sortedRun.begin();
+                _end = sorter->_sortedRun.end();
+            }
+            return;
         }
+
+        for ( unsigned i = 0; i < _files.size(); i++ ) {
+            if ( _files[i]->more() ) {
+                _heads[i] = _files[i]->next();
+                _live[i] = true;
+            }
+        }
+
+        // play the initial tournament bottom up.  runs are the leaves k..2k-1 of an implicit
+        // tree; each internal node keeps its match's loser, and the overall winner goes in [0].
+        const int k = _files.size();
+        _tree.resize( k );
+        vector<int> winners( 2 * k );
+        for ( int i = 0; i < k; i++ )
+            winners[k + i] = i;
+        for ( int node = k - 1; node > 0; node-- ) {
+            int a = winners[2 * node];
+            int b = winners[2 * node + 1];
+            if ( _beats( b , a ) )
+                swap( a , b );
+            winners[node] = a;
+            _tree[node] = b;
+        }
+        _tree[0] = winners[1];
     }
 
     BSONObjExternalSorter::Iterator::~Iterator() {
@@ -211,49 +322,48 @@ namespace mongo {
         _files.clear();
     }
 
+    bool BSONObjExternalSorter::Iterator::_beats( int a , int b ) const {
+        if ( ! _live[a] )
+            return false;
+        if ( ! _live[b] )
+            return true;
+        return _cmp( _heads[a] , _heads[b] );
+    }
+
     bool BSONObjExternalSorter::Iterator::more() {
 
         if ( _in )
-            return _it != _in->end();
+            return _it != _end;
 
-        for ( vector<FileIterator*>::iterator i=_files.begin(); i!=_files.end(); i++ )
-            if ( (*i)->more() )
-                return true;
-        for ( vector< pair<Data,bool> >::iterator i=_stash.begin(); i!=_stash.end(); i++ )
-            if ( i->second )
-                return true;
-        return false;
+        return ! _tree.empty() && _live[ _tree[0] ];
     }
 
     BSONObjExternalSorter::Data BSONObjExternalSorter::Iterator::next() {
 
         if ( _in ) {
-            Data& d = *_it;
+            Data& d = **_it;
             ++_it;
             return d;
         }
 
-        Data best;
-        int slot = -1;
-
-        for ( unsigned i=0; i<_stash.size(); i++ ) {
-
-            if ( ! _stash[i].second ) {
-                if ( _files[i]->more() )
-                    _stash[i] = pair<Data,bool>( _files[i]->next() , true );
-                else
-                    continue;
-            }
-
-            if ( slot == -1 || _cmp( best , _stash[i].first ) == 0 ) {
-                best = _stash[i].first;
-                slot = i;
-            }
+        verify( more() );
+        int run = _tree[0];
+        Data best = _heads[run];
 
+        if ( _files[run]->more() )
+            _heads[run] = _files[run]->next();
+        else {
+            _heads[run] = Data( BSONObj() , DiskLoc() );
+            _live[run] = false;
         }
 
-        verify( slot >= 0 );
-        _stash[slot].second = false;
+        // replay the run's path to the root against the losers stored along it
+        const int k = _files.size();
+        for ( int node = ( run + k ) / 2; node > 0; node /= 2 ) {
+            if ( _beats( _tree[node] , run ) )
+                swap( _tree[node] , run );
+        }
+        _tree[0] = run;
 
         return best;
     }
@@ -279,6 +389,7 @@ namespace mongo {
 
         _length = (unsigned long long)boost::filesystem::file_size( file );
         _readSoFar = 0;
+        _blockPos = 0;
     }
     BSONObjExternalSorter::FileIterator::~FileIterator() {
         if ( _file >= 0 ) {
@@ -291,7 +402,7 @@ namespace mongo {
     }
 
     bool BSONObjExternalSorter::FileIterator::more() {
-        return _readSoFar < _length;
+        return _blockPos < _block.size() || _readSoFar < _length;
     }
 
 
@@ -316,29 +427,49 @@ namespace mongo {
         return true;
     }
     
+    void BSONObjExternalSorter::FileIterator::_nextBlock() {
+        int lengths[2];
+        if ( ! _read( reinterpret_cast<char*>( lengths ) , sizeof( lengths ) ) )
+            msgasserted( 16423, std::string("reading block header for external sort failed:") + errnoWithDescription() );
+        massert( 16424, "corrupt external sort file",
+                 lengths[0] > 0 && lengths[1] > 0 &&
+                 _readSoFar + sizeof( lengths ) + lengths[1] <= _length );
+        _compressed.resize( lengths[1] );
+        if ( ! _read( &_compressed[0] , lengths[1] ) )
+            msgasserted( 16425, std::string("reading block for external sort failed:") + errnoWithDescription() );
+        _readSoFar += sizeof( lengths ) + lengths[1];
+
+        size_t len;
+        massert( 16426, "corrupt external sort file",
+                 uncompressedLength( _compressed.data() , _compressed.size() , &len ) &&
+                 len == (size_t) lengths[0] );
+        _block.resize( len );
+        massert( 16427, "corrupt external sort file",
+                 rawUncompress( _compressed.data() , _compressed.size() , &_block[0] ) );
+        _blockPos = 0;
+    }
+
     BSONObjExternalSorter::Data BSONObjExternalSorter::FileIterator::next() {
-        // read BSONObj
+        if ( _blockPos == _block.size() )
+            _nextBlock();
 
+        // read BSONObj
+        const char *p = _block.data() + _blockPos;
         int size;
-        verify( _read( reinterpret_cast<char*>(&size), 4 ) );
+        memcpy( &size , p , sizeof(int) );
+        massert( 16394, "corrupt external sort file",
+                 size >= 5 && _blockPos + size + sizeof( DiskLoc ) <= _block.size() );
+
         char* buf = reinterpret_cast<char*>( malloc( sizeof(unsigned) + size ) );
         verify( buf );
-
         memset( buf, 0, 4 ); // for Holder
-        memcpy( buf+sizeof(unsigned), reinterpret_cast<char*>(&size), sizeof(int) ); // size of doc
-        if ( ! _read( buf + sizeof(unsigned) + sizeof(int), size-sizeof(int) ) ) { // doc content
-            free( buf );
-            msgasserted( 16394, std::string("reading doc for external sort failed:") + errnoWithDescription() );
-        }
-        
+        memcpy( buf+sizeof(unsigned), p, size );
+
         // read DiskLoc
         DiskLoc l;
-        if ( ! _read( reinterpret_cast<char*>(&l), 8 ) ) {
-            free( buf );
-            msgasserted( 16393, std::string("reading DiskLoc for external sort failed") + errnoWithDescription() );            
-        }
-        _readSoFar += 8 + size;
-        
+        memcpy( reinterpret_cast<char*>( &l ) , p + size , sizeof( DiskLoc ) );
+        _blockPos += size + sizeof( DiskLoc );
+
         BSONObj::Holder* h = reinterpret_cast<BSONObj::Holder*>(buf);
         return Data( BSONObj(h), l );
     }
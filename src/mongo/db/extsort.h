@@ -40,7 +40,6 @@ namespace mongo {
         const IndexInterface& getIndexInterface() const { return _idxi; }
  
     private:
-        static HLMutex _extSortMutex;
         IndexInterface& _idxi;
 
         static int _compare(IndexInterface& i, const Data& l, const Data& r, const Ordering& order);
@@ -56,10 +55,27 @@ namespace mongo {
             const Ordering _order;
         };
 
-        static IndexInterface *extSortIdxInterface;
-        static Ordering extSortOrder;
-        static int extSortComp( const void *lv, const void *rv );
+        /** compares for the run sorting threads: no interrupt checks (they have no Client) and
+            no _compares count */
+        class RunCmp {
+        public:
+            RunCmp( IndexInterface& i, const BSONObj& order ) : _i(&i), _order( Ordering::make(order) ) {}
+            bool operator()( const Data *l, const Data *r ) const {
+                int x = _i->keyCompare(l->first, r->first, _order);
+                if ( x )
+                    return x < 0;
+                return l->second.compare( r->second ) < 0;
+            }
+        private:
+            IndexInterface *_i;
+            Ordering _order;
+        };
+
+        static void _sortChunk( Data **begin, Data **end, RunCmp cmp );
+        static void _mergeChunks( Data **begin, Data **middle, Data **end, RunCmp cmp );
 
+        /** reads back a run written by finishMap(): snappy compressed blocks, each holding
+            whole (key, DiskLoc) pairs */
         class FileIterator : boost::noncopyable {
         public:
             FileIterator( string file );
@@ -68,16 +84,24 @@ namespace mongo {
             Data next();
         private:
             bool _read( char* buf, long long count );
+            void _nextBlock();
 
             int _file;
             unsigned long long _length;
             unsigned long long _readSoFar;
+
+            string _compressed;
+            string _block;     // the uncompressed current block
+            size_t _blockPos;
         };
 
     public:
 
         typedef FastArray<Data> InMemory;
 
+        /** returns the keys in order.  with more than one run this is a k-way merge over a
+            tournament (loser) tree, so each next() costs log2(runs) compares.
+        */
         class Iterator : boost::noncopyable {
         public:
 
@@ -87,12 +111,18 @@ namespace mongo {
             Data next();
 
         private:
+            /** @return true if run a's current key comes before run b's; exhausted runs lose */
+            bool _beats( int a , int b ) const;
+
             MyCmp _cmp;
             vector<FileIterator*> _files;
-            vector< pair<Data,bool> > _stash;
+            vector<Data> _heads;       // current key of each run
+            vector<bool> _live;        // false once a run is exhausted
+            vector<int> _tree;         // [0] is the winning run, [1..k) the loser at each node
 
             InMemory * _in;
-            InMemory::iterator _it;
+            vector<Data*>::const_iterator _it;
+            vector<Data*>::const_iterator _end;
 
         };
 
@@ -101,8 +131,10 @@ namespace mongo {
             add( o , DiskLoc( a , b ) );
         }
 
-        /* call after adding values, and before fetching the iterator */
-        void sort();
+        /* call after adding values, and before fetching the iterator
+           @param pm if set, is advanced as the last run is sorted
+        */
+        void sort( ProgressMeter* pm = 0 );
 
         auto_ptr<Iterator> iterator() {
             uassert( 10052 ,  "not sorted" , _sorted );
@@ -122,9 +154,12 @@ namespace mongo {
 
     private:
 
-        void _sortInMem();
+        enum { SpillBlockSize = 256 * 1024 ,   // uncompressed bytes per compressed block of a run file
+               MinChunkSize = 10000 };         // fewest keys worth handing to a sorting thread
+
+        /** sort _cur into _sortedRun, on up to one thread per core */
+        void _sortInMem( ProgressMeter* pm = 0 );
 
-        void sort( string file );
         void finishMap();
 
         BSONObj _order;
@@ -133,6 +168,7 @@ namespace mongo {
 
         int _arraySize;
         InMemory * _cur;
+        vector<Data*> _sortedRun;  // _cur in key order, once sorted
         long _curSizeSoFar;
 
         list<string> _files;
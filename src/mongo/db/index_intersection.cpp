@@ -0,0 +1,156 @@
+// @file index_intersection.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/index_intersection.h"
+
+#include "mongo/db/matcher.h"
+
+namespace mongo {
+
+    bool indexIntersection = false;
+
+    IndexIntersectionCursor::IndexIntersectionCursor( const shared_ptr<Cursor> &drive,
+                                                      const vector< shared_ptr<Cursor> > &filters ) :
+        _drive( drive ),
+        _filters( filters ),
+        _nextFilter(),
+        _haveLocs(),
+        _filtering(),
+        _filterNscanned() {
+        readFilters();
+        skipFilteredOut();
+    }
+
+    void IndexIntersectionCursor::readFilters() {
+        for ( int budget = FilterKeysPerAdvance; reading() && budget > 0; --budget ) {
+            Cursor &filter = *_filters[ _nextFilter ];
+            bool done = !filter.ok();
+            if ( !done && filter.nscanned() <= MaxFilterKeys ) {
+                DiskLoc loc = filter.currLoc();
+                // with a filter already read, only its members can be in both
+                if ( !_haveLocs || _locs.count( loc ) )
+                    _reading.insert( loc );
+                filter.advance();
+                continue;
+            }
+            _filterNscanned += filter.nscanned();
+            if ( done ) {
+                _filterNames.push_back( filter.toString() );
+                _locs.swap( _reading );
+                _haveLocs = true;
+            }
+            else {
+                _droppedNames.push_back( filter.toString() );
+            }
+            _reading.clear();
+            _filters[ _nextFilter++ ].reset();
+        }
+        _filtering = _haveLocs && !reading();
+    }
+
+    void IndexIntersectionCursor::skipFilteredOut() {
+        if ( !_filtering )
+            return;
+        while ( _drive->ok() && !_locs.count( _drive->currLoc() ) )
+            _drive->advance();
+    }
+
+    bool IndexIntersectionCursor::advance() {
+        _drive->advance();
+        if ( reading() )
+            readFilters();
+        skipFilteredOut();
+        return ok();
+    }
+
+    long long IndexIntersectionCursor::nscanned() {
+        long long ret = _drive->nscanned() + _filterNscanned;
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            ret += _filters[ i ]->nscanned();
+        return ret;
+    }
+
+    // The filters not yet read are positioned in their indexes, so they move with the driving
+    // cursor.  Relocating the driving cursor may leave it on a key whose document no filter has
+    // seen, e.g. one inserted while we yielded.
+
+    void IndexIntersectionCursor::aboutToDeleteBucket( const DiskLoc &b ) {
+        _drive->aboutToDeleteBucket( b );
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->aboutToDeleteBucket( b );
+    }
+
+    void IndexIntersectionCursor::noteLocation() {
+        _drive->noteLocation();
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->noteLocation();
+    }
+
+    void IndexIntersectionCursor::checkLocation() {
+        _drive->checkLocation();
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->checkLocation();
+        skipFilteredOut();
+    }
+
+    void IndexIntersectionCursor::prepareToTouchEarlierIterate() {
+        _drive->prepareToTouchEarlierIterate();
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->prepareToTouchEarlierIterate();
+    }
+
+    void IndexIntersectionCursor::recoverFromTouchingEarlierIterate() {
+        _drive->recoverFromTouchingEarlierIterate();
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->recoverFromTouchingEarlierIterate();
+        skipFilteredOut();
+    }
+
+    void IndexIntersectionCursor::prepareToYield() {
+        _drive->prepareToYield();
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->prepareToYield();
+    }
+
+    void IndexIntersectionCursor::recoverFromYield() {
+        _drive->recoverFromYield();
+        for ( unsigned i = _nextFilter; i < _filters.size(); i++ )
+            _filters[ i ]->recoverFromYield();
+        skipFilteredOut();
+    }
+
+    string IndexIntersectionCursor::toString() {
+        stringstream ss;
+        ss << "IndexIntersectionCursor " << _drive->toString();
+        for ( unsigned i = 0; i < _filterNames.size(); i++ )
+            ss << " & " << _filterNames[ i ];
+        return ss.str();
+    }
+
+    void IndexIntersectionCursor::explainDetails( BSONObjBuilder &b ) {
+        _drive->explainDetails( b );
+        long long filterNscanned = nscanned() - _drive->nscanned();
+        b.appendNumber( "nscannedFilters", filterNscanned );
+        b.append( "filters", _filterNames );
+        if ( !_droppedNames.empty() )
+            b.append( "droppedFilters", _droppedNames );
+    }
+
+} // namespace mongo
@@ -0,0 +1,120 @@
+// @file index_intersection.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/unordered_set.hpp>
+
+#include "mongo/db/cursor.h"
+#include "mongo/db/diskloc.h"
+
+namespace mongo {
+
+    /** race index intersection plans with the single index ones.  setParameter indexIntersection */
+    extern bool indexIntersection;
+
+    /**
+     * An index scan that only returns the documents which are also in the ranges of one or more
+     * other indexes, so the documents those rule out are never loaded.  The other indexes - the
+     * filters - are read into a hash set of DiskLocs a few keys at each advance(), so a racing
+     * plan that finishes quickly isn't held up by them; until they are read every document of
+     * the driving index is returned, as the matcher checks them anyway.  After that we skip
+     * the locations not in the set.
+     *
+     * For yields, deletes and getMore we behave as the driving cursor does, with the filters
+     * still being read kept in step.  A document moved by an update while we yield may be
+     * missed, as by any index scan.
+     */
+    class IndexIntersectionCursor : public Cursor {
+    public:
+        /** a filter with more keys than this is dropped: it costs more to read than it can save */
+        static const long long MaxFilterKeys = 100000;
+        /** filter keys read at each advance() */
+        static const int FilterKeysPerAdvance = 32;
+
+        /** @param filters positioned at the start of their ranges */
+        IndexIntersectionCursor( const shared_ptr<Cursor> &drive,
+                                 const vector< shared_ptr<Cursor> > &filters );
+
+        virtual bool ok() { return _drive->ok(); }
+        virtual Record* _current() { return _drive->_current(); }
+        virtual BSONObj current() { return _drive->current(); }
+        virtual DiskLoc currLoc() { return _drive->currLoc(); }
+        virtual bool advance();
+        virtual BSONObj currKey() const { return _drive->currKey(); }
+        virtual DiskLoc refLoc() { return _drive->refLoc(); }
+        virtual void aboutToDeleteBucket( const DiskLoc &b );
+        virtual BSONObj indexKeyPattern() { return _drive->indexKeyPattern(); }
+
+        virtual bool supportGetMore() { return true; }
+        virtual bool supportYields() { return _drive->supportYields(); }
+        virtual void noteLocation();
+        virtual void checkLocation();
+        virtual void prepareToTouchEarlierIterate();
+        virtual void recoverFromTouchingEarlierIterate();
+        virtual void prepareToYield();
+        virtual void recoverFromYield();
+
+        virtual string toString();
+        virtual bool getsetdup( DiskLoc loc ) { return _drive->getsetdup( loc ); }
+        virtual bool isMultiKey() const { return _drive->isMultiKey(); }
+        virtual bool modifiedKeys() const { return _drive->modifiedKeys(); }
+        virtual BSONObj prettyIndexBounds() const { return _drive->prettyIndexBounds(); }
+        virtual long long nscanned();
+
+        virtual CoveredIndexMatcher *matcher() const { return _matcher.get(); }
+        virtual shared_ptr<CoveredIndexMatcher> matcherPtr() const { return _matcher; }
+        virtual void setMatcher( shared_ptr<CoveredIndexMatcher> matcher ) { _matcher = matcher; }
+        virtual const Projection::KeyOnly *keyFieldsOnly() const { return _keyFieldsOnly.get(); }
+        virtual void setKeyFieldsOnly( const shared_ptr<Projection::KeyOnly> &keyFieldsOnly ) {
+            _keyFieldsOnly = keyFieldsOnly;
+        }
+        virtual void explainDetails( BSONObjBuilder &b );
+
+        /** @return true once the filters are read and we skip documents not in all of them */
+        bool filtering() const { return _filtering; }
+
+    private:
+        struct LocHash {
+            size_t operator()( const DiskLoc &loc ) const {
+                return (size_t) loc.a() * 1000003 ^ (size_t) loc.getOfs();
+            }
+        };
+        typedef boost::unordered_set<DiskLoc,LocHash> LocSet;
+
+        /** read up to FilterKeysPerAdvance keys of the filters not yet read */
+        void readFilters();
+        /** move the driving cursor on to a location in every filter */
+        void skipFilteredOut();
+        bool reading() const { return _nextFilter < _filters.size(); }
+
+        shared_ptr<Cursor> _drive;
+        vector< shared_ptr<Cursor> > _filters;
+        unsigned _nextFilter;    // the one being read
+        LocSet _reading;         // its locations, if in _locs when there is a _locs
+        bool _haveLocs;
+        LocSet _locs;            // locations in all the filters read so far
+        bool _filtering;
+        long long _filterNscanned;  // of filters we are done with
+        vector<string> _filterNames;
+        vector<string> _droppedNames;
+        shared_ptr<CoveredIndexMatcher> _matcher;
+        shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
+    };
+
+} // namespace mongo
@@ -308,7 +308,11 @@ namespace mongo {
             d->setIndexIsMultikey(ns, idxNo);
 
         if ( logLevel > 1 ) printMemInfo( "before final sort" );
-        phase1->sorter->sort();
+        {
+            ProgressMeter& sortpm = op->setMessage( "index: (1/3) external sort: last run" , 1 , 10 );
+            phase1->sorter->sort( &sortpm );
+            sortpm.finished();
+        }
         if ( logLevel > 1 ) printMemInfo( "after final sort" );
 
         log(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles() << " files " << " in " << t.seconds() << " secs" << endl;
@@ -320,6 +324,8 @@ namespace mongo {
             buildBottomUpPhases2And3<V0>(dupsAllowed, idx, sorter, dropDups, dupsToDrop, op, phase1, pm, t);
         else if( idx.version() == 1 ) 
             buildBottomUpPhases2And3<V1>(dupsAllowed, idx, sorter, dropDups, dupsToDrop, op, phase1, pm, t);
+        else if( idx.version() == 2 ) 
+            buildBottomUpPhases2And3<V2>(dupsAllowed, idx, sorter, dropDups, dupsToDrop, op, phase1, pm, t);
         else
             verify(false);
 
@@ -417,7 +423,7 @@ namespace mongo {
         set<NamespaceDetails*> bgJobsInProgress;
 
         void prep(const char *ns, NamespaceDetails *d) {
-            Lock::assertWriteLocked(ns);
+            Lock::assertCatalogWriteLocked(ns);
             uassert( 13130 , "can't start bg index b/c in recursive lock (db.eval?)" , !Lock::nested() );
             bgJobsInProgress.insert(d);
         }
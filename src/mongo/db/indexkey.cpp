@@ -406,7 +406,8 @@ namespace mongo {
                 g.getKeys( obj, keys );
                 break;
             }
-            case 1: {
+            case 1:
+            case 2: { // v2 only changes how buckets store keys
                 KeyGeneratorV1 g( *this );
                 g.getKeys( obj, keys );
                 break;
@@ -542,6 +542,23 @@ namespace mongo {
         delete database; // closes files
     }
 
+    /**
+     * lock for writing documents of ns.  if the collection exists only it is locked, so writes
+     * to other collections of the database go on; if it doesn't, writing will create it, which
+     * needs the whole database.
+     */
+    static Lock::DBWrite* lockForDocumentWrite( const char *ns ) {
+        auto_ptr<Lock::DBWrite> lk( new Lock::DBWrite( ns, true ) );
+        if ( lk->collectionLocked() ) {
+            Database *db = dbHolder().get( ns, dbpath );
+            if ( db == 0 || db->namespaceIndex.details( ns ) == 0 ) {
+                lk.reset();
+                lk.reset( new Lock::DBWrite( ns ) );
+            }
+        }
+        return lk.release();
+    }
+
     void receivedUpdate(Message& m, CurOp& op) {
         DbMessage d(m);
         const char *ns = d.getns();
@@ -563,9 +580,10 @@ namespace mongo {
         op.setQuery(query);
 
         PageFaultRetryableSection s;
+        bool dbLock = false;
         while ( 1 ) {
             try {
-                Lock::DBWrite lk(ns);
+                scoped_ptr<Lock::DBWrite> lk( dbLock ? new Lock::DBWrite( ns ) : lockForDocumentWrite( ns ) );
                 
                 // void ReplSetImpl::relinquish() uses big write lock so 
                 // this is thus synchronized given our lock above.
@@ -584,6 +602,11 @@ namespace mongo {
             catch ( PageFaultException& e ) {
                 e.touch();
             }
+            catch ( AssertionException& e ) {
+                if ( dbLock || e.getCode() != UpsertNeedsDatabaseLockAssertionCode )
+                    throw;
+                dbLock = true;
+            }
         }
     }
 
@@ -603,7 +626,7 @@ namespace mongo {
         PageFaultRetryableSection s;
         while ( 1 ) {
             try {
-                Lock::DBWrite lk(ns);
+                scoped_ptr<Lock::DBWrite> lk( lockForDocumentWrite(ns) );
                 
                 // writelock is used to synchronize stepdowns w/ writes
                 uassert( 10056 ,  "not master", isMasterNs( ns ) );
@@ -653,27 +676,34 @@ namespace mongo {
         int pass = 0;
         bool exhaust = false;
         QueryResult* msgdata = 0;
+        // what an awaitData getMore that found nothing waits on: the oplog's last optime, or an
+        // insert into the capped collection
+        bool oplog = str::startsWith(ns, "local.oplog.");
         OpTime last;
+        shared_ptr<CappedInsertNotifier> notifier;
+        unsigned long long notifierVersion = 0;
         while( 1 ) {
             try {
                 const NamespaceString nsString( ns );
                 uassert( 16258, str::stream() << "Invalid ns [" << ns << "]", nsString.isValid() );
 
-                if (str::startsWith(ns, "local.oplog.")){
-                    if (pass == 0) {
+                Client::ReadContext ctx(ns);
+
+                // call this readlocked so state can't change
+                replVerifyReadsOk();
+                msgdata = processGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust);
+
+                if ( msgdata == 0 ) {
+                    // still locked, so nothing can be written before we start waiting below
+                    if ( oplog ) {
                         mutex::scoped_lock lk(OpTime::m);
                         last = OpTime::getLast(lk);
                     }
                     else {
-                        last.waitForDifferent(1000/*ms*/);
+                        notifier = NamespaceDetailsTransient::get( ns ).cappedInsertNotifier();
+                        notifierVersion = notifier->getVersion();
                     }
                 }
-
-                Client::ReadContext ctx(ns);
-
-                // call this readlocked so state can't change
-                replVerifyReadsOk();
-                msgdata = processGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust);
             }
             catch ( AssertionException& e ) {
                 ex.reset( new AssertionException( e.getInfo().msg, e.getCode() ) );
@@ -688,20 +718,23 @@ namespace mongo {
                 if ( ! timer ) {
                     timer.reset( new Timer() );
                 }
+                // after about 4 seconds, return. pass stops at 1000 normally.
+                // we want to return occasionally so slave can checkpoint.
+                int waitMillis = 4000 - timer->millis();
+                if ( waitMillis <= 0 ) {
+                    pass = 10000;
+                }
                 else {
-                    if ( timer->seconds() >= 4 ) {
-                        // after about 4 seconds, return. pass stops at 1000 normally.
-                        // we want to return occasionally so slave can checkpoint.
-                        pass = 10000;
-                    }
+                    // wake at least once a second to check for shutdown
+                    waitMillis = std::min( waitMillis, 1000 );
+                    if ( oplog )
+                        last.waitForDifferent( waitMillis );
+                    else
+                        notifier->waitForInsert( notifierVersion, waitMillis );
                 }
                 pass++;
-                if (debug)
-                    sleepmillis(20);
-                else
-                    sleepmillis(2);
                 
-                // note: the 1100 is beacuse of the waitForDifferent above
+                // note: the 1100 is because of the waits above
                 // should eventually clean this up a bit
                 curop.setExpectedLatencyMs( 1100 + timer->millis() );
                 
@@ -800,7 +833,7 @@ namespace mongo {
         PageFaultRetryableSection s;
         while ( true ) {
             try {
-                Lock::DBWrite lk(ns);
+                scoped_ptr<Lock::DBWrite> lk( lockForDocumentWrite(ns) );
                 
                 // CONCURRENCY TODO: is being read locked in big log sufficient here?
                 // writelock is used to synchronize stepdowns w/ writes
@@ -668,6 +668,233 @@ namespace mongo {
         return true;
     }
 
+    // KeyV2 is for V2 indexes: KeyV1 data, prefix compressed within a bucket
+
+    void KeyV2::copyFrom(const KeyV1& k) {
+        int len = k.dataSize();
+        void *p = malloc(sizeof(AtomicUInt32) + len);
+        verify( p );
+        AtomicUInt32 *buf = new (p) AtomicUInt32(1);
+        memcpy(buf + 1, k.data(), len);
+        release();
+        _buf = buf;
+        _keyData = (const unsigned char *) (buf + 1);
+    }
+
+    KeyV2::KeyV2(const char *prefix, int prefixLen, const char *rest) : _buf(0) {
+        StackBufBuilder b;
+        decode(prefix, prefixLen, rest, &b);
+        copyFrom(KeyV1(b.buf()));
+    }
+
+    KeyV2Owned::KeyV2Owned(const BSONObj& obj) {
+        KeyV1Owned k(obj);
+        copyFrom(k);
+    }
+
+    /* the prefix form of a string element is [type][chars][0][0], with a 0 among the chars
+       written as [0][1].  it sorts the same way as the stored form but puts the characters
+       right after the type byte, where strings with a common start share them.
+    */
+    template< class Builder >
+    void KeyV2::appendPrefixForm(Builder& b) const {
+        const unsigned char *p = _keyData;
+        if( !isCompactFormat() ) {
+            b.appendBuf(p, dataSize());
+            return;
+        }
+        bool more;
+        do {
+            unsigned z = sizeOfElement(p);
+            more = (*p & cHASMORE) != 0;
+            if( (*p & cCANONTYPEMASK) == cstring ) {
+                b.appendUChar(*p);
+                const unsigned char *s = p + 2;
+                for( unsigned i = 0; i < p[1]; i++ ) {
+                    b.appendUChar(s[i]);
+                    if( s[i] == 0 )
+                        b.appendUChar(1);
+                }
+                b.appendUChar(0);
+                b.appendUChar(0);
+            }
+            else {
+                b.appendBuf(p, z);
+            }
+            p += z;
+        } while( more );
+    }
+
+    int KeyV2::restSize(const char *prefix, int prefixLen, const char *rest) {
+        return decode(prefix, prefixLen, rest, (BufBuilder *) 0);
+    }
+
+    namespace {
+        /** reads the prefix bytes and then the rest bytes of a key's prefix form as one stream */
+        class PrefixFormReader {
+        public:
+            PrefixFormReader(const char *prefix, int prefixLen, const char *rest) :
+                _prefix((const unsigned char *) prefix), _prefixLen(prefixLen),
+                _rest((const unsigned char *) rest), _pos(0) { }
+            unsigned char peek() const {
+                return _pos < _prefixLen ? _prefix[_pos] : _rest[_pos - _prefixLen];
+            }
+            unsigned char get() {
+                unsigned char c = peek();
+                _pos++;
+                return c;
+            }
+            template< class Builder >
+            void copy(int n, Builder *b) {
+                for( int i = 0; i < n; i++ ) {
+                    unsigned char c = get();
+                    if( b )
+                        b->appendUChar(c);
+                }
+            }
+            /** @return bytes consumed from rest */
+            int restUsed() const { return _pos - _prefixLen; }
+        private:
+            const unsigned char *_prefix;
+            const int _prefixLen;
+            const unsigned char *_rest;
+            int _pos;
+        };
+
+        /** appends to a fixed buffer big enough for one element of a key */
+        class ElementBuilder {
+        public:
+            ElementBuilder() : _len(0) { }
+            void appendUChar(unsigned char c) {
+                verify( _len < (int) sizeof(_buf) );
+                _buf[_len++] = c;
+            }
+            void appendBuf(const void *src, int len) {
+                verify( _len + len <= (int) sizeof(_buf) );
+                memcpy(_buf + _len, src, len);
+                _len += len;
+            }
+            const unsigned char *buf() const { return _buf; }
+        private:
+            // type, length and at most 255 characters of a string; bindata and the fixed size
+            // types are smaller
+            unsigned char _buf[258];
+            int _len;
+        };
+    }
+
+    /** converts the rest of a compact format element of the given type from its prefix form
+        to KeyV1 data, appended to *b if b is not null.  the type byte has already been read.
+    */
+    template< class Builder >
+    static void decodeElement(unsigned char type, PrefixFormReader& r, Builder *b) {
+        unsigned t = type & cCANONTYPEMASK;
+        if( t == cstring ) {
+            unsigned char s[256];
+            unsigned len = 0;
+            while( 1 ) {
+                unsigned char c = r.get();
+                if( c == 0 ) {
+                    unsigned char e = r.get();
+                    if( e == 0 )
+                        break;
+                    massert( 16419, "corrupt prefix compressed btree key", e == 1 );
+                }
+                massert( 16420, "corrupt prefix compressed btree key", len < 255 );
+                s[len++] = c;
+            }
+            if( b ) {
+                b->appendUChar(len);
+                b->appendBuf(s, len);
+            }
+        }
+        else if( t == cbindata ) {
+            unsigned char code = r.get();
+            if( b )
+                b->appendUChar(code);
+            r.copy(binDataCodeToLength(code), b);
+        }
+        else {
+            unsigned sz = sizes[t];
+            massert( 16421, "corrupt prefix compressed btree key", sz != 0 );
+            r.copy(sz - 1, b);
+        }
+    }
+
+    /** converts a prefix form back to KeyV1 data, appended to *b if b is not null.
+        @return bytes consumed from rest
+    */
+    template< class Builder >
+    int KeyV2::decode(const char *prefix, int prefixLen, const char *rest, Builder *b) {
+        PrefixFormReader r(prefix, prefixLen, rest);
+        unsigned char type = r.get();
+        if( b )
+            b->appendUChar(type);
+        if( type == IsBSON ) {
+            unsigned char sz[4];
+            for( int i = 0; i < 4; i++ )
+                sz[i] = r.get();
+            if( b )
+                b->appendBuf(sz, 4);
+            int objsize = sz[0] | (sz[1] << 8) | (sz[2] << 16) | (sz[3] << 24); // little endian as bson is
+            r.copy(objsize - 4, b);
+            return r.restUsed();
+        }
+        while( 1 ) {
+            decodeElement(type, r, b);
+            if( (type & cHASMORE) == 0 )
+                break;
+            type = r.get();
+            if( b )
+                b->appendUChar(type);
+        }
+        return r.restUsed();
+    }
+
+    int KeyV2::compareToStored(const char *prefix, int prefixLen, const char *rest, const Ordering &order) const {
+        PrefixFormReader r(prefix, prefixLen, rest);
+        if( !isCompactFormat() || r.peek() == IsBSON ) {
+            // a bson key on either side; rare enough to just decode
+            KeyV2 stored(prefix, prefixLen, rest);
+            return woCompare(stored, order);
+        }
+
+        // as KeyV1::woCompare, decoding one element of the stored key at a time
+        const unsigned char *l = _keyData;
+        unsigned mask = 1;
+        while( 1 ) {
+            unsigned char lval = *l;
+            unsigned char rval = r.get();
+            {
+                ElementBuilder e;
+                e.appendUChar(rval);
+                decodeElement(rval, r, &e);
+                const unsigned char *rp = e.buf();
+                int x = compare(l, rp); // updates l
+                if( x ) {
+                    if( order.descending(mask) )
+                        x = -x;
+                    return x;
+                }
+            }
+
+            {
+                int x = ((int)(lval & cHASMORE)) - ((int)(rval & cHASMORE));
+                if( x )
+                    return x;
+                if( (lval & cHASMORE) == 0 )
+                    break;
+            }
+
+            mask <<= 1;
+        }
+
+        return 0;
+    }
+
+    template void KeyV2::appendPrefixForm<BufBuilder>(BufBuilder&) const;
+    template void KeyV2::appendPrefixForm<StackBufBuilder>(StackBufBuilder&) const;
+
     struct CmpUnitTest : public StartupTest {
         void run() {
             char a[2];
@@ -19,6 +19,7 @@
 #pragma once
  
 #include "jsobj.h"
+#include "mongo/platform/atomic_word.h"
 
 namespace mongo { 
 
@@ -115,4 +116,84 @@ namespace mongo {
         void traditional(const BSONObj& obj); // store as traditional bson not as compact format
     };
 
+    class KeyV2Owned;
+
+    /** corresponding to BtreeData_V2.  the key data is KeyV1 format; what differs is how a bucket
+        stores it.  a V2 bucket keeps a byte prefix in its header and stores each key as the bytes
+        of its "prefix form" that follow the part it shares with that prefix.  the prefix form is
+        the KeyV1 format with each string written as its characters and a terminator instead of a
+        length byte and its characters - that way keys with long common leading strings
+        (tenant ids, paths) have long common byte prefixes.
+
+        a key that had to be decoded owns a refcounted copy of its KeyV1 data; one a bucket stores
+        whole just points into the bucket, as KeyV1 does.  the refcount is atomic, as copies of a
+        key can end up on other threads (e.g. a cursor's saved position).  searching a bucket
+        doesn't decode: see compareToStored().
+    */
+    class KeyV2 : public KeyV1 {
+        void operator=(const KeyV2&);
+        KeyV2(const KeyV2Owned&);     // disallowed as KeyV2Owned likely will go out of scope
+    public:
+        KeyV2() : _buf(0) { }
+        ~KeyV2() { release(); }
+
+        KeyV2(const KeyV2& rhs) : KeyV1(rhs), _buf(rhs._buf) {
+            if( _buf )
+                _buf->fetchAndAdd(1);
+        }
+
+        void assign(const KeyV2& rhs) {
+            if( rhs._buf )
+                rhs._buf->fetchAndAdd(1);
+            release();
+            _buf = rhs._buf;
+            _keyData = rhs._keyData;
+        }
+
+        /** @param keyData KeyV1 format data, which we just wrap */
+        explicit KeyV2(const char *keyData) : KeyV1(keyData), _buf(0) { }
+
+        /** decode a key stored in a bucket.
+            @param prefix the first prefixLen bytes of the key's prefix form
+            @param rest the remaining bytes of its prefix form
+        */
+        KeyV2(const char *prefix, int prefixLen, const char *rest);
+
+        /** append the prefix form of this key.  Builder is BufBuilder or StackBufBuilder */
+        template< class Builder >
+        void appendPrefixForm(Builder& b) const;
+
+        /** @return the number of bytes at 'rest' belonging to the key; see the decoding constructor */
+        static int restSize(const char *prefix, int prefixLen, const char *rest);
+
+        /** same as woCompare() with the key the decoding constructor would make of prefix and
+            rest, but without decoding or allocating: the stored key is read an element at a time
+            and only as far as the first difference.
+        */
+        int compareToStored(const char *prefix, int prefixLen, const char *rest, const Ordering &o) const;
+
+    protected:
+        /** make this key an owned copy of k's data */
+        void copyFrom(const KeyV1& k);
+    private:
+        AtomicUInt32 *_buf; // refcount, followed by our key data; null if we don't own the data
+        void release() {
+            if( _buf && _buf->subtractAndFetch(1) == 0 )
+                free(_buf);
+            _buf = 0;
+        }
+        template< class Builder >
+        static int decode(const char *prefix, int prefixLen, const char *rest, Builder *b);
+    };
+
+    class KeyV2Owned : public KeyV2 {
+        void operator=(const KeyV2Owned&);
+    public:
+        /** @obj a BSON object to be translated to KeyV1 format, see KeyV1Owned */
+        KeyV2Owned(const BSONObj& obj);
+
+        /** makes a copy */
+        KeyV2Owned(const KeyV2& rhs) { copyFrom(rhs); }
+    };
+
 };
@@ -33,6 +33,10 @@ namespace mongo {
         BSONObjBuilder a( b.subobjStart( "timeAcquiringMicros" ) );
         _append( a , timeAcquiring );
         a.done();
+
+        BSONObjBuilder c( b.subobjStart( "acquireCount" ) );
+        _append( c , acquireCount );
+        c.done();
         
         return b.obj();
     }
@@ -90,15 +94,24 @@ namespace mongo {
 
     void LockStat::recordAcquireTimeMicros( char type , long long micros ) {
         timeAcquiring[mapNo(type)].fetchAndAdd( micros );
+        acquireCount[mapNo(type)].fetchAndAdd( 1 );
     }
     void LockStat::recordLockTimeMicros( char type , long long micros ) {
         timeLocked[mapNo(type)].fetchAndAdd( micros );
     }
 
+    long long LockStat::getTotalTimeAcquiring() const {
+        long long t = 0;
+        for ( int i = 0; i < N; i++ )
+            t += timeAcquiring[i].load();
+        return t;
+    }
+
     void LockStat::reset() {
         for ( int i = 0; i < N; i++ ) {
             timeAcquiring[i].store(0);
             timeLocked[i].store(0);
+            acquireCount[i].store(0);
         }
     }
 }
@@ -38,6 +38,9 @@ namespace mongo {
         void report( StringBuilder& builder ) const;
 
         long long getTimeLocked( char type ) const { return timeLocked[mapNo(type)].load(); }
+        long long getAcquireCount( char type ) const { return acquireCount[mapNo(type)].load(); }
+        /** micros spent waiting to acquire locks, of all types */
+        long long getTotalTimeAcquiring() const;
     private:
         static void _append( BSONObjBuilder& builder, const AtomicInt64* data );
         
@@ -45,6 +48,7 @@ namespace mongo {
         // in micros
         AtomicInt64 timeAcquiring[N];
         AtomicInt64 timeLocked[N];
+        AtomicInt64 acquireCount[N];
 
         static unsigned mapNo(char type);
         static char nameFor(unsigned offset);
@@ -34,6 +34,8 @@ namespace mongo {
           _nestableCount(0), 
           _otherCount(0), 
           _otherLock(NULL),
+          _otherIntent(false),
+          _collectionLock(NULL),
           _scopedLk(NULL),
           _lockPending(false)
     {
@@ -121,9 +123,15 @@ namespace mongo {
         }
         if( _otherCount ) { 
             WrapperForRWLock *k = _otherLock;
+            WrapperForRWLock *c = _collectionLock;
             if( k ) {
                 string s = "^";
                 s += k->name();
+                b.append(s, _otherIntent ? "w" : kind(_otherCount));
+            }
+            if( c ) {
+                string s = "^";
+                s += c->name();
                 b.append(s, kind(_otherCount));
             }
         }
@@ -151,6 +159,10 @@ namespace mongo {
             ss << " otherCount:" << _otherCount;
             if( _otherCount ) {
                 ss << " otherdb:" << _otherName;
+                if( _otherIntent )
+                    ss << " intent";
+                if( _collectionLock )
+                    ss << " collection:" << _collectionLock->name();
             }
             if( _nestableCount ) {
                 ss << " nestableCount:" << _nestableCount << " which:";
@@ -197,22 +209,31 @@ namespace mongo {
         _nestableCount = 0;
     }
 
-    void LockState::lockedOther( int type ) {
+    void LockState::lockedOther( int type , bool intent ) {
         fassert( 16231 , _otherCount == 0 );
         _otherCount = type;
+        _otherIntent = intent;
     }
 
-    void LockState::lockedOther( const string& other , int type , WrapperForRWLock* lock ) {
+    void LockState::lockedOther( const string& other , int type , WrapperForRWLock* lock , bool intent ) {
         fassert( 16170 , _otherCount == 0 );
         _otherName = other;
         _otherCount = type;
         _otherLock = lock;
+        _otherIntent = intent;
     }
 
     void LockState::unlockedOther() {
         _otherName = "";
         _otherCount = 0;
         _otherLock = 0;
+        _otherIntent = false;
+        _collectionLock = 0;
+    }
+
+    void LockState::lockedCollection( WrapperForRWLock* lock ) {
+        fassert( 16410 , _otherCount > 0 && _otherIntent && _collectionLock == 0 );
+        _collectionLock = lock;
     }
 
     LockStat* LockState::getRelevantLockStat() {
@@ -20,6 +20,7 @@
 #pragma once
 
 #include "mongo/db/d_concurrency.h"
+#include "mongo/util/concurrency/qlock.h"
 
 namespace mongo {
 
@@ -70,15 +71,23 @@ namespace mongo {
         int otherCount() const { return _otherCount; }
         string otherName() const { return _otherName; }
         WrapperForRWLock* otherLock() const { return _otherLock; }
+
+        /** true if the other db is only locked for intent to write (w); its writers then hold the
+            collection they write to exclusively.  otherCount() is 1 in that case too */
+        bool otherIntent() const { return _otherIntent; }
+
+        /** set if the other db is only intent locked, and this one collection in it exclusively */
+        WrapperForRWLock* collectionLock() const { return _collectionLock; }
         
         void enterScopedLock( Lock::ScopedLock* lock );
         Lock::ScopedLock* leaveScopedLock();
 
         void lockedNestable( Lock::Nestable what , int type );
         void unlockedNestable();
-        void lockedOther( const string& db , int type , WrapperForRWLock* lock );
-        void lockedOther( int type );  // "same lock as last time" case 
+        void lockedOther( const string& db , int type , WrapperForRWLock* lock , bool intent = false );
+        void lockedOther( int type , bool intent = false );  // "same lock as last time" case 
         void unlockedOther();
+        void lockedCollection( WrapperForRWLock* lock );
         bool _batchWriter;
 
         LockStat* getRelevantLockStat();
@@ -95,6 +104,8 @@ namespace mongo {
         int _otherCount;               //   >0 means write lock, <0 read lock - XXX change name
         string _otherName;             // which database are we locking and working with (besides local/admin) 
         WrapperForRWLock* _otherLock;  // so we don't have to check the map too often (the map has a mutex)
+        bool _otherIntent;             // see otherIntent()
+        WrapperForRWLock* _collectionLock; // see collectionLock()
 
         // for temprelease
         // for the nonrecursive case. otherwise there would be many
@@ -106,16 +117,21 @@ namespace mongo {
         friend class Acquiring;
     };
 
+    /** a database or collection lock.  besides shared and exclusive, a database can be locked
+        for intent to write (w) when its writers lock the collections they write to themselves. */
     class WrapperForRWLock : boost::noncopyable { 
-        SimpleRWLock r;
+        QLock q;
+        const string _name;
     public:
-        string name() const { return r.name; }
+        string name() const { return _name; }
         LockStat stats;
-        WrapperForRWLock(const char *name) : r(name) { }
-        void lock()          { r.lock(); }
-        void lock_shared()   { r.lock_shared(); }
-        void unlock()        { r.unlock(); }
-        void unlock_shared() { r.unlock_shared(); }
+        WrapperForRWLock(const char *name) : _name(name) { }
+        void lock()          { q.lock_W(); }
+        void lock_shared()   { q.lock_R(); }
+        void lock_w()        { q.lock_w(); }
+        void unlock()        { q.unlock_W(); }
+        void unlock_shared() { q.unlock_R(); }
+        void unlock_w()      { q.unlock_w(); }
     };
 
     class ScopedLock;
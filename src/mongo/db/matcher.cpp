@@ -140,6 +140,64 @@ namespace mongo {
 
     };
 
+    /**
+     * A Matcher's basics, regexes and $and clauses compiled to a flat list of predicates over a
+     * tree of the field paths they read.  run() finds every path in one pass over each object
+     * level, so predicates on the same field or on fields with a common prefix share the
+     * lookups.  A path's predicates are checked as soon as the path is found (or known to be
+     * missing), so as with the interpreted matcher a mismatch on an early field ends the pass.
+     *
+     * Arrays are where the match semantics get involved (matching elements, elemMatchKey, whole
+     * array equality); run() reports Unsupported on meeting one and the caller falls back to the
+     * interpreted matcher.  $or, $nor and $where are not compiled.
+     */
+    class MatchProgram : boost::noncopyable {
+    public:
+        enum Result { Mismatch, Match, Unsupported };
+
+        /** @return a program for m, or 0 if m has nothing to compile or uses operators we don't */
+        static MatchProgram* compile( const Matcher& m );
+
+        Result run( const BSONObj& obj ) const;
+
+    private:
+        enum { MaxPaths = 32 };
+
+        /** a field name component, or for index keys the position of a key field */
+        struct Path {
+            Path( const string& n, int p ) : name( n ), pos( p ) { }
+            string name;
+            int pos;
+            vector<int> children;
+            vector<int> predicates; // of this path, indexes into _predicates
+        };
+
+        struct Predicate {
+            Predicate( int p, const ElementMatcher* e, const RegexMatcher* r ) : path( p ), em( e ), rm( r ) { }
+            int path;
+            const ElementMatcher* em; // exactly one of em and rm is set
+            const RegexMatcher* rm;
+        };
+
+        /** of a path in one run.  Broken means a parent is missing or not an object */
+        enum State { Missing, Found, Broken };
+
+        MatchProgram( const Matcher& m );
+        bool add( const Matcher& m );
+        int addPath( const char* fieldName );
+
+        Result scan( int node, const BSONObj& obj, char* states ) const;
+        Result settle( int node, const char* elt, char* states ) const;
+        Result missing( int node, char state ) const;
+        bool satisfied( const Predicate& p, const BSONElement& e, char state ) const;
+        int positiveCmp( int op, const ElementMatcher& em, const BSONElement& e, char state ) const;
+
+        const Matcher& _matcher;
+        BSONObj _keyPattern;    // set when compiling a key matcher; paths are then key positions
+        vector<Path> _paths;    // [0] is the root
+        vector<Predicate> _predicates;
+    };
+
     Matcher::~Matcher() {
         delete _where;
         _where = 0;
@@ -174,10 +232,91 @@ namespace mongo {
         }
     }
 
+    bool ElementInSet::hashable( const BSONElement& e ) {
+        switch ( e.type() ) {
+        case Object:
+        case Array:
+        case RegEx:
+        case CodeWScope:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    size_t ElementInSet::Hash::operator()( const BSONElement& e ) const {
+        size_t h = e.canonicalType();
+        switch ( e.type() ) {
+        case NumberDouble:
+        case NumberInt:
+        case NumberLong: {
+            // numbers of different types compare by value, so hash them as doubles
+            double d = e.number();
+            if ( d == 0 )
+                d = 0; // -0.0
+            boost::hash_combine( h, isNaN( d ) ? 0 : boost::hash_value( d ) );
+            break;
+        }
+        case Bool:
+            boost::hash_combine( h, *e.value() );
+            break;
+        case Date:
+        case Timestamp:
+            boost::hash_combine( h, e.date().millis );
+            break;
+        case jstOID:
+            boost::hash_combine( h, boost::hash_range( e.value(), e.value() + 12 ) );
+            break;
+        case Code:
+        case Symbol:
+        case String:
+            boost::hash_combine( h, boost::hash_range( e.valuestr(), e.valuestr() + e.valuestrsize() ) );
+            break;
+        case DBRef:
+            boost::hash_combine( h, boost::hash_range( e.value(), e.value() + e.valuesize() ) );
+            break;
+        case BinData:
+            // length, subtype and data
+            boost::hash_combine( h, boost::hash_range( e.value(), e.value() + 5 + e.objsize() ) );
+            break;
+        default:
+            // null, undefined, MinKey, MaxKey: equal to anything of the same canonical type
+            break;
+        }
+        return h;
+    }
+
+    bool ElementInSet::insert( const BSONElement& e ) {
+        if ( hashable( e ) ) {
+            if ( !_hashed.insert( e ).second )
+                return false;
+        }
+        else {
+            vector<BSONElement>::iterator i = lower_bound( _unhashed.begin(), _unhashed.end(), e, element_lt() );
+            if ( i != _unhashed.end() && !element_lt()( e, *i ) )
+                return false;
+            _unhashed.insert( i, e );
+        }
+        _all.push_back( e );
+        return true;
+    }
+
+    bool ElementInSet::contains( const BSONElement& e ) const {
+        if ( hashable( e ) )
+            return _hashed.count( e ) > 0;
+        return binary_search( _unhashed.begin(), _unhashed.end(), e, element_lt() );
+    }
+
+    vector<BSONElement> ElementInSet::sorted() const {
+        vector<BSONElement> v( _all );
+        sort( v.begin(), v.end(), element_lt() );
+        return v;
+    }
+
     ElementMatcher::ElementMatcher( BSONElement e , int op , const BSONObj& array, bool isNot )
         : _toMatch( e ) , _compareOp( op ), _isNot( isNot ), _subMatcherOnPrimitives(false) {
 
-        _myset.reset( new set<BSONElement,element_lt>() );
+        _myset.reset( new ElementInSet() );
 
         BSONObjIterator i( array );
         while ( i.more() ) {
@@ -532,6 +671,7 @@ namespace mongo {
         while ( i.more() ) {
             parseMatchExpressionElement( i.next(), nested );
         }
+        _program.reset( MatchProgram::compile( *this ) );
     }
 
     Matcher::Matcher( const Matcher &docMatcher, const BSONObj &key ) :
@@ -553,7 +693,8 @@ namespace mongo {
                     break;
                 case BSONObj::opIN: {
                     bool inContainsArray = false;
-                    for( set<BSONElement,element_lt>::const_iterator j = i->_myset->begin(); j != i->_myset->end(); ++j ) {
+                    const vector<BSONElement>& members = i->_myset->members();
+                    for( vector<BSONElement>::const_iterator j = members.begin(); j != members.end(); ++j ) {
                         if ( j->type() == Array ) {
                             inContainsArray = true;
                             break;
@@ -588,6 +729,7 @@ namespace mongo {
         for( list< shared_ptr< Matcher > >::const_iterator i = docMatcher._orMatchers.begin(); i != docMatcher._orMatchers.end(); ++i ) {
             _orMatchers.push_back( shared_ptr< Matcher >( new Matcher( **i, key ) ) );
         }
+        _program.reset( MatchProgram::compile( *this ) );
     }
 
     inline bool regexMatches(const RegexMatcher& rm, const BSONElement& e) {
@@ -733,7 +875,8 @@ namespace mongo {
             BSONElementSet myValues;
             obj.getFieldsDotted( fieldName , myValues );
 
-            for( set< BSONElement, element_lt >::const_iterator i = em._myset->begin(); i != em._myset->end(); ++i ) {
+            const vector<BSONElement>& members = em._myset->members();
+            for( vector<BSONElement>::const_iterator i = members.begin(); i != members.end(); ++i ) {
                 // ignore nulls
                 if ( i->type() == jstNULL )
                     continue;
@@ -892,17 +1035,296 @@ namespace mongo {
 
     extern int dump;
 
+    /** @return true if a basic is satisfied, given matchesDotted's result cmp for it */
+    inline bool basicSatisfied( int cmp, const ElementMatcher& bm ) {
+        const BSONElement& m = bm._toMatch;
+        if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
+            // If missing, match cmp is opposite of $exists spec.
+            cmp = -retExistsFound(bm);
+        }
+        if ( bm._isNot )
+            cmp = -cmp;
+        if ( cmp < 0 )
+            return false;
+        if ( cmp == 0 ) {
+            /* missing is ok iff we were looking for null */
+            if ( m.type() == jstNULL || m.type() == Undefined ||
+                ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
+                if ( bm.negativeCompareOp() ^ bm._isNot ) {
+                    return false;
+                }
+            }
+            else {
+                if ( !bm._isNot ) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    MatchProgram* MatchProgram::compile( const Matcher& m ) {
+        auto_ptr<MatchProgram> p( new MatchProgram( m ) );
+        if ( !p->add( m ) || p->_predicates.empty() )
+            return 0;
+        return p.release();
+    }
+
+    MatchProgram::MatchProgram( const Matcher& m ) :
+        _matcher( m ), _keyPattern( m._constrainIndexKey ) {
+        _paths.push_back( Path( "", -1 ) );
+    }
+
+    bool MatchProgram::add( const Matcher& m ) {
+        for ( vector<ElementMatcher>::const_iterator i = m._basics.begin(); i != m._basics.end(); ++i ) {
+            switch( i->_compareOp ) {
+            case BSONObj::Equality:
+            case BSONObj::LT:
+            case BSONObj::LTE:
+            case BSONObj::GT:
+            case BSONObj::GTE:
+            case BSONObj::NE:
+            case BSONObj::opIN:
+            case BSONObj::NIN:
+            case BSONObj::opSIZE:
+            case BSONObj::opEXISTS:
+            case BSONObj::opMOD:
+            case BSONObj::opTYPE:
+                break;
+            default:
+                return false;
+            }
+            int path = addPath( i->_toMatch.fieldName() );
+            if ( path < 0 )
+                return false;
+            _paths[path].predicates.push_back( _predicates.size() );
+            _predicates.push_back( Predicate( path, &*i, 0 ) );
+        }
+        for ( vector<RegexMatcher>::const_iterator i = m._regexs.begin(); i != m._regexs.end(); ++i ) {
+            int path = addPath( i->_fieldName );
+            if ( path < 0 )
+                return false;
+            _paths[path].predicates.push_back( _predicates.size() );
+            _predicates.push_back( Predicate( path, 0, &*i ) );
+        }
+        // an $and clause is just more predicates, unless it has parts we don't compile
+        for ( list< shared_ptr< Matcher > >::const_iterator i = m._andMatchers.begin(); i != m._andMatchers.end(); ++i ) {
+            const Matcher& clause = **i;
+            if ( clause._where || !clause._orMatchers.empty() || !clause._norMatchers.empty() )
+                return false;
+            if ( !add( clause ) )
+                return false;
+        }
+        return true;
+    }
+
+    int MatchProgram::addPath( const char* fieldName ) {
+        if ( !_keyPattern.isEmpty() ) {
+            // a key has one element per key pattern field; a dotted field name is one path
+            int pos = 0;
+            BSONObjIterator i( _keyPattern );
+            while ( i.more() && !str::equals( i.next().fieldName(), fieldName ) )
+                ++pos;
+            if ( pos == _keyPattern.nFields() )
+                return -1;
+            vector<int>& children = _paths[0].children;
+            for ( unsigned j = 0; j < children.size(); j++ ) {
+                if ( _paths[ children[j] ].pos == pos )
+                    return children[j];
+            }
+            _paths.push_back( Path( fieldName, pos ) );
+            _paths[0].children.push_back( _paths.size() - 1 );
+            return _paths.size() <= MaxPaths ? (int) _paths.size() - 1 : -1;
+        }
+
+        int node = 0;
+        const char* p = fieldName;
+        while ( true ) {
+            const char* dot = strchr( p, '.' );
+            string name = dot ? string( p, dot - p ) : string( p );
+            int child = -1;
+            for ( unsigned j = 0; j < _paths[node].children.size(); j++ ) {
+                if ( _paths[ _paths[node].children[j] ].name == name ) {
+                    child = _paths[node].children[j];
+                    break;
+                }
+            }
+            if ( child < 0 ) {
+                _paths.push_back( Path( name, -1 ) );
+                child = _paths.size() - 1;
+                _paths[node].children.push_back( child );
+            }
+            node = child;
+            if ( !dot )
+                break;
+            p = dot + 1;
+        }
+        return _paths.size() <= MaxPaths ? node : -1;
+    }
+
+    /** find the children of node in obj, settling each as it is found and the rest once we
+        know they are missing.  states[] holds only the children of node still to be found.
+    */
+    MatchProgram::Result MatchProgram::scan( int node, const BSONObj& obj, char* states ) const {
+        const vector<int>& children = _paths[node].children;
+        for ( unsigned j = 0; j < children.size(); j++ )
+            states[ children[j] ] = Missing;
+
+        const bool byPosition = !_keyPattern.isEmpty();
+        unsigned remaining = children.size();
+        int pos = 0;
+        BSONObjIterator i( obj );
+        while ( remaining && i.more() ) {
+            BSONElement e = i.next();
+            const char* fieldName = e.fieldName();
+            for ( unsigned j = 0; j < children.size(); j++ ) {
+                const int c = children[j];
+                if ( states[c] != Missing )
+                    continue;
+                const Path& path = _paths[c];
+                if ( byPosition ? path.pos == pos :
+                     path.name[0] == fieldName[0] && strcmp( path.name.c_str(), fieldName ) == 0 ) {
+                    // like getField(), the first element with the name is the one
+                    states[c] = Found;
+                    --remaining;
+                    Result r = settle( c, e.rawdata(), states );
+                    if ( r != Match )
+                        return r;
+                    break;
+                }
+            }
+            ++pos;
+        }
+
+        for ( unsigned j = 0; remaining && j < children.size(); j++ ) {
+            const int c = children[j];
+            if ( states[c] == Missing ) {
+                Result r = missing( c, Missing );
+                if ( r != Match )
+                    return r;
+            }
+        }
+        return Match;
+    }
+
+    /** check the predicates of a path found at elt, and go on to the paths below it */
+    MatchProgram::Result MatchProgram::settle( int node, const char* elt, char* states ) const {
+        const Path& path = _paths[node];
+        const BSONElement e( elt );
+        if ( e.type() == Array )
+            return Unsupported;
+        for ( unsigned j = 0; j < path.predicates.size(); j++ ) {
+            if ( !satisfied( _predicates[ path.predicates[j] ], e, Found ) )
+                return Mismatch;
+        }
+        if ( path.children.empty() )
+            return Match;
+        if ( e.type() == Object )
+            return scan( node, e.embeddedObject(), states );
+        for ( unsigned j = 0; j < path.children.size(); j++ ) {
+            Result r = missing( path.children[j], Broken );
+            if ( r != Match )
+                return r;
+        }
+        return Match;
+    }
+
+    /** check the predicates of a path that isn't there, and of the paths below it */
+    MatchProgram::Result MatchProgram::missing( int node, char state ) const {
+        const Path& path = _paths[node];
+        const BSONElement eoo;
+        for ( unsigned j = 0; j < path.predicates.size(); j++ ) {
+            if ( !satisfied( _predicates[ path.predicates[j] ], eoo, state ) )
+                return Mismatch;
+        }
+        for ( unsigned j = 0; j < path.children.size(); j++ ) {
+            Result r = missing( path.children[j], Broken );
+            if ( r != Match )
+                return r;
+        }
+        return Match;
+    }
+
+    /** what matchesDotted() returns for a positive op on a field that isn't in an array */
+    int MatchProgram::positiveCmp( int op, const ElementMatcher& em, const BSONElement& e, char state ) const {
+        if ( state == Broken )
+            return 0;
+        if ( op == BSONObj::opEXISTS )
+            return e.eoo() ? 0 : retExistsFound( em );
+        if ( _matcher.valuesMatch( e, em._toMatch, op, em ) )
+            return 1;
+        return e.eoo() ? 0 : -1;
+    }
+
+    bool MatchProgram::satisfied( const Predicate& p, const BSONElement& e, char state ) const {
+        if ( p.rm ) {
+            bool match = state == Found && regexMatches( *p.rm, e );
+            return match ^ p.rm->_isNot;
+        }
+
+        const ElementMatcher& em = *p.em;
+        int cmp;
+        if ( em.negativeCompareOp() ) {
+            // as inverseMatch()
+            int inverseRet = positiveCmp( em.inverseOfNegativeCompareOp(), em, e, state );
+            if ( em.negativeCompareOpContainsNull() )
+                cmp = ( inverseRet <= 0 ) ? 1 : 0;
+            else
+                cmp = -inverseRet;
+        }
+        else {
+            cmp = positiveCmp( em._compareOp, em, e, state );
+        }
+        return basicSatisfied( cmp, em );
+    }
+
+    MatchProgram::Result MatchProgram::run( const BSONObj& obj ) const {
+        char states[MaxPaths];
+        return scan( 0, obj, states );
+    }
+
+    bool Matcher::usesWhere() const {
+        if ( _where )
+            return true;
+        for ( vector<ElementMatcher>::const_iterator i = _basics.begin(); i != _basics.end(); ++i ) {
+            if ( i->_subMatcher && i->_subMatcher->usesWhere() )
+                return true;
+        }
+        const list< shared_ptr< Matcher > > *clauses[] = { &_andMatchers, &_orMatchers, &_norMatchers };
+        for ( int j = 0; j < 3; j++ ) {
+            for ( list< shared_ptr< Matcher > >::const_iterator i = clauses[j]->begin(); i != clauses[j]->end(); ++i ) {
+                if ( (*i)->usesWhere() )
+                    return true;
+            }
+        }
+        return false;
+    }
+
     /* See if an object matches the query.
     */
     bool Matcher::matches(const BSONObj& jsobj , MatchDetails * details ) const {
+        LOG(5) << "Matcher::matches() " << jsobj.toString() << endl;
+
+        if ( _program ) {
+            switch( _program->run( jsobj ) ) {
+            case MatchProgram::Mismatch:
+                return false;
+            case MatchProgram::Match:
+                return matchesAlternatives( jsobj );
+            case MatchProgram::Unsupported:
+                break;
+            }
+        }
+        return matchesInterpreted( jsobj, details );
+    }
+
+    bool Matcher::matchesInterpreted(const BSONObj& jsobj , MatchDetails * details ) const {
         /*
           NB:  if any modifications are made to how this operates, make sure
           they are reflected in visitReferences(), whose implementation
-          parallels this.
+          parallels this, and in MatchProgram.
          */
 
-        LOG(5) << "Matcher::matches() " << jsobj.toString() << endl;
-
         /* assuming there is usually only one thing to match.  if more this
            could be slow sometimes. */
 
@@ -912,28 +1334,8 @@ namespace mongo {
             const BSONElement& m = bm._toMatch;
             // -1=mismatch. 0=missing element. 1=match
             int cmp = matchesDotted(m.fieldName(), m, jsobj, bm._compareOp, bm , false , details );
-            if ( cmp == 0 && bm._compareOp == BSONObj::opEXISTS ) {
-                // If missing, match cmp is opposite of $exists spec.
-                cmp = -retExistsFound(bm);
-            }
-            if ( bm._isNot )
-                cmp = -cmp;
-            if ( cmp < 0 )
+            if ( !basicSatisfied( cmp, bm ) )
                 return false;
-            if ( cmp == 0 ) {
-                /* missing is ok iff we were looking for null */
-                if ( m.type() == jstNULL || m.type() == Undefined ||
-                    ( ( bm._compareOp == BSONObj::opIN || bm._compareOp == BSONObj::NIN ) && bm._myset->count( staticNull.firstElement() ) > 0 ) ) {
-                    if ( bm.negativeCompareOp() ^ bm._isNot ) {
-                        return false;
-                    }
-                }
-                else {
-                    if ( !bm._isNot ) {
-                        return false;
-                    }
-                }
-            }
         }
 
         for (vector<RegexMatcher>::const_iterator it = _regexs.begin();
@@ -977,6 +1379,10 @@ namespace mongo {
             }
         }
 
+        return matchesAlternatives( jsobj );
+    }
+
+    bool Matcher::matchesAlternatives( const BSONObj& jsobj ) const {
         if ( _orMatchers.size() > 0 ) {
             bool match = false;
             for( list< shared_ptr< Matcher > >::const_iterator i = _orMatchers.begin();
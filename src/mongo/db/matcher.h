@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <boost/unordered_set.hpp>
+
 #include "jsobj.h"
 #include "pcrecpp.h"
 
@@ -29,6 +31,7 @@ namespace mongo {
     class CoveredIndexMatcher;
     class ElementMatcher;
     class Matcher;
+    class MatchProgram;
     class FieldRangeVector;
 
     class RegexMatcher {
@@ -51,6 +54,48 @@ namespace mongo {
         }
     };
 
+    /**
+     * The values of a $in, $nin or $all array.  Two elements are the same member when element_lt
+     * orders neither before the other, so 1, 1.0 and NumberLong(1) are one value.
+     *
+     * Membership tests on numbers, strings, ObjectIds, dates and the other scalar types are
+     * hashed; objects, arrays and the remaining types, which element_lt compares structurally,
+     * are kept sorted and binary searched.
+     */
+    class ElementInSet {
+    public:
+        /** @return false if an equal value was already a member */
+        bool insert( const BSONElement& e );
+
+        bool contains( const BSONElement& e ) const;
+        int count( const BSONElement& e ) const { return contains( e ) ? 1 : 0; }
+
+        int size() const { return _all.size(); }
+        bool empty() const { return _all.empty(); }
+
+        /** @return the members in the order they were inserted */
+        const vector<BSONElement>& members() const { return _all; }
+
+        /** @return the members in element_lt order */
+        vector<BSONElement> sorted() const;
+
+    private:
+        static bool hashable( const BSONElement& e );
+
+        struct Hash {
+            size_t operator()( const BSONElement& e ) const;
+        };
+        struct Equal {
+            bool operator()( const BSONElement& l, const BSONElement& r ) const {
+                return l.canonicalType() == r.canonicalType() && compareElementValues( l, r ) == 0;
+            }
+        };
+
+        boost::unordered_set<BSONElement,Hash,Equal> _hashed;
+        vector<BSONElement> _unhashed; // in element_lt order
+        vector<BSONElement> _all;
+    };
+
     /**
      * An interface for visiting a Matcher and all of its nested Matchers and ElementMatchers.
      * RegexMatchers are not visited.
@@ -83,7 +128,7 @@ namespace mongo {
         BSONElement _toMatch;
         int _compareOp;
         bool _isNot;
-        shared_ptr< set<BSONElement,element_lt> > _myset;
+        shared_ptr< ElementInSet > _myset;
         shared_ptr< vector<RegexMatcher> > _myregex;
 
         // these are for specific operators
@@ -174,6 +219,12 @@ namespace mongo {
 
         bool matches(const BSONObj& j, MatchDetails * details = 0 ) const;
 
+        /** matches() without the compiled program; what matches() falls back to.  for testing */
+        bool matchesInterpreted(const BSONObj& j, MatchDetails * details = 0 ) const;
+
+        /** @return true if matches() runs a compiled program, see MatchProgram */
+        bool compiled() const { return _program.get() != 0; }
+
 #ifdef MONGO_LATER_SERVER_4644
         class FieldSink {
         public:
@@ -204,6 +255,9 @@ namespace mongo {
         
         bool atomic() const { return _atomic; }
 
+        /** @return true if this or a nested clause has a $where, which needs a js scope to match */
+        bool usesWhere() const;
+
         string toString() const {
             return _jsobj.toString();
         }
@@ -249,6 +303,9 @@ namespace mongo {
         void parseWhere( const BSONElement &e );
         void parseMatchExpressionElement( const BSONElement &e, bool nested );
 
+        /** the $or, $nor and $where parts of matches() */
+        bool matchesAlternatives( const BSONObj& jsobj ) const;
+
         Where *_where;                    // set if query uses $where
         BSONObj _jsobj;                  // the query pattern.  e.g., { name: "joe" }
         BSONObj _constrainIndexKey;
@@ -273,7 +330,10 @@ namespace mongo {
         list< shared_ptr< Matcher > > _orMatchers;
         list< shared_ptr< Matcher > > _norMatchers;
 
+        scoped_ptr<MatchProgram> _program; // null if this matcher can't be compiled
+
         friend class CoveredIndexMatcher;
+        friend class MatchProgram;
     };
 
     // If match succeeds on index key, then attempt to match full document.
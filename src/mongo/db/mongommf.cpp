@@ -29,6 +29,7 @@
 #include "d_globals.h"
 #include "memconcept.h"
 #include "d_concurrency.h"
+#include "record_compression.h"
 
 using namespace mongoutils;
 
@@ -46,6 +47,55 @@ namespace mongo {
         fassert( 16112, _view_private == old );
     }
 
+    void MongoMMF::noteWrite(unsigned long long ofs, unsigned len) {
+        if( len == 0 )
+            return;
+        if( _dirty.empty() )
+            _dirty.resize( (size_t) ((length() + RemapChunkSize - 1) / RemapChunkSize) );
+        size_t last = (size_t) ((ofs + len - 1) / RemapChunkSize);
+        for( size_t c = (size_t) (ofs / RemapChunkSize); c <= last && c < _dirty.size(); c++ ) {
+            // usually it will already be set, so we check first
+            // to avoid possibility of cpu cache line contention
+            if( !_dirty[c] ) {
+                _dirty[c] = true;
+                _nDirtyChunks++;
+            }
+        }
+    }
+
+    unsigned MongoMMF::remapDirtyChunks(unsigned max) {
+        verify( cmdLine.dur );
+        if( _nDirtyChunks == 0 || max == 0 )
+            return 0;
+#if defined(_WIN32)
+        // no partial remap there, see MemoryMappedFile::remapPrivateView
+        unsigned n = _nDirtyChunks;
+        remapThePrivateView();
+        _dirty.assign(_dirty.size(), false);
+        _nDirtyChunks = 0;
+        return n;
+#else
+        unsigned n = 0;
+        size_t c = 0;
+        while( c < _dirty.size() && n < max ) {
+            if( !_dirty[c] ) {
+                c++;
+                continue;
+            }
+            size_t from = c;
+            while( c < _dirty.size() && _dirty[c] && n < max ) {
+                _dirty[c++] = false;
+                n++;
+            }
+            unsigned long long ofs = from * RemapChunkSize;
+            unsigned long long len = min( (unsigned long long) (c - from) * RemapChunkSize, length() - ofs );
+            remapPrivateViewRange(_view_private, ofs, len);
+        }
+        _nDirtyChunks -= n;
+        return n;
+#endif
+    }
+
     /** register view. threadsafe */
     void PointerToMMF::add(void *view, MongoMMF *f) {
         verify(view);
@@ -200,7 +250,7 @@ namespace mongo {
         return false;
     }
 
-    MongoMMF::MongoMMF() : _willNeedRemap(false) {
+    MongoMMF::MongoMMF() : _nDirtyChunks(0) {
         _view_write = _view_private = 0;
     }
 
@@ -239,6 +289,7 @@ namespace mongo {
         memconcept::invalidate(_view_private);
         _view_write = _view_private = 0;
         MemoryMappedFile::close();
+        dataFilesUnmapped();
     }
 
 }
@@ -83,11 +83,24 @@ namespace mongo {
         int fileSuffixNo() const { return _fileSuffixNo; }
         HANDLE getFd() { return MemoryMappedFile::getFd(); }
 
-        /** true if we have written.
-            set in PREPLOGBUFFER, it is NOT set immediately on write intent declaration.
-            reset to false in REMAPPRIVATEVIEW
+        /** the private view is remapped RemapChunkSize bytes at a time, so that a write lock
+            pause in REMAPPRIVATEVIEW need not cover whole files.  multiple of the page size.
         */
-        bool& willNeedRemap() { return _willNeedRemap; }
+        static const unsigned long long RemapChunkSize = 16 * 1024 * 1024;
+
+        /** note [ofs, ofs+len) of the private view was written.
+            called in PREPLOGBUFFER, it is NOT done immediately on write intent declaration.
+        */
+        void noteWrite(unsigned long long ofs, unsigned len);
+
+        /** true if we have written since the last remap of the chunks written */
+        bool willNeedRemap() const { return _nDirtyChunks != 0; }
+        unsigned dirtyChunks() const { return _nDirtyChunks; }
+
+        /** remap up to max of the chunks written, adjacent ones in a single call.  in REMAPPRIVATEVIEW
+            @return number of chunks remapped
+        */
+        unsigned remapDirtyChunks(unsigned max);
 
         void remapThePrivateView();
 
@@ -97,7 +110,8 @@ namespace mongo {
 
         void *_view_write;
         void *_view_private;
-        bool _willNeedRemap;
+        vector<bool> _dirty;     // by RemapChunkSize chunk of the file
+        unsigned _nDirtyChunks;
         RelativePath _p;   // e.g. "somepath/dbname"
         int _fileSuffixNo;  // e.g. 3.  -1="ns"
 
@@ -31,6 +31,7 @@
 #include "mongo/db/ops/update.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/scripting/engine.h"
+#include "mongo/util/concurrency/threadlocal.h"
 #include "mongo/util/hashtab.h"
 
 namespace mongo {
@@ -70,6 +71,9 @@ namespace mongo {
         reservedA = 0;
         extraOffset = 0;
         indexBuildInProgress = 0;
+        _deletedBuckets = 0;
+        _compressedSize = 0;
+        _uncompressedSize = 0;
         memset(reserved, 0, sizeof(reserved));
     }
 
@@ -146,7 +150,7 @@ namespace mongo {
     NOINLINE_DECL void NamespaceIndex::_init() {
         verify( !ht );
 
-        Lock::assertWriteLocked(database_);
+        Lock::assertCatalogWriteLocked(database_);
 
         /* if someone manually deleted the datafiles for a database,
            we need to be sure to clear any cached info for the database in
@@ -242,11 +246,15 @@ namespace mongo {
             }
         }
         else {
+            if ( DrainingExtents::orphan( DiskLoc( dloc.a(), d->extentOfs() ), dloc ) )
+                return;
             int b = bucket(d->lengthWithHeaders());
             DiskLoc& list = deletedList[b];
             DiskLoc oldHead = list;
             getDur().writingDiskLoc(list) = dloc;
             d->nextDeleted() = oldHead;
+            if ( !( _deletedBuckets & ( 1 << b ) ) )
+                *getDur().writing(&_deletedBuckets) |= ( 1 << b );
         }
     }
 
@@ -318,7 +326,10 @@ namespace mongo {
        @param peekOnly just look up where and don't reserve
        returned item is out of the deleted list upon return
     */
-    DiskLoc NamespaceDetails::__stdAlloc(int len, bool peekOnly) {
+    DiskLoc NamespaceDetails::__stdAlloc(int len, bool peekOnly, int *probes) {
+        if ( isUserFlagSet( Flag_UsePowerOf2Sizes ) && len <= bucketSizes[MaxBucket-1] )
+            return __pow2Alloc(len, peekOnly, probes);
+
         DiskLoc *prev;
         DiskLoc *bestprev = 0;
         DiskLoc bestmatch;
@@ -328,6 +339,7 @@ namespace mongo {
         prev = &deletedList[b];
         int extra = 5; // look for a better fit, a little.
         int chain = 0;
+        int examined = 0;
         while ( 1 ) {
             {
                 int a = cur.a();
@@ -347,6 +359,8 @@ namespace mongo {
                 b++;
                 if ( b > MaxBucket ) {
                     // out of space. alloc a new extent.
+                    if ( probes )
+                        *probes = examined;
                     return DiskLoc();
                 }
                 cur = deletedList[b];
@@ -354,6 +368,7 @@ namespace mongo {
                 continue;
             }
             DeletedRecord *r = cur.drec();
+            examined++;
             if ( r->lengthWithHeaders() >= len &&
                  r->lengthWithHeaders() < bestmatchlen ) {
                 bestmatchlen = r->lengthWithHeaders();
@@ -388,9 +403,75 @@ namespace mongo {
             verify(bmr->extentOfs() < bestmatch.getOfs());
         }
 
+        if ( probes )
+            *probes = examined;
         return bestmatch;
     }
 
+    /* for collections with Flag_UsePowerOf2Sizes.  every record in a bucket above bucket(len) is
+       at least bucketSizes[bucket(len)] > len long, so no chain is walked: we try the head of
+       bucket(len) (which always fits when len is a power of 2) and otherwise take the head of the
+       next non-empty bucket up.  _deletedBuckets finds that bucket without touching the lists.
+       it is only a hint -- other code empties lists without clearing bits -- so a bit whose list
+       is empty is cleared when seen, and the bits are rebuilt once from the list heads before we
+       give up and let the caller add an extent.
+    */
+    DiskLoc NamespaceDetails::__pow2Alloc(int len, bool peekOnly, int *probes) {
+        const int b = bucket(len);
+        int examined = 0;
+        DiskLoc *prev = 0;
+        for ( int pass = 0; prev == 0; pass++ ) {
+            if ( pass > 0 && ( peekOnly || !resetDeletedBuckets() ) )
+                break;
+            if ( !deletedList[b].isNull() ) {
+                examined++;
+                if ( deletedList[b].drec()->lengthWithHeaders() >= len )
+                    prev = &deletedList[b];
+            }
+            unsigned bits = _deletedBuckets >> ( b + 1 );
+            for ( int i = b + 1; bits && prev == 0; i++, bits >>= 1 ) {
+                if ( !( bits & 1 ) )
+                    continue;
+                if ( deletedList[i].isNull() ) {
+                    if ( !peekOnly )
+                        *getDur().writing(&_deletedBuckets) &= ~( 1 << i );
+                    continue;
+                }
+                examined++;
+                prev = &deletedList[i];
+            }
+        }
+
+        if ( probes )
+            *probes = examined;
+        if ( prev == 0 )
+            return DiskLoc();
+
+        DiskLoc loc = *prev;
+        if( !peekOnly ) {
+            DeletedRecord *r = loc.drec();
+            *getDur().writing(prev) = r->nextDeleted();
+            r->nextDeleted().writing().setInvalid(); // defensive.
+            verify(r->extentOfs() < loc.getOfs());
+            if ( prev->isNull() )
+                *getDur().writing(&_deletedBuckets) &= ~( 1 << ( prev - deletedList ) );
+        }
+        return loc;
+    }
+
+    /** recompute _deletedBuckets from the list heads.  @return true if any bit changed */
+    bool NamespaceDetails::resetDeletedBuckets() {
+        unsigned bits = 0;
+        for ( int i = 0; i < Buckets; i++ ) {
+            if ( !deletedList[i].isNull() )
+                bits |= ( 1 << i );
+        }
+        if ( bits == _deletedBuckets )
+            return false;
+        *getDur().writing(&_deletedBuckets) = bits;
+        return true;
+    }
+
     void NamespaceDetails::dumpDeleted(set<DiskLoc> *extents) {
         for ( int i = 0; i < Buckets; i++ ) {
             DiskLoc dl = deletedList[i];
@@ -445,16 +526,35 @@ namespace mongo {
         }
     }
 
+    /* counts allocations on this thread, so that the stats are kept for only one in
+       AllocationStats::SampleEvery of them: recording takes _qcMutex and reads the clock, which
+       writers of different collections shouldn't contend for on every record. */
+    struct AllocationSampler {
+        AllocationSampler() : n(0) { }
+        unsigned n;
+    };
+    TSP_DECLARE(AllocationSampler,allocationSampler)
+    TSP_DEFINE(AllocationSampler,allocationSampler)
+
     /* alloc with capped table handling. */
     DiskLoc NamespaceDetails::_alloc(const char *ns, int len) {
-        if ( ! isCapped() )
-            return __stdAlloc(len, false);
+        if ( ! isCapped() ) {
+            if ( ! NamespaceString::normal(ns) ) // index buckets
+                return __stdAlloc(len, false);
+            if ( ++allocationSampler.getMake()->n % AllocationStats::SampleEvery != 0 )
+                return __stdAlloc(len, false);
+            unsigned long long start = curTimeMicros64();
+            int probes = 0;
+            DiskLoc loc = __stdAlloc(len, false, &probes);
+            NamespaceDetailsTransient::get(ns).allocationStats().record( curTimeMicros64() - start, probes );
+            return loc;
+        }
 
         return cappedAlloc(ns,len);
     }
 
     void NamespaceIndex::kill_ns(const char *ns) {
-        Lock::assertWriteLocked(ns);
+        Lock::assertCatalogWriteLocked(ns);
         if ( !ht )
             return;
         Namespace n(ns);
@@ -476,7 +576,7 @@ namespace mongo {
         add_ns( ns, details );
     }
     void NamespaceIndex::add_ns( const char *ns, const NamespaceDetails &details ) {
-        Lock::assertWriteLocked(ns);
+        Lock::assertCatalogWriteLocked(ns);
         init();
         Namespace n(ns);
         uassert( 10081 , "too many namespaces/collections", ht->put(n, details));
@@ -484,7 +584,7 @@ namespace mongo {
 
     /* extra space for indexes when more than 10 */
     NamespaceDetails::Extra* NamespaceIndex::newExtra(const char *ns, int i, NamespaceDetails *d) {
-        Lock::assertWriteLocked(ns);
+        Lock::assertCatalogWriteLocked(ns);
         verify( i >= 0 && i <= 1 );
         Namespace n(ns);
         Namespace extra(n.extraName(i).c_str()); // throws userexception if ns name too long
@@ -615,16 +715,92 @@ namespace mongo {
 
     /* ------------------------------------------------------------------------- */
 
+    SimpleMutex DrainingExtents::_m("drainingExtents");
+    map< DiskLoc , vector<DiskLoc> > DrainingExtents::_extents;
+    AtomicUInt32 DrainingExtents::_n;
+
+    void DrainingExtents::add( const DiskLoc& ext ) {
+        SimpleMutex::scoped_lock lk(_m);
+        _extents[ext];
+        _n.store( _extents.size() );
+    }
+
+    bool DrainingExtents::orphan( const DiskLoc& ext , const DiskLoc& dloc ) {
+        if ( _n.load() == 0 )
+            return false;
+        SimpleMutex::scoped_lock lk(_m);
+        map< DiskLoc , vector<DiskLoc> >::iterator i = _extents.find( ext );
+        if ( i == _extents.end() )
+            return false;
+        i->second.push_back( dloc );
+        return true;
+    }
+
+    vector<DiskLoc> DrainingExtents::remove( const DiskLoc& ext ) {
+        SimpleMutex::scoped_lock lk(_m);
+        vector<DiskLoc> orphans;
+        map< DiskLoc , vector<DiskLoc> >::iterator i = _extents.find( ext );
+        if ( i != _extents.end() ) {
+            orphans.swap( i->second );
+            _extents.erase( i );
+        }
+        _n.store( _extents.size() );
+        return orphans;
+    }
+
+    AllocationStats::AllocationStats() :
+        _n(0), _micros( options( 16 ) ), _probes( options( 8 ) ) {
+    }
+
+    /*static*/ Histogram::Options AllocationStats::options( uint32_t numBuckets ) {
+        Histogram::Options opts;
+        opts.numBuckets = numBuckets;
+        opts.bucketSize = 1;
+        opts.exponential = true;
+        return opts;
+    }
+
+    void AllocationStats::record( unsigned long long micros , int probes ) {
+        _n++;
+        _micros.insert( micros > 0xffffffffULL ? 0xffffffffU : (uint32_t) micros );
+        _probes.insert( probes );
+    }
+
+    static void appendHistogram( BSONObjBuilder& b , const char *name , const Histogram& h ) {
+        BSONObjBuilder sub( b.subobjStart( name ) );
+        for ( uint32_t i = 0; i < h.getBucketsNum(); i++ ) {
+            if ( h.getCount( i ) == 0 )
+                continue;
+            if ( i == h.getBucketsNum() - 1 )
+                sub.appendNumber( string( str::stream() << ">" << h.getBoundary( i - 1 ) ) , (long long) h.getCount( i ) );
+            else
+                sub.appendNumber( string( str::stream() << "<=" << h.getBoundary( i ) ) , (long long) h.getCount( i ) );
+        }
+        sub.done();
+    }
+
+    void AllocationStats::append( BSONObjBuilder& b ) const {
+        b.appendNumber( "n" , _n );
+        b.append( "sampleEvery" , (int) SampleEvery );
+        appendHistogram( b , "micros" , _micros );
+        appendHistogram( b , "chainLength" , _probes );
+    }
+
     SimpleMutex NamespaceDetailsTransient::_qcMutex("qc");
     SimpleMutex NamespaceDetailsTransient::_isMutex("is");
     map< string, shared_ptr< NamespaceDetailsTransient > > NamespaceDetailsTransient::_nsdMap;
     typedef map< string, shared_ptr< NamespaceDetailsTransient > >::iterator ouriter;
 
+    unsigned long long NamespaceDetailsTransient::_nextEpoch = 0;
+
     void NamespaceDetailsTransient::reset() {
         Lock::assertWriteLocked(_ns); 
-        clearQueryCache();
+        // a pinned index may be the one going away
+        clearQueryCache( true );
         _keysComputed = false;
         _indexSpecs.clear();
+        // a new index may return unordered results in a different order
+        _resultCache.clear();
     }
 
     /*static*/ NOINLINE_DECL NamespaceDetailsTransient& NamespaceDetailsTransient::make_inlock(const char *ns) {
@@ -641,16 +817,153 @@ namespace mongo {
         return *t;
     }
 
+    void NamespaceDetailsTransient::clearQueryCache( bool includePinned ) {
+        _qcWriteCount = 0;
+        if ( includePinned ) {
+            _qcCache.clear();
+            return;
+        }
+        for( map<QueryPattern,CachedPlanEntry>::iterator i = _qcCache.begin(); i != _qcCache.end(); ) {
+            if ( i->second.plan.pinned() )
+                ++i;
+            else
+                _qcCache.erase( i++ );
+        }
+    }
+
+    static bool samePlan( const CachedQueryPlan &a, const CachedQueryPlan &b ) {
+        return a.indexKey().woCompare( b.indexKey() ) == 0 &&
+                a.intersectKeys().woCompare( b.intersectKeys() ) == 0;
+    }
+
+    void NamespaceDetailsTransient::registerCachedQueryPlanForPattern( const QueryPattern &pattern,
+                                                                      const CachedQueryPlan &cachedQueryPlan ) {
+        map<QueryPattern,CachedPlanEntry>::iterator i = _qcCache.find( pattern );
+        if ( i == _qcCache.end() ) {
+            if ( cachedQueryPlan.indexKey().isEmpty() )
+                return;
+            _qcCache[ pattern ].plan = cachedQueryPlan;
+            return;
+        }
+        CachedPlanEntry &e = i->second;
+        if ( e.plan.pinned() )
+            return;
+        if ( cachedQueryPlan.indexKey().isEmpty() ) {
+            _qcCache.erase( i );
+            return;
+        }
+        // a different plan starts a new history
+        if ( !samePlan( e.plan, cachedQueryPlan ) )
+            e.stats = CachedPlanStats();
+        e.plan = cachedQueryPlan;
+    }
+
+    void NamespaceDetailsTransient::notePlanRun( const QueryPattern &pattern, const BSONObj &indexKey,
+                                                 const BSONObj &intersectKeys,
+                                                 long long nScanned, long long nReturned,
+                                                 long long micros ) {
+        map<QueryPattern,CachedPlanEntry>::iterator i = _qcCache.find( pattern );
+        if ( i == _qcCache.end() )
+            return;
+        // an intersection plan and a plain one on the same index are different plans
+        const CachedQueryPlan &cached = i->second.plan;
+        if ( cached.indexKey().woCompare( indexKey ) != 0 ||
+             cached.intersectKeys().woCompare( intersectKeys ) != 0 )
+            return;
+        CachedPlanEntry &e = i->second;
+        if ( !e.plan.pinned() && e.stats.drifted( nScanned, micros ) ) {
+            LOG(1) << "evicting cached plan " << indexKey << " for " << pattern.toString()
+                   << " on " << _ns << ": nscanned " << nScanned << " micros " << micros << endl;
+            _qcCache.erase( i );
+            ++_qcDriftEvictions;
+            return;
+        }
+        e.stats.noteRun( nScanned, nReturned, micros );
+    }
+
+    void NamespaceDetailsTransient::pinCachedQueryPlan( const QueryPattern &pattern,
+                                                        const CachedQueryPlan &cachedQueryPlan ) {
+        verify( cachedQueryPlan.pinned() );
+        CachedPlanEntry &e = _qcCache[ pattern ];
+        if ( !samePlan( e.plan, cachedQueryPlan ) )
+            e.stats = CachedPlanStats();
+        e.plan = cachedQueryPlan;
+    }
+
+    bool NamespaceDetailsTransient::unpinCachedQueryPlan( const QueryPattern &pattern ) {
+        map<QueryPattern,CachedPlanEntry>::iterator i = _qcCache.find( pattern );
+        if ( i == _qcCache.end() || !i->second.plan.pinned() )
+            return false;
+        const CachedQueryPlan &p = i->second.plan;
+        i->second.plan = CachedQueryPlan( p.indexKey(), p.nScanned(), p.planCharacter(), false,
+                                          p.intersectKeys() );
+        return true;
+    }
+
+    bool NamespaceDetailsTransient::clearCachedQueryPlan( const QueryPattern &pattern ) {
+        return _qcCache.erase( pattern ) > 0;
+    }
+
+    void NamespaceDetailsTransient::appendPlanCache( BSONObjBuilder &b ) const {
+        BSONArrayBuilder a( b.subarrayStart( "plans" ) );
+        for( map<QueryPattern,CachedPlanEntry>::const_iterator i = _qcCache.begin(); i != _qcCache.end(); ++i ) {
+            const CachedPlanEntry &e = i->second;
+            BSONObjBuilder p( a.subobjStart() );
+            p.appendElements( i->first.toBSON() );
+            p.append( "index", e.plan.indexKey() );
+            if ( !e.plan.intersectKeys().isEmpty() )
+                p.appendArray( "intersect", e.plan.intersectKeys() );
+            p.append( "pinned", e.plan.pinned() );
+            p.appendNumber( "raceNscanned", e.plan.nScanned() );
+            e.stats.append( p );
+            p.done();
+        }
+        a.done();
+        b.appendNumber( "writesSinceReset", _qcWriteCount );
+        b.appendNumber( "driftEvictions", _qcDriftEvictions );
+    }
+
     // note with repair there could be two databases with the same ns name.
     // that is NOT handled here yet!  TODO
     // repair may not use nsdt though not sure.  anyway, requires work.
     NamespaceDetailsTransient::NamespaceDetailsTransient(Database *db, const char *ns) : 
-        _ns(ns), _keysComputed(false), _qcWriteCount() 
+        _ns(ns), _keysComputed(false), _qcWriteCount(), _qcDriftEvictions(),
+        _writeVersion( ++_nextEpoch << 32 ), // under _qcMutex, from make_inlock()
+        _cappedInsertNotifier( new CappedInsertNotifier() )
     {
         dassert(db);
     }
 
     NamespaceDetailsTransient::~NamespaceDetailsTransient() { 
+        // waiters go look for their cursors, which a drop will have invalidated
+        _cappedInsertNotifier->notifyAll();
+    }
+
+    void CappedInsertNotifier::notifyAll() {
+        mutex::scoped_lock lk( _mutex );
+        ++_version;
+        _notifier.notify_all();
+    }
+
+    unsigned long long CappedInsertNotifier::getVersion() const {
+        mutex::scoped_lock lk( _mutex );
+        return _version;
+    }
+
+    void CappedInsertNotifier::waitForInsert( unsigned long long prev, unsigned millis ) const {
+        boost::xtime deadline;
+        boost::xtime_get( &deadline, MONGO_BOOST_TIME_UTC );
+        deadline.sec += millis / 1000;
+        deadline.nsec += ( millis % 1000 ) * 1000 * 1000;
+        if ( deadline.nsec >= 1000 * 1000 * 1000 ) {
+            deadline.nsec -= 1000 * 1000 * 1000;
+            deadline.sec++;
+        }
+        mutex::scoped_lock lk( _mutex );
+        while ( _version == prev ) {
+            if ( !_notifier.timed_wait( lk.boost(), deadline ) )
+                return; // timed out
+        }
     }
 
     void NamespaceDetailsTransient::clearForPrefix(const char *prefix) {
@@ -659,7 +972,7 @@ namespace mongo {
         for( ouriter i = _nsdMap.begin(); i != _nsdMap.end(); ++i ) {
             if ( strncmp( i->first.c_str(), prefix, strlen( prefix ) ) == 0 ) {
                 found.push_back( i->first );
-                Lock::assertWriteLocked(i->first);
+                Lock::assertCatalogWriteLocked(i->first);
             }
         }
         for( vector< string >::iterator i = found.begin(); i != found.end(); ++i ) {
@@ -673,7 +986,7 @@ namespace mongo {
         for( ouriter i = _nsdMap.begin(); i != _nsdMap.end(); ++i ) {
             if ( strncmp( i->first.c_str(), prefix, strlen( prefix ) ) == 0 ) {
                 found.push_back( i->first );
-                Lock::assertWriteLocked(i->first);
+                Lock::assertCatalogWriteLocked(i->first);
             }
         }
         for( vector< string >::iterator i = found.begin(); i != found.end(); ++i ) {
@@ -706,7 +1019,7 @@ namespace mongo {
      * should be changed, just not sure to what
      */
     void NamespaceDetails::syncUserFlags( const string& ns ) {
-        Lock::assertWriteLocked( ns );
+        Lock::assertCatalogWriteLocked( ns );
         
         string system_namespaces = NamespaceString( ns ).db + ".system.namespaces";
 
@@ -744,6 +1057,11 @@ namespace mongo {
 
 
 
+    void NamespaceDetails::noteCompressedRecord( int storedLen , int objsize , int n ) {
+        *getDur().writing( &_compressedSize ) += n * storedLen;
+        *getDur().writing( &_uncompressedSize ) += n * objsize;
+    }
+
     int NamespaceDetails::getRecordAllocationSize( int minRecordSize ) {
         if ( _paddingFactor == 0 ) {
             warning() << "implicit updgrade of paddingFactor of very old collection" << endl;
@@ -753,9 +1071,9 @@ namespace mongo {
 
         
         if ( isUserFlagSet( Flag_UsePowerOf2Sizes ) ) {
-            int x = bucket( minRecordSize );
-            x = bucketSizes[x];
-            return x;
+            int x = bucketSizes[ bucket( minRecordSize ) ];
+            if ( x >= minRecordSize ) // the largest bucket is open ended
+                return x;
         }
 
         return static_cast<int>(minRecordSize * _paddingFactor);
@@ -796,6 +1114,7 @@ namespace mongo {
         // index details across commands are in cursors and nsd
         // transient (including query cache) so clear these.
         ClientCursor::invalidate( from );
+        cc().database()->dropCursorsByLoc( from );
         NamespaceDetailsTransient::eraseForPrefix( from );
 
         NamespaceDetails *details = ni->details( from );
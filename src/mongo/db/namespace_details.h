@@ -20,6 +20,8 @@
 
 #include "pch.h"
 
+#include <boost/thread/condition.hpp>
+
 #include "mongo/db/d_concurrency.h"
 #include "mongo/db/diskloc.h"
 #include "mongo/db/index.h"
@@ -27,8 +29,11 @@
 #include "mongo/db/mongommf.h"
 #include "mongo/db/namespace.h"
 #include "mongo/db/queryoptimizercursor.h"
+#include "mongo/db/query_result_cache.h"
 #include "mongo/db/querypattern.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/hashtab.h"
+#include "mongo/util/histogram.h"
 
 namespace mongo {
     class Database;
@@ -99,7 +104,10 @@ namespace mongo {
         int indexBuildInProgress;             // 1 if in prog
     private:
         int _userFlags;
-        char reserved[72];
+        unsigned _deletedBuckets;             // bit b set: deletedList[b] may be non-empty.  only a hint, see __pow2Alloc()
+        long long _compressedSize;            // stored bytes of the compressed records, headers included
+        long long _uncompressedSize;          // the size of those records' objects
+        char reserved[52];
         /*-------- end data 496 bytes */
     public:
         explicit NamespaceDetails( const DiskLoc &loc, bool _capped );
@@ -190,7 +198,8 @@ namespace mongo {
         };
 
         enum UserFlags {
-            Flag_UsePowerOf2Sizes = 1 << 0
+            Flag_UsePowerOf2Sizes = 1 << 0,
+            Flag_CompressRecords = 1 << 1      // snappy compress new records, see record_compression.h
         };
 
         IndexDetails& idx(int idxNo, bool missingExpected = false );
@@ -372,6 +381,12 @@ namespace mongo {
         DiskLoc lastRecord( const DiskLoc &startExtent = DiskLoc() ) const;
         long long storageSize( int * numExtents = 0 , BSONArrayBuilder * extentInfo = 0 ) const;
 
+        /* totals over the records stored compressed (whatever the current flag), for collStats */
+        long long compressedSize() const { return _compressedSize; }
+        long long uncompressedSize() const { return _uncompressedSize; }
+        /** a compressed record was added (n=1) or removed (n=-1) */
+        void noteCompressedRecord( int storedLen , int objsize , int n );
+
         int averageObjectSize() {
             if ( stats.nrecords == 0 )
                 return 5;
@@ -387,7 +402,9 @@ namespace mongo {
     private:
         DiskLoc _alloc(const char *ns, int len);
         void maybeComplain( const char *ns, int len ) const;
-        DiskLoc __stdAlloc(int len, bool willBeAt);
+        DiskLoc __stdAlloc(int len, bool willBeAt, int *probes = 0);
+        DiskLoc __pow2Alloc(int len, bool willBeAt, int *probes);
+        bool resetDeletedBuckets();
         void compact(); // combine adjacent deleted records
         friend class NamespaceIndex;
         struct ExtraOld {
@@ -409,6 +426,42 @@ namespace mongo {
     class ParsedQuery;
     class QueryPlanSummary;
     
+    /** extents an online compact is emptying, see compact.cpp.  space freed in them isn't put back
+        on the deleted lists -- the whole extent goes to the freelist once empty -- but remembered,
+        so it can be given back if the compact stops early.
+    */
+    class DrainingExtents {
+    public:
+        static void add( const DiskLoc& ext );
+        /** @return true if ext is draining, in which case dloc is remembered instead of reused */
+        static bool orphan( const DiskLoc& ext , const DiskLoc& dloc );
+        /** stop draining ext.  @return the space orphaned in it */
+        static vector<DiskLoc> remove( const DiskLoc& ext );
+    private:
+        static SimpleMutex _m;
+        static map< DiskLoc , vector<DiskLoc> > _extents;
+        static AtomicUInt32 _n; // _extents.size(), so the usual no compact case doesn't take _m
+    };
+
+    /** latency and deleted list probes of record allocations for one collection, sampled.  kept
+        in memory only (see NamespaceDetailsTransient), updated under the collection's write lock.
+    */
+    class AllocationStats : boost::noncopyable {
+    public:
+        /** each thread records one in this many of its allocations */
+        static const unsigned SampleEvery = 16;
+
+        AllocationStats();
+        void record( unsigned long long micros , int probes );
+        /** { n : <sampled>, sampleEvery : ..., micros : { "<=1" : n, ... }, chainLength : { ... } } */
+        void append( BSONObjBuilder& b ) const;
+    private:
+        static Histogram::Options options( uint32_t numBuckets );
+        long long _n;
+        Histogram _micros;
+        Histogram _probes;
+    };
+
     /* NamespaceDetailsTransient
 
        these are things we know / compute about a namespace that are transient -- things
@@ -423,6 +476,26 @@ namespace mongo {
     */
     // todo: multiple db's with the same name (repairDatbase) is not handled herein.  that may be 
     //       the way to go, if not used by repair, but need some sort of enforcement / asserts.
+    /**
+     * Wakes getMores on tailable awaitData cursors when a document is inserted into a capped
+     * collection, so they needn't poll.  An insert bumps the version; a getMore that found no data
+     * notes the version while still locked and then waits for it to change.
+     */
+    class CappedInsertNotifier : boost::noncopyable {
+    public:
+        CappedInsertNotifier() : _mutex( "CappedInsertNotifier" ), _version() { }
+        /** wake all waiters.  called by an inserter, under the write lock */
+        void notifyAll();
+        /** call under at least a read lock, so no insert can be missed before waitForInsert() */
+        unsigned long long getVersion() const;
+        /** wait up to millis for an insert after 'prev', from getVersion() */
+        void waitForInsert( unsigned long long prev, unsigned millis ) const;
+    private:
+        mutable mongo::mutex _mutex;
+        mutable boost::condition _notifier;
+        unsigned long long _version;
+    };
+
     class NamespaceDetailsTransient : boost::noncopyable {
         BOOST_STATIC_ASSERT( sizeof(NamespaceDetails) == 496 );
 
@@ -536,8 +609,13 @@ namespace mongo {
 
         /* query cache (for query optimizer) ------------------------------------- */
     private:
+        struct CachedPlanEntry {
+            CachedQueryPlan plan;
+            CachedPlanStats stats;
+        };
         int _qcWriteCount;
-        map<QueryPattern,CachedQueryPlan> _qcCache;
+        map<QueryPattern,CachedPlanEntry> _qcCache;
+        long long _qcDriftEvictions;
         static NamespaceDetailsTransient& make_inlock(const char *ns);
     public:
         static SimpleMutex _qcMutex;
@@ -556,24 +634,68 @@ namespace mongo {
             return get_inlock(ns);
         }
 
-        void clearQueryCache() {
-            _qcCache.clear();
-            _qcWriteCount = 0;
-        }
+        /** pinned plans are kept unless includePinned, as when the indexes change */
+        void clearQueryCache( bool includePinned = false );
         /* you must notify the cache if you are doing writes, as query plan utility will change */
         void notifyOfWriteOp() {
+            ++_writeVersion;
             if ( _qcCache.empty() )
                 return;
             if ( ++_qcWriteCount >= 100 )
                 clearQueryCache();
         }
         CachedQueryPlan cachedQueryPlanForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ];
+            map<QueryPattern,CachedPlanEntry>::const_iterator i = _qcCache.find( pattern );
+            return i == _qcCache.end() ? CachedQueryPlan() : i->second.plan;
         }
+        /** a pinned plan for the pattern is left as it is */
         void registerCachedQueryPlanForPattern( const QueryPattern &pattern,
-                                               const CachedQueryPlan &cachedQueryPlan ) {
-            _qcCache[ pattern ] = cachedQueryPlan;
-        }
+                                               const CachedQueryPlan &cachedQueryPlan );
+        /**
+         * note the cost of a query run with the index indexKey, intersected with the indexes of
+         * intersectKeys if any, if that is the plan cached for pattern.  a run far costlier than
+         * the plan's earlier ones evicts an unpinned plan, so the next query of the pattern races
+         * the candidate plans again.
+         */
+        void notePlanRun( const QueryPattern &pattern, const BSONObj &indexKey,
+                          const BSONObj &intersectKeys, long long nScanned, long long nReturned,
+                          long long micros );
+
+        /** cache cachedQueryPlan for pattern, pinned, in place of any cached plan */
+        void pinCachedQueryPlan( const QueryPattern &pattern, const CachedQueryPlan &cachedQueryPlan );
+        /** @return false if no plan is pinned for pattern */
+        bool unpinCachedQueryPlan( const QueryPattern &pattern );
+        /** drop the plan cached for pattern, pinned or not.  @return false if there was none */
+        bool clearCachedQueryPlan( const QueryPattern &pattern );
+        /** for the planCache command */
+        void appendPlanCache( BSONObjBuilder &b ) const;
+
+        /* query result cache ---------------------------------------------------- */
+    private:
+        unsigned long long _writeVersion;
+        QueryResultCache _resultCache;
+        static unsigned long long _nextEpoch;
+    public:
+        /** for writes the query optimizer doesn't track, as an update in place, which still change
+            query results */
+        void bumpWriteVersion() { ++_writeVersion; }
+        /** changes with every write to the namespace, under its write lock.  unique across
+            NamespaceDetailsTransient instances, so it also changes if the collection is dropped */
+        unsigned long long writeVersion() const { return _writeVersion; }
+        QueryResultCache& resultCache() { return _resultCache; }
+
+        /* record allocation stats -------------------------------------------- */
+    private:
+        AllocationStats _allocStats;
+    public:
+        AllocationStats& allocationStats() { return _allocStats; }
+
+        /* tailable cursor notification --------------------------------------- */
+    private:
+        shared_ptr<CappedInsertNotifier> _cappedInsertNotifier;
+    public:
+        /** a waiter keeps its own reference, as we go away on a drop while it is unlocked */
+        shared_ptr<CappedInsertNotifier> cappedInsertNotifier() const { return _cappedInsertNotifier; }
 
     }; /* NamespaceDetailsTransient */
 
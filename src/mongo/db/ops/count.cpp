@@ -21,10 +21,30 @@
 #include "../client.h"
 #include "../clientcursor.h"
 #include "../namespace.h"
+#include "../parallel_scan.h"
 #include "../queryutil.h"
 #include "mongo/client/dbclientinterface.h"
 
 namespace mongo {
+
+    /** counts the matches of a table scan, see ParallelCollectionScan */
+    class ParallelCount : public ParallelCollectionScan {
+    public:
+        ParallelCount( const char *ns, const BSONObj &query ) :
+            ParallelCollectionScan( ns, query ), _count() {
+        }
+        long long count() const { return _count; }
+    private:
+        class CountPart : public Part {
+        public:
+            CountPart() : n() { }
+            virtual void match( const DiskLoc &loc, const BSONObj &obj ) { ++n; }
+            long long n;
+        };
+        virtual Part* newPart() { return new CountPart(); }
+        virtual void merge( Part &part ) { _count += static_cast<CountPart&>( part ).n; }
+        long long _count;
+    };
     
     long long runCount( const char *ns, const BSONObj &cmd, string &err, int &errCode ) {
         Client::Context cx(ns);
@@ -48,13 +68,26 @@ namespace mongo {
             limit  = -limit;
         }
 
+        // with a limit we can usually stop early, which beats scanning everything in parallel
+        bool parallel = ( limit == 0 && ParallelCollectionScan::worthwhile( ns, d, query ) );
+
         bool simpleEqualityMatch = false;
-        shared_ptr<Cursor> cursor =
-        NamespaceDetailsTransient::getCursor( ns, query, BSONObj(), QueryPlanSelectionPolicy::any(),
-                                             &simpleEqualityMatch );
+        shared_ptr<Cursor> cursor;
+        if ( !parallel ) {
+            cursor = NamespaceDetailsTransient::getCursor( ns, query, BSONObj(),
+                                                           QueryPlanSelectionPolicy::any(),
+                                                           &simpleEqualityMatch );
+        }
         ClientCursor::Holder ccPointer;
         ElapsedTracker timeToStartYielding( 256, 20 );
         try {
+            if ( parallel ) {
+                ParallelCount scan( ns, query );
+                // if the collection is dropped while we yield, what we counted so far stands, as below
+                scan.run();
+                return applySkipLimit( scan.count(), cmd );
+            }
+
             while( cursor->ok() ) {
                 if ( !ccPointer ) {
                     if ( timeToStartYielding.intervalHasElapsed() ) {
@@ -350,9 +350,10 @@ namespace mongo {
     ReorderBuildStrategy* ReorderBuildStrategy::make( const ParsedQuery& parsedQuery,
                                                       const shared_ptr<Cursor>& cursor,
                                                       BufBuilder& buf,
-                                                      const QueryPlanSummary& queryPlan ) {
+                                                      const QueryPlanSummary& queryPlan,
+                                                      bool allowSpill ) {
         auto_ptr<ReorderBuildStrategy> ret( new ReorderBuildStrategy( parsedQuery, cursor, buf ) );
-        ret->init( queryPlan );
+        ret->init( queryPlan, allowSpill );
         return ret.release();
     }
 
@@ -363,8 +364,8 @@ namespace mongo {
     _bufferedMatches() {
     }
     
-    void ReorderBuildStrategy::init( const QueryPlanSummary &queryPlan ) {
-        _scanAndOrder.reset( newScanAndOrder( queryPlan ) );
+    void ReorderBuildStrategy::init( const QueryPlanSummary &queryPlan, bool allowSpill ) {
+        _scanAndOrder.reset( newScanAndOrder( queryPlan, allowSpill ) );
     }
 
     bool ReorderBuildStrategy::handleMatch( bool &orderedMatch, MatchDetails& details ) {
@@ -388,9 +389,14 @@ namespace mongo {
         _bufferedMatches = ret;
         return ret;
     }
+
+    shared_ptr<Cursor> ReorderBuildStrategy::sortedRemainder() const {
+        return _scanAndOrder->remaining();
+    }
     
     ScanAndOrder *
-    ReorderBuildStrategy::newScanAndOrder( const QueryPlanSummary &queryPlan ) const {
+    ReorderBuildStrategy::newScanAndOrder( const QueryPlanSummary &queryPlan,
+                                           bool allowSpill ) const {
         verify( !_parsedQuery.getOrder().isEmpty() );
         verify( _cursor->ok() );
         const FieldRangeSet *fieldRangeSet = 0;
@@ -405,7 +411,8 @@ namespace mongo {
         return new ScanAndOrder( _parsedQuery.getSkip(),
                                 _parsedQuery.getNumToReturn(),
                                 _parsedQuery.getOrder(),
-                                *fieldRangeSet );
+                                *fieldRangeSet,
+                                allowSpill );
     }
 
     HybridBuildStrategy* HybridBuildStrategy::make( const ParsedQuery& parsedQuery,
@@ -425,8 +432,9 @@ namespace mongo {
     }
 
     void HybridBuildStrategy::init() {
+        // no spilling: running out of memory is what tells us to fall back to the in order plan
         _reorderBuild.reset( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf,
-                                                         QueryPlanSummary() ) );
+                                                         QueryPlanSummary(), false ) );
     }
 
     bool HybridBuildStrategy::handleMatch( bool &orderedMatch, MatchDetails& details ) {
@@ -469,6 +477,10 @@ namespace mongo {
         return _reorderBuild->rewriteMatches();
     }
 
+    shared_ptr<Cursor> HybridBuildStrategy::sortedRemainder() const {
+        return _reorderedMatches ? _reorderBuild->sortedRemainder() : shared_ptr<Cursor>();
+    }
+
     int HybridBuildStrategy::bufferedMatches() const {
         return _reorderedMatches ?
                 _reorderBuild->bufferedMatches() :
@@ -563,6 +575,13 @@ namespace mongo {
         return _builder->bufferedMatches();
     }
 
+    shared_ptr<Cursor> QueryResponseBuilder::sortedRemainder() const {
+        if ( _parsedQuery.isExplain() || !_parsedQuery.wantMore() ) {
+            return shared_ptr<Cursor>();
+        }
+        return _builder->sortedRemainder();
+    }
+
     ShardChunkManagerPtr QueryResponseBuilder::newChunkManager() const {
         if ( !shardingState.needShardChunkManager( _parsedQuery.ns() ) ) {
             return ShardChunkManagerPtr();
@@ -609,7 +628,7 @@ namespace mongo {
         if ( singlePlan ||
             !queryOptimizerPlans.mayRunInOrderPlan() ) {
             return shared_ptr<ResponseBuildStrategy>
-            ( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf, queryPlan ) );
+            ( ReorderBuildStrategy::make( _parsedQuery, _cursor, _buf, queryPlan, true ) );
         }
         return shared_ptr<ResponseBuildStrategy>
         ( HybridBuildStrategy::make( _parsedQuery, _queryOptimizerCursor, _buf ) );
@@ -750,15 +769,27 @@ namespace mongo {
 
         int nReturned = queryResponseBuilder->handoff( result );
 
+        // sorted matches past the first batch are returned by getMore, like any cursor's
+        shared_ptr<Cursor> clientCursor = cursor;
+        shared_ptr<Cursor> sorted;
+        if ( cursor ) {
+            sorted = queryResponseBuilder->sortedRemainder();
+        }
+        if ( sorted ) {
+            verify( !saveClientCursor );
+            clientCursor = sorted;
+            saveClientCursor = true;
+        }
+
         ccPointer.reset();
         long long cursorid = 0;
         if ( saveClientCursor ) {
             // Create a new ClientCursor, with a default timeout.
-            ccPointer.reset( new ClientCursor( queryOptions, cursor, ns,
+            ccPointer.reset( new ClientCursor( queryOptions, clientCursor, ns,
                                               jsobj.getOwned() ) );
             cursorid = ccPointer->cursorid();
             DEV tlog(2) << "query has more, cursorid: " << cursorid << endl;
-            if ( cursor->supportYields() ) {
+            if ( clientCursor->supportYields() ) {
                 ClientCursor::YieldData data;
                 ccPointer->prepareToYield( data );
             }
@@ -797,6 +828,22 @@ namespace mongo {
         qr->startingFrom = 0;
         qr->nReturned = nReturned;
         
+        if ( cursor && !pq.isExplain() ) {
+            // The plan cache keeps statistics, and evicts plans that drift, by initial batches.
+            const QueryPlanSummary *plan = &queryPlan;
+            shared_ptr<QueryOptimizerCursor> qoc =
+                    dynamic_pointer_cast<QueryOptimizerCursor>( cursor );
+            if ( qoc ) {
+                plan = &qoc->completePlanSummary();
+            }
+            if ( plan->valid() ) {
+                // Lock waits are down to the other operations, not the plan, so a spike in lock
+                // contention shouldn't evict a good plan.
+                long long micros = curop.elapsedMicros() - curop.lockStat().getTotalTimeAcquiring();
+                plan->noteRun( cursor->nscanned(), nReturned, max( micros, 0LL ) );
+            }
+        }
+        
         int duration = curop.elapsedMillis();
         bool dbprofile = curop.shouldDBProfile( duration );
         if ( dbprofile || duration >= cmdLine.slowMS ) {
@@ -972,6 +1019,9 @@ namespace mongo {
         query = query.getOwned();
         order = order.getOwned();
 
+        // empty if the results aren't to be cached
+        const string cacheKey = QueryResultCache::key( pq, q.fields );
+
         bool hasRetried = false;
         scoped_ptr<PageFaultRetryableSection> pgfs;
         scoped_ptr<NoPageFaultsAllowed> npfe;
@@ -1001,6 +1051,20 @@ namespace mongo {
                 }
                 
                 
+                // A repeat of a query whose results haven't been written since.
+                unsigned long long writeVersion = 0;
+                if ( ! cacheKey.empty() ) {
+                    NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get( ns );
+                    writeVersion = nsdt.writeVersion();
+                    QueryResult *qr = nsdt.resultCache().find( cacheKey, writeVersion );
+                    if ( qr ) {
+                        result.setData( qr, true );
+                        curop.debug().responseLength = qr->len;
+                        curop.debug().nreturned = qr->nReturned;
+                        return "";
+                    }
+                }
+
                 // Run a regular query.
                 
                 BSONObj oldPlan;
@@ -1010,9 +1074,19 @@ namespace mongo {
                 }
              
    
-                return queryWithQueryOptimizer( queryOptions, ns, jsobj, curop, query, order,
-                                                pq_shared, oldPlan, shardingVersionAtStart, 
-                                                pgfs, npfe, result );
+                string exhaustNs = queryWithQueryOptimizer( queryOptions, ns, jsobj, curop, query, order,
+                                                            pq_shared, oldPlan, shardingVersionAtStart,
+                                                            pgfs, npfe, result );
+
+                if ( ! cacheKey.empty() && result.isSingleBuffer() ) {
+                    QueryResult *qr = (QueryResult *) result.header();
+                    NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get( ns );
+                    // not if there's a getMore to come, or a yield let in a write
+                    if ( qr->cursorId == 0 && nsdt.writeVersion() == writeVersion ) {
+                        nsdt.resultCache().add( cacheKey, writeVersion, qr );
+                    }
+                }
+                return exhaustNs;
             }
             catch ( PageFaultException& e ) {
                 e.touch();
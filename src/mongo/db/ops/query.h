@@ -145,6 +145,8 @@ namespace mongo {
          * @return number of matches written, or -1 if no op.
          */
         virtual int rewriteMatches() { return -1; }
+        /** @return the sorted matches rewriteMatches() had no room for, if any. */
+        virtual shared_ptr<Cursor> sortedRemainder() const { return shared_ptr<Cursor>(); }
         /** @return the number of matches that have been written to the buffer. */
         virtual int bufferedMatches() const = 0;
         /**
@@ -183,21 +185,27 @@ namespace mongo {
     /** Build strategy for a cursor returning out of order results. */
     class ReorderBuildStrategy : public ResponseBuildStrategy {
     public:
+        /**
+         * @param allowSpill if false, a sort exceeding ScanAndOrder::MaxScanAndOrderBytes fails
+         *     rather than continuing on disk, see ScanAndOrder.
+         */
         static ReorderBuildStrategy* make( const ParsedQuery& parsedQuery,
                                            const shared_ptr<Cursor>& cursor,
                                            BufBuilder& buf,
-                                           const QueryPlanSummary& queryPlan );
+                                           const QueryPlanSummary& queryPlan,
+                                           bool allowSpill );
         virtual bool handleMatch( bool &orderedMatch, MatchDetails& details );
         /** Handle a match without performing deduping. */
         void _handleMatchNoDedup();
         virtual int rewriteMatches();
+        virtual shared_ptr<Cursor> sortedRemainder() const;
         virtual int bufferedMatches() const { return _bufferedMatches; }
     private:
         ReorderBuildStrategy( const ParsedQuery& parsedQuery,
                               const shared_ptr<Cursor>& cursor,
                               BufBuilder& buf );
-        void init( const QueryPlanSummary& queryPlan );
-        ScanAndOrder *newScanAndOrder( const QueryPlanSummary &queryPlan ) const;
+        void init( const QueryPlanSummary& queryPlan, bool allowSpill );
+        ScanAndOrder *newScanAndOrder( const QueryPlanSummary &queryPlan, bool allowSpill ) const;
         shared_ptr<ScanAndOrder> _scanAndOrder;
         int _bufferedMatches;
     };
@@ -230,6 +238,7 @@ namespace mongo {
         void init();
         virtual bool handleMatch( bool &orderedMatch, MatchDetails &details );
         virtual int rewriteMatches();
+        virtual shared_ptr<Cursor> sortedRemainder() const;
         virtual int bufferedMatches() const;
         virtual void finishedFirstBatch();
         bool handleReorderMatch();
@@ -271,6 +280,11 @@ namespace mongo {
          * @return the number of results in the buffer.
          */
         int handoff( Message &result );
+        /**
+         * @return a cursor over the sorted matches that didn't fit in the first batch, for
+         * getMore; null if there are none.  call after handoff().
+         */
+        shared_ptr<Cursor> sortedRemainder() const;
         /** A chunk manager found at the beginning of the query. */
         ShardChunkManagerPtr chunkManager() const { return _chunkManager; }
 
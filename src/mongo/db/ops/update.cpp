@@ -87,8 +87,11 @@ namespace mongo {
             const BSONObj& onDisk = loc.obj();
             auto_ptr<ModSetState> mss = mods->prepare( onDisk );
 
-            if( mss->canApplyInPlace() ) {
+            // a compressed record's onDisk is an uncompressed copy, so it can't be modified in place
+            if( !r->compressed() && mss->canApplyInPlace() ) {
                 mss->applyModsInPlace(true);
+                verify(nsdt);
+                nsdt->bumpWriteVersion();
                 DEBUGUPDATE( "\t\t\t updateById doing in place update" );
             }
             else {
@@ -347,7 +350,9 @@ namespace mongo {
 
                     auto_ptr<ModSetState> mss = useMods->prepare( onDisk );
 
-                    bool willAdvanceCursor = multi && c->ok() && ( modsIsIndexed || ! mss->canApplyInPlace() );
+                    // a compressed record's onDisk is an uncompressed copy, so it can't be modified in place
+                    bool inPlace = !r->compressed() && mss->canApplyInPlace();
+                    bool willAdvanceCursor = multi && c->ok() && ( modsIsIndexed || ! inPlace );
 
                     if ( willAdvanceCursor ) {
                         if ( cc.get() ) {
@@ -356,8 +361,9 @@ namespace mongo {
                         c->prepareToTouchEarlierIterate();
                     }
 
-                    if ( modsIsIndexed <= 0 && mss->canApplyInPlace() ) {
+                    if ( modsIsIndexed <= 0 && inPlace ) {
                         mss->applyModsInPlace( true );// const_cast<BSONObj&>(onDisk) );
+                        nsdt->bumpWriteVersion();
 
                         DEBUGUPDATE( "\t\t\t doing in place update" );
                         if ( profile && !multi )
@@ -439,6 +445,11 @@ namespace mongo {
             return UpdateResult( 1 , 1 , numModded , BSONObj() );
 
         if ( upsert ) {
+            // recreating a collection dropped while we yielded is a catalog change, which a writer
+            // holding only the collection's lock (see Lock::DBWrite) can't make
+            uassert( UpsertNeedsDatabaseLockAssertionCode,
+                     str::stream() << "collection dropped during upsert: " << ns,
+                     nsdetails(ns) || !client.lockState().otherIntent() );
             if ( updateobj.firstElementFieldName()[0] == '$' ) {
                 // upsert of an $operation. build a default object
                 BSONObj newObj = mods->createNewFromQuery( patternOrig );
@@ -26,6 +26,10 @@ namespace mongo {
 
     // ---------- public -------------
 
+    /** an upsert found its collection dropped (while it yielded) holding only the collection's
+        lock; nothing was written, retry it under the database's write lock */
+    static const int UpsertNeedsDatabaseLockAssertionCode = 16435;
+
     struct UpdateResult {
         const bool existing; // if existing objects were modified
         const bool mod;      // was this a $ mod
@@ -0,0 +1,388 @@
+// @file parallel_scan.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/parallel_scan.h"
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/db/client.h"
+#include "mongo/db/clientcursor.h"
+#include "mongo/db/cmdline.h"
+#include "mongo/db/curop-inl.h"
+#include "mongo/db/namespace_details.h"
+#include "mongo/db/pdfile.h"
+#include "mongo/db/queryutil.h"
+#include "mongo/util/concurrency/thread_pool.h"
+#include "mongo/util/processinfo.h"
+
+namespace mongo {
+
+    int parallelScanThreads = 0;
+    long long parallelScanMinBytes = 64 * 1024 * 1024;
+
+    /** the most threads a scan runs on, and the size of the pool they come from */
+    static const int MaxScanThreads = 16;
+
+    /** @return how many threads to scan with; 1 means don't */
+    static int scanThreads() {
+        if ( parallelScanThreads > 0 )
+            return std::min( parallelScanThreads, MaxScanThreads );
+        int cores = ProcessInfo().getNumCores();
+        return std::min( cores, MaxScanThreads );
+    }
+
+    /** the workers of every scan, each with a Client of its own.  never destroyed, like the journal's */
+    static ThreadPool& scanWorkers() {
+        static ThreadPool *pool = new ThreadPool( MaxScanThreads );
+        return *pool;
+    }
+
+    bool ParallelCollectionScan::worthwhile( const char *ns, NamespaceDetails *d,
+                                             const BSONObj &query ) {
+        if ( !d || scanThreads() < 2 || cmdLine.noTableScan || d->isCapped() )
+            return false;
+        if ( d->stats.datasize < parallelScanMinBytes || d->firstExtent == d->lastExtent )
+            return false;
+        // $or clauses each get their own plan, possibly indexed
+        if ( query.hasField( "$or" ) )
+            return false;
+
+        FieldRangeSet frs( ns, query, true, true );
+        if ( !frs.matchPossible() || !frs.getSpecial().empty() )
+            return false;
+        // as the optimizer would: an index on a field the query constrains is a candidate plan
+        NamespaceDetails::IndexIterator i = d->ii();
+        while ( i.more() ) {
+            const char *field = i.next().keyPattern().firstElementFieldName();
+            if ( !frs.range( field ).universal() )
+                return false;
+        }
+
+        Matcher m( query );
+        return !m.usesWhere();
+    }
+
+    ParallelCollectionScan::ParallelCollectionScan( const char *ns, const BSONObj &query ) :
+        _ns( ns ),
+        _matcher( query ),
+        _threads( scanThreads() ),
+        _nscanned(),
+        _mutex( "ParallelCollectionScan" ),
+        _running(),
+        _failed() {
+    }
+
+    bool ParallelCollectionScan::run() {
+        if ( !nsdetails( _ns.c_str() ) )
+            return true;
+        vector<Record*> faults;
+        while ( round( &faults ) ) {
+            if ( !_yield( faults ) )
+                return false;
+            faults.clear();
+        }
+        return true;
+    }
+
+    bool ParallelCollectionScan::round( vector<Record*> *faults ) {
+        NamespaceDetails *d = nsdetails( _ns.c_str() );
+        verify( d );
+        while ( (int) _window.size() < _threads ) {
+            DiskLoc x = _lastExtent.isNull() ? d->firstExtent : _lastExtent.ext()->xnext;
+            if ( x.isNull() )
+                break;
+            _lastExtent = x;
+            Extent *e = x.ext();
+            if ( e->firstRecord.isNull() )
+                continue;
+            Pending p;
+            p.extent = x;
+            p.next = e->firstRecord;
+            _window.push_back( p );
+        }
+        if ( _window.empty() )
+            return false;
+
+        long long buffered = 0;
+        for ( unsigned i = 1; i < _window.size(); i++ )
+            for ( unsigned j = 0; j < _window[i].parts.size(); j++ )
+                buffered += _window[i].parts[j]->bytes;
+
+        vector<Claim> claims;
+        for ( unsigned i = 0; i < _window.size(); i++ ) {
+            Pending &p = _window[i];
+            if ( i > 0 && buffered > MaxBufferedBytes )
+                break;
+            if ( p.next.isNull() )
+                continue;
+            Claim c;
+            c.extent = p.extent.ext();
+            c.pending = i;
+            c.start = p.next;
+            c.mayStop = ( p.next != p.touched );
+            c.fault = 0;
+            c.part = newPart();
+            p.parts.push_back( shared_ptr<Part>( c.part ) );
+            claims.push_back( c );
+        }
+
+        _next.zero();
+        _failed = false;
+        {
+            int n = std::min( _threads, (int) claims.size() );
+            scoped_lock lk( _mutex );
+            _running = n;
+            for ( int i = 0; i < n; i++ )
+                scanWorkers().schedule( &ParallelCollectionScan::_work, this, &claims, faults != 0 );
+            while ( _running )
+                _done.wait( lk.boost() );
+        }
+        if ( _failed ) {
+            if ( _errorCode )
+                uasserted( _errorCode, _errorMessage );
+            msgasserted( 16429, _errorMessage );
+        }
+
+        for ( unsigned i = 0; i < claims.size(); i++ ) {
+            Pending &p = _window[ claims[i].pending ];
+            p.next = claims[i].end;
+            if ( claims[i].fault ) {
+                p.touched = p.next;
+                faults->push_back( claims[i].fault );
+            }
+        }
+
+        // the first extent's parts are next in order; once it is done, so are the next one's
+        while ( !_window.empty() ) {
+            Pending &p = _window.front();
+            for ( unsigned i = 0; i < p.parts.size(); i++ ) {
+                Part &part = *p.parts[i];
+                _nscanned += part.nscanned;
+                if ( !part.last.isNull() )
+                    _lastMerged = part.last;
+                merge( part );
+            }
+            p.parts.clear();
+            if ( !p.next.isNull() )
+                break;
+            _window.pop_front();
+        }
+        return true;
+    }
+
+    void ParallelCollectionScan::restartAfter( const DiskLoc &loc ) {
+        Record *r = loc.rec();
+        _window.clear();
+        _lastExtent = DiskLoc( loc.a(), r->extentOfs() );
+        _lastMerged = loc;
+        Pending p;
+        p.extent = _lastExtent;
+        p.next = r->nextInExtent( loc );
+        if ( !p.next.isNull() )
+            _window.push_back( p );
+    }
+
+    bool ParallelCollectionScan::_yield( const vector<Record*> &faults ) {
+        int micros = ClientCursor::suggestYieldMicros();
+        if ( micros <= 0 && faults.empty() ) {
+            killCurrentOp.checkForInterrupt();
+            return true;
+        }
+
+        // deletes while we're unlocked move each extent's cursor on past the record we resume at
+        vector< shared_ptr<Cursor> > cursors;
+        vector< shared_ptr<ClientCursor::Holder> > holders;
+        vector<ClientCursor::YieldData> data( _window.size() );
+        for ( unsigned i = 0; i < _window.size(); i++ ) {
+            shared_ptr<Cursor> c( new BasicCursor( _window[i].next ) );
+            cursors.push_back( c );
+            if ( _window[i].next.isNull() )
+                continue;
+            ClientCursor *cc = new ClientCursor( QueryOption_NoCursorTimeout, c, _ns );
+            holders.push_back( shared_ptr<ClientCursor::Holder>( new ClientCursor::Holder( cc ) ) );
+            cc->prepareToYield( data[i] );
+        }
+
+        if ( faults.empty() )
+            ClientCursor::staticYield( micros, _ns, 0 );
+        for ( unsigned i = 0; i < faults.size(); i++ )
+            ClientCursor::staticYield( i == 0 ? micros : 0, _ns, faults[i] );
+
+        for ( unsigned i = 0; i < _window.size(); i++ ) {
+            if ( !_window[i].next.isNull() && !ClientCursor::recoverFromYield( data[i] ) )
+                return false;
+        }
+        killCurrentOp.checkForInterrupt();
+        if ( !nsdetails( _ns.c_str() ) )
+            return false;
+
+        for ( unsigned i = 0; i < _window.size(); i++ ) {
+            Pending &p = _window[i];
+            if ( p.next.isNull() )
+                continue;
+            DiskLoc loc = cursors[i]->ok() ? cursors[i]->currLoc() : DiskLoc();
+            // moved on into the next extent means this one is done
+            if ( !loc.isNull() && DiskLoc( loc.a(), loc.rec()->extentOfs() ) != p.extent )
+                loc = DiskLoc();
+            if ( loc != p.next )
+                p.touched = DiskLoc();
+            p.next = loc;
+        }
+        return true;
+    }
+
+    void ParallelCollectionScan::_work( vector<Claim> *claims, bool faults ) {
+        // records not in memory look at cc() to count the fault; we never take locks
+        if ( !haveClient() )
+            Client::initThread( "parallelScan" );
+        try {
+            for ( unsigned i = _next++; i < claims->size() && !_failed; i = _next++ )
+                _scan( (*claims)[i], faults );
+        }
+        catch ( DBException &e ) {
+            scoped_lock lk( _mutex );
+            if ( !_failed ) {
+                _errorCode = e.getCode();
+                _errorMessage = e.what();
+                _failed = true;
+            }
+        }
+        catch ( std::exception &e ) {
+            scoped_lock lk( _mutex );
+            if ( !_failed ) {
+                _errorCode = 0;
+                _errorMessage = e.what();
+                _failed = true;
+            }
+        }
+        scoped_lock lk( _mutex );
+        if ( --_running == 0 )
+            _done.notify_one();
+    }
+
+    void ParallelCollectionScan::_scan( Claim &claim, bool faults ) {
+        Part &part = *claim.part;
+        int n = 0;
+        int bytes = 0;
+        DiskLoc loc = claim.start;
+        while ( !loc.isNull() && n < ChunkRecords && bytes < ChunkBytes ) {
+            Record *r = claim.extent->getRecord( loc );
+            if ( faults && ( n > 0 || claim.mayStop ) && !r->likelyInPhysicalMemory() ) {
+                claim.fault = r;
+                break;
+            }
+            BSONObj o = BSONObj::make( r );
+            ++n;
+            bytes += r->netLength();
+            ++part.nscanned;
+            part.last = loc;
+            if ( _matcher.matches( o ) )
+                part.match( loc, o );
+            loc = r->nextInExtent( loc );
+        }
+        claim.end = loc;
+    }
+
+    ParallelScanCursor::ParallelScanCursor( const char *ns, const BSONObj &query ) :
+        _i(),
+        _noMatch(),
+        _serial(),
+        _resume(),
+        _nscanned(),
+        _scan( ns, query, _matches ) {
+        _nextRound();
+    }
+
+    bool ParallelScanCursor::advance() {
+        if ( !ok() )
+            return false;
+        if ( _resume ) {
+            // the current record is still there: a delete would have advanced us past it
+            _resume = false;
+            DiskLoc loc = currLoc();
+            loc = loc.rec()->getNext( loc );
+            _matches.clear();
+            _i = 0;
+            _noMatch = false;
+            if ( loc.isNull() )
+                return false;
+            Match m;
+            m.loc = loc;
+            m.obj = loc.obj().getOwned();
+            _matches.push_back( m );
+            _serial = true;
+            ++_nscanned;
+            _scan.restartAfter( loc );
+            return true;
+        }
+        _serial = false;
+        if ( ++_i < _matches.size() )
+            return true;
+        _nextRound();
+        return ok();
+    }
+
+    void ParallelScanCursor::_nextRound() {
+        _matches.clear();
+        _i = 0;
+        _noMatch = false;
+        if ( !_scan.round( 0 ) || !_matches.empty() )
+            return;
+        Match m;
+        m.loc = _scan.lastMerged();
+        m.obj = m.loc.obj().getOwned();
+        _matches.push_back( m );
+        _noMatch = true;
+    }
+
+    void ParallelScanCursor::prepareToYield() {
+        // the window's extents are only positioned by records we don't hold
+        if ( ok() ) {
+            _matches.resize( _i + 1 );
+            _resume = true;
+        }
+    }
+
+    bool ParallelScanCursor::currentMatches( MatchDetails *details ) {
+        if ( _noMatch )
+            return false;
+        if ( details ) {
+            details->resetOutput();
+            details->setLoadedRecord( true );
+        }
+        // a positional projection needs the array match, which we find again
+        if ( _serial || ( details && details->needRecord() ) )
+            return _scan.matcher().matches( current(), details );
+        return true;
+    }
+
+    void ParallelScanCursor::Scan::FindPart::match( const DiskLoc &loc, const BSONObj &obj ) {
+        Match m;
+        m.loc = loc;
+        m.obj = obj.getOwned();
+        bytes += m.obj.objsize();
+        matches.push_back( m );
+    }
+
+    void ParallelScanCursor::Scan::merge( Part &part ) {
+        vector<Match> &m = static_cast<FindPart&>( part ).matches;
+        _matches.insert( _matches.end(), m.begin(), m.end() );
+    }
+
+} // namespace mongo
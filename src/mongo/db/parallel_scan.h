@@ -0,0 +1,228 @@
+// @file parallel_scan.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <deque>
+
+#include "mongo/db/cursor.h"
+#include "mongo/db/diskloc.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/matcher.h"
+
+namespace mongo {
+
+    class Extent;
+    class NamespaceDetails;
+    class Record;
+
+    /**
+     * 0 for one thread per core, 1 to never scan in parallel, at most 16.  setParameter
+     * parallelScanThreads
+     */
+    extern int parallelScanThreads;
+    /** collections with less data than this are scanned the usual way.  setParameter parallelScanMinBytes */
+    extern long long parallelScanMinBytes;
+
+    /**
+     * A table scan that runs the matcher on several threads at once.  The extents being scanned
+     * form a window; each round, every extent in it gets a worker that scans a bounded range of
+     * its records, picking up where the last round stopped.  The caller's read lock covers the
+     * round, and the workers take no locks of their own.  The results for each range are merged
+     * on the calling thread in record order, so a subclass sees them as a sequential scan would.
+     * After every round run() checks for interrupts and yields like any other cursor, faulting
+     * in outside the lock the records a worker stopped at because they weren't in memory.
+     *
+     * For whole collection operations whose result doesn't depend on seeing matches one at a time
+     * in order - count, distinct - and, a round at a time, ParallelScanCursor.
+     */
+    class ParallelCollectionScan : boost::noncopyable {
+    public:
+        /** what a worker finds in one range of an extent */
+        class Part : boost::noncopyable {
+        public:
+            Part() : nscanned(), bytes() { }
+            virtual ~Part() { }
+            /** called on a worker thread for each match, in record order */
+            virtual void match( const DiskLoc &loc, const BSONObj &obj ) = 0;
+            long long nscanned;
+            long long bytes;       // held by the part until it is merged, see MaxBufferedBytes
+            DiskLoc last;          // the last record scanned
+        };
+
+        /** a worker's range ends after this many records, or this many bytes of them */
+        static const int ChunkRecords = 1000;
+        static const int ChunkBytes = 1024 * 1024;
+        /**
+         * parts of extents after the first in the window wait for it to be merged.  while they
+         * hold more than this, only the first extent is scanned.
+         */
+        static const long long MaxBufferedBytes = 32 * 1024 * 1024;
+
+        /**
+         * @return true if a table scan is the only plan for query, and the collection is big
+         * enough for a parallel scan to be worth it.  We leave anything the optimizer might use
+         * an index for, or that can't be matched off the calling thread ($where), to it.
+         */
+        static bool worthwhile( const char *ns, NamespaceDetails *d, const BSONObj &query );
+
+        ParallelCollectionScan( const char *ns, const BSONObj &query );
+        virtual ~ParallelCollectionScan() { }
+
+        /**
+         * scan the collection, calling merge() for each Part.
+         * @return false if the collection went away while we yielded.
+         */
+        bool run();
+
+        long long nscanned() const { return _nscanned; }
+        int threads() const { return _threads; }
+        const Matcher& matcher() const { return _matcher; }
+
+    protected:
+        /** called on the calling thread before each range is scanned */
+        virtual Part* newPart() = 0;
+        /** called on the calling thread for each Part, in record order */
+        virtual void merge( Part& part ) = 0;
+
+        /**
+         * scan a range of each extent in the window, and merge the parts that are next in order.
+         * @param faults if set, workers stop at records that aren't in memory and add them here;
+         * the caller touches them before the next round.
+         * @return false if there was nothing left to scan.
+         */
+        bool round( vector<Record*> *faults );
+        /**
+         * forget the window, and go on with the record after loc the next round.  loc must not
+         * have been deleted since it was scanned.
+         */
+        void restartAfter( const DiskLoc &loc );
+        /** the last record covered by the parts merged so far */
+        DiskLoc lastMerged() const { return _lastMerged; }
+
+    private:
+        /** an extent of the window */
+        struct Pending {
+            DiskLoc extent;
+            DiskLoc next;          // the next record to scan, null when the extent is done
+            DiskLoc touched;       // a record faulted in for us, which we don't stop at again
+            vector< shared_ptr<Part> > parts;
+        };
+        struct Claim {
+            Extent *extent;
+            unsigned pending;      // in _window
+            DiskLoc start;
+            bool mayStop;          // may stop at start if it isn't in memory
+            DiskLoc end;           // where the worker stopped
+            Record *fault;
+            Part *part;
+        };
+
+        void _work( vector<Claim> *claims, bool faults );
+        void _scan( Claim &claim, bool faults );
+        /** let writers in, touching faults while unlocked.  @return false if the collection went away */
+        bool _yield( const vector<Record*> &faults );
+
+        string _ns;
+        Matcher _matcher;
+        int _threads;
+        long long _nscanned;
+
+        deque<Pending> _window;
+        DiskLoc _lastExtent;       // the last extent that entered the window
+        DiskLoc _lastMerged;
+
+        // per round
+        AtomicUInt _next;
+        mongo::mutex _mutex;
+        boost::condition _done;
+        int _running;              // workers yet to finish the round
+        volatile bool _failed;
+        int _errorCode;
+        string _errorMessage;
+    };
+
+    /**
+     * An unindexed, unsorted find over a ParallelCollectionScan, one round per advance() once
+     * the matches of the last are used up.  Matches are copies, so like a ScanAndOrderCursor
+     * this yields without following writes to the documents it holds; a round that finds none
+     * leaves the cursor at its last record, which doesn't match, so the caller can yield between
+     * rounds.  What has been scanned past the current record is thrown away when we yield.  The
+     * next advance() steps to the following record as a BasicCursor would, matching it itself -
+     * that may be a delete moving us off the current one, which shouldn't wait on a round - and
+     * the scan picks up after it.
+     */
+    class ParallelScanCursor : public Cursor {
+    public:
+        ParallelScanCursor( const char *ns, const BSONObj &query );
+        virtual bool ok() { return _i < _matches.size(); }
+        virtual Record* _current() { verify( false ); return 0; }
+        virtual BSONObj current() { return _matches[ _i ].obj; }
+        virtual DiskLoc currLoc() { return ok() ? _matches[ _i ].loc : DiskLoc(); }
+        virtual DiskLoc refLoc() { return currLoc(); }
+        virtual bool advance();
+        virtual bool supportGetMore() { return true; }
+        virtual bool supportYields() { return true; }
+        virtual void prepareToYield();
+        virtual void recoverFromYield() { }
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual bool isMultiKey() const { return false; }
+        virtual bool modifiedKeys() const { return false; }
+        virtual long long nscanned() { return _scan.nscanned() + _nscanned; }
+        virtual bool currentMatches( MatchDetails *details = 0 );
+        virtual CoveredIndexMatcher *matcher() const { return _coveredMatcher.get(); }
+        virtual shared_ptr< CoveredIndexMatcher > matcherPtr() const { return _coveredMatcher; }
+        virtual void setMatcher( shared_ptr< CoveredIndexMatcher > matcher ) { _coveredMatcher = matcher; }
+        virtual string toString() { return "ParallelScanCursor"; }
+    private:
+        struct Match {
+            DiskLoc loc;
+            BSONObj obj;
+        };
+        class Scan : public ParallelCollectionScan {
+        public:
+            Scan( const char *ns, const BSONObj &query, vector<Match> &matches ) :
+                ParallelCollectionScan( ns, query ), _matches( matches ) { }
+            using ParallelCollectionScan::round;
+            using ParallelCollectionScan::restartAfter;
+            using ParallelCollectionScan::lastMerged;
+        private:
+            class FindPart : public Part {
+            public:
+                virtual void match( const DiskLoc &loc, const BSONObj &obj );
+                vector<Match> matches;
+            };
+            virtual Part* newPart() { return new FindPart(); }
+            virtual void merge( Part &part );
+            vector<Match> &_matches;
+        };
+
+        /** run a round, stopping at its first match or, if it has none, its last record */
+        void _nextRound();
+
+        vector<Match> _matches;
+        unsigned _i;
+        bool _noMatch;             // the current record is where a round without matches stopped
+        bool _serial;              // the current record is matched here, not by the scan
+        bool _resume;              // we yielded, and the scan must restart after the current record
+        long long _nscanned;       // records we matched ourselves
+        Scan _scan;
+        shared_ptr< CoveredIndexMatcher > _coveredMatcher;
+    };
+
+} // namespace mongo
@@ -49,6 +49,7 @@ _ disallow system* manipulations from the database.
 #include "memconcept.h"
 #include "mongo/db/lasterror.h"
 #include "mongo/db/index_update.h"
+#include "mongo/db/record_compression.h"
 
 #include <boost/filesystem/operations.hpp>
 
@@ -945,6 +946,7 @@ namespace mongo {
         log(1) << "\t dropIndexes done" << endl;
         result.append("ns", name.c_str());
         ClientCursor::invalidate(name.c_str());
+        cc().database()->dropCursorsByLoc( name );
         Top::global.collectionDropped( name );
         NamespaceDetailsTransient::eraseForPrefix( name.c_str() );
         dropNS(name);
@@ -987,6 +989,14 @@ namespace mongo {
                 s->nrecords--;
             }
 
+            // only collection records can be compressed: a btree bucket may start with a
+            // negative int too
+            if ( !strchr( ns, '$' ) && todelete->compressed() ) {
+                const CompressedRecordHeader *h = (const CompressedRecordHeader *) todelete->data();
+                d->noteCompressedRecord( -h->negLen, h->objsize, -1 );
+                compressedRecordWritten( todelete );
+            }
+
             if ( strstr(ns, ".system.indexes") ) {
                 /* temp: if in system.indexes, don't reuse, and zero out: we want to be
                    careful until validated more, as IndexDetails has pointers
@@ -1025,7 +1035,7 @@ namespace mongo {
         }
 
         /* check if any cursors point to us.  if so, advance them. */
-        ClientCursor::aboutToDelete(dl);
+        ClientCursor::aboutToDelete(ns, dl);
 
         unindexRecord(d, todelete, dl, noWarn);
 
@@ -1076,7 +1086,12 @@ namespace mongo {
         uassert( 13596 , str::stream() << "cannot change _id of a document old:" << objOld << " new:" << objNew , ! changedId );
         dupCheck(changes, *d, dl);
 
-        if ( toupdate->netLength() < objNew.objsize() ) {
+        string packed;
+        if ( d->isUserFlagSet( NamespaceDetails::Flag_CompressRecords ) && !d->isCapped() )
+            compressRecordData( objNew, &packed );
+        const int storedLen = packed.empty() ? objNew.objsize() : (int) packed.size();
+
+        if ( toupdate->netLength() < storedLen ) {
             // doesn't fit.  reallocate -----------------------------------------------------
             uassert( 10003 , "failing update: objects in a capped ns cannot grow", !(d && d->isCapped()));
             d->paddingTooSmall();
@@ -1136,6 +1151,17 @@ namespace mongo {
         }
 
         //  update in place
+        if ( toupdate->compressed() ) {
+            const CompressedRecordHeader *h = (const CompressedRecordHeader *) toupdate->data();
+            d->noteCompressedRecord( -h->negLen, h->objsize, -1 );
+            compressedRecordWritten( toupdate );
+        }
+        if ( !packed.empty() ) {
+            d->noteCompressedRecord( storedLen, objNew.objsize(), 1 );
+            compressedRecordWritten( toupdate );
+            memcpy(getDur().writingPtr(toupdate->data(), storedLen), packed.data(), storedLen);
+            return dl;
+        }
         int sz = objNew.objsize();
         memcpy(getDur().writingPtr(toupdate->data(), sz), objNew.objdata(), sz);
         return dl;
@@ -1447,6 +1473,26 @@ namespace mongo {
             BSONElementManipulator::lookForTimestamps( io );
         }
 
+        /* for a compressed record obuf/len become the stored bytes; 'uncompressed' is what we index */
+        string packed;
+        BSONObj uncompressed;
+        if( !god && !addIndex && !d->isCapped() &&
+            d->isUserFlagSet( NamespaceDetails::Flag_CompressRecords ) ) {
+            BSONObj o((const char *) obuf);
+            if( addID ) {
+                BSONObjBuilder b;
+                b.append( idToInsert );
+                b.appendElements( o );
+                o = b.obj();
+            }
+            if( compressRecordData( o, &packed ) ) {
+                uncompressed = o;
+                obuf = packed.data();
+                len = packed.size();
+                addID = 0;
+            }
+        }
+
         int lenWHdr = d->getRecordAllocationSize( len + Record::HeaderSize );
 
         // If the collection is capped, check if the new object will violate a unique index
@@ -1480,7 +1526,7 @@ namespace mongo {
             // add record to indexes using two step method so we can do the reading outside a write lock
             if ( d->nIndexes ) {
                 verify( obuf );
-                BSONObj obj((const char *) obuf);
+                BSONObj obj = packed.empty() ? BSONObj((const char *) obuf) : uncompressed;
                 try {
                     indexRecordUsingTwoSteps(ns, d, obj, loc, true);
                 }
@@ -1521,9 +1567,22 @@ namespace mongo {
             s->nrecords++;
         }
 
+        if ( !packed.empty() ) {
+            d->noteCompressedRecord( len, uncompressed.objsize(), 1 );
+            compressedRecordWritten( r );
+        }
+
         // we don't bother resetting query optimizer stats for the god tables - also god is true when adding a btree bucket
-        if ( !god )
-            NamespaceDetailsTransient::get( ns ).notifyOfWriteOp();
+        if ( !god || !strchr( ns, '$' ) ) {
+            NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get( ns );
+            if ( !god )
+                nsdt.notifyOfWriteOp();
+            else
+                nsdt.bumpWriteVersion();
+            // tailers waiting for data (system.profile is inserted into as god)
+            if ( d->isCapped() )
+                nsdt.cappedInsertNotifier()->notifyAll();
+        }
 
         if ( tableToIndex ) {
             insert_makeIndex(tableToIndex, tabletoidxns, loc);
@@ -1532,7 +1591,7 @@ namespace mongo {
         /* add this record to our indexes */
         if ( !earlyIndex && d->nIndexes ) {
             try {
-                BSONObj obj(r->data());
+                BSONObj obj = packed.empty() ? BSONObj(r->data()) : uncompressed;
                 // not sure which of these is better -- either can be used.  oldIndexRecord may be faster, 
                 // but twosteps handles dup key errors more efficiently.
                 //oldIndexRecord(d, obj, loc);
@@ -1627,7 +1686,7 @@ namespace mongo {
 
     void dropDatabase(string db) {
         log(1) << "dropDatabase " << db << endl;
-        Lock::assertWriteLocked(db);
+        Lock::assertCatalogWriteLocked(db);
         Database *d = cc().database();
         verify( d );
         verify( d->name == db );
@@ -228,6 +228,13 @@ namespace mongo {
 
         int netLength() const { _accessing(); return _netLength(); }
 
+        /**
+         * @return true if data() is a CompressedRecordHeader rather than a BSONObj, see
+         * record_compression.h.  only meaningful for records of a collection: index buckets and
+         * other $ namespaces can start with a negative int.
+         */
+        bool compressed() const { _accessing(); return *reinterpret_cast<const int*>( _data ) < 0; }
+
         /* use this when a record is deleted. basically a union with next/prev fields */
         DeletedRecord& asDeleted() { return *((DeletedRecord*) this); }
 
@@ -611,7 +618,11 @@ namespace mongo {
 
     void ensureHaveIdIndex(const char *ns);
 
+    BSONObj uncompressRecord( const Record* r );
+
     inline BSONObj BSONObj::make(const Record* r ) {
+        if ( r->compressed() )
+            return uncompressRecord( r );
         return BSONObj( r->data() );
     }
     
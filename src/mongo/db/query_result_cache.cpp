@@ -0,0 +1,169 @@
+// @file query_result_cache.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/query_result_cache.h"
+
+#include "mongo/client/dbclientinterface.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/db/queryutil.h"
+#include "mongo/s/d_logic.h"
+
+namespace mongo {
+
+    long long queryResultCacheBytes = 0;
+
+    SimpleMutex QueryResultCache::_mutex( "QueryResultCache" );
+    QueryResultCache::LRU QueryResultCache::_lru;
+    long long QueryResultCache::_bytes = 0;
+    long long QueryResultCache::_hits = 0;
+    long long QueryResultCache::_misses = 0;
+    long long QueryResultCache::_evictions = 0;
+
+    /** @return true if query has a $where at any depth */
+    static bool hasWhere( const BSONObj &query ) {
+        BSONObjIterator i( query );
+        while ( i.more() ) {
+            BSONElement e = i.next();
+            if ( str::equals( e.fieldName(), "$where" ) )
+                return true;
+            if ( e.isABSONObj() && hasWhere( e.embeddedObject() ) )
+                return true;
+        }
+        return false;
+    }
+
+    string QueryResultCache::key( const ParsedQuery &pq, const BSONObj &fields ) {
+        if ( queryResultCacheBytes <= 0 )
+            return "";
+        // answered from a cursor, or depend on where it is
+        if ( pq.isExplain() || pq.showDiskLoc() ||
+             pq.hasOption( QueryOption_CursorTailable | QueryOption_OplogReplay |
+                           QueryOption_AwaitData | QueryOption_Exhaust ) )
+            return "";
+        // written without bumping a write version: the oplog, system.profile
+        if ( pq.isLocalDB() || str::contains( pq.ns(), ".system." ) )
+            return "";
+        // depend on chunk ownership, or on javascript
+        if ( shardingState.needShardChunkManager( pq.ns() ) || hasWhere( pq.getFilter() ) )
+            return "";
+
+        BSONObjBuilder b;
+        b.append( "q", pq.getFilter() );
+        b.append( "o", pq.getOrder() );
+        b.append( "p", fields );
+        b.append( "h", pq.getHint() );
+        b.append( "min", pq.getMin() );
+        b.append( "max", pq.getMax() );
+        b.append( "s", pq.getSkip() );
+        b.append( "n", pq.getNumToReturn() );
+        b.append( "w", pq.wantMore() );
+        b.append( "m", pq.getMaxScan() );
+        b.append( "k", pq.returnKey() );
+        b.append( "x", pq.isSnapshot() );
+        BSONObj k = b.done();
+        return string( k.objdata(), k.objsize() );
+    }
+
+    QueryResult* QueryResultCache::find( const string &key, unsigned long long writeVersion ) {
+        SimpleMutex::scoped_lock lk( _mutex );
+        map<string, LRU::iterator>::iterator i = _entries.find( key );
+        if ( i == _entries.end() ) {
+            _misses++;
+            return 0;
+        }
+        LRU::iterator e = i->second;
+        if ( e->writeVersion != writeVersion ) {
+            _erase_inlock( e );
+            _misses++;
+            return 0;
+        }
+        _lru.splice( _lru.begin(), _lru, e );
+        _hits++;
+        QueryResult *qr = (QueryResult *) malloc( e->reply.size() );
+        memcpy( (void *) qr, e->reply.data(), e->reply.size() );
+        return qr;
+    }
+
+    void QueryResultCache::add( const string &key, unsigned long long writeVersion,
+                                const QueryResult *reply ) {
+        // one reply mustn't push out everything else
+        if ( reply->len > queryResultCacheBytes / 8 )
+            return;
+
+        SimpleMutex::scoped_lock lk( _mutex );
+        if ( writeVersion < _writeVersion )
+            return;
+        if ( writeVersion > _writeVersion ) {
+            // the namespace has been written since our entries were made
+            while ( !_entries.empty() )
+                _erase_inlock( _entries.begin()->second );
+            _writeVersion = writeVersion;
+        }
+
+        map<string, LRU::iterator>::iterator i = _entries.find( key );
+        if ( i != _entries.end() )
+            _erase_inlock( i->second );
+
+        Entry e;
+        e.owner = this;
+        e.key = key;
+        e.writeVersion = writeVersion;
+        e.reply.assign( (const char *) reply, reply->len );
+        _lru.push_front( e );
+        _entries[ key ] = _lru.begin();
+        _bytes += e.bytes();
+        _shrink_inlock();
+    }
+
+    void QueryResultCache::clear() {
+        SimpleMutex::scoped_lock lk( _mutex );
+        while ( !_entries.empty() )
+            _erase_inlock( _entries.begin()->second );
+    }
+
+    void QueryResultCache::shrink() {
+        SimpleMutex::scoped_lock lk( _mutex );
+        _shrink_inlock();
+    }
+
+    void QueryResultCache::_shrink_inlock() {
+        while ( _bytes > queryResultCacheBytes && !_lru.empty() ) {
+            _evictions++;
+            _erase_inlock( --_lru.end() );
+        }
+    }
+
+    void QueryResultCache::_erase_inlock( LRU::iterator i ) {
+        _bytes -= i->bytes();
+        i->owner->_entries.erase( i->key );
+        _lru.erase( i );
+    }
+
+    void QueryResultCache::appendStats( BSONObjBuilder &b ) {
+        SimpleMutex::scoped_lock lk( _mutex );
+        b.appendNumber( "maxBytes", queryResultCacheBytes );
+        b.appendNumber( "bytes", _bytes );
+        b.appendNumber( "entries", (long long) _lru.size() );
+        b.appendNumber( "hits", _hits );
+        b.appendNumber( "misses", _misses );
+        b.appendNumber( "evictions", _evictions );
+    }
+
+} // namespace mongo
@@ -0,0 +1,95 @@
+// @file query_result_cache.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    class ParsedQuery;
+    struct QueryResult;
+
+    /** the memory all result caches may use together; 0, the default, turns them off.
+        setParameter queryResultCacheBytes */
+    extern long long queryResultCacheBytes;
+
+    /**
+     * Replies to queries that were answered in full by their first batch, so that a repeat of one
+     * against a collection that hasn't been written since is answered without running it.
+     *
+     * Each namespace has one, see NamespaceDetailsTransient::resultCache().  An entry is tagged
+     * with the namespace's write version as of the start of the query that filled it, and is
+     * ignored once that has moved on; any write bumps it before it is acknowledged, so a client
+     * always reads its own writes.  The entries of all namespaces share one LRU list and the
+     * queryResultCacheBytes budget.
+     */
+    class QueryResultCache : boost::noncopyable {
+    public:
+        QueryResultCache() : _writeVersion() { }
+        ~QueryResultCache() { clear(); }
+
+        /**
+         * @return a key for the shape of pq - its filter, projection, sort, skip, limit and so on -
+         * or an empty string if the cache is off or pq's results may depend on more than the
+         * collection's contents (sharding, $where, explain, ...).
+         * @param fields the projection as the client sent it
+         */
+        static string key( const ParsedQuery &pq, const BSONObj &fields );
+
+        /**
+         * @return a copy of the reply cached for key as of writeVersion, for the caller to free,
+         * or null on a miss.
+         */
+        QueryResult* find( const string &key, unsigned long long writeVersion );
+
+        /** cache reply, a first batch with no cursor, for key as of writeVersion */
+        void add( const string &key, unsigned long long writeVersion, const QueryResult *reply );
+
+        void clear();
+
+        /** evict least recently used entries until we're within queryResultCacheBytes */
+        static void shrink();
+
+        static void appendStats( BSONObjBuilder &b );
+
+    private:
+        struct Entry {
+            QueryResultCache *owner;
+            string key;
+            unsigned long long writeVersion;
+            string reply;
+            long long bytes() const { return sizeof( Entry ) + key.size() + reply.size(); }
+        };
+        typedef list<Entry> LRU;                    // most recently used first
+
+        static void _erase_inlock( LRU::iterator i );
+        static void _shrink_inlock();
+
+        map<string, LRU::iterator> _entries;
+        unsigned long long _writeVersion;           // of the newest entry
+
+        static SimpleMutex _mutex;                  // for all of the above, in every cache
+        static LRU _lru;
+        static long long _bytes;
+        static long long _hits;
+        static long long _misses;
+        static long long _evictions;
+    };
+
+} // namespace mongo
@@ -23,14 +23,28 @@
 #include "cmdline.h"
 #include "../server.h"
 #include "pagefault.h"
+#include "mongo/db/index_intersection.h"
 
 //#define DEBUGQO(x) cout << x << endl;
 #define DEBUGQO(x)
 
 namespace mongo {
 
+    bool indexSkipScan = false;
+
     QueryPlanSummary QueryPlan::summary() const { return QueryPlanSummary( *this ); }
 
+    void QueryPlanSummary::noteRun( long long nScanned, long long nReturned,
+                                   long long micros ) const {
+        if ( !_pattern ) {
+            return;
+        }
+        SimpleMutex::scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
+        NamespaceDetailsTransient &nsdt =
+                NamespaceDetailsTransient::get_inlock( _fieldRangeSetMulti->ns() );
+        nsdt.notePlanRun( *_pattern, _indexKey, _intersectKeys, nScanned, nReturned, micros );
+    }
+
     double elementDirection( const BSONElement &e ) {
         if ( e.isNumber() )
             return e.number();
@@ -254,7 +268,8 @@ doneCheckOrder:
         }
 
         if ( ( _scanAndOrderRequired || _order.isEmpty() ) && 
-            _frs.range( idxKey.firstElementFieldName() ).universal() ) { // NOTE SERVER-2140
+            _frs.range( idxKey.firstElementFieldName() ).universal() && // NOTE SERVER-2140
+            !( indexSkipScan && constrainsLaterKeyField( idxKey ) ) ) {
             _utility = Unhelpful;
         }
             
@@ -267,6 +282,18 @@ doneCheckOrder:
         }
     }
 
+    bool QueryPlan::constrainsLaterKeyField( const BSONObj &idxKey ) const {
+        // The cursor's bounds jump from the keys of each leading value to the next.
+        BSONObjIterator i( idxKey );
+        i.next();
+        while( i.more() ) {
+            if ( !_frs.range( i.next().fieldName() ).universal() ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     shared_ptr<Cursor> QueryPlan::newCursor( const DiskLoc &startLoc ) const {
 
         if ( _type ) {
@@ -299,12 +326,28 @@ doneCheckOrder:
             return shared_ptr<Cursor>( BtreeCursor::make( _d, _idxNo, *_index, _frv->startKey(), _frv->endKey(), true, _direction >= 0 ? 1 : -1 ) );
         }
         else {
-            return shared_ptr<Cursor>( BtreeCursor::make( _d, _idxNo, *_index, _frv,
-                                                         independentRangesSingleIntervalLimit(),
-                                                         _direction >= 0 ? 1 : -1 ) );
+            shared_ptr<Cursor> c( BtreeCursor::make( _d, _idxNo, *_index, _frv,
+                                                     independentRangesSingleIntervalLimit(),
+                                                     _direction >= 0 ? 1 : -1 ) );
+            if ( intersects() ) {
+                return newIntersectionCursor( c );
+            }
+            return c;
         }
     }
 
+    shared_ptr<Cursor> QueryPlan::newIntersectionCursor( const shared_ptr<Cursor> &drive ) const {
+        vector<shared_ptr<Cursor> > filters;
+        for( vector<int>::const_iterator i = _intersectIdxNos.begin();
+            i != _intersectIdxNos.end(); ++i ) {
+            IndexDetails &id = _d->idx( *i );
+            // The multikey ranges hold whether or not the filter index is multikey.
+            shared_ptr<FieldRangeVector> frv( new FieldRangeVector( _frsMulti, id.getSpec(), 1 ) );
+            filters.push_back( shared_ptr<Cursor>( BtreeCursor::make( _d, *i, id, frv, 0, 1 ) ) );
+        }
+        return shared_ptr<Cursor>( new IndexIntersectionCursor( drive, filters ) );
+    }
+
     shared_ptr<Cursor> QueryPlan::newReverseCursor() const {
         if ( willScanTable() ) {
             int orderSpec = _order.getIntField( "$natural" );
@@ -322,6 +365,15 @@ doneCheckOrder:
         return _index->keyPattern();
     }
 
+    BSONObj QueryPlan::intersectIndexKeys() const {
+        BSONArrayBuilder b;
+        for( vector<int>::const_iterator i = _intersectIdxNos.begin();
+            i != _intersectIdxNos.end(); ++i ) {
+            b.append( _d->idx( *i ).keyPattern() );
+        }
+        return b.arr();
+    }
+
     void QueryPlan::registerSelf( long long nScanned,
                                  CandidatePlanCharacter candidatePlans ) const {
         // Impossible query constraints can be detected before scanning and historically could not
@@ -332,7 +384,8 @@ doneCheckOrder:
 
         SimpleMutex::scoped_lock lk(NamespaceDetailsTransient::_qcMutex);
         QueryPattern queryPattern = _frs.pattern( _order );
-        CachedQueryPlan queryPlanToCache( indexKey(), nScanned, candidatePlans );
+        CachedQueryPlan queryPlanToCache( indexKey(), nScanned, candidatePlans, false,
+                                          intersectIndexKeys() );
         NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get_inlock( ns() );
         nsdt.registerCachedQueryPlanForPattern( queryPattern, queryPlanToCache );
     }
@@ -470,11 +523,14 @@ doneCheckOrder:
     }
 
     string QueryPlan::toString() const {
-        return BSON(
-                    "index" << indexKey() <<
-                    "frv" << ( _frv ? _frv->toString() : "" ) <<
-                    "order" << _order
-                    ).jsonString();
+        BSONObjBuilder b;
+        b.append( "index", indexKey() );
+        if ( intersects() ) {
+            b.appendArray( "intersect", intersectIndexKeys() );
+        }
+        b.append( "frv", _frv ? _frv->toString() : "" );
+        b.append( "order", _order );
+        return b.obj().jsonString();
     }
     
     shared_ptr<CoveredIndexMatcher> QueryPlan::matcher() const {
@@ -591,9 +647,49 @@ doneCheckOrder:
             ++i ) {
             _qps.addCandidatePlan( *i );
         }        
+
+        if ( indexIntersection ) {
+            addIntersectionPlans( d, plans );
+        }
         
         _qps.addCandidatePlan( newPlan( d, -1 ) );
     }
+
+    void QueryPlanGenerator::addIntersectionPlans( NamespaceDetails *d,
+                                                   const vector<shared_ptr<QueryPlan> > &plans ) {
+        // An index may filter if the query constrains its first field, so its ranges are likely
+        // to leave documents out.  A sparse index leaves out documents the query may match.
+        vector<shared_ptr<QueryPlan> > filters;
+        for( vector<shared_ptr<QueryPlan> >::const_iterator i = plans.begin(); i != plans.end();
+            ++i ) {
+            const char *first = (*i)->indexKey().firstElementFieldName();
+            if ( !(*i)->index()->getSpec().isSparse() &&
+                !(*i)->multikeyFrs().range( first ).universal() ) {
+                filters.push_back( *i );
+            }
+        }
+
+        // Each filter drives one plan, filtered by up to two others that constrain a field its
+        // own index doesn't.
+        const unsigned maxFilters = 2;
+        for( vector<shared_ptr<QueryPlan> >::const_iterator i = filters.begin();
+            i != filters.end(); ++i ) {
+            BSONObj driveKey = (*i)->indexKey();
+            vector<int> idxNos;
+            for( vector<shared_ptr<QueryPlan> >::const_iterator j = filters.begin();
+                j != filters.end() && idxNos.size() < maxFilters; ++j ) {
+                if ( j != i && !driveKey.hasField( (*j)->indexKey().firstElementFieldName() ) ) {
+                    idxNos.push_back( (*j)->idxNo() );
+                }
+            }
+            if ( idxNos.empty() ) {
+                continue;
+            }
+            shared_ptr<QueryPlan> p = newPlan( d, (*i)->idxNo() );
+            p->setIntersectIndexes( idxNos );
+            _qps.addCandidatePlan( p );
+        }
+    }
     
     bool QueryPlanGenerator::addShortCircuitPlan( NamespaceDetails *d ) {
         return
@@ -708,6 +804,24 @@ doneCheckOrder:
             return false;
         }
 
+        // An intersection plan is only used while all of its indexes exist, and intersection
+        // is on.
+        if ( !best.intersectKeys().isEmpty() ) {
+            if ( !indexIntersection ) {
+                return false;
+            }
+            vector<int> idxNos;
+            BSONObjIterator k( best.intersectKeys() );
+            while( k.more() ) {
+                int j = d->findIndexByKeyPattern( k.next().embeddedObject() );
+                if ( j < 0 ) {
+                    return false;
+                }
+                idxNos.push_back( j );
+            }
+            p->setIntersectIndexes( idxNos );
+        }
+
         _qps.setCachedPlan( p, best );
         return true;
     }
@@ -814,6 +928,7 @@ doneCheckOrder:
         _frsp( frsp ),
         _mayRecordPlan(),
         _usingCachedPlan(),
+        _usingPinnedPlan(),
         _order( order.getOwned() ),
         _oldNScanned( 0 ),
         _yieldSometimesTracker( 256, 20 ),
@@ -831,6 +946,7 @@ doneCheckOrder:
         DEBUGQO( "QueryPlanSet::init " << ns << "\t" << _originalQuery );
         _plans.clear();
         _usingCachedPlan = false;
+        _usingPinnedPlan = false;
 
         _generator.addInitialPlans();
     }
@@ -845,6 +961,7 @@ doneCheckOrder:
                                      const CachedQueryPlan &cachedPlan ) {
         verify( nPlans() == 0 );
         _usingCachedPlan = true;
+        _usingPinnedPlan = cachedPlan.pinned();
         _oldNScanned = cachedPlan.nScanned();
         _cachedPlanCharacter = cachedPlan.planCharacter();
         pushPlan( plan );
@@ -853,12 +970,22 @@ doneCheckOrder:
     void QueryPlanSet::addCandidatePlan( const QueryPlanPtr &plan ) {
         // If _plans is nonempty, the new plan may be supplementing a recorded plan at the first
         // position of _plans.  It must not duplicate the first plan.
-        if ( nPlans() > 0 && plan->indexKey() == firstPlan()->indexKey() ) {
+        if ( nPlans() > 0 && plan->indexKey() == firstPlan()->indexKey() &&
+            plan->intersectIndexKeys() == firstPlan()->intersectIndexKeys() ) {
             return;
         }
         pushPlan( plan );
         _mayRecordPlan = true;
     }
+
+    bool QueryPlanSet::hasIntersectionPlan() const {
+        for( PlanSet::const_iterator i = _plans.begin(); i != _plans.end(); ++i ) {
+            if ( (*i)->intersects() ) {
+                return true;
+            }
+        }
+        return false;
+    }
     
     void QueryPlanSet::addFallbackPlans() {
         _generator.addFallbackPlans();
@@ -873,6 +1000,7 @@ doneCheckOrder:
     bool QueryPlanSet::hasPossiblyExcludedPlans() const {
         return
             _usingCachedPlan &&
+            !_usingPinnedPlan &&
             ( nPlans() == 1 ) &&
             ( firstPlan()->utility() != QueryPlan::Optimal );
     }
@@ -1041,9 +1169,10 @@ doneCheckOrder:
         }
         
         // Put runnable ops in the priority queue.
+        bool countObjects = _plans.hasIntersectionPlan();
         for( vector<shared_ptr<QueryOp> >::iterator i = _ops.begin(); i != _ops.end(); ++i ) {
             if ( !(*i)->error() ) {
-                _queue.push( *i );
+                _queue.push( OpHolder( *i, countObjects ) );
             }
         }
         
@@ -1095,8 +1224,10 @@ doneCheckOrder:
         if ( _plans.hasPossiblyExcludedPlans() &&
             op.nscanned() > _plans._oldNScanned * 10 ) {
             verify( _plans.nPlans() == 1 && _plans.firstPlan()->special().empty() );
-            holder._offset = -op.nscanned();
             _plans.addFallbackPlans();
+            holder._countObjects = _plans.hasIntersectionPlan();
+            holder._offset = 0;
+            holder._offset = -holder.cost();
             PlanSet::iterator i = _plans._plans.begin();
             ++i;
             for( ; i != _plans._plans.end(); ++i ) {
@@ -1106,7 +1237,7 @@ doneCheckOrder:
                 initOp( *op );
                 if ( op->complete() )
                     return op;
-                _queue.push( op );
+                _queue.push( OpHolder( op, holder._countObjects ) );
             }
             _plans._usingCachedPlan = false;
         }
@@ -30,6 +30,12 @@ namespace mongo {
     class IndexDetails;
     class IndexType;
     class QueryPlanSummary;
+
+    /**
+     * consider indexes whose leading field the query leaves open, when it constrains a later one,
+     * skipping from each leading value to the next.  setParameter indexSkipScan
+     */
+    extern bool indexSkipScan;
     
     /**
      * A plan for executing a query using the given index spec and FieldRangeSet.  An object of this
@@ -85,6 +91,8 @@ namespace mongo {
         shared_ptr<Cursor> newReverseCursor() const;
         /** Register this plan as a winner for its QueryPattern, with specified 'nscanned'. */
         void registerSelf( long long nScanned, CandidatePlanCharacter candidatePlans ) const;
+        /** @return the QueryPattern this plan is registered for.  Not for Impossible plans. */
+        QueryPattern pattern() const { return _frs.pattern( _order ); }
 
         int direction() const { return _direction; }
         BSONObj indexKey() const;
@@ -97,6 +105,15 @@ namespace mongo {
         shared_ptr<FieldRangeVector> originalFrv() const { return _originalFrv; }
 
         const FieldRangeSet &multikeyFrs() const { return _frsMulti; }
+
+        /**
+         * Only scan the documents also in the multikey ranges of these other indexes, see
+         * IndexIntersectionCursor.  Set before the plan is used.
+         */
+        void setIntersectIndexes( const vector<int> &idxNos ) { _intersectIdxNos = idxNos; }
+        bool intersects() const { return !_intersectIdxNos.empty(); }
+        /** @return an array of the key patterns of the intersected indexes, empty if none. */
+        BSONObj intersectIndexKeys() const;
         
         shared_ptr<Projection::KeyOnly> keyFieldsOnly() const { return _keyFieldsOnly; }
 
@@ -129,6 +146,9 @@ namespace mongo {
         int independentRangesSingleIntervalLimit() const;
         /** @return true when the plan's query may contains an $exists:false predicate. */
         bool hasPossibleExistsFalsePredicate() const;
+        /** @return true if the query constrains a field of idxKey after the first. */
+        bool constrainsLaterKeyField( const BSONObj &idxKey ) const;
+        shared_ptr<Cursor> newIntersectionCursor( const shared_ptr<Cursor> &drive ) const;
 
         NamespaceDetails * _d;
         int _idxNo;
@@ -151,6 +171,7 @@ namespace mongo {
         IndexType * _type;
         bool _startOrEndSpec;
         shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
+        vector<int> _intersectIdxNos;
         mutable shared_ptr<CoveredIndexMatcher> _matcher; // Lazy initialization.
     };
 
@@ -168,12 +189,25 @@ namespace mongo {
         QueryPlanSummary( const QueryPlan &queryPlan ) :
         _fieldRangeSetMulti( new FieldRangeSet( queryPlan.multikeyFrs() ) ),
         _keyFieldsOnly( queryPlan.keyFieldsOnly() ),
-        _scanAndOrderRequired( queryPlan.scanAndOrderRequired() ) {
+        _scanAndOrderRequired( queryPlan.scanAndOrderRequired() ),
+        _indexKey( queryPlan.indexKey() ),
+        _intersectKeys( queryPlan.intersectIndexKeys() ) {
+            if ( queryPlan.utility() != QueryPlan::Impossible ) {
+                _pattern.reset( new QueryPattern( queryPlan.pattern() ) );
+            }
         }
         bool valid() const { return _fieldRangeSetMulti; }
+        /**
+         * Note the cost of a query run with this plan in the plan cache, if this is the plan
+         * cached for its pattern.  micros should not include time waiting for locks.
+         */
+        void noteRun( long long nScanned, long long nReturned, long long micros ) const;
         shared_ptr<FieldRangeSet> _fieldRangeSetMulti;
         shared_ptr<Projection::KeyOnly> _keyFieldsOnly;
         bool _scanAndOrderRequired;
+        BSONObj _indexKey;
+        BSONObj _intersectKeys;
+        shared_ptr<QueryPattern> _pattern;
     };
 
     /**
@@ -208,6 +242,11 @@ namespace mongo {
          * cost to other QueryOps.
          */
         virtual long long nscanned() = 0;
+        /**
+         * @return the number of documents loaded so far, counted in the cost of a plan racing
+         * index intersection plans.
+         */
+        virtual long long nscannedObjects() { return 0; }
         /** Take any steps necessary before the db mutex is yielded. */
         virtual void prepareToYield() = 0;
         /** Recover once the db mutex is regained. */
@@ -327,6 +366,7 @@ namespace mongo {
         bool addSpecialPlan( NamespaceDetails *d );
         void addStandardPlans( NamespaceDetails *d );
         bool addCachedPlan( NamespaceDetails *d );
+        void addIntersectionPlans( NamespaceDetails *d, const vector<shared_ptr<QueryPlan> > &plans );
         shared_ptr<QueryPlan> newPlan( NamespaceDetails *d,
                                       int idxNo,
                                       const BSONObj &min = BSONObj(),
@@ -379,7 +419,12 @@ namespace mongo {
         
         /** @return true if a plan is selected based on previous success of this plan. */
         bool usingCachedPlan() const { return _usingCachedPlan; }
-        /** @return true if some candidate plans may have been excluded due to plan caching. */
+        /** @return true if the cached plan was pinned, and so runs without other candidates. */
+        bool usingPinnedPlan() const { return _usingPinnedPlan; }
+        /**
+         * @return true if some candidate plans may have been excluded due to plan caching.  Never
+         * true for a pinned plan.
+         */
         bool hasPossiblyExcludedPlans() const;
         /** @return a single plan that may work well for the specified query. */
         QueryPlanPtr getBestGuess() const;
@@ -407,10 +452,13 @@ namespace mongo {
         void setCachedPlan( const QueryPlanPtr &plan, const CachedQueryPlan &cachedPlan );
         /** Add a candidate query plan, potentially one of many. */
         void addCandidatePlan( const QueryPlanPtr &plan );
+        /** @return true if some candidate plan intersects indexes. */
+        bool hasIntersectionPlan() const;
         
         //for testing
         bool modifiedKeys() const;
         bool hasMultiKey() const;
+        QueryPlanPtr getPlan( int i ) const { return _plans[ i ]; }
 
         class Runner {
         public:
@@ -448,12 +496,25 @@ namespace mongo {
             shared_ptr<QueryOp> _next();
 
             vector<shared_ptr<QueryOp> > _ops;
+            /**
+             * Ops are advanced cheapest first.  Against an index intersection plan, which reads
+             * more keys to load fewer documents, loading a document costs ObjectCost keys.
+             */
             struct OpHolder {
-                OpHolder( const shared_ptr<QueryOp> &op ) : _op( op ), _offset() {}
+                static const int ObjectCost = 4;
+                OpHolder( const shared_ptr<QueryOp> &op, bool countObjects ) :
+                    _op( op ), _offset(), _countObjects( countObjects ) {}
                 shared_ptr<QueryOp> _op;
                 long long _offset;
+                bool _countObjects;
+                long long cost() const {
+                    long long ret = _op->nscanned() + _offset;
+                    if ( _countObjects )
+                        ret += ObjectCost * _op->nscannedObjects();
+                    return ret;
+                }
                 bool operator<( const OpHolder &other ) const {
-                    return _op->nscanned() + _offset > other._op->nscanned() + other._offset;
+                    return cost() > other.cost();
                 }
             };
             our_priority_queue<OpHolder> _queue;
@@ -485,6 +546,7 @@ namespace mongo {
         PlanSet _plans;
         bool _mayRecordPlan;
         bool _usingCachedPlan;
+        bool _usingPinnedPlan;
         CandidatePlanCharacter _cachedPlanCharacter;
         BSONObj _order;
         long long _oldNScanned;
@@ -576,6 +638,8 @@ namespace mongo {
             return !_or && _currentQps->hasPossiblyExcludedPlans();
         }
         bool hasMultiKey() const { return _currentQps->hasMultiKey(); }
+        /** @return true if this is a $or query, run clause by clause. */
+        bool orQuery() const { return _or; }
         
         /** Clear recorded indexes for the current QueryPlanSet's patterns. */
         void clearIndexesForPatterns() const;
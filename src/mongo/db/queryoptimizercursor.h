@@ -24,6 +24,7 @@
 namespace mongo {
     
     class QueryPlan;
+    class QueryPlanSummary;
     class CandidatePlanCharacter;
     
     /**
@@ -111,6 +112,12 @@ namespace mongo {
          */
         virtual bool completePlanOfHybridSetScanAndOrderRequired() const = 0;
 
+        /**
+         * @return the plan that won the race among the candidate plans, once one has completed
+         * or been picked to take over.  Not valid() before that, or for a $or query.
+         */
+        virtual const QueryPlanSummary &completePlanSummary() const = 0;
+
         /** Clear recorded indexes for the current clause's query patterns. */
         virtual void clearIndexesForPatterns() = 0;
         /** Stop returning results from out of order plans and do not allow them to complete. */
@@ -24,6 +24,7 @@
 #include "btree.h"
 #include "explain.h"
 #include "mongo/client/dbclientinterface.h"
+#include "mongo/db/parallel_scan.h"
 #include "mongo/db/queryoptimizer.h"
 
 namespace mongo {
@@ -68,6 +69,7 @@ namespace mongo {
         QueryOptimizerCursorOp( long long &aggregateNscanned, const QueryPlanSelectionPolicy &selectionPolicy,
                                const bool &requireOrder, bool alwaysCountMatches, int cumulativeCount = 0 ) :
         _matchCounter( aggregateNscanned, cumulativeCount ),
+        _nscannedObjects(),
         _countingMatches(),
         _mustAdvance(),
         _capped(),
@@ -115,6 +117,8 @@ namespace mongo {
         virtual long long nscanned() {
             return _c ? _c->nscanned() : _matchCounter.nscanned();
         }
+
+        virtual long long nscannedObjects() { return _nscannedObjects; }
         
         virtual void prepareToYield() {
             if ( _c && !_cc ) {
@@ -193,12 +197,16 @@ namespace mongo {
                 return false;
             }
             
+            // Details are always wanted, to count the documents loaded.
             MatchDetails myDetails;
-            if ( !details && _explainPlanInfo ) {
+            if ( !details ) {
                 details = &myDetails;
             }
 
             bool match = queryPlan().matcher()->matchesCurrent( _c.get(), details );
+            if ( details->hasLoadedRecord() ) {
+                ++_nscannedObjects;
+            }
             // Cache the match, so we can count it in mayAdvance().
             bool newMatch = _matchCounter.setMatch( match );
 
@@ -286,6 +294,7 @@ namespace mongo {
         }
 
         CachedMatchCounter _matchCounter;
+        long long _nscannedObjects;
         bool _countingMatches;
         bool _mustAdvance;
         bool _capped;
@@ -553,6 +562,10 @@ namespace mongo {
         virtual bool completePlanOfHybridSetScanAndOrderRequired() const {
             return _completePlanOfHybridSetScanAndOrderRequired;
         }
+
+        virtual const QueryPlanSummary &completePlanSummary() const {
+            return _completePlanSummary;
+        }
         
         virtual void clearIndexesForPatterns() {
             if ( !_takeover ) {
@@ -608,6 +621,9 @@ namespace mongo {
             if ( !op->complete() ) {
                 _currOp = dynamic_cast<QueryOptimizerCursorOp*>( op.get() );
             }
+            else {
+                noteCompletePlan( op->queryPlan() );
+            }
         }
 
         /**
@@ -637,6 +653,7 @@ namespace mongo {
                 _currOp = qocop;
             }
             else if ( op->stopRequested() ) {
+                noteCompletePlan( op->queryPlan() );
                 if ( qocop->cursor() ) {
                     _takeover.reset( new MultiCursor( _mps,
                                                      qocop->cursor(),
@@ -647,6 +664,7 @@ namespace mongo {
                 }
             }
             else {
+                noteCompletePlan( op->queryPlan() );
                 if ( _initialCandidatePlans.hybridPlanSet() ) {
                     _completePlanOfHybridSetScanAndOrderRequired =
                             op->queryPlan().scanAndOrderRequired();
@@ -655,6 +673,11 @@ namespace mongo {
 
             return ok();
         }
+        void noteCompletePlan( const QueryPlan &plan ) {
+            if ( !_mps->orQuery() && !_completePlanSummary.valid() ) {
+                _completePlanSummary = plan.summary();
+            }
+        }
         /** Forward an exception when the runner errs out. */
         void rethrowOnError( const shared_ptr< QueryOp > &op ) {
             if ( op->error() ) {
@@ -683,6 +706,7 @@ namespace mongo {
         shared_ptr<QueryOptimizerCursorOp> _originalOp;
         QueryOptimizerCursorOp *_currOp;
         bool _completePlanOfHybridSetScanAndOrderRequired;
+        QueryPlanSummary _completePlanSummary;
         shared_ptr<MultiCursor> _takeover;
         long long _nscanned;
         // Using a SmallDupSet seems a bit hokey, but I've measured a 5% performance improvement
@@ -818,7 +842,16 @@ namespace mongo {
         if ( _singlePlanSummary ) {
             *_singlePlanSummary = singlePlan->summary();
         }
-        shared_ptr<Cursor> single = singlePlan->newCursor();
+        shared_ptr<Cursor> single;
+        // a findOne or a small limit is likely done long before a round of the parallel scan
+        if ( _parsedQuery && singlePlan->willScanTable() && _order.isEmpty() &&
+             ( _parsedQuery->getNumToReturn() == 0 || _parsedQuery->getNumToReturn() > 100 ) &&
+             ParallelCollectionScan::worthwhile( _ns, nsdetails( _ns ), _query ) ) {
+            single.reset( new ParallelScanCursor( _ns, _query ) );
+        }
+        else {
+            single = singlePlan->newCursor();
+        }
         if ( !_query.isEmpty() && !single->matcher() ) {
             single->setMatcher( singlePlan->matcher() );
         }
@@ -80,11 +80,15 @@ namespace mongo {
     }
     
     string QueryPattern::toString() const {
+        return toBSON().toString();
+    }
+
+    BSONObj QueryPattern::toBSON() const {
         BSONObjBuilder b;
         for( map<string,Type>::const_iterator i = _fieldTypes.begin(); i != _fieldTypes.end(); ++i ) {
             b << i->first << typeToString( i->second );
         }
-        return BSON( "query" << b.done() << "sort" << _sort ).toString();
+        return BSON( "query" << b.done() << "sort" << _sort );
     }
     
     void QueryPattern::setSort( const BSONObj sort ) {
@@ -107,10 +111,76 @@ namespace mongo {
     }
     
     CachedQueryPlan::CachedQueryPlan( const BSONObj &indexKey, long long nScanned,
-                                     CandidatePlanCharacter planCharacter ) :
+                                     CandidatePlanCharacter planCharacter, bool pinned,
+                                     const BSONObj &intersectKeys ) :
     _indexKey( indexKey ),
     _nScanned( nScanned ),
-    _planCharacter( planCharacter ) {
+    _planCharacter( planCharacter ),
+    _pinned( pinned ),
+    _intersectKeys( intersectKeys ) {
+    }
+
+    CachedPlanStats::Series::Series() :
+    total() {
+        memset( buckets, 0, sizeof( buckets ) );
+    }
+
+    void CachedPlanStats::Series::note( long long value ) {
+        total += value;
+        int i = 0;
+        while( value > 0 && i < Buckets - 1 ) {
+            value >>= 1;
+            ++i;
+        }
+        ++buckets[ i ];
+    }
+
+    void CachedPlanStats::Series::append( BSONObjBuilder &b, const char *name,
+                                         long long runs ) const {
+        BSONObjBuilder s( b.subobjStart( name ) );
+        s.appendNumber( "total", total );
+        s.append( "avg", runs ? (double)total / runs : 0.0 );
+        // only up to the highest bucket in use, bucket i being values below 2^i
+        int used = Buckets;
+        while( used > 0 && buckets[ used - 1 ] == 0 ) {
+            --used;
+        }
+        BSONArrayBuilder h( s.subarrayStart( "histogram" ) );
+        for( int i = 0; i < used; ++i ) {
+            h.append( buckets[ i ] );
+        }
+        h.done();
+        s.done();
+    }
+
+    CachedPlanStats::CachedPlanStats() :
+    _runs() {
+    }
+
+    void CachedPlanStats::noteRun( long long nScanned, long long nReturned, long long micros ) {
+        ++_runs;
+        _nScanned.note( nScanned );
+        _nReturned.note( nReturned );
+        _micros.note( micros );
+    }
+
+    bool CachedPlanStats::drifted( long long nScanned, long long micros ) const {
+        if ( _runs < MinRunsForDrift ) {
+            return false;
+        }
+        // The slack keeps small, fast queries from flip-flopping on noise: the scan must be
+        // worse by a hundred documents and the time by ten milliseconds as well.
+        if ( nScanned > DriftFactor * ( _nScanned.total / _runs ) + 100 ) {
+            return true;
+        }
+        return micros > DriftFactor * ( _micros.total / _runs ) + 10000;
+    }
+
+    void CachedPlanStats::append( BSONObjBuilder &b ) const {
+        b.appendNumber( "runs", _runs );
+        _nScanned.append( b, "nscanned", _runs );
+        _nReturned.append( b, "nreturned", _runs );
+        _micros.append( b, "micros", _runs );
     }
 
     
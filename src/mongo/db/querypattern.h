@@ -49,6 +49,8 @@ namespace mongo {
         bool operator!=( const QueryPattern &other ) const;
         /** for development / debugging */
         string toString() const;
+        /** { query : { <field> : <type name> ... }, sort : <normalized sort> } */
+        BSONObj toBSON() const;
     private:
         void setSort( const BSONObj sort );
         static BSONObj normalizeSort( const BSONObj &spec );
@@ -80,17 +82,65 @@ namespace mongo {
     class CachedQueryPlan {
     public:
         CachedQueryPlan() :
-        _nScanned() {
+        _nScanned(),
+        _pinned() {
         }
+        /**
+         * @param pinned - a pinned plan is used without racing other plans, and stays cached until
+         * it is unpinned or the collection's indexes change.  See the planCache command.
+         * @param intersectKeys - array of the key patterns of indexes the plan intersects with
+         * indexKey, if any.
+         */
         CachedQueryPlan( const BSONObj &indexKey, long long nScanned,
-                        CandidatePlanCharacter planCharacter );
+                        CandidatePlanCharacter planCharacter, bool pinned = false,
+                        const BSONObj &intersectKeys = BSONObj() );
         BSONObj indexKey() const { return _indexKey; }
+        BSONObj intersectKeys() const { return _intersectKeys; }
         long long nScanned() const { return _nScanned; }
         CandidatePlanCharacter planCharacter() const { return _planCharacter; }
+        bool pinned() const { return _pinned; }
     private:
         BSONObj _indexKey;
         long long _nScanned;
         CandidatePlanCharacter _planCharacter;
+        bool _pinned;
+        BSONObj _intersectKeys;
+    };
+
+    /**
+     * Running statistics for the queries a cached plan has answered: how many documents each
+     * scanned and returned, and how long it took.  Each is kept as a total and a histogram with
+     * power of two buckets, bucket i counting values in [ 2^(i-1), 2^i ).
+     */
+    class CachedPlanStats {
+    public:
+        CachedPlanStats();
+        void noteRun( long long nScanned, long long nReturned, long long micros );
+        long long runs() const { return _runs; }
+        /**
+         * @return true if a run scanning nScanned documents in micros is so far out of line with
+         * the earlier runs that the plan is no longer the one the plan set would pick.
+         */
+        bool drifted( long long nScanned, long long micros ) const;
+        void append( BSONObjBuilder &b ) const;
+
+        /** a plan needs this many runs before drifted() may be true */
+        static const long long MinRunsForDrift = 4;
+        /** and a run costing this many times the mean, as the cached plan fallback uses */
+        static const long long DriftFactor = 10;
+    private:
+        enum { Buckets = 32 };
+        struct Series {
+            Series();
+            void note( long long value );
+            void append( BSONObjBuilder &b, const char *name, long long runs ) const;
+            long long total;
+            long long buckets[ Buckets ];
+        };
+        long long _runs;
+        Series _nScanned;
+        Series _nReturned;
+        Series _micros;
     };
 
     inline bool QueryPattern::operator<( const QueryPattern &other ) const {
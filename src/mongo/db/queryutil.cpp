@@ -169,7 +169,7 @@ namespace mongo {
         // NOTE with $not, we could potentially form a complementary set of intervals.
         if ( !isNot && !e.eoo() && e.type() != RegEx && op == BSONObj::opIN ) {
             bool exactMatchesOnly = true;
-            set<BSONElement,element_lt> vals;
+            ElementInSet vals;
             vector<FieldRange> regexes;
             uassert( 12580 , "invalid query" , e.isABSONObj() );
             BSONObjIterator i( e.embeddedObject() );
@@ -199,7 +199,8 @@ namespace mongo {
             }
 
             _exactMatchRepresentation = exactMatchesOnly;
-            for( set<BSONElement,element_lt>::const_iterator i = vals.begin(); i != vals.end(); ++i )
+            vector<BSONElement> sorted = vals.sorted();
+            for( vector<BSONElement>::const_iterator i = sorted.begin(); i != sorted.end(); ++i )
                 _intervals.push_back( FieldInterval(*i) );
 
             for( vector<FieldRange>::const_iterator i = regexes.begin(); i != regexes.end(); ++i )
@@ -5,6 +5,7 @@
 #include "mongo/db/pagefault.h"
 #include "mongo/db/pdfile.h"
 #include "mongo/db/record.h"
+#include "mongo/db/record_compression.h"
 #include "mongo/util/net/listen.h"
 #include "mongo/util/processinfo.h"
 #include "mongo/util/stack_introspect.h"
@@ -21,6 +22,9 @@ namespace mongo {
 
     void Record::appendStats( BSONObjBuilder& b ) {
         recordStats.record( b );
+        BSONObjBuilder compression( b.subobjStart( "compression" ) );
+        appendRecordCompressionStats( compression );
+        compression.done();
     }
 
     namespace ps {
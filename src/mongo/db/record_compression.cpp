@@ -0,0 +1,145 @@
+// @file record_compression.cpp
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pch.h"
+
+#include "mongo/db/record_compression.h"
+
+#include "mongo/db/pdfile.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/compress.h"
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    namespace {
+        /* write epochs, striped on the record address.  every write of a compressed record bumps
+           the epoch of its stripe, and a cached copy is only used while the epoch of its record's
+           stripe is the one it was made in.  so a record rewritten or freed (and its address
+           reused) since can't be served stale, while writes elsewhere leave the copy alone.
+        */
+        const unsigned WriteEpochStripes = 4096;
+        AtomicUInt64 writeEpochs[WriteEpochStripes];
+
+        AtomicUInt64& writeEpoch( const Record *r ) {
+            return writeEpochs[ ( reinterpret_cast<size_t>( r ) >> 4 ) % WriteEpochStripes ];
+        }
+
+        /* bumped when data files are unmapped.  an address can then be mapped again for another
+           file, whose records this process may never have written, so no cached copy from
+           before is used.
+        */
+        AtomicUInt64 mappingGeneration;
+
+        AtomicUInt64 cacheHits;
+        AtomicUInt64 cacheMisses;
+    }
+
+    /** a few recently uncompressed records, direct mapped on the record address */
+    class UncompressedRecordCache : boost::noncopyable {
+    public:
+        enum { Slots = 32 , MaxCachedSize = 32 * 1024 }; // at most 1MB held per thread
+
+        struct Slot {
+            Slot() : r(0), epoch(0), generation(0) { }
+            const Record *r;
+            unsigned long long epoch;
+            unsigned long long generation;
+            BSONObj obj;
+        };
+
+        Slot& slot( const Record *r ) {
+            return _slots[ ( reinterpret_cast<size_t>( r ) >> 4 ) % Slots ];
+        }
+
+    private:
+        Slot _slots[Slots];
+    };
+
+    TSP_DECLARE(UncompressedRecordCache,uncompressedRecordCache)
+    TSP_DEFINE(UncompressedRecordCache,uncompressedRecordCache)
+
+    bool compressRecordData( const BSONObj& obj , string* out ) {
+        const size_t hdr = sizeof(CompressedRecordHeader);
+        const size_t objsize = obj.objsize();
+        out->resize( hdr + maxCompressedLength( objsize ) );
+        size_t len;
+        rawCompress( obj.objdata() , objsize , &(*out)[hdr] , &len );
+        if ( hdr + len > objsize - objsize / 8 ) {
+            // less than 1/8 saved; not worth uncompressing on every read
+            out->clear();
+            return false;
+        }
+        out->resize( hdr + len );
+        CompressedRecordHeader *h = reinterpret_cast<CompressedRecordHeader*>( &(*out)[0] );
+        h->negLen = - (int) ( hdr + len );
+        h->objsize = (int) objsize;
+        return true;
+    }
+
+    BSONObj uncompressRecord( const Record *r ) {
+        const unsigned long long epoch = writeEpoch( r ).load();
+        const unsigned long long generation = mappingGeneration.load();
+        UncompressedRecordCache::Slot& slot = uncompressedRecordCache.getMake()->slot( r );
+        if ( slot.r == r && slot.epoch == epoch && slot.generation == generation ) {
+            cacheHits.fetchAndAdd( 1 );
+            return slot.obj;
+        }
+        cacheMisses.fetchAndAdd( 1 );
+
+        const CompressedRecordHeader *h = reinterpret_cast<const CompressedRecordHeader*>( r->data() );
+        const int stored = - h->negLen - (int) sizeof(CompressedRecordHeader);
+        size_t objsize;
+        massert( 16414 , "corrupt compressed record" ,
+                 stored > 0 && stored <= r->netLength() &&
+                 uncompressedLength( (const char *) ( h + 1 ) , stored , &objsize ) &&
+                 objsize == (size_t) h->objsize );
+
+        // room for the BSONObj::Holder refcount before the object
+        char *buf = (char *) malloc( sizeof(unsigned) + objsize );
+        verify( buf );
+        memset( buf , 0 , sizeof(unsigned) );
+        if ( ! rawUncompress( (const char *) ( h + 1 ) , stored , buf + sizeof(unsigned) ) ) {
+            free( buf );
+            msgasserted( 16415 , "corrupt compressed record" );
+        }
+        BSONObj obj( reinterpret_cast<BSONObj::Holder*>( buf ) );
+
+        if ( objsize <= UncompressedRecordCache::MaxCachedSize ) {
+            slot.r = r;
+            slot.epoch = epoch;
+            slot.generation = generation;
+            slot.obj = obj;
+        }
+        return obj;
+    }
+
+    void compressedRecordWritten( const Record *r ) {
+        writeEpoch( r ).fetchAndAdd( 1 );
+    }
+
+    void dataFilesUnmapped() {
+        mappingGeneration.fetchAndAdd( 1 );
+    }
+
+    void appendRecordCompressionStats( BSONObjBuilder& b ) {
+        b.appendNumber( "cacheHits" , (long long) cacheHits.load() );
+        b.appendNumber( "cacheMisses" , (long long) cacheMisses.load() );
+    }
+
+} // namespace mongo
@@ -0,0 +1,67 @@
+// @file record_compression.h
+
+/**
+*    Copyright (C) 2012 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* snappy compressed records, for collections with NamespaceDetails::Flag_CompressRecords.
+
+   a compressed record's data is a CompressedRecordHeader followed by the snappy bytes of the
+   object.  the header starts with the negated stored length where a BSONObj has its (always
+   positive) size, so Record::compressed() can tell the two apart without knowing which
+   collection the record is in, and records written before the flag was set (or after it
+   was cleared) stay readable.
+
+   BSONObj::make() hands out an uncompressed copy of a compressed record.  copies are cached
+   per thread, as a query typically looks at the same record several times (matcher, projection,
+   reply); a write of a compressed record invalidates the cached copies of that record (and of
+   the few others sharing its slot in a striped table of write epochs), and closing a data file
+   or a database invalidates them all.
+*/
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+
+namespace mongo {
+
+    class Record;
+
+#pragma pack(1)
+    struct CompressedRecordHeader {
+        int negLen;     // -(sizeof(CompressedRecordHeader) + compressed length)
+        int objsize;    // of the uncompressed object
+    };
+#pragma pack()
+
+    /**
+     * @param out receives the header and compressed bytes of 'obj'
+     * @return false if obj does not compress well enough to be worth storing compressed
+     */
+    bool compressRecordData( const BSONObj& obj , std::string* out );
+
+    /** @return an owned, uncompressed copy of the compressed record r */
+    BSONObj uncompressRecord( const Record* r );
+
+    /** call when the compressed record r is written or freed; drops cached copies of it */
+    void compressedRecordWritten( const Record *r );
+
+    /** call when data files are closed or a database is; drops every cached copy */
+    void dataFilesUnmapped();
+
+    /** serverStatus "recordCompression" section: cache hits and misses */
+    void appendRecordCompressionStats( BSONObjBuilder& b );
+
+} // namespace mongo
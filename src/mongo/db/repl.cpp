@@ -251,6 +251,7 @@ namespace mongo {
 
             result.appendNumber("maxBsonObjectSize", BSONObjMaxUserSize);
             result.appendDate("localTime", jsTime());
+            negotiateWireCompression( cmdObj , result );
             return true;
         }
     } cmdismaster;
@@ -20,6 +20,7 @@
 
 #include "pch.h"
 #include "scanandorder.h"
+#include "mongo/db/extsort.h"
 #include "mongo/db/matcher.h"
 #include "mongo/util/mongoutils/str.h"
 
@@ -27,6 +28,17 @@ namespace mongo {
 
     const unsigned ScanAndOrder::MaxScanAndOrderBytes = 32 * 1024 * 1024;
 
+    ScanAndOrder::ScanAndOrder(int startFrom, int limit, const BSONObj &order,
+                               const FieldRangeSet &frs, bool allowSpill) :
+        _cmp( order ),
+        _startFrom(startFrom), _order(order, frs),
+        _approxSize(0), _n(0), _nextSeq(0), _allowSpill(allowSpill) {
+        _limit = limit > 0 ? limit + _startFrom : 0x7fffffff;
+    }
+
+    ScanAndOrder::~ScanAndOrder() {
+    }
+
     void ScanAndOrder::add(const BSONObj& o, const DiskLoc* loc) {
         verify( o.isValid() );
         BSONObj k;
@@ -45,70 +57,97 @@ namespace mongo {
         if ( k.isEmpty() ) {
             return;   
         }
-        if ( (int) _best.size() < _limit ) {
-            _add(k, o, loc);
+        DiskLoc l = loc ? *loc : DiskLoc();
+        if ( _n < _limit || _spill ) {
+            _add(k, o, l);
             return;
         }
-        BestMap::iterator i;
-        verify( _best.end() != _best.begin() );
-        i = _best.end();
-        i--;
-        _addIfBetter(k, o, i, loc);
+        verify( !_best.empty() );
+        _addIfBetter(k, o, l);
     }
 
-
-    void ScanAndOrder::fill( BufBuilder& b, const ParsedQuery *parsedQuery, int& nout ) const {
-        int n = 0;
-        int nFilled = 0;
+    void ScanAndOrder::fill( BufBuilder& b, const ParsedQuery *parsedQuery, int& nout ) {
+        shared_ptr<Cursor> c( new ScanAndOrderCursor( *this, parsedQuery ) );
         Projection *projection = parsedQuery ? parsedQuery->getFields() : NULL;
-        scoped_ptr<Matcher> arrayMatcher;
-        scoped_ptr<MatchDetails> details;
-        if ( projection && projection->getArrayOpType() == Projection::ARRAY_OP_POSITIONAL ) {
-            // the projection specified an array positional match operator; create a new matcher
-            // for the projected array
-            arrayMatcher.reset( new Matcher( parsedQuery->getFilter() ) );
-            details.reset( new MatchDetails );
-            details->requestElemMatchKey();
-        }
-        for ( BestMap::const_iterator i = _best.begin(); i != _best.end(); i++ ) {
-            n++;
-            if ( n <= _startFrom )
-                continue;
-            const BSONObj& o = i->second;
-            massert( 16355, "positional operator specified, but no array match",
-                     ! arrayMatcher || arrayMatcher->matches( o, details.get() ) );
-            fillQueryResultFromObj( b, projection, o, details.get() );
+        bool showDiskLoc = parsedQuery && parsedQuery->showDiskLoc();
+        bool explain = parsedQuery && parsedQuery->isExplain();
+        // a hard limit gets one batch, as on the ordered path
+        bool firstBatch = parsedQuery && !explain;
+        int nFilled = 0;
+        for ( ; c->ok(); c->advance() ) {
+            MatchDetails details;
+            if ( projection && projection->getArrayOpType() == Projection::ARRAY_OP_POSITIONAL )
+                details.requestElemMatchKey();
+            c->currentMatches( &details );
             nFilled++;
-            if ( nFilled >= _limit )
+            if ( explain )
+                continue;
+            DiskLoc loc = c->currLoc();
+            fillQueryResultFromObj( b, projection, c->current(), &details,
+                                    showDiskLoc ? &loc : 0 );
+            if ( firstBatch && parsedQuery->enoughForFirstBatch( nFilled, b.len() ) ) {
+                c->advance();
                 break;
+            }
         }
         nout = nFilled;
+        if ( c->ok() )
+            _remaining = c;
     }
 
-    void ScanAndOrder::_add(const BSONObj& k, const BSONObj& o, const DiskLoc* loc) {
-        BSONObj docToReturn = o;
-        if ( loc ) {
-            BSONObjBuilder b;
-            b.appendElements(o);
-            b.append("$diskLoc", loc->toBSONObj());
-            docToReturn = b.obj();
+    void ScanAndOrder::_add(const BSONObj& k, const BSONObj& o, const DiskLoc& loc) {
+        ++_n;
+        if ( _spill ) {
+            _spillItem( k, o, loc, _nextSeq++ );
+            return;
         }
-        _validateAndUpdateApproxSize( k.objsize() + docToReturn.objsize() );
-        _best.insert(make_pair(k.getOwned(),docToReturn.getOwned()));
+        if ( _allowSpill && _approxSize + k.objsize() + o.objsize() >= MaxScanAndOrderBytes ) {
+            _startSpill();
+            _spillItem( k, o, loc, _nextSeq++ );
+            return;
+        }
+        _validateAndUpdateApproxSize( k.objsize() + o.objsize() );
+        _best.push_back( Item( k.getOwned(), o.getOwned(), loc, _nextSeq++ ) );
+        if ( bounded() )
+            push_heap( _best.begin(), _best.end(), _cmp );
     }
     
-    void ScanAndOrder::_addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i,
-                                    const DiskLoc* loc) {
-        const BSONObj& worstBestKey = i->first;
-        int cmp = worstBestKey.woCompare(k, _order._spec.keyPattern);
+    void ScanAndOrder::_addIfBetter(const BSONObj& k, const BSONObj& o, const DiskLoc& loc) {
+        const Item& worst = _best.front();
+        int cmp = worst.key.woCompare(k, _order._spec.keyPattern);
         if ( cmp > 0 ) {
             // k is better, 'upgrade'
-            _validateAndUpdateApproxSize( -i->first.objsize() + -i->second.objsize() );
-            _best.erase(i);
+            _validateAndUpdateApproxSize( -worst.key.objsize() + -worst.obj.objsize() );
+            pop_heap( _best.begin(), _best.end(), _cmp );
+            _best.pop_back();
+            --_n;
             _add(k, o, loc);
         }
     }
 
+    void ScanAndOrder::_startSpill() {
+        LOG(1) << "scanAndOrder: more than " << MaxScanAndOrderBytes / 1024 / 1024
+               << "MB of matches, sorting externally" << endl;
+        // each run the sorter writes holds about as much as we'd keep in memory
+        _spill.reset( new BSONObjExternalSorter( *IndexDetails::iis[1], _order._spec.keyPattern,
+                                                 MaxScanAndOrderBytes ) );
+        for ( vector<Item>::const_iterator i = _best.begin(); i != _best.end(); ++i )
+            _spillItem( i->key, i->obj, i->loc, i->seq );
+        _best.clear();
+        _approxSize = 0;
+    }
+
+    void ScanAndOrder::_spillItem(const BSONObj& k, const BSONObj& o, const DiskLoc& loc,
+                                  unsigned long long seq) {
+        // the sorter keeps keys, so the object rides along after them.  seq is unique, so the
+        // objects themselves are never compared and equal keys keep their arrival order.
+        BSONObjBuilder b( k.objsize() + o.objsize() + 32 );
+        b.appendElements( k );
+        b.append( "", (long long) seq );
+        b.append( "", o );
+        _spill->add( b.done(), loc );
+    }
+
     void ScanAndOrder::_validateAndUpdateApproxSize( const int approxSizeDelta ) {
         // note : adjust when bson return limit adjusts. note this limit should be a bit higher.
         int newApproxSize = _approxSize + approxSizeDelta;
@@ -119,4 +158,74 @@ namespace mongo {
         _approxSize = newApproxSize;
     }
 
+    ScanAndOrderCursor::ScanAndOrderCursor( ScanAndOrder& so, const ParsedQuery* query ) :
+        _i(0), _ok(false), _nscanned(0), _end(so._limit) {
+        if ( query && query->getFields() &&
+             query->getFields()->getArrayOpType() == Projection::ARRAY_OP_POSITIONAL ) {
+            // the projection specified an array positional match operator; create a new matcher
+            // for the projected array
+            _filter = query->getFilter().getOwned();
+            _arrayMatcher.reset( new Matcher( _filter ) );
+        }
+        if ( so._spill ) {
+            _spill.swap( so._spill );
+            _spill->sort();
+            _spilled.reset( _spill->iterator().release() );
+        }
+        else {
+            _items.swap( so._best );
+            _sorted.reserve( _items.size() );
+            for ( vector<ScanAndOrder::Item>::const_iterator i = _items.begin(); i != _items.end(); ++i )
+                _sorted.push_back( &*i );
+            std::sort( _sorted.begin(), _sorted.end(), so._cmp );
+        }
+        so._approxSize = 0;
+        _next();
+        for ( int i = 0; i < so._startFrom && _ok; ++i )
+            _next();
+    }
+
+    bool ScanAndOrderCursor::advance() {
+        _next();
+        return _ok;
+    }
+
+    void ScanAndOrderCursor::_next() {
+        if ( _nscanned >= _end ) {
+            _ok = false;
+        }
+        else if ( _spilled ) {
+            _ok = _spilled->more();
+            if ( _ok ) {
+                // the object is the last field of the spilled key, see _spillItem().  the
+                // iterator reuses its buffer, so copy it
+                BSONObjExternalSorter::Data d = _spilled->next();
+                BSONObjIterator j( d.first );
+                BSONObj o;
+                while ( j.more() )
+                    o = j.next().embeddedObject();
+                _obj = o.getOwned();
+                _loc = d.second;
+            }
+        }
+        else {
+            _ok = _i < _sorted.size();
+            if ( _ok ) {
+                _obj = _sorted[ _i ]->obj;
+                _loc = _sorted[ _i ]->loc;
+                ++_i;
+            }
+        }
+        if ( _ok )
+            ++_nscanned;
+        else
+            _obj = BSONObj();
+    }
+
+    bool ScanAndOrderCursor::currentMatches( MatchDetails* details ) {
+        massert( 16355, "positional operator specified, but no array match",
+                 ! _arrayMatcher || _arrayMatcher->matches( _obj, details ) );
+        return true;
+    }
+
 } // namespace mongo
@@ -23,6 +23,8 @@
 #include "indexkey.h"
 #include "queryutil.h"
 #include "projection.h"
+#include "cursor.h"
+#include "extsort.h"
 
 namespace mongo {
 
@@ -73,40 +75,88 @@ namespace mongo {
         }
     }
 
-    typedef multimap<BSONObj,BSONObj,BSONObjCmp> BestMap;
+    /** sorts the matches of a query that can't be read in order from an index.
+
+        with a limit only the best skip+limit matches are kept, in a heap with the worst of them
+        on top.  without one every match is kept.  either way, if spilling is allowed, once the
+        matches kept would exceed MaxScanAndOrderBytes they, and every match after, go to an
+        external sorter rather than failing the query.  those past the first batch are then
+        left in a ScanAndOrderCursor for getMore.
+    */
     class ScanAndOrder {
     public:
         static const unsigned MaxScanAndOrderBytes;
 
-        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs) :
-            _best( BSONObjCmp( order ) ),
-            _startFrom(startFrom), _order(order, frs) {
-            _limit = limit > 0 ? limit + _startFrom : 0x7fffffff;
-            _approxSize = 0;
-        }
+        /** @param limit skip+limit bounds the matches kept, 0 for no bound.
+            @param allowSpill if false, fail with ScanAndOrderMemoryLimitExceededAssertionCode
+                   rather than spill to disk - for callers that have an in order plan to fall
+                   back to instead.
+        */
+        ScanAndOrder(int startFrom, int limit, const BSONObj &order, const FieldRangeSet &frs,
+                     bool allowSpill = false);
+        ~ScanAndOrder();
 
-        int size() const { return _best.size(); }
+        int size() const { return _n; }
 
         /**
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if adding would grow memory usage
-         * to ScanAndOrder::MaxScanAndOrderBytes.
+         * to ScanAndOrder::MaxScanAndOrderBytes and we can't spill.
          */
         void add(const BSONObj &o, const DiskLoc* loc);
 
-        /* scanning complete. stick the query result in b for n objects. */
-        void fill(BufBuilder& b, const ParsedQuery *query, int& nout) const;
+        /**
+         * scanning complete.  stick the query result in b, nout objects.  call once.  stops once
+         * it has enough for query's first batch; the rest are then left in remaining().  for an
+         * explain the result is only counted.
+         */
+        void fill(BufBuilder& b, const ParsedQuery *query, int& nout);
+
+        /** @return a cursor over the matches fill() didn't return, or null if none */
+        shared_ptr<Cursor> remaining() const { return _remaining; }
 
     /** Functions for testing. */
     protected:
 
         unsigned approxSize() const { return _approxSize; }
+        bool spilled() const { return _spill.get() != 0; }
 
     private:
 
-        void _add(const BSONObj& k, const BSONObj& o, const DiskLoc* loc);
-
-        void _addIfBetter(const BSONObj& k, const BSONObj& o, const BestMap::iterator& i,
-                          const DiskLoc* loc);
+        friend class ScanAndOrderCursor;
+
+        struct Item {
+            Item( const BSONObj& k, const BSONObj& o, const DiskLoc& l, unsigned long long s ) :
+                key( k ), obj( o ), loc( l ), seq( s ) { }
+            BSONObj key;
+            BSONObj obj;
+            DiskLoc loc;            // null unless the query shows it
+            unsigned long long seq; // order of arrival; matches with equal keys keep it
+        };
+
+        /** orders Items by key, then arrival */
+        class ItemCmp {
+        public:
+            ItemCmp( const BSONObj& keyPattern ) : _keyPattern( keyPattern ) { }
+            bool operator()( const Item& l, const Item& r ) const {
+                int x = l.key.woCompare( r.key, _keyPattern );
+                return x ? x < 0 : l.seq < r.seq;
+            }
+            bool operator()( const Item* l, const Item* r ) const { return (*this)( *l, *r ); }
+        private:
+            BSONObj _keyPattern;
+        };
+
+        bool bounded() const { return _limit != 0x7fffffff; }
+
+        void _add(const BSONObj& k, const BSONObj& o, const DiskLoc& loc);
+
+        /** with a limit and a full heap: replace the worst match with o if it is better */
+        void _addIfBetter(const BSONObj& k, const BSONObj& o, const DiskLoc& loc);
+
+        /** move what we have in memory to the external sorter, which takes all adds after */
+        void _startSpill();
+        void _spillItem(const BSONObj& k, const BSONObj& o, const DiskLoc& loc,
+                        unsigned long long seq);
 
         /**
          * @throw ScanAndOrderMemoryLimitExceededAssertionCode if approxSize would grow too high,
@@ -114,12 +164,59 @@ namespace mongo {
          */
         void _validateAndUpdateApproxSize( const int approxSizeDelta );
 
-        BestMap _best; // key -> full object
+        vector<Item> _best;     // a heap when bounded(), else in arrival order
+        ItemCmp _cmp;
         int _startFrom;
         int _limit;   // max to send back.
         KeyType _order;
         unsigned _approxSize;
+        int _n;
+        unsigned long long _nextSeq;
+        bool _allowSpill;
+        scoped_ptr<BSONObjExternalSorter> _spill;
+        shared_ptr<Cursor> _remaining;
+
+    };
 
+    /** the sorted matches of a ScanAndOrder, skip applied.  they are copies rather than records,
+        so a ClientCursor can hold one across getMores without following writes, and yield
+        freely.  a positional projection's array match is redone in currentMatches().
+    */
+    class ScanAndOrderCursor : public Cursor {
+    public:
+        /** takes the matches of so, which must be done adding */
+        ScanAndOrderCursor( ScanAndOrder& so, const ParsedQuery* query );
+        virtual bool ok() { return _ok; }
+        virtual Record* _current() { verify( false ); return 0; }
+        virtual BSONObj current() { return _obj; }
+        virtual DiskLoc currLoc() { return _loc; }
+        virtual DiskLoc refLoc() { return DiskLoc(); }
+        virtual bool advance();
+        virtual bool supportGetMore() { return true; }
+        virtual bool supportYields() { return true; }
+        virtual bool getsetdup(DiskLoc loc) { return false; }
+        virtual bool isMultiKey() const { return false; }
+        virtual bool modifiedKeys() const { return false; }
+        virtual long long nscanned() { return _nscanned; }
+        virtual bool currentMatches( MatchDetails* details = 0 );
+        virtual string toString() { return "ScanAndOrderCursor"; }
+    private:
+        void _next();
+
+        vector<ScanAndOrder::Item> _items;      // in memory, in arrival order
+        vector<const ScanAndOrder::Item*> _sorted;
+        unsigned _i;
+        scoped_ptr<BSONObjExternalSorter> _spill;
+        scoped_ptr<BSONObjExternalSorter::Iterator> _spilled;   // declared after _spill, its sorter
+
+        bool _ok;
+        BSONObj _obj;
+        DiskLoc _loc;
+        long long _nscanned;
+        long long _end;         // skip+limit: a spilled bounded sort holds more than that
+
+        BSONObj _filter;
+        scoped_ptr<Matcher> _arrayMatcher;
     };
 
 } // namespace mongo
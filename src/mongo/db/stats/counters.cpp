@@ -182,6 +182,10 @@ namespace mongo {
         b.appendNumber( "bytesOut" , _bytesOut );
         b.appendNumber( "numRequests" , _requests );
         _lock.unlock();
+
+        BSONObjBuilder pool( b.subobjStart( "bufferPool" ) );
+        MessageBufferPool::appendStats( pool );
+        pool.done();
     }
 
 
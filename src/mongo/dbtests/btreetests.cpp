@@ -58,3 +58,193 @@ namespace BtreeTests1 {
 namespace BtreeTests2 {
  #include "btreetests.inl"
 }
+
+#undef BtreeBucket
+#undef btree
+#undef btreemod
+#undef Continuation
+#undef testName
+#undef BTVERSION
+#undef TESTTWOSTEP
+
+namespace BtreePrefixTests {
+
+    /** a v:2 (prefix compressed) index on keys with long common leading strings */
+    class Base {
+    public:
+        Base() {
+            _c.dropCollection( ns() );
+            _c.dropCollection( ns1() );
+        }
+        virtual ~Base() {
+            _c.dropCollection( ns() );
+            _c.dropCollection( ns1() );
+        }
+    protected:
+        static const char *ns() { return "unittests.btreeprefix"; }
+        static const char *ns1() { return "unittests.btreeprefix_v1"; }
+        static BSONObj keyPattern() { return BSON( "t" << 1 << "p" << 1 ); }
+        static BSONObj doc( int i ) {
+            stringstream p;
+            p << "/org/engineering/projects/p" << i / 100 << "/src/file" << i % 100 << ".cpp";
+            return BSON( "_id" << i << "t" << "tenant-00000000042" << "p" << p.str() );
+        }
+        void ensureIndex( const char *ns, int v ) {
+            _c.ensureIndex( ns, keyPattern(), false, "tp", false, false, v );
+        }
+        void insert( const char *ns, int n ) {
+            for( int i = 0; i < n; ++i ) {
+                _c.insert( ns, doc( i ) );
+            }
+        }
+        bool present( int i ) {
+            BSONObj o = doc( i );
+            BSONObj q = BSON( "t" << o[ "t" ] << "p" << o[ "p" ] );
+            return !_c.findOne( ns(), Query( q ).hint( keyPattern() ) ).isEmpty();
+        }
+        long long fullValidate( const char *ns ) {
+            Lock::GlobalWrite lk;
+            Client::Context ctx( ns );
+            IndexDetails& id = nsdetails( ns )->idx( 1 );
+            return id.idxInterface().fullValidate( id.head, id.keyPattern() );
+        }
+        long long buckets( const char *ns ) {
+            Lock::GlobalWrite lk;
+            Client::Context ctx( ns );
+            IndexDetails& id = nsdetails( ns )->idx( 1 );
+            return nsdetails( id.indexNamespace().c_str() )->stats.nrecords;
+        }
+        DBDirectClient _c;
+    };
+
+    class InsertFindRemove : public Base {
+    public:
+        void run() {
+            ensureIndex( ns(), 2 );
+            insert( ns(), 3000 );
+            ASSERT_EQUALS( 3000, fullValidate( ns() ) );
+            for( int i = 0; i < 3000; i += 7 ) {
+                ASSERT( present( i ) );
+            }
+            // removals merge and rebalance buckets with differing prefixes
+            _c.remove( ns(), BSON( "_id" << GTE << 500 << LT << 2500 ) );
+            ASSERT_EQUALS( 1000, fullValidate( ns() ) );
+            for( int i = 0; i < 3000; i += 7 ) {
+                ASSERT_EQUALS( i < 500 || i >= 2500, present( i ) );
+            }
+            insert( ns(), 3000 ); // dups on _id are rejected; 2000 get back in
+            ASSERT_EQUALS( 3000, fullValidate( ns() ) );
+        }
+    };
+
+    class Denser : public Base {
+    public:
+        void run() {
+            ensureIndex( ns(), 2 );
+            ensureIndex( ns1(), 1 );
+            insert( ns(), 5000 );
+            insert( ns1(), 5000 );
+            ASSERT_EQUALS( 5000, fullValidate( ns() ) );
+            ASSERT( buckets( ns() ) < buckets( ns1() ) );
+        }
+    };
+
+    class BulkBuild : public Base {
+    public:
+        void run() {
+            insert( ns(), 5000 );
+            insert( ns1(), 5000 );
+            ensureIndex( ns(), 2 );
+            ensureIndex( ns1(), 1 );
+            ASSERT_EQUALS( 5000, fullValidate( ns() ) );
+            ASSERT( buckets( ns() ) < buckets( ns1() ) );
+            for( int i = 0; i < 5000; i += 13 ) {
+                ASSERT( present( i ) );
+            }
+        }
+    };
+
+    /** keys whose prefix forms need escaping, and keys kept in bson format */
+    class OddKeys : public Base {
+    public:
+        void run() {
+            ensureIndex( ns(), 2 );
+            string big( 300, 'x' );
+            for( int i = 0; i < 400; ++i ) {
+                stringstream p;
+                p << "tenant-00000000042" << '\0' << i;
+                BSONObjBuilder b;
+                b << "_id" << i;
+                b.append( "t", p.str() );
+                if ( i % 3 == 0 )
+                    b << "p" << big;
+                else if ( i % 3 == 1 )
+                    b << "p" << i;
+                else
+                    b << "p" << BSON( "x" << i );
+                _c.insert( ns(), b.obj() );
+            }
+            ASSERT_EQUALS( 400, fullValidate( ns() ) );
+            ASSERT_EQUALS( 134, _c.query( ns(), Query( BSON( "p" << big ) ).hint( keyPattern() ) )->itcount() );
+            stringstream p;
+            p << "tenant-00000000042" << '\0' << 7;
+            ASSERT_EQUALS( 7, _c.findOne( ns(), Query( BSON( "t" << p.str() ) ).hint( keyPattern() ) )[ "_id" ].numberInt() );
+        }
+    };
+
+    /** compareToStored() orders keys as woCompare() does with the decoded stored key */
+    class CompareToStored {
+    public:
+        void run() {
+            vector<BSONObj> objs;
+            objs.push_back( BSON( "t" << "tenant-42" << "p" << "/a/b" ) );
+            objs.push_back( BSON( "t" << "tenant-42" << "p" << "/a/bc" ) );
+            objs.push_back( BSON( "t" << "tenant-42" << "p" << string( "/a/b\0c", 6 ) ) );
+            objs.push_back( BSON( "t" << "tenant-42" << "p" << 3.5 ) );
+            objs.push_back( BSON( "t" << "tenant-42" << "p" << -7 ) );
+            objs.push_back( BSON( "t" << "tenant-4" << "p" << "/a/b" ) );
+            objs.push_back( BSON( "t" << "tenant-43" << "p" << OID( "4f3a3c4c8d3a9c0a10b6c5d1" ) ) );
+            objs.push_back( BSON( "t" << "tenant-42" << "p" << BSON( "x" << 1 ) ) ); // kept as bson
+            {
+                BSONObjBuilder b;
+                b.append( "t", string( "tenant\0-42", 10 ) );
+                b.append( "p", "/a" );
+                objs.push_back( b.obj() );
+            }
+            Ordering orders[] = { Ordering::make( BSON( "t" << 1 << "p" << 1 ) ),
+                                  Ordering::make( BSON( "t" << 1 << "p" << -1 ) ) };
+            for( unsigned i = 0; i < objs.size(); ++i ) {
+                KeyV2Owned stored( objs[ i ] );
+                BufBuilder form;
+                stored.appendPrefixForm( form );
+                // store the key against each possible shared prefix length
+                for( int u = 1; u < form.len() && u < 256; ++u ) {
+                    KeyV2 decoded( form.buf(), u, form.buf() + u );
+                    for( unsigned j = 0; j < objs.size(); ++j ) {
+                        KeyV2Owned key( objs[ j ] );
+                        for( int o = 0; o < 2; ++o ) {
+                            int expected = key.woCompare( decoded, orders[ o ] );
+                            int got = key.compareToStored( form.buf(), u, form.buf() + u, orders[ o ] );
+                            ASSERT_EQUALS( expected < 0, got < 0 );
+                            ASSERT_EQUALS( expected > 0, got > 0 );
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "btreeprefix" ) {
+        }
+        void setupTests() {
+            add< InsertFindRemove >();
+            add< Denser >();
+            add< BulkBuild >();
+            add< OddKeys >();
+            add< CompareToStored >();
+        }
+    } myall;
+
+} // namespace BtreePrefixTests
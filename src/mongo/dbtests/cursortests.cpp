@@ -283,6 +283,31 @@ namespace CursorTests {
             }
         };
 
+        /** skipPastPrefix() seeks to the next value of the prefix, within the bounds. */
+        class SkipPastPrefix : public Base {
+        public:
+            void run() {
+                _c.dropCollection( ns() );
+                IndexSpec idx( BSON( "a" << 1 << "b" << 1 ) );
+                _c.ensureIndex( ns(), idx.keyPattern );
+                for( int i = 0; i < 500; ++i ) {
+                    _c.insert( ns(), BSON( "a" << i % 5 << "b" << i ) );
+                }
+                FieldRangeSet frs( ns(), BSON( "b" << GT << 100 ), true, true );
+                boost::shared_ptr<FieldRangeVector> frv( new FieldRangeVector( frs, idx, 1 ) );
+                Client::WriteContext ctx( ns() );
+                scoped_ptr<BtreeCursor> c( BtreeCursor::make( nsdetails( ns() ), nsdetails( ns() )->idx(1), frv, 1 ) );
+                for( int a = 0; a < 5; ++a ) {
+                    ASSERT( c->ok() );
+                    ASSERT_EQUALS( a, c->currKey().firstElement().number() );
+                    ASSERT( c->currKey()[ 1 ].number() > 100 );
+                    c->skipPastPrefix( 1 );
+                }
+                ASSERT( !c->ok() );
+                ASSERT( c->nscanned() < 20 );
+            }
+        };
+
     } // namespace BtreeCursor
     
     namespace ClientCursor {
@@ -368,7 +393,7 @@ namespace CursorTests {
                 ClientCursor::YieldData data;
                 clientCursor->prepareToYield( data );
                 // The cursor will be advanced in aboutToDelete().
-                ClientCursor::aboutToDelete( loc );
+                ClientCursor::aboutToDelete( ns(), loc );
                 clientCursor->recoverFromYield( data );
                 ASSERT( clientCursor->ok() );
                 
@@ -427,6 +452,85 @@ namespace CursorTests {
             }
         };
 
+        /**
+         * Cursors on many namespaces are registered, found, listed and invalidated independently
+         * across the shards of the id registry.
+         */
+        class ManyCursors : public Base {
+        public:
+            ~ManyCursors() {
+                client.dropCollection( ns2() );
+            }
+            void run() {
+                client.insert( ns(), BSON( "a" << 1 ) );
+                client.insert( ns2(), BSON( "a" << 1 ) );
+                unsigned startNumCursors = ClientCursor::numCursors();
+                vector<CursorId> ids;
+                const char *namespaces[] = { ns(), ns2() };
+                for( int n = 0; n < 2; ++n ) {
+                    Client::ReadContext ctx( namespaces[ n ] );
+                    for( int i = 0; i < 100; ++i ) {
+                        ClientCursor *cc = new ClientCursor( 0, theDataFileMgr.findAll( namespaces[ n ] ),
+                                                             namespaces[ n ] );
+                        ids.push_back( cc->cursorid() );
+                    }
+                }
+                ASSERT_EQUALS( startNumCursors + 200, ClientCursor::numCursors() );
+                for( vector<CursorId>::const_iterator i = ids.begin(); i != ids.end(); ++i ) {
+                    ClientCursor::Pin pin( *i );
+                    ASSERT( pin.c() );
+                    ASSERT_EQUALS( *i, pin.c()->cursorid() );
+                }
+
+                set<CursorId> found;
+                ClientCursor::find( ns(), found );
+                ASSERT_EQUALS( 100U, found.size() );
+                {
+                    Client::WriteContext ctx( ns() );
+                    ClientCursor::invalidate( ns() );
+                }
+                found.clear();
+                ClientCursor::find( ns(), found );
+                ASSERT( found.empty() );
+                ClientCursor::find( ns2(), found );
+                ASSERT_EQUALS( 100U, found.size() );
+
+                for( set<CursorId>::const_iterator i = found.begin(); i != found.end(); ++i ) {
+                    ASSERT( ClientCursor::erase( *i ) );
+                }
+                ASSERT_EQUALS( startNumCursors, ClientCursor::numCursors() );
+            }
+        private:
+            static const char *ns2() { return "unittests.cursortests.clientcursor2"; }
+        };
+
+        /**
+         * Deletes don't register a namespace no cursor was opened on, and a dropped namespace's
+         * registry goes with it.
+         */
+        class CursorsByLocLifetime : public Base {
+        public:
+            void run() {
+                client.insert( ns(), BSON( "a" << 1 ) );
+                client.remove( ns(), BSONObj() );
+                {
+                    Client::ReadContext ctx( ns() );
+                    ASSERT( !cc().database()->findCursorsByLoc( ns() ) );
+                }
+                client.insert( ns(), BSON( "a" << 1 ) );
+                {
+                    Client::WriteContext ctx( ns() );
+                    ClientCursor::Holder c( new ClientCursor( 0, theDataFileMgr.findAll( ns() ), ns() ) );
+                    ASSERT( cc().database()->findCursorsByLoc( ns() ) );
+                }
+                client.dropCollection( ns() );
+                {
+                    Client::ReadContext ctx( ns() );
+                    ASSERT( !cc().database()->findCursorsByLoc( ns() ) );
+                }
+            }
+        };
+
         namespace Pin {
 
             class Base {
@@ -514,10 +618,13 @@ namespace CursorTests {
             add<BtreeCursor::RangeEq>();
             add<BtreeCursor::RangeIn>();
             add<BtreeCursor::AbortImplicitScan>();
+            add<BtreeCursor::SkipPastPrefix>();
             add<ClientCursor::HandleDelete>();
             add<ClientCursor::AboutToDelete>();
             add<ClientCursor::AboutToDeleteDuplicate>();
             add<ClientCursor::AboutToDeleteDuplicateNextClause>();
+            add<ClientCursor::ManyCursors>();
+            add<ClientCursor::CursorsByLocLifetime>();
             add<ClientCursor::Pin::PinCursor>();
             add<ClientCursor::Pin::PinTwice>();
             add<ClientCursor::Pin::CursorDeleted>();
@@ -1770,6 +1770,67 @@ namespace JsobjTests {
         };
 
 
+        /** many runs of interleaved keys, with duplicates: the merge must give exact (key, loc) order */
+        class ManyRuns {
+        public:
+            void run() {
+                const int total = 20000;
+                BSONObjExternalSorter sorter( indexInterfaceForTheseTests, BSONObj() , 20000 );
+                for ( int i=0; i<total; i++ ) {
+                    sorter.add( BSON( "x" << ( i * 7919 ) % 1000 << "s" << "some padding to compress" ) , 1 , total - i );
+                }
+
+                sorter.sort();
+                ASSERT( sorter.numFiles() > 20 );
+
+                auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+                int num=0;
+                int prevX = -1;
+                DiskLoc prevLoc;
+                while ( i->more() ) {
+                    pair<BSONObj,DiskLoc> p = i->next();
+                    int x = p.first["x"].numberInt();
+                    ASSERT( x >= prevX );
+                    if ( x == prevX )
+                        ASSERT( prevLoc < p.second );
+                    ASSERT_EQUALS( "some padding to compress" , p.first["s"].String() );
+                    prevX = x;
+                    prevLoc = p.second;
+                    num++;
+                }
+                ASSERT_EQUALS( total , num );
+            }
+        };
+
+        /** a single run big enough to be sorted in chunks on several threads */
+        class ParallelRun {
+        public:
+            void run() {
+                const int total = 200000;
+                BSONObjExternalSorter sorter( indexInterfaceForTheseTests );
+                for ( int i=0; i<total; i++ ) {
+                    sorter.add( BSON( "x" << rand() % 50000 ) , 2 , i );
+                }
+
+                ProgressMeter pm( 1 );
+                sorter.sort( &pm );
+                ASSERT_EQUALS( 0 , sorter.numFiles() );
+                ASSERT_EQUALS( pm.total() , pm.done() );
+
+                auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+                int num=0;
+                double prev = 0;
+                while ( i->more() ) {
+                    pair<BSONObj,DiskLoc> p = i->next();
+                    num++;
+                    double cur = p.first["x"].number();
+                    ASSERT( cur >= prev );
+                    prev = cur;
+                }
+                ASSERT_EQUALS( total , num );
+            }
+        };
+
         class D1 {
         public:
             void run() {
@@ -2384,6 +2445,8 @@ namespace JsobjTests {
             add< external_sort::Big1 >();
             add< external_sort::Big2 >();
             add< external_sort::Big3 >();
+            add< external_sort::ManyRuns >();
+            add< external_sort::ParallelRun >();
             add< external_sort::D1 >();
             add< CompatBSON >();
             add< CompareDottedFieldNamesTest >();
@@ -112,6 +112,40 @@ namespace MatcherTests {
         }
     };
 
+    /** A long $in list, with values of hashed and unhashed types. */
+    class LargeIN {
+    public:
+        void run() {
+            BSONArrayBuilder a;
+            for( int i = 0; i < 20000; i += 2 ) {
+                a.append( i );
+            }
+            a.append( "s" );
+            a.append( BSON( "x" << 1 ) );
+            a.append( BSON_ARRAY( 1 << 2 ) );
+            a.appendNull();
+            Matcher m( BSON( "a" << BSON( "$in" << a.arr() ) ) );
+
+            ASSERT( m.matches( BSON( "a" << 10 ) ) );
+            ASSERT( m.matches( BSON( "a" << 10.0 ) ) );
+            ASSERT( m.matches( BSON( "a" << 10LL ) ) );
+            ASSERT( !m.matches( BSON( "a" << 11 ) ) );
+            ASSERT( !m.matches( BSON( "a" << 20000 ) ) );
+            ASSERT( m.matches( BSON( "a" << BSON_ARRAY( 7 << 18 ) ) ) );
+            ASSERT( m.matches( BSON( "a" << "s" ) ) );
+            ASSERT( !m.matches( BSON( "a" << "t" ) ) );
+            ASSERT( m.matches( BSON( "a" << BSON( "x" << 1.0 ) ) ) );
+            ASSERT( !m.matches( BSON( "a" << BSON( "x" << 2 ) ) ) );
+            ASSERT( m.matches( BSON( "a" << BSON_ARRAY( BSON_ARRAY( 1 << 2 ) ) ) ) );
+            ASSERT( m.matches( BSON( "b" << 1 ) ) );
+
+            Matcher nin( BSON( "a" << BSON( "$nin" << BSON_ARRAY( 1 << 2.0 ) ) ) );
+            ASSERT( !nin.matches( BSON( "a" << 2 ) ) );
+            ASSERT( nin.matches( BSON( "a" << 3 ) ) );
+            ASSERT( nin.matches( BSON( "b" << 1 ) ) );
+        }
+    };
+
     class MixedNumericEmbedded {
     public:
         void run() {
@@ -249,6 +283,71 @@ namespace MatcherTests {
         }
     };
 
+    /** the compiled program agrees with the interpreted matcher */
+    class Compiled {
+    public:
+        void run() {
+            const char* queries[] = {
+                "{a:5}", "{a:{$gt:3,$lt:7}}", "{a:{$ne:5}}", "{a:{$ne:null}}", "{a:null}",
+                "{a:{$in:[1,5,null]}}", "{a:{$nin:[5,'x']}}", "{a:{$exists:false}}",
+                "{a:{$mod:[2,1]}}", "{a:{$type:2}}", "{a:{$size:2}}", "{a:/^x/}", "{a:{$not:/^x/}}",
+                "{'b.c':3}", "{'b.c':null}", "{'b.c':{$exists:true},'b.d':{$lt:5}}", "{a:{c:3}}",
+                "{$and:[{a:{$gte:1}},{'b.c':{$ne:4}}]}", "{a:5,$or:[{'b.c':3},{e:1}]}", 0
+            };
+            const char* docs[] = {
+                "{}", "{a:5}", "{a:5.0}", "{a:null}", "{a:'xy'}", "{a:'yx'}", "{a:7,b:5}",
+                "{a:{c:3}}", "{b:{c:3}}", "{b:{c:3,d:4}}", "{b:{c:null}}", "{b:{d:4},e:1}",
+                "{a:[5,6]}", "{b:[{c:3}]}", "{a:5,b:{c:[3]}}", "{a:3,a:5}", 0
+            };
+            for ( int i = 0; queries[i]; i++ ) {
+                Matcher m( fromjson( queries[i] ) );
+                ASSERT( m.compiled() );
+                for ( int j = 0; docs[j]; j++ ) {
+                    BSONObj doc = fromjson( docs[j] );
+                    if ( m.matches( doc ) != m.matchesInterpreted( doc ) ) {
+                        string fail = string( queries[i] ) + " " + docs[j];
+                        FAIL( fail.c_str() );
+                    }
+                }
+            }
+            ASSERT( !Matcher( BSON( "a" << BSON( "$elemMatch" << BSON( "b" << 1 ) ) ) ).compiled() );
+            ASSERT( !Matcher( fromjson( "{$or:[{a:1},{b:1}]}" ) ).compiled() );
+        }
+    };
+
+    class CompiledTiming {
+    public:
+        void run() {
+            vector<BSONObj> docs;
+            for ( int i = 0; i < 1000; i++ ) {
+                docs.push_back( BSON( "_id" << i << "name" << "somebody" << "a" << i % 10 <<
+                                      "b" << BSON( "c" << i % 7 << "d" << "x" ) <<
+                                      "e" << i * 1.5 << "f" << "zzz" ) );
+            }
+            const char* queries[] = {
+                "{a:5}", "{a:{$gt:3,$lt:7},e:{$gte:100}}", "{'b.c':3,'b.d':'x',f:'zzz'}",
+                "{a:{$in:[1,3,5,7]},name:{$ne:'x'}}", 0
+            };
+            for ( int i = 0; queries[i]; i++ ) {
+                Matcher m( fromjson( queries[i] ) );
+                int interpreted = 0, compiled = 0;
+                Timer t;
+                for ( int r = 0; r < 100; r++ )
+                    for ( unsigned j = 0; j < docs.size(); j++ )
+                        interpreted += m.matchesInterpreted( docs[j] );
+                long interpretedMillis = t.millis();
+                t.reset();
+                for ( int r = 0; r < 100; r++ )
+                    for ( unsigned j = 0; j < docs.size(); j++ )
+                        compiled += m.matches( docs[j] );
+                long compiledMillis = t.millis();
+                ASSERT_EQUALS( interpreted, compiled );
+                cout << queries[i] << " interpreted: " << interpretedMillis
+                     << " compiled: " << compiledMillis << endl;
+            }
+        }
+    };
+
     /**
      * Helper class to extract the top level equality fields of a matcher, which can serve as a
      * useful way to identify the matcher.
@@ -363,6 +462,7 @@ namespace MatcherTests {
             add<MixedNumericEqual>();
             add<MixedNumericGt>();
             add<MixedNumericIN>();
+            add<LargeIN>();
             add<Size>();
             add<MixedNumericEmbedded>();
             add<ElemMatchKey>();
@@ -370,6 +470,8 @@ namespace MatcherTests {
             add<Covered::ElemMatchKeyIndexed>();
             add<Covered::ElemMatchKeyIndexedSingleKey>();
             add<AllTiming>();
+            add<Compiled>();
+            add<CompiledTiming>();
             add<Visit>();
         }
     } dball;
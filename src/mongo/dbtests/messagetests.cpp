@@ -0,0 +1,97 @@
+// messagetests.cpp : util/net/message.{h,cpp} unit tests.
+
+/**
+ *    Copyright (C) 2012 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pch.h"
+
+#include "mongo/util/net/message.h"
+
+#include "dbtests.h"
+
+namespace MessageTests {
+
+    /** a released buffer is handed out again for any size in the same class */
+    class PoolReuse {
+    public:
+        void run() {
+            char *a = MessageBufferPool::allocate( 2000 );
+            MessageBufferPool::release( a );
+            char *b = MessageBufferPool::allocate( 1500 );
+            ASSERT_EQUALS( a, b );
+            MessageBufferPool::release( b );
+        }
+    };
+
+    /** sizes in different classes don't share buffers */
+    class PoolClasses {
+    public:
+        void run() {
+            char *a = MessageBufferPool::allocate( 500 );
+            char *b = MessageBufferPool::allocate( 5000 );
+            ASSERT( a != b );
+            MessageBufferPool::release( a );
+            char *c = MessageBufferPool::allocate( 5000 );
+            ASSERT( a != c );
+            MessageBufferPool::release( b );
+            MessageBufferPool::release( c );
+        }
+    };
+
+    /** buffers over the largest class come from malloc and are usable end to end */
+    class PoolOversize {
+    public:
+        void run() {
+            int size = ( 1 << MessageBufferPool::MaxClassBits ) * 4;
+            char *a = MessageBufferPool::allocate( size );
+            memset( a, 'x', size );
+            MessageBufferPool::release( a );
+        }
+    };
+
+    /** Message::reset() hands a pooled buffer back */
+    class MessageReturnsBuffer {
+    public:
+        void run() {
+            char *buf = MessageBufferPool::allocate( 100 );
+            MsgData *md = (MsgData *) buf;
+            md->len = MsgDataHeaderSize;
+            md->setOperation( dbMsg );
+            {
+                Message m;
+                m.setPooledData( md );
+                Message other;
+                other = m; // ownership, including pool membership, moves
+                ASSERT( m.empty() );
+            }
+            ASSERT_EQUALS( buf, MessageBufferPool::allocate( 100 ) );
+            MessageBufferPool::release( buf );
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "message" ) {}
+
+        void setupTests() {
+            add< PoolReuse >();
+            add< PoolClasses >();
+            add< PoolOversize >();
+            add< MessageReturnsBuffer >();
+        }
+    } myall;
+
+} // namespace MessageTests
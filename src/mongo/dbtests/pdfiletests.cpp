@@ -378,6 +378,28 @@ namespace PdfileTests {
         }
     };
 
+    /** reads of compressed records after the database is dropped and created again */
+    class CompressedRecordsRecreated {
+    public:
+        void run() {
+            const string dbname = "unittests_compressed";
+            const string ns = dbname + ".c";
+            DBDirectClient db;
+            db.dropDatabase( dbname );
+            for ( int i = 0; i < 3; i++ ) {
+                // a new value each time, easily compressible, at the same place in a new file
+                string v( 10000 , 'a' + i );
+                BSONObj info;
+                ASSERT( db.createCollection( ns ) );
+                BSONObj cmd = BSON( "collMod" << "c" << "compressRecords" << true );
+                ASSERT( db.runCommand( dbname , cmd , info ) );
+                db.insert( ns , BSON( "_id" << 1 << "v" << v ) );
+                ASSERT_EQUALS( v , db.findOne( ns , BSONObj() )[ "v" ].String() );
+                ASSERT_EQUALS( v , db.findOne( ns , BSON( "_id" << 1 ) )[ "v" ].String() );
+                db.dropDatabase( dbname );
+            }
+        }
+    };
 
     class All : public Suite {
     public:
@@ -400,6 +422,7 @@ namespace PdfileTests {
             add< Insert::UpdateDate >();
             add< ExtentSizing >();
             add< ExtentAllocOrder >();
+            add< CompressedRecordsRecreated >();
         }
     } myall;
 
@@ -19,6 +19,7 @@
  * Performance timing and space utilization testing for btree indexes.
  */
 
+#include <iomanip>
 #include <iostream>
 
 #include <boost/random/bernoulli_distribution.hpp>
@@ -398,12 +399,75 @@ private:
     char _buf[ 1024 ];
 };
 
+/**
+ * Compares index version 1 with the prefix compressed index version 2 on
+ * compound keys with long shared leading strings (a tenant id and a path), as
+ * multi-tenant schemas have.  The same documents are loaded into one
+ * collection per index version; for each we print the index size and the time
+ * taken by indexed point lookups in random order.
+ */
+class PrefixCompressionComparison {
+public:
+    PrefixCompressionComparison( DBClientConnection &conn, int docs ) :
+        _conn( conn ),
+        _docs( docs ) {
+    }
+    void run() {
+        cout << "indexVersion,docs,totalBucketSize,lookups,lookupMillis" << endl;
+        runVersion( 1 );
+        runVersion( 2 );
+    }
+private:
+    static string tenant( int i ) {
+        stringstream ss;
+        ss << "tenant-" << setw( 12 ) << setfill( '0' ) << i % 20;
+        return ss.str();
+    }
+    static string path( int i ) {
+        stringstream ss;
+        ss << "/home/projects/" << i % 50 << "/src/main/java/com/example/service/Module" << i << ".java";
+        return ss.str();
+    }
+    void runVersion( int v ) {
+        stringstream coll;
+        coll << "btreeperf_prefix_v" << v;
+        string collNs = string( db ) + "." + coll.str();
+        _conn.dropCollection( collNs );
+        _conn.ensureIndex( collNs, BSON( "t" << 1 << "p" << 1 ), false, "", false, false, v );
+        for( int i = 0; i < _docs; ++i ) {
+            _conn.insert( collNs, BSON( "t" << tenant( i ) << "p" << path( i ) ) );
+        }
+        _conn.getLastError();
+
+        BSONObj result;
+        _conn.runCommand( db, BSON( "collstats" << ( coll.str() + ".$t_1_p_1" ) ), result );
+        long long totalBucketSize = result.getField( "count" ).numberLong() * 8192;
+
+        uniform_int< int > docRange( 0, _docs - 1 );
+        variate_generator< mt19937&, uniform_int< int > > nextDoc( randomNumberGenerator, docRange );
+        int lookups = _docs < 100000 ? _docs : 100000;
+        Timer t;
+        for( int i = 0; i < lookups; ++i ) {
+            int d = nextDoc();
+            _conn.findOne( collNs, Query( BSON( "t" << tenant( d ) << "p" << path( d ) ) ).hint( BSON( "t" << 1 << "p" << 1 ) ) );
+        }
+        cout << v << ',' << _docs << ',' << totalBucketSize << ',' << lookups << ',' << t.millis() << endl;
+    }
+    DBClientConnection &_conn;
+    int _docs;
+};
+
 int main( int argc, const char **argv ) {
 
     DBClientConnection conn;
     conn.connect( "127.0.0.1:27017" );
     conn.dropCollection( ns );
 
+    if ( argc > 1 && string( argv[ 1 ] ) == "--prefix" ) {
+        PrefixCompressionComparison( conn, argc > 2 ? atoi( argv[ 2 ] ) : 1000000 ).run();
+        return 0;
+    }
+
 //    UniformInsertRangedUniformRemoveInteger strategy;
 //    UniformInsertUniformRemoveInteger strategy;
 //    UniformInsertRangedUniformRemoveString strategy;
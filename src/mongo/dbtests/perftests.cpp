@@ -1061,6 +1061,39 @@ namespace PerfTests {
         }
     };
 
+    /** removes and reinserts documents of random sizes so the deleted lists fill with records
+        that are slightly too small.  compares the default allocator with usePowerOf2Sizes,
+        see NamespaceDetails::__pow2Alloc()
+    */
+    template< bool PowerOf2 >
+    class Churn : public B {
+        enum { N = 10000 };
+        static BSONObj doc( int id ) {
+            return BSON( "_id" << id << "s" << string( 20 + std::rand() % 1000 , 'x' ) );
+        }
+    public:
+        virtual int howLongMillis() { return 3000; }
+        virtual bool showDurStats() { return false; }
+        string name() { return PowerOf2 ? "churn-powerof2-sizes" : "churn-exact-fit"; }
+        void prep() {
+            client().createCollection( ns() );
+            if ( PowerOf2 ) {
+                BSONObj info;
+                ASSERT( client().runCommand( "perftest" , BSON( "collMod" << name() << "usePowerOf2Sizes" << true ) , info ) );
+            }
+            for ( int i = 0; i < N; i++ )
+                client().insert( ns(), doc( i ) );
+        }
+        void timed() {
+            int id = std::rand() % N;
+            client().remove( ns(), BSON( "_id" << id ) );
+            client().insert( ns(), doc( id ) );
+        }
+        void post() {
+            ASSERT( client().count( ns() ) <= N );
+        }
+    };
+
     template <typename T>
     class MoreIndexes : public T {
     public:
@@ -1159,6 +1192,8 @@ namespace PerfTests {
                 add< Update1 >();
                 add< MoreIndexes<Update1> >();
                 add< InsertBig >();
+                add< Churn<false> >();
+                add< Churn<true> >();
             }
         }
     } myall;
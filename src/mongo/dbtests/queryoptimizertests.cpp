@@ -23,6 +23,7 @@
 #include "../db/ops/count.h"
 #include "../db/ops/query.h"
 #include "../db/ops/delete.h"
+#include "mongo/db/index_intersection.h"
 #include "mongo/db/json.h"
 #include "dbtests.h"
 
@@ -540,6 +541,34 @@ namespace QueryOptimizerTests {
             }
         };
         
+        /** With indexSkipScan set, an index is helpful if a field after the first is constrained. */
+        class SkipScan : public Base {
+        public:
+            SkipScan() : _old( indexSkipScan ) {}
+            ~SkipScan() { indexSkipScan = _old; }
+            void run() {
+                indexSkipScan = true;
+                scoped_ptr<QueryPlan> p( QueryPlan::make( nsd(), INDEXNO( "a" << 1 << "b" << 1 ),
+                                                         FRSP( BSON( "b" << 1 ) ),
+                                                         FRSP2( BSON( "b" << 1 ) ),
+                                                         BSON( "b" << 1 ), BSONObj() ) );
+                ASSERT_EQUALS( QueryPlan::Helpful, p->utility() );
+                scoped_ptr<QueryPlan> p2( QueryPlan::make( nsd(), INDEXNO( "b" << 1 << "c" << 1 ),
+                                                          FRSP( BSON( "d" << 1 ) ),
+                                                          FRSP2( BSON( "d" << 1 ) ),
+                                                          BSON( "d" << 1 ), BSONObj() ) );
+                ASSERT_EQUALS( QueryPlan::Unhelpful, p2->utility() );
+                indexSkipScan = false;
+                scoped_ptr<QueryPlan> p3( QueryPlan::make( nsd(), INDEXNO( "a" << 1 << "b" << 1 ),
+                                                          FRSP( BSON( "b" << 1 ) ),
+                                                          FRSP2( BSON( "b" << 1 ) ),
+                                                          BSON( "b" << 1 ), BSONObj() ) );
+                ASSERT_EQUALS( QueryPlan::Unhelpful, p3->utility() );
+            }
+        private:
+            bool _old;
+        };
+
         class KeyFieldsOnly : public Base {
         public:
             void run() {
@@ -1354,6 +1383,162 @@ namespace QueryOptimizerTests {
             }
         };
 
+        /** A pinned plan runs alone and stays cached until unpinned. */
+        class PinnedPlan : public Base {
+        public:
+            void run() {
+                client().ensureIndex( ns(), BSON( "a" << 1 ) );
+                client().ensureIndex( ns(), BSON( "b" << 1 ) );
+                QueryPattern pattern = makePattern( BSON( "a" << 1 ), BSON( "b" << 1 ) );
+
+                NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get( ns() );
+                nsdt.pinCachedQueryPlan( pattern,
+                                        CachedQueryPlan( BSON( "b" << 1 ), 0,
+                                                        CandidatePlanCharacter( true, false ),
+                                                        true ) );
+                {
+                    shared_ptr<QueryPlanSet> qps = makeQps( BSON( "a" << 1 ), BSON( "b" << 1 ) );
+                    ASSERT_EQUALS( 1, qps->nPlans() );
+                    ASSERT_EQUALS( BSON( "b" << 1 ), qps->firstPlan()->indexKey() );
+                    ASSERT( qps->usingCachedPlan() );
+                    ASSERT( qps->usingPinnedPlan() );
+                    // No fallback plans are tried.
+                    ASSERT( !qps->hasPossiblyExcludedPlans() );
+                }
+
+                // Neither another winning plan nor writes replace it.
+                nsdt.registerCachedQueryPlanForPattern( pattern,
+                                                       CachedQueryPlan( BSON( "a" << 1 ), 1,
+                                                        CandidatePlanCharacter( true, true ) ) );
+                for( int i = 0; i < 100; ++i ) {
+                    nsdt.notifyOfWriteOp();
+                }
+                CachedQueryPlan cached = nsdt.cachedQueryPlanForPattern( pattern );
+                ASSERT_EQUALS( BSON( "b" << 1 ), cached.indexKey() );
+                ASSERT( cached.pinned() );
+
+                // Once unpinned it may be.
+                ASSERT( nsdt.unpinCachedQueryPlan( pattern ) );
+                ASSERT( !nsdt.unpinCachedQueryPlan( pattern ) );
+                nsdt.registerCachedQueryPlanForPattern( pattern,
+                                                       CachedQueryPlan( BSON( "a" << 1 ), 1,
+                                                        CandidatePlanCharacter( true, true ) ) );
+                ASSERT_EQUALS( BSON( "a" << 1 ),
+                               nsdt.cachedQueryPlanForPattern( pattern ).indexKey() );
+
+                // Index changes clear pinned plans too.
+                nsdt.pinCachedQueryPlan( pattern,
+                                        CachedQueryPlan( BSON( "b" << 1 ), 0,
+                                                        CandidatePlanCharacter( true, false ),
+                                                        true ) );
+                client().ensureIndex( ns(), BSON( "c" << 1 ) );
+                ASSERT( nsdt.cachedQueryPlanForPattern( pattern ).indexKey().isEmpty() );
+            }
+        };
+
+        /** A cached plan is evicted when a run costs far more than its earlier runs. */
+        class EvictDriftedPlan : public Base {
+        public:
+            void run() {
+                client().ensureIndex( ns(), BSON( "a" << 1 ) );
+                QueryPattern pattern = makePattern( BSON( "a" << 1 ), BSONObj() );
+                CachedQueryPlan plan( BSON( "a" << 1 ), 10, CandidatePlanCharacter( true, false ) );
+
+                NamespaceDetailsTransient &nsdt = NamespaceDetailsTransient::get( ns() );
+                nsdt.registerCachedQueryPlanForPattern( pattern, plan );
+                // Runs of another index don't count.
+                nsdt.notePlanRun( pattern, BSON( "b" << 1 ), BSONObj(), 1000000, 0, 1000000 );
+                // Nor do runs of an intersection plan driven by the same index.
+                nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSON_ARRAY( BSON( "b" << 1 ) ),
+                                  1000000, 0, 1000000 );
+                // Too few runs to judge by.
+                nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 10, 5, 100 );
+                nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 1000, 5, 100 );
+                for( int i = 0; i < 3; ++i ) {
+                    nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 10, 5, 100 );
+                }
+                ASSERT_EQUALS( 5, runs( nsdt ) );
+                // Within the slack.
+                nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 300, 5, 100 );
+                ASSERT_EQUALS( 6, runs( nsdt ) );
+                nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 10000, 5, 100 );
+                ASSERT( nsdt.cachedQueryPlanForPattern( pattern ).indexKey().isEmpty() );
+
+                // A pinned plan is kept however it does.
+                nsdt.pinCachedQueryPlan( pattern,
+                                        CachedQueryPlan( BSON( "a" << 1 ), 10,
+                                                        CandidatePlanCharacter( true, false ),
+                                                        true ) );
+                for( int i = 0; i < 5; ++i ) {
+                    nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 10, 5, 100 );
+                }
+                nsdt.notePlanRun( pattern, BSON( "a" << 1 ), BSONObj(), 10000, 5, 1000000 );
+                ASSERT_EQUALS( 6, runs( nsdt ) );
+            }
+        private:
+            static long long runs( const NamespaceDetailsTransient &nsdt ) {
+                BSONObjBuilder b;
+                nsdt.appendPlanCache( b );
+                BSONObj plans = b.obj()[ "plans" ].embeddedObject();
+                ASSERT_EQUALS( 1, plans.nFields() );
+                return plans.firstElement().embeddedObject()[ "runs" ].numberLong();
+            }
+        };
+
+        /** With indexIntersection set, plans intersecting the constrained indexes race too. */
+        class IntersectionPlans : public Base {
+        public:
+            IntersectionPlans() : _old( indexIntersection ) {}
+            ~IntersectionPlans() { indexIntersection = _old; }
+            void run() {
+                client().ensureIndex( ns(), BSON( "a" << 1 ) );
+                client().ensureIndex( ns(), BSON( "b" << 1 ) );
+                client().ensureIndex( ns(), BSON( "a" << 1 << "c" << 1 ) );
+                for( int i = 0; i < 100; ++i ) {
+                    client().insert( ns(), BSON( "a" << i % 10 << "b" << i ) );
+                }
+                BSONObj query = BSON( "a" << GT << 5 << "b" << GT << 50 );
+
+                indexIntersection = false;
+                ASSERT_EQUALS( 4, makeQps( query )->nPlans() );
+
+                // a and a_c don't filter each other.
+                indexIntersection = true;
+                shared_ptr<QueryPlanSet> qps = makeQps( query );
+                ASSERT_EQUALS( 7, qps->nPlans() );
+                ASSERT( qps->hasIntersectionPlan() );
+                shared_ptr<QueryPlan> plan;
+                for( int i = 0; i < qps->nPlans(); ++i ) {
+                    shared_ptr<QueryPlan> p = qps->getPlan( i );
+                    if ( p->intersects() && p->indexKey() == BSON( "a" << 1 ) ) {
+                        plan = p;
+                    }
+                }
+                ASSERT( plan );
+                ASSERT_EQUALS( BSON( "0" << BSON( "b" << 1 ) ), plan->intersectIndexKeys() );
+
+                // The b keys are read over the first advances, then only the 20 documents in
+                // both ranges remain.
+                shared_ptr<Cursor> c = plan->newCursor();
+                IndexIntersectionCursor *ic = dynamic_cast<IndexIntersectionCursor*>( c.get() );
+                ASSERT( ic );
+                int filtered = 0;
+                for( ; c->ok(); c->advance() ) {
+                    if ( ic->filtering() ) {
+                        ASSERT( c->current()[ "b" ].number() > 50 );
+                        ++filtered;
+                    }
+                }
+                ASSERT( ic->filtering() );
+                ASSERT( filtered <= 20 );
+                ASSERT( filtered >= 15 );
+                ASSERT( c->nscanned() >= 40 + 49 );
+                ASSERT( c->nscanned() <= 40 + 49 + 2 );
+            }
+        private:
+            bool _old;
+        };
+
         /** Special plans are only selected when allowed. */
         class AllowSpecial : public Base {
         public:
@@ -1606,6 +1791,7 @@ namespace QueryOptimizerTests {
             add<QueryPlanTests::MoreKeyMatch>();
             add<QueryPlanTests::ExactKeyQueryTypes>();
             add<QueryPlanTests::Unhelpful>();
+            add<QueryPlanTests::SkipScan>();
             add<QueryPlanTests::KeyFieldsOnly>();
             add<QueryPlanTests::SparseExistsFalse>();
             add<QueryPlanTests::QueryBoundsExactOrderSuffix::Unindexed>();
@@ -1658,6 +1844,9 @@ namespace QueryOptimizerTests {
             add<QueryPlanSetTests::PossiblePlans>();
             add<QueryPlanSetTests::AvoidUnhelpfulRecordedPlan>();
             add<QueryPlanSetTests::AvoidDisallowedRecordedPlan>();
+            add<QueryPlanSetTests::PinnedPlan>();
+            add<QueryPlanSetTests::EvictDriftedPlan>();
+            add<QueryPlanSetTests::IntersectionPlans>();
             add<QueryPlanSetTests::AllowSpecial>();
             add<MultiPlanScannerTests::ToString>();
             add<MultiPlanScannerTests::PossiblePlans>();
@@ -1494,22 +1494,38 @@ namespace QueryTests {
         
         class TestableScanAndOrder : public ScanAndOrder {
         public:
-            TestableScanAndOrder(int startFrom, int limit, BSONObj order, const FieldRangeSet &frs)
-            : ScanAndOrder( startFrom, limit, order, frs ) {
+            TestableScanAndOrder(int startFrom, int limit, BSONObj order, const FieldRangeSet &frs,
+                                 bool allowSpill = false)
+            : ScanAndOrder( startFrom, limit, order, frs, allowSpill ) {
             }
             unsigned approxSize() const { return ScanAndOrder::approxSize(); }
+            bool spilled() const { return ScanAndOrder::spilled(); }
         };
         typedef TestableScanAndOrder Testable;
         
         class Base {
         protected:
-            void assertNumFilled( int expected, const Testable &t ) {
+            void assertNumFilled( int expected, Testable &t ) {
                 ASSERT_EQUALS( expected, t.size() );
                 BufBuilder bb;
                 int nout;
                 t.fill( bb, 0, nout );
                 ASSERT_EQUALS( expected, nout );                
             }
+            /** @return the 'a' fields of the filled objects, in order */
+            vector<int> filledA( Testable &t ) {
+                BufBuilder bb;
+                int nout;
+                t.fill( bb, 0, nout );
+                vector<int> ret;
+                for ( int pos = 0; pos < bb.len(); ) {
+                    BSONObj o( bb.buf() + pos );
+                    ret.push_back( o[ "a" ].numberInt() );
+                    pos += o.objsize();
+                }
+                ASSERT_EQUALS( nout, (int)ret.size() );
+                return ret;
+            }
         };
         
         class Unlimited : public Base {
@@ -1555,6 +1571,139 @@ namespace QueryTests {
             }
         };
         
+        /** with a limit only the best skip+limit are kept */
+        class TopK : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                Testable t( 2, 3, BSON( "a" << -1 ), frs );
+                for ( int i = 0; i < 100; ++i ) {
+                    t.add( BSON( "a" << ( i * 37 ) % 100 ), 0 );
+                    ASSERT( t.size() <= 5 );
+                }
+                vector<int> a = filledA( t );
+                ASSERT_EQUALS( 3U, a.size() );
+                ASSERT_EQUALS( 97, a[ 0 ] );
+                ASSERT_EQUALS( 96, a[ 1 ] );
+                ASSERT_EQUALS( 95, a[ 2 ] );
+            }
+        };
+
+        /** matches with equal keys come back in the order they were added */
+        class TopKTies : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                Testable t( 0, 3, BSON( "a" << 1 ), frs );
+                for ( int i = 0; i < 10; ++i ) {
+                    t.add( BSON( "a" << i % 2 << "b" << i ), 0 );
+                }
+                BufBuilder bb;
+                int nout;
+                t.fill( bb, 0, nout );
+                ASSERT_EQUALS( 3, nout );
+                int pos = 0;
+                for ( int i = 0; i < 3; ++i ) {
+                    BSONObj o( bb.buf() + pos );
+                    ASSERT_EQUALS( 0, o[ "a" ].numberInt() );
+                    ASSERT_EQUALS( i * 2, o[ "b" ].numberInt() );
+                    pos += o.objsize();
+                }
+            }
+        };
+
+        /** without a limit, matches past MaxScanAndOrderBytes are sorted on disk */
+        class Spill : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                string big( 1024 * 1024, 'x' );
+                int n = ScanAndOrder::MaxScanAndOrderBytes / big.size() + 10;
+                // skip most so the result fits in a reply
+                Testable t( n - 5, 0, BSON( "a" << 1 ), frs, true );
+                Testable noSpill( 0, 0, BSON( "a" << 1 ), frs );
+                bool asserted = false;
+                for ( int i = 0; i < n; ++i ) {
+                    BSONObj o = BSON( "a" << ( i * 5 ) % n << "big" << big );
+                    t.add( o, 0 );
+                    try {
+                        noSpill.add( o, 0 );
+                    }
+                    catch ( const UserException &e ) {
+                        ASSERT_EQUALS( ScanAndOrderMemoryLimitExceededAssertionCode, e.getCode() );
+                        asserted = true;
+                    }
+                }
+                ASSERT( asserted );
+                ASSERT( t.spilled() );
+                ASSERT_EQUALS( n, t.size() );
+                ASSERT( t.approxSize() < ScanAndOrder::MaxScanAndOrderBytes );
+                vector<int> a = filledA( t );
+                ASSERT_EQUALS( 5U, a.size() );
+                for ( int i = 0; i < 5; ++i ) {
+                    ASSERT_EQUALS( n - 5 + i, a[ i ] );
+                }
+            }
+        };
+
+        /** without a limit, the matches past the first batch are left in a cursor */
+        class Remaining : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                ParsedQuery pq( "n/a", 1, 3, 0, BSONObj(), BSONObj() );
+                ASSERT( pq.wantMore() );
+                Testable t( 1, 0, BSON( "a" << 1 ), frs );
+                for ( int i = 0; i < 10; ++i ) {
+                    t.add( BSON( "a" << ( i * 3 ) % 10 ), 0 );
+                }
+                BufBuilder bb;
+                int nout;
+                t.fill( bb, &pq, nout );
+                ASSERT_EQUALS( 3, nout );
+                int pos = 0;
+                for ( int i = 1; i <= 3; ++i ) {
+                    BSONObj o( bb.buf() + pos );
+                    ASSERT_EQUALS( i, o[ "a" ].numberInt() );
+                    pos += o.objsize();
+                }
+                shared_ptr<Cursor> c = t.remaining();
+                ASSERT( c );
+                for ( int i = 4; i < 10; ++i ) {
+                    ASSERT( c->ok() );
+                    ASSERT( c->refLoc().isNull() );
+                    ASSERT_EQUALS( i, c->current()[ "a" ].numberInt() );
+                    c->advance();
+                }
+                ASSERT( !c->ok() );
+            }
+        };
+
+        /** with a limit the best skip+limit are kept, and those past the first batch are left */
+        class BoundedRemaining : public Base {
+        public:
+            void run() {
+                FieldRangeSet frs( "n/a", BSONObj(), true, true );
+                ParsedQuery pq( "n/a", 1, 2, 0, BSONObj(), BSONObj() );
+                Testable t( 1, 4, BSON( "a" << 1 ), frs );
+                for ( int i = 0; i < 10; ++i ) {
+                    t.add( BSON( "a" << ( i * 3 ) % 10 ), 0 );
+                }
+                BufBuilder bb;
+                int nout;
+                t.fill( bb, &pq, nout );
+                ASSERT_EQUALS( 2, nout );
+                shared_ptr<Cursor> c = t.remaining();
+                ASSERT( c );
+                for ( int i = 3; i < 5; ++i ) {
+                    ASSERT( c->ok() );
+                    ASSERT_EQUALS( i, c->current()[ "a" ].numberInt() );
+                    c->advance();
+                }
+                ASSERT( !c->ok() );
+            }
+        };
+
     } // namespace ScanAndOrderTests
 
     class All : public Suite {
@@ -1626,6 +1775,11 @@ namespace QueryTests {
             
             add< ScanAndOrderTests::Unlimited >();
             add< ScanAndOrderTests::LimitOne >();
+            add< ScanAndOrderTests::TopK >();
+            add< ScanAndOrderTests::TopKTies >();
+            add< ScanAndOrderTests::Spill >();
+            add< ScanAndOrderTests::Remaining >();
+            add< ScanAndOrderTests::BoundedRemaining >();
         }
     } myall;
 
@@ -484,6 +484,24 @@ namespace QueryUtilTests {
             }
         };
 
+        /** $in values equal under element_lt become one point interval, and intervals are ordered. */
+        class InDuplicatesMixedTypes {
+        public:
+            void run() {
+                BSONObj in = BSON_ARRAY( 3 << BSON( "b" << 1 ) << 1.0 << "x" << 1 << BSON( "b" << 1.0 )
+                                         << 2 << 3LL );
+                FieldRangeSet f( "", BSON( "a" << BSON( "$in" << in ) ), true, true );
+                const vector<FieldInterval>& intervals = f.range( "a" ).intervals();
+                ASSERT_EQUALS( 5U, intervals.size() );
+                ASSERT_EQUALS( 1, intervals[ 0 ]._lower._bound.number() );
+                ASSERT_EQUALS( 2, intervals[ 1 ]._lower._bound.number() );
+                ASSERT_EQUALS( 3, intervals[ 2 ]._lower._bound.number() );
+                ASSERT_EQUALS( "x", intervals[ 3 ]._lower._bound.String() );
+                ASSERT_EQUALS( BSON( "b" << 1 ), intervals[ 4 ]._lower._bound.Obj() );
+                ASSERT( f.range( "a" ).isPointIntervalSet() );
+            }
+        };
+
         /** Check union of two non overlapping ranges. */
         class BoundUnion {
         public:
@@ -2498,6 +2516,7 @@ namespace QueryUtilTests {
             add<FieldRangeTests::Numeric>();
             add<FieldRangeTests::InLowerBound>();
             add<FieldRangeTests::InUpperBound>();
+            add<FieldRangeTests::InDuplicatesMixedTypes>();
             add<FieldRangeTests::BoundUnion>();
             add<FieldRangeTests::BoundUnionFullyContained>();
             add<FieldRangeTests::BoundUnionOverlapWithInclusivity>();
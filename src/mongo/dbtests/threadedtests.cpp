@@ -890,6 +890,61 @@ namespace ThreadedTests {
         }
     };
 
+    /** writers of different collections in one db don't wait for each other; a db lock waits for both.
+        sequenced with notifications rather than sleeps: a regression hangs instead of passing by luck */
+    class CollectionLevelWrites : public ThreadedTest<3> {
+    public:
+        CollectionLevelWrites() : ls3(0), aReleased(false), bReleased(false), dbLocked(false) { }
+    private:
+        Notification aLocked;     // 1 -> 2
+        Notification bLocked;     // 2 -> 3
+        Notification dbWaiting;   // 1 -> 2
+        LockState * volatile ls3; // set by 3 just before it asks for the db lock
+        volatile bool aReleased, bReleased, dbLocked;
+        virtual void validate() { ASSERT( dbLocked ); }
+        virtual void subthread(int x) {
+            Client::initThread("ctest");
+            if( x == 1 ) {
+                Lock::DBWrite lk("ctest.a", true);
+                ASSERT( lk.collectionLocked() );
+                // only intent on the db: no catalog changes under it
+                ASSERT( cc().lockState().otherIntent() );
+                ASSERT_THROWS( Lock::assertCatalogWriteLocked("ctest.a"), MsgAssertionException );
+                aLocked.notifyOne();
+                // 3 can only be waiting once 2 holds ctest.b alongside us
+                while( ls3 == 0 || !ls3->hasLockPending() )
+                    sleepmillis(1);
+                dbWaiting.notifyOne();
+                aReleased = true;
+            }
+            if( x == 2 ) {
+                aLocked.waitToBeNotified();
+                Lock::DBWrite lk("ctest.b", true);
+                ASSERT( lk.collectionLocked() );
+                {
+                    // nesting the same collection is fine
+                    Lock::DBWrite inner("ctest.b");
+                    ASSERT( !inner.collectionLocked() );
+                }
+                bLocked.notifyOne();
+                dbWaiting.waitToBeNotified();
+                ASSERT( !dbLocked );
+                bReleased = true;
+            }
+            if( x == 3 ) {
+                bLocked.waitToBeNotified();
+                ls3 = &cc().lockState();
+                Lock::DBWrite lk("ctest");
+                ASSERT( !lk.collectionLocked() );
+                ASSERT( !cc().lockState().otherIntent() );
+                ASSERT( aReleased && bReleased );
+                Lock::assertCatalogWriteLocked("ctest.a");
+                dbLocked = true;
+            }
+            cc().shutdown();
+        }
+    };
+
     // Tests waiting on the TicketHolder by running many more threads than can fit into the "hotel", but only
     // max _nRooms threads should ever get in at once
     class TicketHolderWaits : public ThreadedTest<10> {
@@ -972,6 +1027,8 @@ namespace ThreadedTests {
             add< WriteLocksAreGreedy >();
             add< QLockTest >();
             add< QLockTest >();
+            if( Lock::collectionLevelLockingEnabled() )
+                add< CollectionLevelWrites >();
 
             // Slack is a test to see how long it takes for another thread to pick up
             // and begin work after another relinquishes the lock.  e.g. a spin lock 
@@ -37,6 +37,7 @@
 namespace mongo {
 
     ClientInfo::ClientInfo() {
+        _port = 0;
         _cur = &_a;
         _prev = &_b;
         _autoSplitOk = true;
@@ -54,6 +54,9 @@ namespace mongo {
          */
         HostAndPort getRemote() const { return _remote; }
 
+        AbstractMessagingPort * port() const { return _port; }
+        void setPort( AbstractMessagingPort * p ) { _port = p; }
+
         /**
          * notes that this client use this shard
          * keeps track of all shards accessed this request
@@ -118,6 +121,7 @@ namespace mongo {
 
         int _id; // unique client id
         HostAndPort _remote; // server:port of remote socket end
+        AbstractMessagingPort * _port;
 
         // we use _a and _b to store shards we've talked to on the current request and the previous
         // we use 2 so we can flip for getLastError type operations
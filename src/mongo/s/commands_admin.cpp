@@ -1124,6 +1124,7 @@ namespace mongo {
                 result.appendBool("ismaster", true );
                 result.append("msg", "isdbgrid");
                 result.appendNumber("maxBsonObjectSize", BSONObjMaxUserSize);
+                negotiateWireCompression( cmdObj , result );
                 return true;
             }
         } ismaster;
@@ -602,7 +602,9 @@ namespace mongo {
                              str::equals( e.fieldName() , "ok" ) || 
                              str::equals( e.fieldName() , "avgObjSize" ) ||
                              str::equals( e.fieldName() , "lastExtentSize" ) ||
-                             str::equals( e.fieldName() , "paddingFactor" ) ) {
+                             str::equals( e.fieldName() , "paddingFactor" ) ||
+                             str::equals( e.fieldName() , "allocation" ) ||
+                             str::equals( e.fieldName() , "compression" ) ) {
                             continue;
                         }
                         else if ( str::equals( e.fieldName() , "count" ) ||
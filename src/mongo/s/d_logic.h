@@ -179,6 +179,11 @@ namespace mongo {
 
         static ShardedConnectionInfo* get( bool create );
         static void reset();
+
+        /** detach this thread's info, if any, without deleting it.  caller owns the result */
+        static ShardedConnectionInfo* release();
+        /** make info (may be null) this thread's info, takes ownership */
+        static void set( ShardedConnectionInfo* info );
         static void addHook();
 
         bool inForceVersionOkMode() const {
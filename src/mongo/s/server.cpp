@@ -95,6 +95,7 @@ namespace mongo {
         virtual void connected( AbstractMessagingPort* p ) {
             ClientInfo *c = ClientInfo::get();
             massert(15849, "client info not defined", c);
+            c->setPort( p );
             if( p->remote().isLocalHost() )
                 c->getAuthenticationInfo()->setIsALocalHostConnectionWithSpecialAuthPowers();
         }
@@ -18,6 +18,14 @@ namespace mongo {
         return snappy::MaxCompressedLength(source_len);
     }
 
+    bool uncompressedLength(const char* compressed, size_t compressed_length, size_t* result) {
+        return snappy::GetUncompressedLength(compressed, compressed_length, result);
+    }
+
+    bool rawUncompress(const char* compressed, size_t compressed_length, char* uncompressed) {
+        return snappy::RawUncompress(compressed, compressed_length, uncompressed);
+    }
+
     size_t compress(const char* input, size_t input_length, std::string* output) {
         return snappy::Compress(input, input_length, output);
     }
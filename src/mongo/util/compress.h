@@ -16,6 +16,12 @@ namespace mongo {
         char* compressed,
         size_t* compressed_length);
 
+    /** @return false if the buffer is corrupt */
+    bool uncompressedLength(const char* compressed, size_t compressed_length, size_t* result);
+
+    /** uncompressed must hold uncompressedLength() bytes.  @return false if the buffer is corrupt */
+    bool rawUncompress(const char* compressed, size_t compressed_length, char* uncompressed);
+
 }
 
 
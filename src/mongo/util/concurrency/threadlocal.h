@@ -87,6 +87,12 @@ namespace mongo {
                 reset( t = new T() );
             return t;
         }
+        /** detach the current value from this thread without deleting it */
+        T* release() {
+            T *t = tsp.release();
+            reset(0);
+            return t;
+        }
     };
 
 # if defined(_WIN32)
@@ -130,6 +136,12 @@ namespace mongo {
                 reset( t = new T() );
             return t;
         }
+        /** detach the current value from this thread without deleting it */
+        T* release() {
+            T *t = tsp.release();
+            reset(0);
+            return t;
+        }
     };
 
 #  define TSP_DECLARE(T,p) extern TSP<T> p;
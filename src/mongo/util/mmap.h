@@ -229,6 +229,13 @@ namespace mongo {
 
         /** close the current private view and open a new replacement */
         void* remapPrivateView(void *oldPrivateAddr);
+
+#if !defined(_WIN32)
+        /** replace [ofs, ofs+len) of the private view with the file's current contents.
+            ofs a multiple of the page size
+        */
+        void remapPrivateViewRange(void *privateAddr, unsigned long long ofs, unsigned long long len);
+#endif
     };
 
     typedef MemoryMappedFile MMF;
@@ -26,6 +26,8 @@
 #include "listen.h"
 
 #include "../goodies.h"
+#include "../concurrency/threadlocal.h"
+#include "mongo/platform/atomic_word.h"
 
 
 namespace mongo {
@@ -42,6 +44,106 @@ namespace mongo {
         }
     }
 
+    void Message::copyTo( char *buf ) const {
+        if ( _buf ) {
+            memcpy( buf, _buf, _buf->len );
+            return;
+        }
+        for( MsgVec::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
+            memcpy( buf, i->first, i->second );
+            buf += i->second;
+        }
+    }
+
+    /* MessageBufferPool -------------------------------------------------------- */
+
+    namespace {
+
+        /** in front of every buffer we hand out, so release() knows where it goes */
+        struct PooledBufferHeader {
+            int sizeClass; // -1 if it came straight from malloc
+            char pad[12];  // keep what we hand out 16 byte aligned, like malloc
+        };
+
+        AtomicUInt64 poolHits;      // allocate() served from the thread's cache
+        AtomicUInt64 poolMisses;    // allocate() of a pooled size class had to malloc
+        AtomicUInt64 poolOversize;  // allocate() too large to pool
+        AtomicUInt64 poolDiscards;  // release() freed because the thread's cache was full
+
+        int classSize( int c ) { return 1 << ( MessageBufferPool::MinClassBits + c ); }
+
+        int maxCached( int c ) {
+            int n = MessageBufferPool::MaxCachedPerClass / classSize( c );
+            return n > 0 ? n : 1;
+        }
+
+    }
+
+    class ThreadBufferPool : boost::noncopyable {
+    public:
+        ~ThreadBufferPool() {
+            for ( int c = 0; c < MessageBufferPool::NumClasses; c++ ) {
+                for ( unsigned i = 0; i < _free[c].size(); i++ )
+                    free( _free[c][i] );
+            }
+        }
+        vector<PooledBufferHeader*> _free[MessageBufferPool::NumClasses];
+    };
+
+    TSP_DECLARE(ThreadBufferPool,tlBufferPool)
+    TSP_DEFINE(ThreadBufferPool,tlBufferPool)
+
+    char * MessageBufferPool::allocate( int size ) {
+        int need = size + sizeof(PooledBufferHeader);
+        int c = 0;
+        while ( c < NumClasses && classSize( c ) < need )
+            c++;
+
+        PooledBufferHeader *h;
+        if ( c == NumClasses ) {
+            poolOversize.fetchAndAdd( 1 );
+            h = (PooledBufferHeader *) malloc( need );
+            c = -1;
+        }
+        else {
+            vector<PooledBufferHeader*>& v = tlBufferPool.getMake()->_free[c];
+            if ( ! v.empty() ) {
+                poolHits.fetchAndAdd( 1 );
+                h = v.back();
+                v.pop_back();
+                return (char *) ( h + 1 );
+            }
+            poolMisses.fetchAndAdd( 1 );
+            h = (PooledBufferHeader *) malloc( classSize( c ) );
+        }
+        verify( h );
+        h->sizeClass = c;
+        return (char *) ( h + 1 );
+    }
+
+    void MessageBufferPool::release( char * buf ) {
+        if ( ! buf )
+            return;
+        PooledBufferHeader *h = ( (PooledBufferHeader *) buf ) - 1;
+        int c = h->sizeClass;
+        if ( c >= 0 ) {
+            vector<PooledBufferHeader*>& v = tlBufferPool.getMake()->_free[c];
+            if ( (int) v.size() < maxCached( c ) ) {
+                v.push_back( h );
+                return;
+            }
+            poolDiscards.fetchAndAdd( 1 );
+        }
+        free( h );
+    }
+
+    void MessageBufferPool::appendStats( BSONObjBuilder& b ) {
+        b.appendNumber( "hits" , (long long) poolHits.load() );
+        b.appendNumber( "misses" , (long long) poolMisses.load() );
+        b.appendNumber( "oversize" , (long long) poolOversize.load() );
+        b.appendNumber( "discards" , (long long) poolDiscards.load() );
+    }
+
     MSGID NextMsgId;
 
     /*struct MsgStart {
@@ -23,6 +23,7 @@
 
 namespace mongo {
 
+    class BSONObjBuilder;
     class Message;
     class MessagingPort;
     class PiggyBackData;
@@ -38,7 +39,8 @@ namespace mongo {
         dbQuery = 2004,
         dbGetMore = 2005,
         dbDelete = 2006,
-        dbKillCursors = 2007
+        dbKillCursors = 2007,
+        dbCompressed = 2012 /* envelope around any of the above, see CompressedHeader */
     };
 
     bool doesOpGetAResponse( int op );
@@ -54,6 +56,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default:
             massert( 16141, str::stream() << "cannot translate opcode " << op, !op );
             return "";
@@ -137,20 +140,53 @@ namespace mongo {
         int dataLen(); // len without header
     };
     const int MsgDataHeaderSize = sizeof(MsgData) - 4;
+
+    /* body of a dbCompressed message: this header, then the compressed body of the original
+       message (everything after its MsgData header).  id and responseTo are those of the original.
+       Nothing is sent compressed unless the peer asked for it through isMaster, see
+       MessagingPort::setCompression().
+    */
+    struct CompressedHeader {
+        enum { Snappy = 1 };
+        int originalOperation;
+        int uncompressedSize; // of the original body
+        char compressor;
+    };
     inline int MsgData::dataLen() {
         return len - MsgDataHeaderSize;
     }
 #pragma pack()
 
+    /**
+     * per thread cache of message buffers in power of two size classes, so the recv path
+     * doesn't malloc and free a buffer for every request.  buffers handed to a Message with
+     * setPooledData() come back here from Message::reset(), on whichever thread resets it.
+     */
+    class MessageBufferPool {
+    public:
+        enum {
+            MinClassBits = 10,       // 1KB, smallest buffer handed out
+            MaxClassBits = 16,       // 64KB, larger requests always go to malloc
+            NumClasses = MaxClassBits - MinClassBits + 1,
+            MaxCachedPerClass = 32 * 1024 // bytes kept per size class per thread (at least one buffer)
+        };
+
+        /** @return a buffer of at least size bytes, to be given back with release() */
+        static char * allocate( int size );
+        static void release( char * buf );
+
+        static void appendStats( BSONObjBuilder& b );
+    };
+
     class Message {
     public:
         // we assume here that a vector with initial size 0 does no allocation (0 is the default, but wanted to make it explicit).
-        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ) {}
+        Message() : _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {}
         Message( void * data , bool freeIt ) :
-            _buf( 0 ), _data( 0 ), _freeIt( false ) {
+            _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {
             _setData( reinterpret_cast< MsgData* >( data ), freeIt );
         };
-        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ) {
+        Message(Message& r) : _buf( 0 ), _data( 0 ), _freeIt( false ), _pooled( false ) {
             *this = r;
         }
         ~Message() {
@@ -171,6 +207,7 @@ namespace mongo {
         }
 
         bool empty() const { return !_buf && _data.empty(); }
+        bool isSingleBuffer() const { return _buf != 0; }
 
         int size() const {
             int res = 0;
@@ -195,6 +232,7 @@ namespace mongo {
             }
 
             verify( _freeIt );
+            verify( !_pooled );
             int totalSize = 0;
             for( vector< pair< char *, int > >::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
                 totalSize += i->second;
@@ -220,13 +258,18 @@ namespace mongo {
             }
             r._freeIt = false;
             _freeIt = true;
+            _pooled = r._pooled;
+            r._pooled = false;
             return *this;
         }
 
         void reset() {
             if ( _freeIt ) {
                 if ( _buf ) {
-                    free( _buf );
+                    if ( _pooled )
+                        MessageBufferPool::release( (char *) _buf );
+                    else
+                        free( _buf );
                 }
                 for( vector< pair< char *, int > >::const_iterator i = _data.begin(); i != _data.end(); ++i ) {
                     free(i->first);
@@ -235,6 +278,7 @@ namespace mongo {
             _buf = 0;
             _data.clear();
             _freeIt = false;
+            _pooled = false;
         }
 
         // use to add a buffer
@@ -250,6 +294,7 @@ namespace mongo {
                 return;
             }
             verify( _freeIt );
+            verify( !_pooled );
             if ( _buf ) {
                 _data.push_back( make_pair( (char*)_buf, _buf->len ) );
                 _buf = 0;
@@ -263,6 +308,12 @@ namespace mongo {
             verify( empty() );
             _setData( d, freeIt );
         }
+        // like setData, but d came from MessageBufferPool::allocate() and goes back there
+        void setPooledData(MsgData *d) {
+            verify( empty() );
+            _setData( d, true );
+            _pooled = true;
+        }
         void setData(int operation, const char *msgtxt) {
             setData(operation, msgtxt, strlen(msgtxt)+1);
         }
@@ -281,6 +332,9 @@ namespace mongo {
         }
 
         void send( MessagingPort &p, const char *context );
+
+        /** copies the whole message, header included, to buf which must hold size() bytes */
+        void copyTo( char *buf ) const;
         
         string toString() const;
 
@@ -295,6 +349,7 @@ namespace mongo {
         typedef vector< pair< char*, int > > MsgVec;
         MsgVec _data;
         bool _freeIt;
+        bool _pooled; // _buf belongs to MessageBufferPool
     };
 
 
@@ -26,6 +26,7 @@
 
 #include "../goodies.h"
 #include "../background.h"
+#include "../compress.h"
 #include "../time_support.h"
 #include "../../db/cmdline.h"
 #include "../scopeguard.h"
@@ -50,6 +51,91 @@ namespace mongo {
         _connectionId = connectionId; 
     }
 
+    const char* AbstractMessagingPort::compressorName = "snappy";
+
+    /* wire compression --------------------------------------------------------- */
+
+    // small messages don't compress well and aren't worth the cpu
+    static const int CompressionThreshold = 1024;
+
+    /** @return false if compressing didn't make 'in' smaller, in which case send it as is */
+    static bool compressMessage( const Message& in , Message& out ) {
+        int len = in.size();
+        char *flat = 0;
+        const MsgData *orig;
+        if ( in.isSingleBuffer() ) {
+            orig = in.singleData();
+        }
+        else {
+            flat = (char *) malloc( len );
+            verify( flat );
+            in.copyTo( flat );
+            orig = (const MsgData *) flat;
+        }
+        ScopeGuard flatGuard = MakeGuard( free, flat );
+
+        size_t bodyLen = len - MsgDataHeaderSize;
+        int max = MsgDataHeaderSize + sizeof(CompressedHeader) + maxCompressedLength( bodyLen );
+        MsgData *md = (MsgData *) malloc( max );
+        verify( md );
+        ScopeGuard guard = MakeGuard( free, md );
+
+        CompressedHeader *ch = (CompressedHeader *) md->_data;
+        size_t compressedLen = 0;
+        rawCompress( orig->_data, bodyLen, md->_data + sizeof(CompressedHeader), &compressedLen );
+        int total = MsgDataHeaderSize + sizeof(CompressedHeader) + compressedLen;
+        if ( total >= len )
+            return false;
+
+        md->len = total;
+        md->id = orig->id;
+        md->responseTo = orig->responseTo;
+        md->setOperation( dbCompressed );
+        ch->originalOperation = orig->operation();
+        ch->uncompressedSize = bodyLen;
+        ch->compressor = CompressedHeader::Snappy;
+
+        guard.Dismiss();
+        out.setData( md, true );
+        return true;
+    }
+
+    bool decompressMessage( Message& m ) {
+        MsgData *in = m.singleData();
+        if ( in->dataLen() < (int) sizeof(CompressedHeader) )
+            return false;
+        const CompressedHeader *ch = (const CompressedHeader *) in->_data;
+        if ( ch->compressor != CompressedHeader::Snappy ) {
+            log() << "unknown wire compressor " << (int) ch->compressor << endl;
+            return false;
+        }
+        if ( ch->uncompressedSize < 0 || ch->uncompressedSize > 48000000 - MsgDataHeaderSize )
+            return false;
+
+        const char *compressed = in->_data + sizeof(CompressedHeader);
+        size_t compressedLen = in->dataLen() - sizeof(CompressedHeader);
+        size_t n = 0;
+        if ( ! uncompressedLength( compressed, compressedLen, &n ) || n != (size_t) ch->uncompressedSize )
+            return false;
+
+        int len = MsgDataHeaderSize + ch->uncompressedSize;
+        MsgData *md = (MsgData *) malloc( len );
+        verify( md );
+        ScopeGuard guard = MakeGuard( free, md );
+        if ( ! rawUncompress( compressed, compressedLen, md->_data ) )
+            return false;
+
+        md->len = len;
+        md->id = in->id;
+        md->responseTo = in->responseTo;
+        md->setOperation( ch->originalOperation );
+
+        guard.Dismiss();
+        m.reset();
+        m.setData( md, true );
+        return true;
+    }
+
     /* messagingport -------------------------------------------------------------- */
 
     class PiggyBackData {
@@ -183,11 +269,9 @@ again:
                 return false;
             }
 
-            int z = (len+1023)&0xfffffc00;
-            verify(z>=len);
-            MsgData *md = (MsgData *) malloc(z);
-            ScopeGuard guard = MakeGuard(free, md);
-            verify(md);
+            char *buf = MessageBufferPool::allocate( len );
+            ScopeGuard guard = MakeGuard( MessageBufferPool::release, buf );
+            MsgData *md = (MsgData *) buf;
             md->len = len;
 
             char *p = (char *) &md->id;
@@ -196,7 +280,13 @@ again:
             psock->recv( p, left );
 
             guard.Dismiss();
-            m.setData(md, true);
+            m.setPooledData( md );
+
+            if ( md->operation() == dbCompressed && ! decompressMessage( m ) ) {
+                log() << "recv(): bad compressed message from " << remote() << endl;
+                m.reset();
+                return false;
+            }
             return true;
 
         }
@@ -264,6 +354,14 @@ again:
             }
         }
 
+        if ( compressionEnabled() && toSend.size() >= CompressionThreshold ) {
+            Message compressed;
+            if ( compressMessage( toSend, compressed ) ) {
+                compressed.send( *this, "say" );
+                return;
+            }
+        }
+
         toSend.send( *this, "say" );
     }
 
@@ -27,9 +27,12 @@ namespace mongo {
 
     typedef AtomicUInt MSGID;
 
+    /** replaces a dbCompressed message in m with the message it wraps.  @return false if it is malformed */
+    bool decompressMessage( Message& m );
+
     class AbstractMessagingPort : boost::noncopyable {
     public:
-        AbstractMessagingPort() : tag(0), _connectionId(0) {}
+        AbstractMessagingPort() : tag(0), _connectionId(0), _compress(false) {}
         virtual ~AbstractMessagingPort() { }
         virtual void reply(Message& received, Message& response, MSGID responseTo) = 0; // like the reply below, but doesn't rely on received.data still being available
         virtual void reply(Message& received, Message& response) = 0;
@@ -40,6 +43,16 @@ namespace mongo {
         long long connectionId() const { return _connectionId; }
         void setConnectionId( long long connectionId );
 
+        /**
+         * once the peer has agreed through isMaster, large outgoing messages are sent
+         * as dbCompressed.  incoming dbCompressed messages are always accepted.
+         */
+        void setCompression( bool on ) { _compress = on; }
+        bool compressionEnabled() const { return _compress; }
+
+        /** name of the only compressor we support, as negotiated in isMaster */
+        static const char* compressorName;
+
     public:
         // TODO make this private with some helpers
 
@@ -48,6 +61,7 @@ namespace mongo {
 
     private:
         long long _connectionId;
+        bool _compress;
     };
 
     class MessagingPort : public AbstractMessagingPort {
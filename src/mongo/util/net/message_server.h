@@ -47,6 +47,42 @@ namespace mongo {
          * called once when a socket is disconnected
          */
         virtual void disconnected( AbstractMessagingPort* p ) = 0;
+
+        /**
+         * per connection thread local state, parked while a multiplexed
+         * connection is waiting for its next message
+         */
+        class ConnectionState {
+        public:
+            virtual ~ConnectionState() {}
+        };
+
+        /**
+         * @return true if detachConnection/attachConnection below move all per connection
+         *         state, so the connection can be serviced from a pool of worker threads
+         */
+        virtual bool supportsMultiplexing() const { return false; }
+
+        /**
+         * called on the worker thread after a message (or connected()) has been handled.
+         * removes the connection's thread local state from the current thread.
+         * @return state to hand back to attachConnection, caller owns it.
+         */
+        virtual ConnectionState* detachConnection( AbstractMessagingPort* p ) { return 0; }
+
+        /**
+         * called on the worker thread before a message (or disconnected()) is handled.
+         * takes over whatever 'state' holds; the caller deletes 'state' afterwards.
+         */
+        virtual void attachConnection( AbstractMessagingPort* p , ConnectionState* state ) { }
+
+        /**
+         * @return true if handling m may keep the thread waiting on the client's behalf for
+         *         seconds or longer, rather than for locks or disk, e.g. a tailable awaitData
+         *         getMore.  a multiplexing server hands such messages a thread of their own
+         *         instead of tying up a worker with them.
+         */
+        virtual bool mayWaitLong( Message& m ) { return false; }
     };
 
     class MessageServer {
@@ -54,8 +90,10 @@ namespace mongo {
         struct Options {
             int port;                   // port to bind to
             string ipList;             // addresses to bind to
+            bool epoll;                 // multiplex connections over an epoll reactor (linux only)
+            int workerThreads;          // size of the worker pool when epoll is set
 
-            Options() : port(0), ipList("") {}
+            Options() : port(0), ipList(""), epoll(false), workerThreads(0) {}
         };
 
         virtual ~MessageServer() {}
@@ -63,6 +101,14 @@ namespace mongo {
         virtual void setAsTimeTracker() = 0;
     };
 
-    // TODO use a factory here to decide between port and asio variations
+    /**
+     * thread per connection server, or the epoll based one if opts.epoll is set and
+     * both the platform and the handler support it
+     */
     MessageServer * createServer( const MessageServer::Options& opts , MessageHandler * handler );
+
+#ifdef __linux__
+    /** see message_server_epoll.cpp */
+    MessageServer * createEpollServer( const MessageServer::Options& opts , MessageHandler * handler );
+#endif
 }
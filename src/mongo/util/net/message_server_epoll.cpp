@@ -0,0 +1,457 @@
+// message_server_epoll.cpp
+
+/*    Copyright 2009 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/*
+  epoll based MessageServer
+
+  Instead of a thread per connection, a single reactor thread waits on all client sockets.
+  It reads from whichever sockets are readable without blocking until it has a complete
+  Message, and then hands the connection to a fixed size worker pool which runs the handler
+  and sends the reply.  Sockets are registered EPOLLONESHOT, so a connection is owned either
+  by the reactor (armed, waiting for bytes) or by exactly one worker (disarmed) - never both.
+  The worker re-arms the socket once the reply has been sent.
+
+  Per connection thread local state (Client, LastError, ...) is moved on and off the worker
+  thread around every message via MessageHandler::attachConnection/detachConnection.
+
+  The reactor never blocks on a client: anything it would have to send (the endian check
+  reply) is left to a worker.  It does stop reading when too many messages are waiting for a
+  worker, so a flood of requests backs up into the clients' sockets rather than into memory.
+
+  The pool has a fixed number of workers (--epollWorkers, 4 per core by default), and a
+  worker is held for as long as its message takes: a slow query, a write queued behind a
+  lock or behind fsync:lock, ...  Once all of them are busy that way, other connections wait
+  too, even for trivial requests, and the reactor stops reading at twice the pool size.
+  Size the pool for the number of such operations expected at once.  Messages that may wait
+  on the client's behalf with no end in sight - tailable awaitData getMores and exhaust
+  cursors, see MessageHandler::mayWaitLong - don't take a worker or count against that
+  limit: each gets a thread of its own for as long as it runs, as without --epoll.
+
+  Messages are read into MessageBufferPool buffers.  The pool is per thread, so the workers
+  hand the buffers back to the reactor, which returns them to its own pool.
+ */
+
+#include "pch.h"
+
+#include <boost/thread/thread.hpp>
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+
+#include "message.h"
+#include "message_port.h"
+#include "message_server.h"
+#include "listen.h"
+
+#include "../../db/cmdline.h"
+#include "../../db/lasterror.h"
+#include "../../db/stats/counters.h"
+#include "../processinfo.h"
+#include "mongo/util/concurrency/thread_pool.h"
+#include "mongo/util/concurrency/ticketholder.h"
+
+namespace mongo {
+
+    namespace epollms {
+
+        /** everything we know about one client connection */
+        struct Connection : boost::noncopyable {
+            Connection( MessagingPort * p ) :
+                port( p ), lastError( new LastError() ), state( 0 ),
+                len( 0 ), got( 0 ), data( 0 ) {
+            }
+
+            ~Connection() {
+                delete state;
+                delete lastError;
+                MessageBufferPool::release( (char *) data );
+            }
+
+            /** start of the next message */
+            void resetRead() {
+                len = 0;
+                got = 0;
+                data = 0;
+            }
+
+            scoped_ptr<MessagingPort> port;
+            LastError * lastError; // owned here while not attached to a worker
+            MessageHandler::ConnectionState * state;
+
+            // partially read message
+            int len;          // from the header, 0 until the first 4 bytes are in
+            int got;          // bytes read so far including the length
+            MsgData * data;   // from MessageBufferPool once len is known
+        };
+
+        enum ReadState {
+            ReadIncomplete,   // wait for more bytes
+            ReadComplete,     // c->data holds a complete message
+            ReadEndianCheck   // the client asked what byte order we use
+        };
+
+        class EpollMessageServer : public MessageServer , public Listener {
+        public:
+            EpollMessageServer( const MessageServer::Options& opts , MessageHandler * handler ) :
+                Listener( "" , opts.ipList , opts.port ),
+                _handler( handler ),
+                _nWorkers( opts.workerThreads > 0 ? opts.workerThreads : defaultWorkers() ),
+                _maxPending( _nWorkers * 2 ),
+                _workers( _nWorkers ),
+                _pendingMutex( "epollPending" ),
+                _pending( 0 ),
+                _returnedMutex( "epollReturned" ) {
+                _epfd = epoll_create( 1024 ); // size is only a hint
+                massert( 16409 , str::stream() << "epoll_create failed: " << errnoWithDescription() , _epfd >= 0 );
+            }
+
+            virtual ~EpollMessageServer() {
+                ::close( _epfd );
+            }
+
+            virtual void acceptedMP( MessagingPort * p ) {
+                if ( ! connTicketHolder.tryAcquire() ) {
+                    log() << "connection refused because too many open connections: " << connTicketHolder.used() << endl;
+                    p->shutdown();
+                    delete p;
+                    sleepmillis(2); // otherwise we'll hard loop
+                    return;
+                }
+
+                p->psock->setLogLevel(1);
+                p->psock->postFork();
+                _workers.schedule( &EpollMessageServer::connect , this , new Connection( p ) );
+            }
+
+            virtual void setAsTimeTracker() {
+                Listener::setAsTimeTracker();
+            }
+
+            void run() {
+                log() << "multiplexing connections with epoll over " << _nWorkers << " worker threads" << endl;
+                boost::thread reactor( boost::bind( &EpollMessageServer::reactorThread , this ) );
+                initAndListen();
+            }
+
+            virtual bool useUnixSockets() const { return true; }
+
+        private:
+
+            static int defaultWorkers() {
+                // workers block on locks and disk, so keep well more than one per core
+                unsigned cores = ProcessInfo().getNumCores();
+                return cores ? cores * 4 : 16;
+            }
+
+            /**
+             * hand the connection back to the reactor to wait for its next message
+             * @return false if the connection has to be closed
+             */
+            bool arm( Connection * c , int op ) {
+                epoll_event ev;
+                memset( &ev , 0 , sizeof(ev) );
+                ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+                ev.data.ptr = c;
+                if ( epoll_ctl( _epfd , op , c->port->psock->rawFD() , &ev ) == 0 )
+                    return true;
+                log() << "epoll_ctl failed: " << errnoWithDescription() << ", closing connection" << endl;
+                return false;
+            }
+
+            /** @return the connection's LastError, now owned by this thread */
+            LastError * attach( Connection * c ) {
+                LastError * le = c->lastError;
+                lastError.reset( le );
+                c->lastError = 0;
+                _handler->attachConnection( c->port.get() , c->state );
+                delete c->state;
+                c->state = 0;
+                return le;
+            }
+
+            void detach( Connection * c ) {
+                c->state = _handler->detachConnection( c->port.get() );
+                c->lastError = lastError._get( true );
+                lastError.release();
+            }
+
+            /** worker: first task for every new connection */
+            void connect( Connection * c ) {
+                lastError.reset( c->lastError );
+                c->lastError = 0;
+                try {
+                    _handler->connected( c->port.get() );
+                }
+                catch ( const DBException& e ) {
+                    log() << "DBException setting up connection, closing: " << e << endl;
+                    detach( c );
+                    close( c );
+                    return;
+                }
+                detach( c );
+                if ( ! arm( c , EPOLL_CTL_ADD ) )
+                    close( c );
+            }
+
+            /**
+             * worker: c->data holds a complete message
+             * @param queued if the message was counted by messageQueued()
+             */
+            void process( Connection * c , bool queued ) {
+                MsgData * buf = c->data;
+                c->resetRead();
+                bool ok = handle( c , buf );
+                giveBack( buf );
+                if ( queued )
+                    messageDone();
+
+                if ( ! ok || inShutdown() || ! arm( c , EPOLL_CTL_MOD ) )
+                    close( c );
+            }
+
+            /**
+             * worker: run the handler on the message in buf, which stays ours
+             * @return false if the connection has to be closed
+             */
+            bool handle( Connection * c , MsgData * buf ) {
+                Message m;
+                m.setData( buf , false );
+
+                if ( m.operation() == dbCompressed && ! decompressMessage( m ) ) {
+                    log() << "bad compressed message from " << c->port->remote() << ", closing connection" << endl;
+                    return false;
+                }
+
+                LastError * le = attach( c );
+                bool ok = true;
+                try {
+                    _handler->process( m , c->port.get() , le );
+                    networkCounter.hit( c->port->psock->getBytesIn() , c->port->psock->getBytesOut() );
+                    c->port->psock->clearCounters();
+                }
+                catch ( AssertionException& e ) {
+                    log() << "AssertionException handling request, closing client connection: " << e << endl;
+                    ok = false;
+                }
+                catch ( SocketException& e ) {
+                    log() << "SocketException handling request, closing client connection: " << e << endl;
+                    ok = false;
+                }
+                catch ( const DBException& e ) {
+                    log() << "DBException handling request, closing client connection: " << e << endl;
+                    ok = false;
+                }
+                catch ( std::exception &e ) {
+                    error() << "Uncaught std::exception: " << e.what() << ", terminating" << endl;
+                    dbexit( EXIT_UNCAUGHT );
+                }
+                catch ( ... ) {
+                    error() << "Uncaught exception, terminating" << endl;
+                    dbexit( EXIT_UNCAUGHT );
+                }
+                detach( c );
+                return ok;
+            }
+
+            /** worker: the endian check, a 4 byte message of -1, gets our byte order back */
+            void endianReply( Connection * c ) {
+                bool ok = true;
+                try {
+                    unsigned foo = 0x10203040;
+                    c->port->psock->send( (char *) &foo, 4, "endian" );
+                }
+                catch ( SocketException& e ) {
+                    LOG( e.shouldPrint() ? 0 : 1 ) << "SocketException: remote: " << c->port->remote() << " error: " << e << endl;
+                    ok = false;
+                }
+                if ( ! ok || inShutdown() || ! arm( c , EPOLL_CTL_MOD ) )
+                    close( c );
+            }
+
+            /** worker: a message buffer goes back to the reactor's pool */
+            void giveBack( MsgData * buf ) {
+                scoped_lock lk( _returnedMutex );
+                _returned.push_back( (char *) buf );
+            }
+
+            /** reactor: put the buffers the workers are done with back in this thread's pool */
+            void reclaimBuffers() {
+                vector<char *> returned;
+                {
+                    scoped_lock lk( _returnedMutex );
+                    returned.swap( _returned );
+                }
+                for ( unsigned i = 0; i < returned.size(); i++ )
+                    MessageBufferPool::release( returned[i] );
+            }
+
+            /** reactor: c->data holds a complete message; hand it to a worker or a thread of its own */
+            void dispatch( Connection * c ) {
+                Message m;
+                m.setData( c->data , false );
+                if ( _handler->mayWaitLong( m ) ) {
+                    try {
+                        boost::thread t( boost::bind( &EpollMessageServer::process , this , c , false ) );
+                        return;
+                    }
+                    catch ( boost::thread_resource_error& ) {
+                        log() << "can't start a thread for a long waiting request, queueing it" << endl;
+                    }
+                }
+                messageQueued();
+                _workers.schedule( &EpollMessageServer::process , this , c , true );
+            }
+
+            /** reactor: about to hand a message to the workers; waits while too many are queued */
+            void messageQueued() {
+                scoped_lock lk( _pendingMutex );
+                while ( _pending >= _maxPending && ! inShutdown() ) {
+                    // wake now and then to notice shutdown
+                    _pendingDone.timed_wait( lk.boost() , boost::posix_time::milliseconds( 1000 ) );
+                }
+                _pending++;
+            }
+
+            /** worker: a message handed over by messageQueued() is done */
+            void messageDone() {
+                scoped_lock lk( _pendingMutex );
+                _pending--;
+                _pendingDone.notify_one();
+            }
+
+            /** worker: tear down; c must not be registered/armed anymore */
+            void close( Connection * c ) {
+                epoll_ctl( _epfd , EPOLL_CTL_DEL , c->port->psock->rawFD() , 0 );
+                if( !cmdLine.quiet ) {
+                    int conns = connTicketHolder.used()-1;
+                    const char* word = (conns == 1 ? " connection" : " connections");
+                    log() << "end connection " << c->port->psock->remoteString() << " (" << conns << word << " now open)" << endl;
+                }
+                c->port->shutdown();
+                attach( c );
+                _handler->disconnected( c->port.get() );
+                detach( c );
+                delete c;
+                connTicketHolder.release();
+            }
+
+            /** reactor: read what is available for c */
+            ReadState readSome( Connection * c ) {
+                Socket& sock = *c->port->psock;
+                while ( c->got < 4 ) {
+                    int n = sock.recvNonBlocking( ((char *) &c->len) + c->got , 4 - c->got );
+                    if ( n == 0 )
+                        return ReadIncomplete;
+                    c->got += n;
+                }
+
+                if ( ! c->data ) {
+                    int len = c->len;
+                    if ( len < 16 || len > 48000000 ) { // messages must be large enough for headers
+                        if ( len == -1 ) {
+                            // Endian check from the client, after connecting, to see what mode server is running in.
+                            c->resetRead();
+                            return ReadEndianCheck;
+                        }
+                        log(0) << "recv(): message len " << len << " is invalid, closing connection" << endl;
+                        throw SocketException( SocketException::RECV_ERROR , sock.remoteString() );
+                    }
+                    c->data = (MsgData *) MessageBufferPool::allocate( len );
+                    c->data->len = len;
+                }
+
+                while ( c->got < c->len ) {
+                    int n = sock.recvNonBlocking( ((char *) c->data) + c->got , c->len - c->got );
+                    if ( n == 0 )
+                        return ReadIncomplete;
+                    c->got += n;
+                }
+                return ReadComplete;
+            }
+
+            void reactorThread() {
+                setThreadName( "epoll" );
+                const int MaxEvents = 256;
+                epoll_event events[MaxEvents];
+
+                while ( ! inShutdown() ) {
+                    reclaimBuffers();
+                    int n = epoll_wait( _epfd , events , MaxEvents , 1000 );
+                    if ( n < 0 ) {
+                        if ( errno == EINTR )
+                            continue;
+                        error() << "epoll_wait failed: " << errnoWithDescription() << endl;
+                        sleepmillis(10);
+                        continue;
+                    }
+
+                    for ( int i = 0; i < n; i++ ) {
+                        Connection * c = (Connection *) events[i].data.ptr;
+                        ReadState state = ReadIncomplete;
+                        bool ok = true;
+                        try {
+                            state = readSome( c );
+                        }
+                        catch ( SocketException& e ) {
+                            LOG( e.shouldPrint() ? 0 : 1 ) << "SocketException: remote: " << c->port->remote() << " error: " << e << endl;
+                            ok = false;
+                        }
+
+                        if ( ! ok ) {
+                            _workers.schedule( &EpollMessageServer::close , this , c );
+                        }
+                        else if ( state == ReadComplete ) {
+                            dispatch( c );
+                        }
+                        else if ( state == ReadEndianCheck ) {
+                            _workers.schedule( &EpollMessageServer::endianReply , this , c );
+                        }
+                        else if ( events[i].events & ( EPOLLHUP | EPOLLERR ) ) {
+                            _workers.schedule( &EpollMessageServer::close , this , c );
+                        }
+                        else if ( ! arm( c , EPOLL_CTL_MOD ) ) {
+                            // partial message, but we can't wait for the rest
+                            _workers.schedule( &EpollMessageServer::close , this , c );
+                        }
+                    }
+                }
+            }
+
+            MessageHandler * _handler;
+            const int _nWorkers;
+            const int _maxPending;  // messages queued or being handled by workers before the reactor waits
+            ThreadPool _workers;
+            int _epfd;
+
+            mongo::mutex _pendingMutex;
+            boost::condition _pendingDone;
+            int _pending;
+
+            mongo::mutex _returnedMutex;
+            vector<char *> _returned; // message buffers for the reactor's pool
+        };
+
+    }
+
+    MessageServer * createEpollServer( const MessageServer::Options& opts , MessageHandler * handler ) {
+        return new epollms::EpollMessageServer( opts , handler );
+    }
+
+}
+
+#endif
@@ -210,6 +210,15 @@ namespace mongo {
 
 
     MessageServer * createServer( const MessageServer::Options& opts , MessageHandler * handler ) {
+        if ( opts.epoll ) {
+#ifdef __linux__
+            if ( handler->supportsMultiplexing() )
+                return createEpollServer( opts , handler );
+            warning() << "message handler can't be multiplexed, using a thread per connection" << endl;
+#else
+            warning() << "epoll networking is only available on linux, using a thread per connection" << endl;
+#endif
+        }
         return new PortMessageServer( opts , handler );
     }
 
@@ -776,6 +776,36 @@ namespace mongo {
     }
 
 
+    int Socket::recvNonBlocking( char *buf, int max ) {
+#ifdef MONGO_SSL
+        // ssl may have already buffered bytes the kernel no longer reports
+        verify( _ssl == 0 );
+#endif
+#if defined(_WIN32)
+        verify( !"recvNonBlocking not supported on windows" );
+        return 0;
+#else
+        while ( true ) {
+            int ret = ::recv( _fd , buf , max , portRecvFlags | MSG_DONTWAIT );
+            if ( ret > 0 ) {
+                _bytesIn += ret;
+                return ret;
+            }
+            if ( ret == 0 ) {
+                log(3) << "Socket recvNonBlocking() conn closed? " << remoteString() << endl;
+                throw SocketException( SocketException::CLOSED , remoteString() );
+            }
+            int e = errno;
+            if ( e == EINTR )
+                continue;
+            if ( e == EAGAIN || e == EWOULDBLOCK )
+                return 0;
+            log(_logLevel) << "Socket recvNonBlocking() " << errnoWithDescription(e) << " " << remoteString() << endl;
+            throw SocketException( SocketException::RECV_ERROR , remoteString() );
+        }
+#endif
+    }
+
     int Socket::_recv( char *buf, int max ) {
 #ifdef MONGO_SSL
         if ( _ssl ){
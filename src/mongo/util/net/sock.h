@@ -197,6 +197,16 @@ namespace mongo {
         // recv len or throw SocketException
         void recv( char * data , int len );
         int unsafe_recv( char *buf, int max );
+
+        /**
+         * read whatever is available without blocking, up to max bytes
+         * @return number of bytes read, 0 if nothing is available yet
+         * throws SocketException if the connection was closed or failed
+         */
+        int recvNonBlocking( char *buf, int max );
+
+        /** the underlying descriptor, for registering with a poller */
+        int rawFD() const { return _fd; }
         
         int getLogLevel() const { return _logLevel; }
         void setLogLevel( int ll ) { _logLevel = ll; }